@@ -319,6 +319,8 @@ int oo_fop_release(struct inode* inode, struct file* filp)
   filp->private_data = 0;
   if (priv->thr != NULL) {
     TCP_HELPER_RESOURCE_ASSERT_VALID(priv->thr, 0);
+    if( priv->fd_flags & OO_FDFLAG_STACK )
+      tcp_helper_pkt_file_release(priv->thr, filp);
     oo_thr_ref_drop(priv->thr->ref,
                     (priv->fd_flags & OO_FDFLAG_SERVICE) ?
                     OO_THR_REF_FILE : OO_THR_REF_APP);
@@ -475,6 +477,11 @@ struct file_operations oo_fops = {
   .unlocked_ioctl = oo_fop_unlocked_ioctl,
   .compat_ioctl = oo_fop_compat_ioctl,
   .mmap    = oo_fop_mmap,
+#ifdef OO_SHMBUF_HAVE_HUGE_FAULT
+  /* Align large mappings to PMD size, so that the shared state can be
+   * mapped with huge pages. */
+  .get_unmapped_area = thp_get_unmapped_area,
+#endif
 
   /* read and poll are used by the cplane server only */
   .read = cp_fop_read,
@@ -80,6 +80,9 @@ static const struct proc_ops efab_version_fops;
 #if CI_CFG_HANDLE_ICMP
 static const struct proc_ops efab_dlfilters_fops;
 #endif
+#if ! CI_CFG_UL_INTERRUPT_HELPER
+static const struct proc_ops efab_stack_pool_fops;
+#endif
 
 /*--------------------------------------------------------------------
  *
@@ -97,6 +100,9 @@ static ci_proc_efab_entry_t ci_proc_efab_table[] = {
 #if CI_CFG_HANDLE_ICMP
     {"dlfilters",     &efab_dlfilters_fops},
 #endif
+#if ! CI_CFG_UL_INTERRUPT_HELPER
+    {"stack_pool",    &efab_stack_pool_fops},
+#endif
 };
 
 #define CI_PROC_EFAB_TABLE_SIZE \
@@ -367,6 +373,32 @@ static const struct proc_ops efab_dlfilters_fops = {
 #endif
 
 
+#if ! CI_CFG_UL_INTERRUPT_HELPER
+/****************************************************************************
+ *
+ * /proc/driver/onload/stack_pool
+ *
+ ****************************************************************************/
+
+static int
+efab_stack_pool_read_proc(struct seq_file *seq, void *s)
+{
+  return oo_stack_pool_show(seq);
+}
+static int efab_stack_pool_open_proc(struct inode *inode, struct file *file)
+{
+    return single_open(file, efab_stack_pool_read_proc, 0);
+}
+static const struct proc_ops efab_stack_pool_fops = {
+    PROC_OPS_SET_OWNER
+    .proc_open    = efab_stack_pool_open_proc,
+    .proc_read    = seq_read,
+    .proc_lseek   = seq_lseek,
+    .proc_release = single_release,
+};
+#endif
+
+
 /****************************************************************************
  *
  * Install new proc entries
@@ -226,8 +226,45 @@ static vm_fault_t vm_op_fault(
 }
 
 
+#ifdef OO_SHMBUF_HAVE_HUGE_FAULT
+static vm_fault_t vm_op_huge_fault(struct vm_fault *vmf,
+#ifdef EFRM_HAVE_HUGE_FAULT_ORDER
+                                   unsigned int order
+#else
+                                   enum page_entry_size pe_size
+#endif
+                                   )
+{
+  struct vm_area_struct *vma = vmf->vma;
+  tcp_helper_resource_t* trs = (tcp_helper_resource_t*) vma->vm_private_data;
+  vm_fault_t rc;
+
+#ifdef EFRM_HAVE_HUGE_FAULT_ORDER
+  if( order != PMD_SHIFT - PAGE_SHIFT )
+#else
+  if( pe_size != PE_SIZE_PMD )
+#endif
+    return VM_FAULT_FALLBACK;
+
+  /* Only the shared state is backed by huge pages; see
+   * tcp_helper_rm_mmap_mem(). */
+  if( OO_MMAP_OFFSET_TO_MAP_ID(VMA_OFFSET(vma)) != CI_NETIF_MMAP_ID_STATE )
+    return VM_FAULT_FALLBACK;
+
+  TCP_HELPER_RESOURCE_ASSERT_VALID(trs, 0);
+  rc = oo_shmbuf_huge_fault(&trs->netif.shmbuf, vmf);
+  if( rc == VM_FAULT_NOPAGE )
+    CITP_STATS_NETIF_INC(&trs->netif, shmbuf_huge_maps);
+  return rc;
+}
+#endif
+
+
 static struct vm_operations_struct vm_ops = {
   .fault = vm_op_fault,
+#ifdef OO_SHMBUF_HAVE_HUGE_FAULT
+  .huge_fault = vm_op_huge_fault,
+#endif
 };
 
 
@@ -243,13 +280,24 @@ static int tcp_helper_rm_mmap_mem(tcp_helper_resource_t* trs,
 {
   OO_DEBUG_VM(ci_log("%s: %u bytes=0x%lx", __func__, trs->id, bytes));
 
+  if( bytes != oo_shmbuf_size(&trs->netif.shmbuf) )
+    return -EFAULT;
+
+#ifdef OO_SHMBUF_HAVE_HUGE_FAULT
+  /* Huge-page-backed chunks are mapped on first access, so that the fault
+   * handler can use PMD mappings.  VM_HUGEPAGE is needed for that when
+   * transparent huge pages are in "madvise" mode.
+   */
+  if( trs->netif.shmbuf.pages != NULL ) {
+    vma->vm_flags |= VM_MIXEDMAP | VM_HUGEPAGE;
+    return 0;
+  }
+#endif
+
   /* Let's fault in the first chunk right now, and defer the socket states
    * to the fault handler.
    */
-  if( bytes == oo_shmbuf_size(&trs->netif.shmbuf) )
-    return oo_shmbuf_fault(&trs->netif.shmbuf, vma, 0);
-  else
-    return -EFAULT;
+  return oo_shmbuf_fault(&trs->netif.shmbuf, vma, 0);
 }
 
 
@@ -449,6 +497,7 @@ static int tcp_helper_rm_mmap_pkts(tcp_helper_resource_t* trs,
 {
   ci_netif* ni;
   ci_netif_state* ns;
+  struct file* file;
   int bufid = map_id - CI_NETIF_MMAP_ID_PKTS;
 
   if( bytes != CI_CFG_PKT_BUF_SIZE * PKTS_PER_SET )
@@ -472,6 +521,16 @@ static int tcp_helper_rm_mmap_pkts(tcp_helper_resource_t* trs,
   }
 #endif
 
+  /* Attach the mapping to the stack's own packet set file rather than the
+   * file it was made through: the /dev/onload files of all stacks share
+   * one address space, and revoking a released set must not touch the
+   * mappings of any other stack. */
+  file = tcp_helper_pkt_file_get(trs);
+  if( IS_ERR(file) )
+    return PTR_ERR(file);
+  vma_set_file(vma, file);
+  fput(file);
+
   if( oo_iobufset_npages(ni->pkt_bufs[bufid]) == 1 ) {
     /* Avoid nopage handler, mmap it all at once */
     return vm_insert_page(vma, vma->vm_start, ni->pkt_bufs[bufid]->pages[0]);
@@ -1,21 +1,90 @@
 #include <onload/debug.h>
 #include <onload/oo_shmbuf.h>
+#ifdef OO_SHMBUF_HAVE_HUGE_FAULT
+#include <linux/huge_mm.h>
+#include <linux/pfn_t.h>
+#endif
 
 
-int oo_shmbuf_alloc(struct oo_shmbuf* sh, int order, int max, int init_num)
+#ifdef OO_SHMBUF_HAVE_HUGE_FAULT
+static void oo_shmbuf_huge_free(struct oo_shmbuf* sh, int from, int to)
+{
+  int i;
+
+  for( i = from; i < to; i++ )
+    if( sh->pages[i] != NULL ) {
+      __free_pages(sh->pages[i], sh->order);
+      sh->pages[i] = NULL;
+    }
+}
+
+
+/* Allocate compound pages for chunks [from, to) and return their kernel
+ * address, or NULL if any of them cannot be allocated.  Several chunks are
+ * made virtually contiguous with vmap(). */
+static void* oo_shmbuf_huge_alloc(struct oo_shmbuf* sh, int from, int to)
+{
+  unsigned long n_pages = (unsigned long)(to - from) << sh->order;
+  struct page** pages;
+  unsigned long i;
+  void* p;
+
+  for( i = from; i < to; i++ ) {
+    sh->pages[i] = alloc_pages(GFP_KERNEL | __GFP_ZERO | __GFP_COMP |
+                               __GFP_NOWARN | __GFP_NORETRY, sh->order);
+    if( sh->pages[i] == NULL ) {
+      oo_shmbuf_huge_free(sh, from, i);
+      return NULL;
+    }
+  }
+  if( to - from == 1 )
+    return page_address(sh->pages[from]);
+
+  pages = kvmalloc_array(n_pages, sizeof(pages[0]), GFP_KERNEL);
+  if( pages == NULL ) {
+    oo_shmbuf_huge_free(sh, from, to);
+    return NULL;
+  }
+  for( i = 0; i < n_pages; i++ )
+    pages[i] = sh->pages[from + (i >> sh->order)] +
+               (i & ((1UL << sh->order) - 1));
+  p = vmap(pages, n_pages, VM_MAP, PAGE_KERNEL);
+  kvfree(pages);
+  if( p == NULL )
+    oo_shmbuf_huge_free(sh, from, to);
+  return p;
+}
+#endif
+
+
+int oo_shmbuf_alloc(struct oo_shmbuf* sh, int order, int max, int init_num,
+                    int flags)
 {
   int i;
 
   sh->max = max;
   sh->order = order;
+  sh->flags = flags;
   sh->num = init_num;
   sh->init_num = init_num;
+  sh->pages = NULL;
   mutex_init(&sh->lock);
 
   sh->addrs = kzalloc(sizeof(sh->addrs[0]) * max, GFP_KERNEL);
   if( sh->addrs == NULL )
     return -ENOMEM;
 
+#ifdef OO_SHMBUF_HAVE_HUGE_FAULT
+  /* Huge mappings of a chunk are only possible if it is exactly one PMD. */
+  if( (flags & OO_SHMBUF_FLAG_HUGE) && order == PMD_SHIFT - PAGE_SHIFT ) {
+    sh->pages = kzalloc(sizeof(sh->pages[0]) * max, GFP_KERNEL);
+    if( sh->pages != NULL )
+      sh->addrs[0] = oo_shmbuf_huge_alloc(sh, 0, init_num);
+    if( sh->addrs[0] != NULL )
+      goto init_chunks;
+  }
+#endif
+
   sh->addrs[0] = vmalloc_user((unsigned long)init_num << PAGE_SHIFT << order);
   if( sh->addrs[0] == 0 ) {
     ci_log("%s: failed to allocate a virtually-continuous buffer of size %ld",
@@ -23,6 +92,9 @@ int oo_shmbuf_alloc(struct oo_shmbuf* sh, int order, int max, int init_num)
     return -ENOMEM;
   }
 
+#ifdef OO_SHMBUF_HAVE_HUGE_FAULT
+ init_chunks:
+#endif
   for( i = 1; i < init_num; i++ )
     sh->addrs[i] = OO_SHMBUF_INIT_CHUNK;
   return 0;
@@ -32,12 +104,23 @@ void oo_shmbuf_free(struct oo_shmbuf* sh)
 {
   int i;
 
-  if( sh->addrs[0] )
+  if( oo_shmbuf_chunk_is_huge(sh, 0) ) {
+    if( sh->init_num > 1 )
+      vunmap(sh->addrs[0]);
+  }
+  else if( sh->addrs[0] ) {
     vfree(sh->addrs[0]);
+  }
 
   for( i = sh->init_num; i < sh->num && sh->addrs[i] != 0; i++ )
-    vfree(sh->addrs[i]);
-
+    if( ! oo_shmbuf_chunk_is_huge(sh, i) )
+      vfree(sh->addrs[i]);
+
+#ifdef OO_SHMBUF_HAVE_HUGE_FAULT
+  if( sh->pages != NULL )
+    oo_shmbuf_huge_free(sh, 0, sh->num);
+#endif
+  kfree(sh->pages);
   kfree(sh->addrs);
 }
 
@@ -55,6 +138,11 @@ int oo_shmbuf_add(struct oo_shmbuf* sh)
   i = sh->num;
   /* Fixme implement locking */
 
+#ifdef OO_SHMBUF_HAVE_HUGE_FAULT
+  if( sh->pages != NULL )
+    sh->addrs[i] = oo_shmbuf_huge_alloc(sh, i, i + 1);
+  if( sh->addrs[i] == 0 )
+#endif
   sh->addrs[i] = vmalloc_user(PAGE_SIZE << sh->order);
   if( sh->addrs[i] == 0 ) {
     mutex_unlock(&sh->lock);
@@ -103,6 +191,25 @@ int oo_shmbuf_fault(struct oo_shmbuf* sh, struct vm_area_struct* vma,
   if( sh->addrs[i] == 0 )
     return -EFAULT;
 
+#ifdef OO_SHMBUF_HAVE_HUGE_FAULT
+  /* Here only if a huge mapping was not possible: map the chunk with small
+   * pages.  The vma is VM_MIXEDMAP, and the pages are not refcounted. */
+  if( oo_shmbuf_chunk_is_huge(sh, i) ) {
+    unsigned long pfn = page_to_pfn(sh->pages[i]);
+    unsigned long j;
+
+    for( j = 0; j < size >> PAGE_SHIFT; j++ ) {
+      vm_fault_t ret = vmf_insert_mixed(vma,
+                                        vma->vm_start + start_off +
+                                        (j << PAGE_SHIFT),
+                                        pfn_to_pfn_t(pfn + j));
+      if( ret & VM_FAULT_ERROR )
+        return -EFAULT;
+    }
+    return 0;
+  }
+#endif
+
   if( i < sh->init_num ) {
     start_off = 0;
     i = 0;
@@ -115,3 +222,25 @@ int oo_shmbuf_fault(struct oo_shmbuf* sh, struct vm_area_struct* vma,
     vma->vm_flags &= ~VM_DONTDUMP; /* remap_vmalloc_range_partial sets this */
   return rc;
 }
+
+
+#ifdef OO_SHMBUF_HAVE_HUGE_FAULT
+/* Map the chunk containing vmf->address with a single PMD, if the chunk is
+ * a compound page and the vma is suitably aligned.  Otherwise the caller
+ * falls back to oo_shmbuf_fault().
+ */
+vm_fault_t oo_shmbuf_huge_fault(struct oo_shmbuf* sh, struct vm_fault* vmf)
+{
+  struct vm_area_struct* vma = vmf->vma;
+  unsigned long addr = vmf->address & PMD_MASK;
+  int i = (addr - vma->vm_start) >> sh->order >> PAGE_SHIFT;
+
+  if( (vma->vm_start & ~PMD_MASK) != 0 || addr < vma->vm_start ||
+      addr + PMD_SIZE > vma->vm_end || i >= sh->num ||
+      ! oo_shmbuf_chunk_is_huge(sh, i) )
+    return VM_FAULT_FALLBACK;
+
+  return vmf_insert_pfn_pmd(vmf, pfn_to_pfn_t(page_to_pfn(sh->pages[i])),
+                            vmf->flags & FAULT_FLAG_WRITE);
+}
+#endif
@@ -134,6 +134,10 @@ EFRM_CLOSE_FD_EXPORTED		export	close_fd	include/linux/fdtable.h	fs/file.c
 EFRM_REMAP_VMALLOC_RANGE_PARTIAL_NEW	symtype	remap_vmalloc_range_partial	include/linux/vmalloc.h int(struct vm_area_struct *vma, unsigned long uaddr, void *kaddr, unsigned long pgoff, unsigned long size)
 EFRM_HAS_REMAP_VMALLOC_RANGE_PARTIAL	export	remap_vmalloc_range_partial	include/linux/vmalloc.h
 
+EFRM_HAVE_HUGE_FAULT_PE_SIZE	memtype	struct_vm_operations_struct	huge_fault	include/linux/mm.h	vm_fault_t (*)(struct vm_fault *vmf, enum page_entry_size pe_size)
+EFRM_HAVE_HUGE_FAULT_ORDER	memtype	struct_vm_operations_struct	huge_fault	include/linux/mm.h	vm_fault_t (*)(struct vm_fault *vmf, unsigned int order)
+EFRM_HAVE_VMF_INSERT_PFN_PMD	symtype	vmf_insert_pfn_pmd	include/linux/huge_mm.h	vm_fault_t(struct vm_fault *, pfn_t, bool)
+
 EFRM_HAS_KTIME_GET_REAL_SECONDS	export	ktime_get_real_seconds	include/linux/timekeeping.h	kernel/time/timekeeping.c
 EFRM_FILE_HAS_F_EP	member	struct_file	f_ep	include/linux/fs.h
 EFRM_HAS_LOOKUP_FD_RCU	symbol	lookup_fd_rcu	include/linux/fdtable.h
@@ -151,6 +155,7 @@ EFRM_HAS_XLNX_EFCT_H			file	include/linux/net/xilinx/xlnx_efct.h
 EFRM_TASK_HAS_CPUMASK		member	struct_task_struct	cpus_mask	include/linux/sched.h
 
 EFRM_HAVE_LOWCASE_PDE_DATA symbol pde_data include/linux/proc_fs.h
+EFRM_HAVE_VMA_SET_FILE	symbol	vma_set_file	include/linux/mm.h
 EFRM_HAVE_NETIF_RX_NI symbol netif_rx_ni include/linux/netdevice.h
 # TODO move onload-related stuff from net kernel_compat
 " | egrep -v -e '^#' -e '^$' | sed 's/[ \t][ \t]*/:/g'
@@ -0,0 +1,103 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+
+/*! \cidoxg_include_ci_app */
+
+#ifndef __CI_APP_HISTOGRAM_H__
+#define __CI_APP_HISTOGRAM_H__
+
+
+/* A histogram of non-negative integer samples (typically latencies in
+ * nanoseconds or cycles) with bounded relative error, in the style of
+ * HdrHistogram.  Values below 2^precision_bits are recorded exactly; above
+ * that each power-of-two range is split into 2^(precision_bits-1) equal
+ * buckets, so the relative error is at most 2^-(precision_bits-1).
+ *
+ * Recording is O(1) and allocation-free, so it is cheap enough to do in the
+ * measurement loop of a continuously running canary.
+ *
+ * Two optional corrections are applied at record time:
+ *
+ * - Warm-up exclusion: the first [n_warmups] samples are discarded.
+ *
+ * - Coordinated-omission correction: if [expected_interval] is non-zero,
+ *   a sample of value V > expected_interval also records the samples
+ *   V - expected_interval, V - 2*expected_interval, ... that a paced sender
+ *   would have observed had it not been stalled behind the slow sample.
+ */
+typedef struct {
+  ci_uint64*  counts;
+  int         counts_len;
+  int         sub_bucket_bits;
+  ci_int64    highest;
+  ci_uint64   total;
+  ci_int64    min;
+  ci_int64    max;
+  double      sum;
+  int         n_warmups;
+  ci_int64    expected_interval;
+} ci_hist;
+
+
+/* Initialise [h] to track values up to [highest] (larger values are clamped
+ * into the top bucket, but min/max/mean remain exact).  [precision_bits]
+ * must be in the range [2, 20]; 7 gives better than 2% resolution.
+ * Returns 0 on success or -ENOMEM.
+ */
+extern int ci_hist_init(ci_hist* h, ci_int64 highest, int precision_bits);
+
+extern void ci_hist_fini(ci_hist* h);
+
+/* Discard all recorded samples.  Warm-up and interval settings are kept. */
+extern void ci_hist_reset(ci_hist* h);
+
+ci_inline void ci_hist_set_warmups(ci_hist* h, int n_warmups)
+{ h->n_warmups = n_warmups; }
+
+/* Enable coordinated-omission correction; zero disables it. */
+ci_inline void ci_hist_set_expected_interval(ci_hist* h, ci_int64 interval)
+{ h->expected_interval = interval; }
+
+/* Record a single sample, applying warm-up exclusion and (if enabled)
+ * coordinated-omission correction.
+ */
+extern void ci_hist_record(ci_hist* h, ci_int64 value);
+
+/* Record [n] identical samples without any correction. */
+extern void ci_hist_record_n(ci_hist* h, ci_int64 value, ci_uint64 n);
+
+/* Accumulate the samples of [src] into [dst].  Both must have been
+ * initialised with the same [highest] and [precision_bits].
+ */
+extern void ci_hist_add(ci_hist* dst, const ci_hist* src);
+
+ci_inline ci_uint64 ci_hist_count(const ci_hist* h)
+{ return h->total; }
+
+ci_inline double ci_hist_mean(const ci_hist* h)
+{ return h->total ? h->sum / h->total : 0.0; }
+
+/* Returns the value at or below which [percentile] percent of the samples
+ * fall.  The result is the highest value equivalent to the containing
+ * bucket, clamped to the observed min and max.  Returns 0 if empty.
+ */
+extern ci_int64 ci_hist_percentile(const ci_hist* h, double percentile);
+
+/* Write a one-line summary:
+ *   <prefix>n=<count> mean=.. min=.. p50=.. p90=.. p99=.. p99.9=.. p99.99=..
+ *   max=..
+ * Values are divided by [div] before printing (e.g. cycles per usec).
+ */
+extern void ci_hist_dump_summary(const ci_hist* h, FILE* f,
+                                 const char* prefix, double div);
+
+/* Write the percentile distribution in the HdrHistogram text (.hgrm)
+ * format, as understood by the HdrHistogram plotting tools.  Values are
+ * divided by [div] before printing.  Returns 0 or -errno.
+ */
+extern int ci_hist_write_hgrm(const ci_hist* h, FILE* f, double div);
+
+
+#endif  /* __CI_APP_HISTOGRAM_H__ */
+
+/*! \cidoxg_end */
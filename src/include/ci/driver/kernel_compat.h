@@ -52,6 +52,7 @@
 #include <linux/uaccess.h>
 #include <linux/syscalls.h>
 #include <linux/fdtable.h>
+#include <linux/file.h>
 #include <asm/syscall.h>
 #include <net/sock.h>
 #include <linux/filter.h>
@@ -294,6 +295,16 @@ static inline void mmap_read_unlock(struct mm_struct *mm)
 }
 #endif
 
+/* Linux < 5.11 does not have vma_set_file() */
+#ifndef EFRM_HAVE_VMA_SET_FILE
+static inline void vma_set_file(struct vm_area_struct *vma, struct file *file)
+{
+  get_file(file);
+  swap(vma->vm_file, file);
+  fput(file);
+}
+#endif
+
 /* For linux<=5.7 you can use kernel_setsockopt(),
  * but newer versions do not have this function. */
 static inline int sock_ops_setsockopt(struct socket *sock,
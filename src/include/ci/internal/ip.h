@@ -481,6 +481,8 @@ extern int  ci_netif_poll_intf_future(ci_netif*, int intf_i, ci_uint64 now_frc)
 extern int  ci_netif_poll_n(ci_netif*, int max_evs) CI_HF;
 #define     ci_netif_poll(ni)  ci_netif_poll_n((ni), NI_OPTS(ni).evs_per_poll)
 extern void ci_netif_loopback_pkts_send(ci_netif* ni) CI_HF;
+extern void ci_netif_loopback_pkt_to_rx(ci_netif* ni,
+                                        ci_ip_pkt_fmt* pkt) CI_HF;
 
 #if CI_CFG_WANT_BPF_NATIVE
 #ifdef __KERNEL__
@@ -512,6 +514,8 @@ ci_inline void ci_netif_send(ci_netif* ni, ci_ip_pkt_fmt* pkt)
   pkt->flags |= CI_PKT_FLAG_TX_PENDING;
   __ci_netif_send(ni, pkt);
 }
+extern void ci_netif_send_batch_add(ci_netif*, ci_ip_pkt_fmt* pkt) CI_HF;
+extern void ci_netif_send_batch_push(ci_netif*, int intf_i) CI_HF;
 extern bool ci_netif_send_immediate(ci_netif* netif, ci_ip_pkt_fmt* pkt,
                                     const struct ef_vi_tx_extra* extra) CI_HF;
 extern int ci_netif_rx_post(ci_netif* netif, int nic_index, ef_vi* vi) CI_HF;
@@ -556,6 +560,9 @@ extern void ci_netif_netstat_sockets_to_logger(ci_netif* ni,
 extern void ci_netif_print_sockets(ci_netif* ni) CI_HF;
 extern void ci_netif_dump_dmaq(ci_netif* ni, int dump) CI_HF;
 extern void ci_netif_dump_timeoutq(ci_netif* ni) CI_HF;
+#if CI_CFG_FLIGHT_RECORDER
+extern void ci_netif_dump_flight_recorder(ci_netif* ni) CI_HF;
+#endif
 extern void ci_netif_dump_reap_list(ci_netif* ni, int verbose) CI_HF;
 extern void ci_netif_config_opts_dump(ci_netif_config_opts* opts,
                                       oo_dump_log_fn_t logger,
@@ -991,6 +998,8 @@ extern int ci_udp_recvmmsg(ci_udp_iomsg_args *a, struct mmsghdr* mmsg,
                            unsigned int vlen, int flags, 
                            const struct timespec* timeout
                            CI_KERNEL_ARG(ci_addr_spc_t addr_spc)) CI_HF;
+extern int ci_udp_sendmmsg(ci_udp_iomsg_args *a, struct mmsghdr* mmsg,
+                           unsigned int vlen, int flags) CI_HF;
 
 struct onload_zc_mmsg;
 extern int ci_tcp_zc_send(ci_netif* ni, ci_tcp_state* ts, 
@@ -1048,6 +1057,15 @@ extern int ci_pipe_read(ci_netif*, struct oo_pipe*, const struct iovec*,
 extern int oo_pipe_write_block(ci_netif* ni, struct oo_pipe* p, int flags) CI_HF;
 extern int ci_pipe_write(ci_netif*, struct oo_pipe*, const struct iovec*,
                          size_t iovlen) CI_HF;
+extern int ci_pipe_recv(ci_netif*, struct oo_pipe*, const struct iovec*,
+                        size_t iovlen, int flags) CI_HF;
+extern int ci_pipe_send(ci_netif*, struct oo_pipe*, const struct iovec*,
+                        size_t iovlen, int flags) CI_HF;
+extern void ci_pipe_shutdown(ci_netif*, struct oo_pipe*, int shift) CI_HF;
+extern int ci_eventfd_read(ci_netif*, struct oo_pipe*, const struct iovec*,
+                           size_t iovlen) CI_HF;
+extern int ci_eventfd_write(ci_netif*, struct oo_pipe*, const struct iovec*,
+                            size_t iovlen) CI_HF;
 extern int ci_pipe_zc_read(ci_netif* ni, struct oo_pipe* p, int len,
                            int flags, ci_pipe_zc_read_cb cb, void* ctx) CI_HF;
 extern int ci_pipe_zc_move(ci_netif* ni, struct oo_pipe* pipe_src,
@@ -1654,6 +1672,8 @@ extern const char* ci_tcp_congstate_str(unsigned state) CI_HF;
 extern void ci_tcp_handle_rx(ci_netif*, struct ci_netif_poll_state*,
                              ci_ip_pkt_fmt*, ci_tcp_hdr*, int ip_paylen) CI_HF;
 extern void ci_tcp_rx_deliver2(ci_tcp_state*,ci_netif*,ciip_tcp_rx_pkt*) CI_HF;
+extern void ci_tcp_rx_loopback_direct(ci_netif* ni, ci_tcp_state* ts,
+                                      ci_ip_pkt_fmt* pkt, int pay_len) CI_HF;
 extern void ci_tcp_rx_plugin_meta(ci_netif*, struct ci_netif_poll_state*,
                                   ci_ip_pkt_fmt* pkt) CI_HF;
 
@@ -1738,6 +1758,8 @@ extern int  ci_tcp_send_wnd_update(ci_netif*, ci_tcp_state*,
 
 /* TCP/UDP filter insertion */
 extern void ci_netif_filter_init(ci_netif* ni, int size_lg2) CI_HF;
+/* Initialises both tables when EF_FILTER_TABLE_BUCKETS is set. */
+extern void ci_netif_filter_bucket_init(ci_netif* ni) CI_HF;
 
 #if CI_CFG_IPV6
 void ci_ip6_netif_filter_init(ci_ip6_netif_filter_table* tbl,
@@ -1796,6 +1818,19 @@ ci_netif_filter_hash(ci_netif* ni, ci_addr_t laddr, unsigned lport,
                      ci_addr_t raddr, unsigned rport,
                      unsigned protocol) CI_HF;
 
+/* Warm the cache ahead of an IPv4 filter lookup, in two stages.  The first
+ * prefetches the table entry (or bucket) at which the lookup would start
+ * and returns a value to pass to the second.  The second, issued once that
+ * entry has had time to arrive, prefetches the socket that it refers to.
+ * Neither has any effect other than on the cache.
+ */
+extern unsigned
+ci_netif_filter_prefetch_entry(ci_netif* ni, unsigned laddr, unsigned lport,
+                               unsigned raddr, unsigned rport,
+                               unsigned protocol) CI_HF;
+extern void
+ci_netif_filter_prefetch_sock(ci_netif* ni, unsigned hash1) CI_HF;
+
 extern int
 ci_netif_filter_insert(ci_netif* netif, oo_sp sock_id, int af_space,
                        const ci_addr_t laddr, unsigned lport,
@@ -1842,6 +1877,20 @@ ci_inline ci_uint32 ci_netif_filter_table_size(ci_netif* ni)
   return 1u << CI_MAX(16U, ci_log2_le(NI_OPTS(ni).max_ep_bufs) + 1);
 }
 
+/* Number of buckets in the IPv4 and IPv6 tables with EF_FILTER_TABLE_BUCKETS.
+ * The bucketised tables fit in the memory of the default ones. */
+ci_inline ci_uint32 ci_netif_filter_n_buckets(ci_netif* ni)
+{
+  return ci_netif_filter_table_size(ni) / 4;
+}
+
+#if CI_CFG_IPV6
+ci_inline ci_uint32 ci_ip6_netif_filter_n_buckets(ci_netif* ni)
+{
+  return ci_netif_filter_table_size(ni) / 8;
+}
+#endif
+
 
 #if CI_CFG_TCP_SHARED_LOCAL_PORTS
 #ifndef __KERNEL__
@@ -2112,6 +2161,105 @@ extern int ci_sock_sleep(ci_netif* ni, citp_waitable* w, ci_bits why,
 #endif
 
 
+/**********************************************************************
+*************************** Flight recorder ***************************
+**********************************************************************/
+
+#if CI_CFG_FLIGHT_RECORDER
+/* Record an event in the stack's flight recorder. */
+ci_inline void
+ci_netif_flight_rec(ci_netif* ni, unsigned type, unsigned a, ci_uint32 b)
+{
+  struct oo_flight_rec* fr = &ni->state->flight_rec;
+  struct oo_flight_rec_ev* ev;
+  ci_uint32 n;
+
+  do {
+    n = fr->n;
+    if( fr->frozen )
+      return;
+  } while( ! ci_cas32u_succeed(&fr->n, n, n + 1) );
+
+  ev = &fr->ring[n & (CI_CFG_FLIGHT_RECORDER_LEN - 1)];
+  ci_frc64(&ev->frc);
+  ev->type = type;
+  ev->a = a;
+  ev->b = b;
+}
+
+ci_inline void
+ci_netif_flight_rec_freeze(ci_netif* ni, unsigned reason, ci_uint32 usec)
+{
+  ci_netif_flight_rec(ni, OO_FR_FREEZE, reason, usec);
+  ni->state->flight_rec.frozen = reason;
+}
+
+/* Record a poll that began at [start_frc] and handled [n_evs] events.
+ * Polls that handle nothing are not recorded, so spinning costs no atomic
+ * and does not flush the history.  A poll slower than
+ * EF_FLIGHT_RECORDER_FREEZE_USEC is always recorded, and freezes the
+ * recorder.
+ */
+ci_inline void
+ci_netif_flight_rec_poll(ci_netif* ni, ci_uint64 start_frc, int n_evs)
+{
+  struct oo_flight_rec* fr = &ni->state->flight_rec;
+  ci_uint64 now_frc, usec;
+  int slow;
+
+  if( fr->frozen || (n_evs == 0 && fr->freeze_cycles == 0) )
+    return;
+
+  ci_frc64(&now_frc);
+  slow = fr->freeze_cycles != 0 && now_frc - start_frc > fr->freeze_cycles;
+  if( n_evs == 0 && ! slow )
+    return;
+
+  usec = (now_frc - start_frc) * 1000 / IPTIMER_STATE(ni)->khz;
+  usec = CI_MIN(usec, (ci_uint64) 0xffffffff);
+  ci_netif_flight_rec(ni, OO_FR_POLL, CI_MIN(n_evs, 0xffff), usec);
+  if( slow )
+    ci_netif_flight_rec_freeze(ni, OO_FR_FROZEN_POLL, usec);
+}
+#else
+# define ci_netif_flight_rec(ni, type, a, b)        do{}while(0)
+# define ci_netif_flight_rec_freeze(ni, reason, us) do{}while(0)
+#endif
+
+
+/**********************************************************************
+**************************** Poll profile *****************************
+**********************************************************************/
+
+#if CI_CFG_POLL_PROFILE
+/* Start timing a phase of the poll loop.  Returns 0 when EF_POLL_PROFILE
+ * is off, in which case ci_netif_prof_end() does nothing.
+ */
+ci_inline ci_uint64 ci_netif_prof_start(ci_netif* ni)
+{
+  ci_uint64 frc = 0;
+  if(CI_UNLIKELY( NI_OPTS(ni).poll_profile ))
+    ci_frc64(&frc);
+  return frc;
+}
+
+ci_inline void
+ci_netif_prof_end(ci_netif* ni, unsigned phase, ci_uint64 start)
+{
+  if(CI_UNLIKELY( start != 0 )) {
+    struct oo_poll_profile* prof = &ni->state->poll_profile;
+    ci_uint64 now;
+    ci_frc64(&now);
+    prof->cycles[phase] += now - start;
+    ++prof->calls[phase];
+  }
+}
+#else
+# define ci_netif_prof_start(ni)               0
+# define ci_netif_prof_end(ni, phase, start)   do{ (void) (start); }while(0)
+#endif
+
+
 /**********************************************************************
 ******************************* Polling *******************************
 **********************************************************************/
@@ -2868,6 +3016,96 @@ ci_inline int ci_netif_need_poll_maybe_spinning(ci_netif* ni, ci_uint64 frc_now,
     return ci_netif_need_poll_frc(ni, frc_now);
 }
 
+
+/* EF_SPIN_ADAPTIVE: returns how long a blocking call should spin, given
+ * that it may spin for up to [max_spin] cycles and the history [sa] of
+ * previous waits on the same socket or epoll set.  A call that is expected
+ * to get its event within [max_spin] spins for the smoothed wait plus four
+ * times its deviation (as for a TCP retransmit timeout), and then blocks.
+ * Otherwise it blocks immediately (returns 0), except that every
+ * OO_SPIN_ADAPT_PROBE-th such call spins in full so that we notice when the
+ * traffic picks up.
+ */
+#define OO_SPIN_ADAPT_PROBE  16
+
+ci_inline ci_uint64
+oo_spin_adapt_budget(struct oo_spin_adapt* sa, ci_uint64 max_spin)
+{
+  ci_uint64 expect;
+
+  if( sa->wait_avg == 0 )
+    return max_spin;
+  expect = (ci_uint64) sa->wait_avg + 4 * (ci_uint64) sa->wait_dev;
+  if( expect < max_spin ) {
+    sa->n_skips = 0;
+    return expect;
+  }
+  if( ++sa->n_skips < OO_SPIN_ADAPT_PROBE )
+    return 0;
+  sa->n_skips = 0;
+  return max_spin;
+}
+
+
+/* EF_SPIN_ADAPTIVE: records that a blocking call got its event [waited]
+ * cycles after it started waiting.  Concurrent callers may lose updates,
+ * which does no harm.
+ */
+ci_inline void
+oo_spin_adapt_update(struct oo_spin_adapt* sa, ci_uint64 waited)
+{
+  ci_int64 sample = CI_MIN(waited, (ci_uint64) 0x7fffffff);
+  ci_int64 err;
+
+  if( sa->wait_avg == 0 ) {
+    sa->wait_avg = (ci_uint32) sample | 1;
+    sa->wait_dev = (ci_uint32) sample >> 1;
+    return;
+  }
+  err = sample - sa->wait_avg;
+  sa->wait_avg = (ci_uint32) (sa->wait_avg + (err >> 3)) | 1;
+  if( err < 0 )
+    err = -err;
+  sa->wait_dev += (err - (ci_int64) sa->wait_dev) >> 2;
+}
+
+
+/* Returns the spin budget for a blocking receive on [w], and counts the
+ * receives that do not spin at all.
+ */
+ci_inline ci_uint64
+ci_sock_spin_budget(ci_netif* ni, citp_waitable* w, ci_uint64 max_spin)
+{
+  ci_uint64 budget;
+
+  if( ! NI_OPTS(ni).spin_adaptive )
+    return max_spin;
+  budget = oo_spin_adapt_budget(&w->spin_adapt, max_spin);
+  if( budget == 0 )
+    CITP_STATS_NETIF_INC(ni, spin_wait_skips);
+  return budget;
+}
+
+
+/* Accounts for a blocking receive on [w] that started waiting at
+ * [start_frc] and spun until [now_frc].  [hit] says whether it got its
+ * event while spinning; if not, it is about to block.
+ */
+ci_inline void
+ci_sock_spin_done(ci_netif* ni, citp_waitable* w, ci_uint64 start_frc,
+                  ci_uint64 now_frc, int hit)
+{
+  if( hit ) {
+    CITP_STATS_NETIF_INC(ni, spin_wait_hits);
+    if( NI_OPTS(ni).spin_adaptive )
+      oo_spin_adapt_update(&w->spin_adapt, now_frc - start_frc);
+  }
+  else {
+    CITP_STATS_NETIF_INC(ni, spin_wait_misses);
+  }
+  CITP_STATS_NETIF_ADD(ni, spin_wait_cycles, now_frc - start_frc);
+}
+
 #if CI_CFG_TCP_SHARED_LOCAL_PORTS
 ci_inline int ci_netif_should_allocate_tcp_shared_local_ports(ci_netif* ni)
 {
@@ -4592,20 +4830,223 @@ ci_inline int  ci_sock_is_locked(ci_netif* ni, citp_waitable* w)
 #define ci_tcp_acceptq_n(tls)			\
   ((tls)->acceptq_n_in - (tls)->acceptq_n_out)
 
+#if CI_CFG_TCP_ACCEPTQ_SHARDS
+ci_inline int ci_tcp_acceptq_shard_not_empty(const ci_tcp_acceptq_shard* sh)
+{
+  return (sh->put >= 0) | OO_SP_NOT_NULL(sh->get);
+}
+
+ci_inline int ci_tcp_acceptq_shards_not_empty(const ci_tcp_socket_listen* tls)
+{
+  unsigned i;
+  for( i = 0; i < tls->acceptq_shards_n; ++i )
+    if( ci_tcp_acceptq_shard_not_empty(&tls->acceptq_shard[i]) )
+      return 1;
+  return 0;
+}
+
+# define CI_TCP_ACCEPTQ_SHARDS_NOT_EMPTY(tls)                           \
+  ((tls)->acceptq_shards_n != 0 && ci_tcp_acceptq_shards_not_empty(tls))
+#else
+# define CI_TCP_ACCEPTQ_SHARDS_NOT_EMPTY(tls)  0
+#endif
+
 /* Use this if you do own the [get] lock. */
 #define ci_tcp_acceptq_not_empty(tls)                                   \
-  (((tls)->acceptq_put >= 0) | OO_SP_NOT_NULL((tls)->acceptq_get))
+  (((tls)->acceptq_put >= 0) | OO_SP_NOT_NULL((tls)->acceptq_get) |     \
+   CI_TCP_ACCEPTQ_SHARDS_NOT_EMPTY(tls))
+
+
+#if CI_CFG_TCP_ACCEPTQ_SHARDS
+/* Connections are spread over the sub-queues by a hash of the 4-tuple, in
+ * the same way as RSS spreads them over receive queues. */
+ci_inline unsigned ci_tcp_acceptq_shard_of(ci_tcp_socket_listen* tls,
+                                           citp_waitable* w)
+{
+  ci_sock_cmn* s = &CI_CONTAINER(citp_waitable_obj, waitable, w)->sock;
+  return onload_hash3(sock_ipx_laddr(s), sock_lport_be16(s),
+                      sock_ipx_raddr(s), sock_rport_be16(s),
+                      IPPROTO_TCP) % tls->acceptq_shards_n;
+}
+
+
+/* The sub-queue lock lives in shared memory and is taken without the
+ * stack or socket lock, so a holder that is descheduled or killed must not
+ * wedge its waiters.  The lock word holds the pid of the holder.  Spin for
+ * a bounded time only, and then take the lock over if the holder has died;
+ * otherwise give up, and callers leave the sub-queue alone for now.  Every
+ * store under the lock leaves the sub-queue in a state that the next
+ * holder can complete, so no queued connection is lost with the holder.
+ * A connection that the holder had already taken is lost with it, as it
+ * would be without sub-queues.
+ *
+ * Pids are compared in the namespace of the caller, so processes sharing
+ * a stack with accept sub-queues must share a pid namespace.
+ */
+#define CI_TCP_ACCEPTQ_SHARD_LOCK_SPINS  10000
+
+extern int ci_tcp_acceptq_shard_lock_slow(ci_netif* ni,
+                                          ci_tcp_acceptq_shard* sh,
+                                          ci_uint32 owner) CI_HF;
+
+/* Complete whatever a dead holder of the sub-queue lock was doing.  Needs
+ * the lock, or the listener to be orphaned. */
+extern void ci_tcp_acceptq_shard_repair(ci_netif* ni,
+                                        ci_tcp_acceptq_shard* sh) CI_HF;
+
+/* Returns the caller's pid, for the sub-queue lock. */
+extern ci_uint32 ci_tcp_acceptq_shard_owner(void) CI_HF;
+
+ci_inline int ci_tcp_acceptq_shard_trylock(ci_netif* ni,
+                                           ci_tcp_acceptq_shard* sh,
+                                           ci_uint32 owner)
+{
+  ci_assert_nequal(owner, 0);
+  if( sh->lock == 0 && ci_cas32u_succeed(&sh->lock, 0, owner) )
+    return 1;
+  return ci_tcp_acceptq_shard_lock_slow(ni, sh, owner);
+}
+
+
+ci_inline void ci_tcp_acceptq_shard_unlock(ci_tcp_acceptq_shard* sh)
+{
+  ci_mb();
+  sh->lock = 0;
+}
+
+
+/* Must hold the sub-queue lock.  Moves the connections on [put] to the
+ * front of [get], oldest first.  [swizzle] first points into [put], and
+ * then to the connections still to move; [swizzle_next] is where it goes
+ * next.  See ci_tcp_acceptq_shard_repair() for how an interrupted move is
+ * completed.
+ */
+ci_inline void __ci_tcp_acceptq_shard_swizzle(ci_netif* ni,
+                                              ci_tcp_acceptq_shard* sh)
+{
+  citp_waitable* w;
+  ci_int32 from;
+
+  if( OO_SP_IS_NULL(sh->swizzle) ) {
+    if( sh->put < 0 )
+      return;
+    do {
+      from = sh->put;
+      sh->swizzle_next = sh->swizzle = OO_SP_FROM_INT(ni, from);
+      ci_wmb();
+    } while( ci_cas32_fail(&sh->put, from, CI_ILL_END) );
+  }
+
+  while( OO_SP_NOT_NULL(sh->swizzle) ) {
+    w = SP_TO_WAITABLE(ni, sh->swizzle);
+    sh->swizzle_next = w->wt_next;
+    ci_wmb();
+    w->wt_next = sh->get;
+    ci_wmb();
+    sh->get = W_SP(w);
+    ci_wmb();
+    sh->swizzle = sh->swizzle_next;
+  }
+}
+
+
+/* Must hold the sub-queue lock.  Returns NULL if the sub-queue is empty. */
+ci_inline citp_waitable*
+__ci_tcp_acceptq_shard_get(ci_netif* ni, ci_tcp_socket_listen* tls,
+                           ci_tcp_acceptq_shard* sh)
+{
+  citp_waitable* w;
+
+  if( OO_SP_IS_NULL(sh->get) ) {
+    __ci_tcp_acceptq_shard_swizzle(ni, sh);
+    if( OO_SP_IS_NULL(sh->get) )
+      return NULL;
+  }
+
+  w = SP_TO_WAITABLE(ni, sh->get);
+  sh->get = w->wt_next;
+  CI_DEBUG(w->wt_next = OO_SP_NULL);
+  ci_atomic32_inc(&sh->n_out);
+  ci_atomic32_inc(&tls->acceptq_n_out);
+  return w;
+}
+
+
+/* Take a connection from sub-queue [home], or from any other sub-queue if
+ * that one is empty.  Does not need the socket lock.  Returns NULL if all
+ * sub-queues are empty or could not be locked; otherwise [*shard_out] is
+ * set to the sub-queue the connection came from, for
+ * ci_tcp_acceptq_shard_put_back().  [owner] is the caller's pid.
+ */
+ci_inline citp_waitable*
+ci_tcp_acceptq_shard_get(ci_netif* ni, ci_tcp_socket_listen* tls,
+                         unsigned home, ci_uint32 owner, unsigned* shard_out)
+{
+  unsigned i, n = tls->acceptq_shards_n;
+
+  for( i = 0; i < n; ++i ) {
+    unsigned k = (home + i) % n;
+    ci_tcp_acceptq_shard* sh = &tls->acceptq_shard[k];
+    citp_waitable* w;
+    if( ! ci_tcp_acceptq_shard_not_empty(sh) ||
+        ! ci_tcp_acceptq_shard_trylock(ni, sh, owner) )
+      continue;
+    w = __ci_tcp_acceptq_shard_get(ni, tls, sh);
+    ci_tcp_acceptq_shard_unlock(sh);
+    if( w != NULL ) {
+      *shard_out = k;
+      return w;
+    }
+  }
+  return NULL;
+}
+
+
+/* Undo ci_tcp_acceptq_shard_get().  With [tail] the connection goes to
+ * the back of the sub-queue, otherwise to the front if the sub-queue lock
+ * can be taken, and to the back if not. */
+ci_inline void ci_tcp_acceptq_shard_put_back(ci_netif* ni,
+                                             ci_tcp_socket_listen* tls,
+                                             unsigned k, citp_waitable* w,
+                                             int tail, ci_uint32 owner)
+{
+  ci_tcp_acceptq_shard* sh = &tls->acceptq_shard[k];
+
+  ci_assert(w->sb_aflags & CI_SB_AFLAG_TCP_IN_ACCEPTQ);
+  if( ! tail && ci_tcp_acceptq_shard_trylock(ni, sh, owner) ) {
+    w->wt_next = sh->get;
+    sh->get = W_SP(w);
+    ci_tcp_acceptq_shard_unlock(sh);
+  }
+  else {
+    /* [put] is lock-free */
+    do
+      w->wt_next = OO_SP_FROM_INT(ni, sh->put);
+    while( ci_cas32_fail(&sh->put, OO_SP_TO_INT(w->wt_next), W_ID(w)) );
+  }
+  ci_atomic32_dec(&sh->n_out);
+  ci_atomic32_dec(&tls->acceptq_n_out);
+}
+#endif
 
 
 ci_inline void ci_tcp_acceptq_put(ci_netif* ni,
                                   ci_tcp_socket_listen* tls,
 				  citp_waitable* w) {
+  volatile ci_int32* put = &tls->acceptq_put;
   ci_assert(OO_SP_IS_NULL(w->wt_next));
   ci_assert(ci_netif_is_locked(ni));
+#if CI_CFG_TCP_ACCEPTQ_SHARDS
+  if( tls->acceptq_shards_n != 0 ) {
+    ci_tcp_acceptq_shard* sh =
+      &tls->acceptq_shard[ci_tcp_acceptq_shard_of(tls, w)];
+    put = &sh->put;
+    ++sh->n_in;
+  }
+#endif
   do
-    w->wt_next = OO_SP_FROM_INT(ni, tls->acceptq_put);
-  while( ci_cas32_fail(&tls->acceptq_put,
-                       OO_SP_TO_INT(w->wt_next), W_ID(w)) );
+    w->wt_next = OO_SP_FROM_INT(ni, *put);
+  while( ci_cas32_fail(put, OO_SP_TO_INT(w->wt_next), W_ID(w)) );
   ++tls->acceptq_n_in;
 }
 
@@ -4648,12 +5089,33 @@ ci_inline void ci_tcp_acceptq_get_swizzle(ci_netif* ni,
 }
 
 
-/* Only call this if ci_tcp_acceptq_not_empty() is true. */
+/* Only call this if ci_tcp_acceptq_not_empty() is true.  With accept
+ * sub-queues this may still return NULL, if another thread has emptied
+ * them in the meantime or holds the lock of the only sub-queue that is not
+ * empty. */
 ci_inline citp_waitable* ci_tcp_acceptq_get(ci_netif* ni,
 					   ci_tcp_socket_listen* tls) {
   citp_waitable* w;
   ci_assert(ci_sock_is_locked(ni, &tls->s.b) ||
             (tls->s.b.sb_aflags & CI_SB_AFLAG_ORPHAN));
+#if CI_CFG_TCP_ACCEPTQ_SHARDS
+  if( tls->acceptq_shards_n != 0 ) {
+    unsigned k;
+    if( tls->s.b.sb_aflags & CI_SB_AFLAG_ORPHAN ) {
+      /* Nobody can be accepting any more, and a thread killed while
+       * accepting may have left a sub-queue locked. */
+      for( k = 0; k < tls->acceptq_shards_n; ++k ) {
+        ci_tcp_acceptq_shard_repair(ni, &tls->acceptq_shard[k]);
+        if( (w = __ci_tcp_acceptq_shard_get(ni, tls,
+                                            &tls->acceptq_shard[k])) )
+          return w;
+      }
+      return NULL;
+    }
+    return ci_tcp_acceptq_shard_get(ni, tls, 0,
+                                    ci_tcp_acceptq_shard_owner(), &k);
+  }
+#endif
   ++tls->acceptq_n_out;
   if( OO_SP_IS_NULL(tls->acceptq_get) )  ci_tcp_acceptq_get_swizzle(ni, tls);
   ci_assert(OO_SP_NOT_NULL(tls->acceptq_get));
@@ -4669,6 +5131,9 @@ ci_inline citp_waitable* ci_tcp_acceptq_get(ci_netif* ni,
 ci_inline ci_tcp_state* ci_tcp_acceptq_peek(ci_netif* ni,
 					    ci_tcp_socket_listen* tls) {
   ci_assert(ci_sock_is_locked(ni, &tls->s.b));
+#if CI_CFG_TCP_ACCEPTQ_SHARDS
+  ci_assert_equal(tls->acceptq_shards_n, 0);
+#endif
   if( OO_SP_IS_NULL(tls->acceptq_get) )  ci_tcp_acceptq_get_swizzle(ni, tls);
   ci_assert(OO_SP_NOT_NULL(tls->acceptq_get));
   return SP_TO_TCP(ni, tls->acceptq_get);
@@ -5450,6 +5915,12 @@ struct ci_zc_usermem {
   uint64_t base;
   uint64_t size;
   uint64_t kernel_id;
+  /* Next in ci_netif::zc_usermem, for local address space registrations */
+  struct ci_zc_usermem* next;
+  /* One for the registration, plus one for each EF_TCP_SEND_ZC_THRESH send
+   * using this memory.  The memory stays pinned and mapped until the last
+   * one is dropped.  See ci_zc_usermem_put(). */
+  ci_uint32 refs;
   /* HW addresses are structured as
    * hw_addr[page_n + intf_i * size << PAGE_SHIFT] */
   uint64_t hw_addrs[0];
@@ -5504,6 +5975,25 @@ static inline struct ci_zc_usermem* zc_handle_to_usermem(onload_zc_handle h)
   return (struct ci_zc_usermem*)((uintptr_t)h - 1);
 }
 
+#ifndef __KERNEL__
+/* Find the local address space registration that contains all of
+ * [ptr, ptr + len), or NULL if there is none.  Caller must hold the stack
+ * lock, and take a reference if it uses the registration after dropping
+ * the lock.
+ */
+static inline struct ci_zc_usermem*
+ci_zc_usermem_find(ci_netif* ni, uint64_t ptr, uint64_t len)
+{
+  struct ci_zc_usermem* um;
+
+  ci_assert(ci_netif_is_locked(ni));
+  for( um = ni->zc_usermem; um != NULL; um = um->next )
+    if( ptr >= um->base && ptr + len <= um->base + um->size )
+      return um;
+  return NULL;
+}
+#endif
+
 static inline ef_addr zc_usermem_dma_addr(struct ci_zc_usermem* um,
                                           uint64_t user_ptr, int intf_i)
 {
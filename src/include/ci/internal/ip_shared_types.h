@@ -636,10 +636,41 @@ typedef struct {
 
 typedef struct {
   CI_ULCONST unsigned              table_size_mask;
-  ci_netif_filter_table_entry_fast table[1];
+  /* Cache-line aligned so that it can hold ci_netif_filter_bucket[]. */
+  ci_netif_filter_table_entry_fast table[1] CI_ALIGN(CI_CACHE_LINE_SIZE);
 } ci_netif_filter_table;
 
 
+/* With EF_FILTER_TABLE_BUCKETS the filter tables are arrays of buckets
+ * instead, each a single cache line holding several entries.  An entry is
+ * stored in the bucket that its hash selects if that has room, and
+ * otherwise in the first bucket after it that does.  The home bucket
+ * counts the entries that spilled like this and how far they went, so that
+ * a lookup continues past the home bucket only when it has to.  Removing
+ * an entry frees its slot outright, so no tombstones are left behind.
+ *
+ * In these tables [table_size_mask] is the number of buckets less one.
+ */
+#define CI_FILTER_BUCKET_SLOTS    6
+#define CI_FILTER_BUCKET_ID_BITS  21
+#define CI_FILTER_BUCKET_ID_MASK  ((1u << CI_FILTER_BUCKET_ID_BITS) - 1)
+
+typedef struct {
+  /* Socket id in the low CI_FILTER_BUCKET_ID_BITS, and a non-zero tag
+   * taken from the hash of the entry's addressing fields above it.  Zero if
+   * the slot is free. */
+  ci_uint32 slot[CI_FILTER_BUCKET_SLOTS];
+  /* Number of entries whose home is this bucket but that are stored in a
+   * later one, and a bound on the distance to the furthest of them. */
+  ci_uint16 n_spilled;
+  ci_uint16 max_dist;
+  /* Local address of each entry.  For the IPv6 table this is folded to 32
+   * bits, and the full addresses follow the array of buckets. */
+  ci_uint32 laddr[CI_FILTER_BUCKET_SLOTS];
+  ci_uint16 lport[CI_FILTER_BUCKET_SLOTS];
+} ci_netif_filter_bucket CI_ALIGN(CI_CACHE_LINE_SIZE);
+
+
 typedef struct {
   ci_addr_t laddr;
   ci_addr_t raddr;
@@ -662,7 +693,8 @@ typedef struct {
 
 typedef struct {
   CI_ULCONST unsigned table_size_mask;
-  ci_ip6_netif_filter_table_entry table[1];
+  /* Cache-line aligned so that it can hold ci_netif_filter_bucket[]. */
+  ci_ip6_netif_filter_table_entry table[1] CI_ALIGN(CI_CACHE_LINE_SIZE);
 } ci_ip6_netif_filter_table;
 #endif
 
@@ -887,6 +919,9 @@ typedef struct {
   CI_ULCONST ci_uint32 sets_max; /**< max number of packet sets */
   /* Packet buffers allocated.  This is [sets_n * PKTS_PER_SET]. */
   CI_ULCONST ci_int32  n_pkts_allocated;
+  /* Time (frc) at which the host-wide packet budget (max_packets_total
+   * module option) last refused to give us another set, or 0. */
+  CI_ULCONST ci_uint64 grow_refused_frc;
 
   oo_pktbuf_set set[0];
 } oo_pktbuf_manager;
@@ -1109,6 +1144,79 @@ typedef struct {
 } ci_netif_state_nic_t;
 
 
+#if CI_CFG_FLIGHT_RECORDER
+/* Events recorded by the flight recorder.  The meaning of the arguments
+ * [a] and [b] is given for each.
+ */
+enum {
+  OO_FR_NONE = 0,
+  OO_FR_POLL,           /* a=events handled b=poll duration in usec */
+  OO_FR_LOCK_CONTEND,   /* (none) -- entering the lock slow path */
+  OO_FR_LOCK_GOT,       /* (none) -- got the lock after contending */
+  OO_FR_WAKE,           /* a=CI_SB_FLAG_WAKE_* b=socket id */
+  OO_FR_RETRANS,        /* a=retransmits of this socket b=socket id */
+  OO_FR_RX_DISCARD,     /* a=EF_EVENT_RX_DISCARD_* b=intf_i */
+  OO_FR_RX_DROP,        /* a=1 if memory pressure, else overflow
+                         * b=socket id */
+  OO_FR_MEM_PRESSURE,   /* a=1 on entry, 0 on exit */
+  OO_FR_FREEZE,         /* a=OO_FR_FROZEN_* b=poll duration in usec */
+  OO_FR_TYPE_N
+};
+
+struct oo_flight_rec_ev {
+  ci_uint64             frc;
+  ci_uint16             type;
+  ci_uint16             a;
+  ci_uint32             b;
+};
+
+/* Fixed-size ring of recent events.  Writers claim a slot by incrementing
+ * [n] with compare-and-swap, so events can be recorded with or without the
+ * stack lock.  A reader may see an event that is still being written.
+ */
+struct oo_flight_rec {
+  /* Number of events recorded.  The last is at [ring[(n-1) % LEN]]. */
+  volatile ci_uint32    n;
+  /* Non-zero when nothing more is to be recorded; gives the reason. */
+  volatile ci_uint32    frozen;
+#define OO_FR_FROZEN_DISABLED  1   /* EF_FLIGHT_RECORDER=0 */
+#define OO_FR_FROZEN_POLL      2   /* EF_FLIGHT_RECORDER_FREEZE_USEC */
+#define OO_FR_FROZEN_USER      3   /* onload_stackdump */
+  /* A poll that takes longer than this freezes the recorder; 0 = never. */
+  CI_ULCONST ci_uint64  freeze_cycles;
+  struct oo_flight_rec_ev ring[CI_CFG_FLIGHT_RECORDER_LEN];
+};
+#endif
+
+#if CI_CFG_POLL_PROFILE
+/* Phases of the poll loop accounted by EF_POLL_PROFILE.  Phases nest as
+ * shown by indentation, so the cycles of an inner phase are also counted
+ * in the phase containing it.
+ */
+enum {
+  OO_PROF_POLL,          /* ci_netif_poll_n() */
+  OO_PROF_EVQ,           /*   ef_eventq_poll() */
+  OO_PROF_RX,            /*   handle_rx_pkt() */
+  OO_PROF_TCP_RX,        /*     ci_tcp_handle_rx() */
+  OO_PROF_UDP_RX,        /*     ci_udp_handle_rx() */
+  OO_PROF_TX_COMPLETE,   /*   TX events and freeing of sent packets */
+  OO_PROF_RX_REFILL,     /*   ci_netif_rx_post_all_batch() */
+  OO_PROF_POST_POLL,     /*   process_post_poll_list() */
+  OO_PROF_LOOPBACK,      /*   ci_netif_loopback_pkts_send() */
+  OO_PROF_TIMERS,        /*   ci_ip_timer_poll() */
+  OO_PROF_DEFERRED,      /* ci_netif_unlock_slow_common(), including any
+                          * deferred poll */
+  OO_PROF_N
+};
+
+/* Accumulated by the lock holder only, and never reset. */
+struct oo_poll_profile {
+  ci_uint64             cycles[OO_PROF_N];
+  ci_uint64             calls[OO_PROF_N];
+};
+#endif
+
+
 struct ci_netif_state_s {
 
   ci_netif_state_nic_t  nic[CI_CFG_MAX_INTERFACES];
@@ -1277,6 +1385,7 @@ struct ci_netif_state_s {
   CI_ULCONST ci_uint32  sw_filter_ofs;  /**< offset of sw filter operations */
 #endif
   CI_ULCONST ci_uint32  seq_table_ofs;   /**< offset of seq no table */
+  CI_ULCONST ci_uint32  udp_ipcache_ofs; /**< offset of UDP dest cache */
   CI_ULCONST ci_uint32  deferred_pkts_ofs; /**< offset of deferred pkts array */
   CI_ULCONST ci_uint32  buf_ofs;         /**< offset of packet metadata */
   CI_ULCONST ci_uint32  dma_ofs;         /**< offset of dma_addrs */
@@ -1436,6 +1545,14 @@ struct ci_netif_state_s {
   volatile ci_uint16    dump_write_i;
 #endif
 
+#if CI_CFG_FLIGHT_RECORDER
+  struct oo_flight_rec  flight_rec CI_ALIGN(8);
+#endif
+
+#if CI_CFG_POLL_PROFILE
+  struct oo_poll_profile poll_profile CI_ALIGN(8);
+#endif
+
   ef_vi_stats           vi_stats CI_ALIGN(8);
 
   CI_ULCONST ci_int32   creation_numa_node;
@@ -1465,6 +1582,12 @@ struct ci_netif_state_s {
   /* Number of entries in the table of previously-used sequence numbers. */
   CI_ULCONST ci_uint32  seq_table_entries_n;
 
+  /* Number of entries in the cache of UDP destinations (a multiple of
+   * CI_UDP_IPCACHE_WAYS, or zero if disabled), and the counter used to
+   * order its entries by age. */
+  CI_ULCONST ci_uint32  udp_ipcache_entries_n;
+  ci_uint32             udp_ipcache_stamp;
+
   CI_ULCONST ci_uint16  rss_instance;
   CI_ULCONST ci_uint16  cluster_size;
 
@@ -1597,6 +1720,9 @@ typedef struct {
   /* Per-socket SO_BUSY_POLL settings */
   ci_uint64             spin_cycles CI_ALIGN(8);
 
+  /* EF_SPIN_ADAPTIVE history of blocking receives */
+  struct oo_spin_adapt  spin_adapt;
+
   /* These bits are set when someone wants to be woken (or other action
   ** associated with things happening). */
   ci_uint32             wake_request;
@@ -2196,6 +2322,23 @@ typedef struct {
 } ci_udp_recv_q;
 
 
+/*! Entry in the stack-wide cache of control plane lookups for unconnected
+ * UDP sends.  [hdrs] is a copy of a socket's [ephemeral_pkt] after a
+ * successful lookup, and is valid for any socket whose [oo_sock_cplane] is
+ * identical to [sock_cp], as these are the only inputs to the lookup other
+ * than the destination.  It is checked against the control plane version
+ * like any other ipcache before it is used.  Protected by the stack lock.
+ */
+#define CI_UDP_IPCACHE_WAYS  4
+
+typedef struct {
+  ci_ip_cached_hdrs     hdrs CI_ALIGN(8);
+  struct oo_sock_cplane sock_cp;
+  /* Value of [udp_ipcache_stamp] when last used, or 0 if free. */
+  ci_uint32             stamp;
+} ci_udp_ipcache_entry;
+
+
 typedef struct {
   ci_uint32 n_rx_os;          /* datagrams received via O/S sock       */
   ci_uint32 n_rx_os_slow;     /* datagrams received via O/S sock (slow)*/
@@ -2214,6 +2357,8 @@ typedef struct {
   ci_uint32 n_tx_cp_uc_lookup;/* unconnected, control plane lookup     */
   ci_uint32 n_tx_cp_c_lookup; /* connected, control plane lookup       */
   ci_uint32 n_tx_cp_a_lookup; /* unconnected, unlocked lookup          */
+  ci_uint32 n_tx_cp_cache_hit; /* unconnected, found in stack cache    */
+  ci_uint32 n_tx_cp_cache_miss;/* unconnected, not in stack cache      */
   ci_uint32 n_tx_cp_no_mac;   /* datagrams delayed due to no mac       */
   ci_uint32 n_tx_lock_poll;   /* locked to poll stack                  */
   ci_uint32 n_tx_lock_pkt;    /* locked to get packet buf              */
@@ -2228,6 +2373,7 @@ typedef struct {
   ci_uint32 n_tx_msg_confirm; /* onload send with MSG_CONFIRM          */
   ci_uint32 n_tx_os_late;     /* sent via OS, after copying            */
   ci_uint32 n_tx_unconnect_late; /* concurrent send and unconnect      */
+  ci_uint32 n_tx_mmsg_batch;  /* sendmmsg() batches of >1 datagram     */
 } ci_udp_socket_stats;
 
 struct  ci_udp_state_s {
@@ -2361,6 +2507,16 @@ struct oo_pipe {
 #define CI_PFD_AFLAG_WRITER_SHIFT   4
 #define CI_PFD_AFLAG_WRITER_MASK    0x70
 
+  /* The pipe is an eventfd: it has no buffers, and its count is in
+   * efd_count.  Set when it is created. */
+#define CI_PFD_AFLAG_EVENTFD        0x100
+  /* A read from the eventfd takes one from the count (EFD_SEMAPHORE) */
+#define CI_PFD_AFLAG_EFD_SEMAPHORE  0x200
+  /* The pipe is one direction of an AF_UNIX stream socketpair: it is read
+   * through its reader file and written through the reader file of
+   * unix_peer.  Its own writer file is closed when it is created. */
+#define CI_PFD_AFLAG_UNIX_STREAM    0x400
+
   ci_uint32 bufs_num;
 
   /* Maximum size of the pipe. It is not always enforced */
@@ -2385,6 +2541,13 @@ struct oo_pipe {
   volatile ci_uint32 bytes_added;           /*!< Total number of bytes written to the pipe */
   volatile ci_uint32 bytes_removed;         /*!< Total number of bytes removed
                                              * from the pipe */
+
+  /* Count of an eventfd, changed only with compare-and-swap */
+  volatile ci_uint64 efd_count;
+#define OO_EVENTFD_MAX  ((ci_uint64) -2)
+
+  /* The other direction of an AF_UNIX socketpair (CI_PFD_AFLAG_UNIX_STREAM) */
+  oo_sp unix_peer;
 };
 
 
@@ -2534,6 +2697,8 @@ struct oo_tcp_socket_stats {
   ci_uint32  tx_msg_warm;     /* Number of MSG_WARM done           */
   ci_uint32  tx_tmpl_send_fast;  /* Number of fast tmpl sends      */
   ci_uint32  tx_tmpl_send_slow;  /* Number of slow tmpl sends      */
+  ci_uint32  tx_zc_sends;     /* sends by reference to user memory */
+  ci_uint32  tx_zc_unregistered; /* large sends from unregistered mem */
   ci_uint32  rx_isn;          /* initial sequence num              */
   ci_uint16  tx_tmpl_active;  /* Number of active tmpl sends       */
   ci_uint16  rtos;            /* RTO timeouts                      */
@@ -2937,6 +3102,29 @@ typedef struct {
 } ci_tcp_socket_listen_stats;
 
 
+#if CI_CFG_TCP_ACCEPTQ_SHARDS
+/* Accept sub-queue of a listening socket.  [put] works just like
+ * ci_tcp_socket_listen::acceptq_put, but [get] is protected by [lock]
+ * rather than by the socket lock, so that threads accepting from different
+ * sub-queues do not contend.  [lock] holds the pid of the holder, so that
+ * a lock left by a dead process can be taken over.  [swizzle] and
+ * [swizzle_next] track connections being moved from [put] to [get], so
+ * that the move can be completed by whoever takes the lock over.  Padded
+ * so that two sub-queues share a cache line at most.
+ */
+typedef struct {
+  ci_int32             put;
+  oo_sp                get;
+  ci_uint32            lock;
+  ci_uint32            n_in;
+  ci_uint32            n_out;
+  oo_sp                swizzle;
+  oo_sp                swizzle_next;
+  ci_uint32            pad[1];
+} ci_tcp_acceptq_shard;
+#endif
+
+
 struct ci_tcp_socket_listen_s {
   ci_sock_cmn          s;
   ci_tcp_socket_cmn    c;
@@ -2950,6 +3138,16 @@ struct ci_tcp_socket_listen_s {
   oo_sp                acceptq_get;
   ci_uint32            acceptq_n_out;
 
+#if CI_CFG_TCP_ACCEPTQ_SHARDS
+  /* If non-zero, established connections are queued on these sub-queues
+   * instead of [acceptq_put], and [acceptq_n_out] is updated atomically.
+   * The totals in [acceptq_n_in] and [acceptq_n_out] are maintained as
+   * usual.  See EF_TCP_ACCEPTQ_SHARDS.
+   */
+  ci_uint32            acceptq_shards_n;
+  ci_tcp_acceptq_shard acceptq_shard[CI_CFG_TCP_ACCEPTQ_SHARDS];
+#endif
+
   /* For each listening socket we have a list of SYNRECV buffs, one for each
    * SYN we've received for which there hasn't yet been an ACK.  i.e. on
    * receipt of SYN we make a synrecv buf, then send the SYNACK.  The on
@@ -187,6 +187,7 @@ struct ci_netif_s {
   struct oo_p_dllink* active_wild_table;
 #endif
   ci_tcp_prev_seq_t*   seq_table;
+  ci_udp_ipcache_entry* udp_ipcache;
 
   struct oo_deferred_pkt* deferred_pkts;
 
@@ -324,6 +325,9 @@ struct ci_netif_s {
 #define S_TO_EPS(ni,s) ID_TO_EPS(ni,S_ID(s))
 #define SC_TO_EPS(ni,s) ID_TO_EPS(ni,SC_ID(s))
   struct ci_extra_ep* eps;
+  /* Buffers registered with onload_zc_register_buffers() in the local
+   * address space.  Protected by the stack lock. */
+  struct ci_zc_usermem* zc_usermem;
 #endif
 };
 
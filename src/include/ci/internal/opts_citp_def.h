@@ -189,6 +189,16 @@ CI_CFG_OPT("EF_FDS_MT_SAFE", fds_mt_safe, ci_uint32,
 "if your signal handlers call bind(), connect(), listen() or close()",
            1, , 1, 0, 1, yesno)
 
+CI_CFG_OPT("EF_FDS_DEFER_FREE", fds_defer_free, ci_uint32,
+"Only has an effect when EF_FDS_MT_SAFE=0.  When set, the calls that look up "
+"a file descriptor most often (send(), recv(), read(), write() and friends) "
+"do not take a reference to Onload's state for the descriptor.  Instead, each "
+"thread publishes the state it is using in a slot of its own, and state that "
+"has been closed or replaced is freed only once no thread publishes it.  "
+"This keeps the safety of EF_FDS_MT_SAFE=0 while avoiding most of its atomic "
+"operations and cache-line bouncing.",
+           1, , 0, 0, 1, yesno)
+
 CI_CFG_OPT("EF_FDTABLE_STRICT", fdtable_strict, ci_uint32,
 "Enables more strict concurrency control for the user-level file descriptor "
 "table.  Enabling this option can reduce performance for applications that "
@@ -396,6 +406,29 @@ CI_CFG_OPT("EF_PIPE", ul_pipe, ci_uint32,
            CI_UNIX_PIPE_DONT_ACCELERATE, CI_UNIX_PIPE_ACCELERATE_IF_NETIF,
            level)
 
+CI_CFG_OPT("EF_EVENTFD", ul_eventfd, ci_uint32,
+"Accelerate eventfd()s, so that they can be read and written without "
+"system calls, and are handled in user space by EF_UL_EPOLL=1 and 3 "
+"like accelerated sockets.  The values are as for EF_PIPE.  The eventfd "
+"can be read through the kernel, but not written, by a process that does "
+"not run with Onload.",
+           2, , CI_UNIX_PIPE_DONT_ACCELERATE,
+           CI_UNIX_PIPE_DONT_ACCELERATE, CI_UNIX_PIPE_ACCELERATE_IF_NETIF,
+           level)
+
+CI_CFG_OPT("EF_UNIX_SOCKETPAIR", ul_unix_socketpair, ci_uint32,
+"Accelerate socketpair(AF_UNIX, SOCK_STREAM), using a pipe in the stack "
+"for each direction, so that the pair can be used without system calls "
+"by the processes that share it.  The values are as for EF_PIPE.  Other "
+"AF_UNIX sockets, including named ones and SOCK_SEQPACKET and SOCK_DGRAM "
+"pairs, are not accelerated, and file descriptors and credentials cannot "
+"be passed over an accelerated pair.  An end of an accelerated pair can "
+"be read and written through the kernel by a process that does not run "
+"with Onload, but it supports only the calls that a pipe does.",
+           2, , CI_UNIX_PIPE_DONT_ACCELERATE,
+           CI_UNIX_PIPE_DONT_ACCELERATE, CI_UNIX_PIPE_ACCELERATE_IF_NETIF,
+           level)
+
 CI_CFG_OPT("EF_FDTABLE_SIZE", fdtable_size, ci_uint32,
 "Limit the number of opened file descriptors by this value.  "
 "If zero, the initial hard limit of open files (`ulimit -n -H`) is used.  "
@@ -484,6 +517,20 @@ CI_CFG_OPT("EF_SPIN_USEC", ul_spin_usec, ci_uint32,
 OO_SPIN_BLURB,
            , , 0, MIN, MAX, time:usec)
 
+CI_CFG_OPT("EF_SPIN_ADAPTIVE", ul_spin_adaptive, ci_uint32,
+"When set, blocking receives and epoll_wait() choose how long to spin on "
+"each call from the history of previous calls on the same socket or epoll "
+"set, rather than always spinning for EF_SPIN_USEC.  A call that usually "
+"gets its event within the spin timeout spins for a little longer than it "
+"usually waits, and then blocks.  A call that usually waits longer than the "
+"spin timeout blocks immediately, except that every 16th such call spins in "
+"full to detect when traffic picks up.  The spin_wait_* stack statistics "
+"show how many events were caught while spinning and the time spent "
+"spinning."
+"\n"
+OO_SPIN_BLURB,
+           1, , 0, 0, 1, yesno)
+
 CI_CFG_OPT("EF_SLEEP_SPIN_USEC", sleep_spin_usec, ci_uint32, 
 "Sets the duration in microseconds of sleep after each spin iteration. "
 "Currently applies to EPOLL3 epoll_wait only. "
@@ -439,6 +439,20 @@ CI_CFG_OPT("EF_TCP_COMBINE_SENDS_MODE", tcp_combine_sends_mode, ci_uint32,
            "explicit need to avoid combined or split sends.",
            1, , 0, 0, 1, yesno)
 
+CI_CFG_OPT("EF_TCP_SEND_ZC_THRESH", tcp_send_zc_thresh, ci_uint32,
+"When non-zero, a send() on a TCP socket of at least this many bytes, whose "
+"buffers all lie in memory registered with onload_zc_register_buffers(), is "
+"sent by reference to that memory as if by onload_zc_send(), rather than "
+"being copied into packet buffers.  Only the headers are placed in packet "
+"buffers, and retransmissions are also made from the application's memory.  "
+"The application must not modify the buffers until it has received the "
+"ONLOAD_SO_ONLOADZC_COMPLETE notification for each of them from the socket's "
+"error queue; the cookie in each notification is the address of the start of "
+"the buffer.  Sends that are too small, or that use memory that is not "
+"registered, are copied as usual.  Not supported with loopback "
+"acceleration.",
+           , , 0, 0, MAX, bincount)
+
 CI_CFG_OPT("EF_TCP_SOCKBUF_MAX_FRACTION", tcp_sockbuf_max_fraction, ci_uint32,
            "This option controls the maximum fraction of the TX buffers "
            "that may be allocated to a single socket with EF_TCP_SNDBUF_MODE=2.  "
@@ -484,6 +498,22 @@ CI_CFG_OPT("EF_UDP_SEND_NONBLOCK_NO_PACKETS_MODE",
            "able to send without error) to malfunction.",
            1, , 0, 0, 1, yesno)
 
+CI_CFG_OPT("EF_UDP_RECVMMSG_BATCH", udp_recvmmsg_batch, ci_uint32,
+"When set, recvmmsg() on a UDP socket takes all the datagrams that are "
+"already queued on the socket, up to the number requested, in one pass "
+"over the receive queue, and releases them together.  When not set, each "
+"datagram is received as if by a separate call to recvmsg().",
+           1, , 1, 0, 1, yesno)
+
+CI_CFG_OPT("EF_UDP_SENDMMSG_BATCH", udp_sendmmsg_batch, ci_uint32,
+"When set, sendmmsg() on a UDP socket builds the datagrams with the stack "
+"lock held throughout and posts them to the adapter together, with a single "
+"doorbell.  The control plane is consulted once for each run of datagrams "
+"to the same destination.  Datagrams that need fragmentation, have control "
+"messages or must be sent via the kernel are sent one at a time.  When not "
+"set, each datagram is sent as if by a separate call to sendmsg().",
+           1, , 1, 0, 1, yesno)
+
 CI_CFG_OPT("EF_TCP_RCVBUF_MODE", tcp_rcvbuf_mode, ci_uint32,
 "This option controls how the RCVBUF is set for TCP "
 "Mode 0 (default) gives fixed size RCVBUF."
@@ -587,6 +617,17 @@ CI_CFG_OPT("EF_TCP_CLIENT_LOOPBACK", tcp_client_loopback, ci_uint32,
            oneof:no;samestack;toconn;tolist;nonew)
 #endif
 
+CI_CFG_OPT("EF_TCP_LOOPBACK_DIRECT", tcp_loopback_direct, ci_uint32,
+"When set, data sent on an established accelerated TCP loopback connection "
+"(see EF_TCP_CLIENT_LOOPBACK) is placed directly in the receive queue of "
+"the peer socket, which always shares the sender's stack.  The data does "
+"not pass through the loopback queue or the TCP receive path, and is not "
+"acknowledged by a separate segment.  Segments carrying SYN, FIN, RST or "
+"urgent data, and segments that arrive while the peer is not on its fast "
+"receive path, are delivered as normal, so the connection still behaves "
+"as TCP to the applications.",
+           1, , 0, 0, 1, yesno)
+
 #if CI_CFG_PKTS_AS_HUGE_PAGES
 CI_CFG_OPT("EF_USE_HUGE_PAGES", huge_pages, ci_uint32,
 "Control of whether huge pages are used for packet buffers:\n"
@@ -606,6 +647,21 @@ CI_CFG_OPT("EF_USE_HUGE_PAGES", huge_pages, ci_uint32,
            2, , 1, 0, 2, oneof:no;try;always)
 #endif
 
+CI_CFG_OPT("EF_STATE_HUGE_PAGES", state_huge_pages, ci_uint32,
+"Control of whether huge pages are used for the shared stack state: the "
+"socket buffers (see EF_MAX_ENDPOINTS), the filter tables, timer wheels "
+"and other per-stack tables:\n"
+"  0 - no (default);\n"
+"  1 - use huge pages where available, falling back to normal pages.\n"
+"Unlike EF_USE_HUGE_PAGES, this does not use hugetlbfs: each 2MB chunk of "
+"the state is allocated as a physically contiguous block and is mapped "
+"with a single TLB entry if transparent huge pages are enabled in "
+"\"always\" or \"madvise\" mode.  This reduces TLB misses when a stack has "
+"a large number of sockets.  The number of chunks allocated as huge pages "
+"is reported as shmbuf_huge_allocs, and the number of times one has been "
+"mapped with a single TLB entry as shmbuf_huge_maps.",
+           1, , 0, 0, 1, oneof:no;try)
+
 CI_CFG_OPT("EF_COMPOUND_PAGES_MODE", compound_pages, ci_uint32,
 "Debug option, not suitable for normal use.\n"
 "For packet buffers, allocate system pages in the following way:\n"
@@ -792,12 +848,52 @@ CI_CFG_OPT("EF_SEND_POLL_MAX_EVS", send_poll_max_events, ci_uint16,
 "number of events handled.",
            , , 96, 1, 65535, count)
 
+#if CI_CFG_FLIGHT_RECORDER
+CI_CFG_OPT("EF_FLIGHT_RECORDER", flight_recorder, ci_uint32,
+"Record recent events in the stack (polls that handle events, lock "
+"contention, socket wake-ups, retransmits, receive drops and memory "
+"pressure) in a fixed-size ring in the stack's shared state.  The ring "
+"can be displayed with \"onload_stackdump flight_recorder\".",
+           1, , 0, 0, 1, yesno)
+
+CI_CFG_OPT("EF_FLIGHT_RECORDER_FREEZE_USEC", flight_recorder_freeze_usec,
+           ci_uint32,
+"When non-zero, stop recording in the flight recorder (see "
+"EF_FLIGHT_RECORDER) when a single poll of the stack takes longer than this "
+"many microseconds, so that the events leading up to the slow poll are "
+"kept for inspection.  Recording is restarted with \"onload_stackdump "
+"flight_recorder_rearm\".",
+           , , 0, MIN, MAX, time:usec)
+#endif
+
+#if CI_CFG_POLL_PROFILE
+CI_CFG_OPT("EF_POLL_PROFILE", poll_profile, ci_uint32,
+"Count the cycles spent in each phase of polling the stack (event queue "
+"polling, packet receive, TCP and UDP receive, transmit completion, receive "
+"ring refill, post-poll processing, loopback, timers and deferred work at "
+"unlock).  This adds a few reads of the CPU timestamp counter to each poll.  "
+"The breakdown can be watched with \"onload_stackdump watch_profile\", and "
+"accounting can be turned on for a running stack with \"onload_stackdump "
+"set_opt EF_POLL_PROFILE 1\".",
+           1, , 0, 0, 1, yesno)
+#endif
+
 CI_CFG_OPT("EF_UDP_SEND_UNLOCK_THRESH", udp_send_unlock_thresh, ci_uint16,
 "UDP message size below which we attempt to take the stack lock early.  "
 "Taking the lock early reduces overhead and latency slightly, but may "
 "increase lock contention in multi-threaded applications.",
            , , 1500, MIN, MAX, count)
 
+CI_CFG_OPT("EF_UDP_SEND_IPCACHE_SIZE", udp_send_ipcache_size, ci_uint32,
+"Number of entries in the per-stack cache of control plane lookups for "
+"unconnected UDP sends.  When an unconnected socket sends to a destination "
+"other than that of its previous send, the result of a recent lookup for "
+"that destination is taken from this cache if it is still valid, avoiding "
+"a full control plane lookup.  This helps applications that send to many "
+"destinations in turn from one socket.  The size is rounded up to a power "
+"of two.  0 disables the cache.",
+           , , 256, 0, 65536, count)
+
 CI_CFG_OPT("EF_UDP_PORT_HANDOVER_MIN", udp_port_handover_min, ci_uint16,
 "When set (together with EF_UDP_PORT_HANDOVER_MAX), this causes UDP sockets "
 "explicitly bound to a port in the given range to be handed over to the "
@@ -889,6 +985,17 @@ CI_CFG_OPT("EF_ACCEPTQ_MIN_BACKLOG", acceptq_min_backlog, ci_uint16,
 "call.  If the application requests a smaller value, use this value instead.",
            , , 1, MIN, MAX, count)
 
+CI_CFG_OPT("EF_TCP_ACCEPTQ_SHARDS", tcp_acceptq_shards, ci_uint16,
+"Number of accept sub-queues for each listening socket.  When set, new "
+"connections are spread over the sub-queues by a hash of their addresses "
+"and ports, and each thread calling accept() takes connections from the "
+"sub-queue chosen by the CPU it is running on, moving on to the other "
+"sub-queues only when that one is empty.  This avoids contention on the "
+"listening socket's lock when many threads accept() from the same socket "
+"at a high rate.  Ideally the number of sub-queues matches the number of "
+"accepting threads.  The default of 0 uses a single accept queue.",
+           4, , 0, 0, CI_CFG_TCP_ACCEPTQ_SHARDS, count)
+
 CI_CFG_OPT("EF_NONAGLE_INFLIGHT_MAX", nonagle_inflight_max, ci_uint16,
 "This option affects the behaviour of TCP sockets with the TCP_NODELAY socket "
 "option.  Nagle's algorithm is enabled when the number of packets in-flight "
@@ -952,6 +1059,16 @@ CI_CFG_OPT("EF_EVS_PER_POLL", evs_per_poll, ci_uint32,
 "value is 192, to increasing batching efficiency.",
            , , 64, 0, 0x7fffffff, level)
 
+CI_CFG_OPT("EF_RX_PREFETCH", rx_prefetch, ci_uint32,
+"When handling a batch of network events, first prefetch the headers of all "
+"of the received packets, then the filter table entries that they will be "
+"looked up in, and then the state of the sockets that they are destined "
+"for, before handling any of them.  This overlaps the cache misses for "
+"different packets, which helps at high packet rates when there are many "
+"active sockets.  It applies to IPv4 TCP and UDP packets that are delivered "
+"in a single buffer.",
+           1, , 1, 0, 1, yesno)
+
 #if CI_CFG_PORT_STRIPING
 CI_CFG_OPT("EF_STRIPE_NETMASK", stripe_netmask_be32, ci_uint32,
 "Port striping is only negotiated with hosts whose IP address is on the same "
@@ -969,6 +1086,10 @@ CI_CFG_OPT("EF_SPIN_USEC", spin_usec, ci_uint32,
            "" /* documented in opts_citp_def.h */,
            ,  poll_cycles, 0, MIN, MAX, time:usec)
 
+CI_CFG_OPT("EF_SPIN_ADAPTIVE", spin_adaptive, ci_uint32,
+           "" /* documented in opts_citp_def.h */,
+           1, , 0, 0, 1, yesno)
+
 CI_CFG_OPT("EF_BUZZ_USEC", buzz_usec, ci_uint32,
 "Sets the timeout in microseconds for lock buzzing options.  Set to zero to "
 "disable lock buzzing (spinning).  Will buzz forever if set to -1.  Also set "
@@ -1056,6 +1177,32 @@ CI_CFG_OPT("EF_PREALLOC_PACKETS", prealloc_packets, ci_int32,
 "EF_MIN_FREE_PACKETS option is not taken into account.",
            , , 0, 0, 1, yesno)
 
+CI_CFG_OPT("EF_STACK_POOL", stack_pool, ci_uint32,
+"When non-zero, the Onload driver keeps up to this many stacks built in "
+"advance for processes that share this process's configuration, "
+"namespaces and user, and a new process adopts one of them instead of "
+"waiting for its stack to be created.  The pool is refilled in the "
+"background, and packet buffers are allocated up to EF_PREFAULT_PACKETS "
+"before a stack is adopted.  Named stacks (EF_NAME) and clustered stacks "
+"are never pooled.  A pool that has not been used for ten minutes is "
+"freed.  The stack_pool_max module option limits the number of stacks "
+"kept for all processes together, and /proc/driver/onload/stack_pool "
+"shows the adoption hits and misses and the time taken to create stacks.",
+           , , 0, 0, 16, count)
+
+CI_CFG_OPT("EF_PACKET_SET_IDLE_RELEASE_MS", pkt_set_idle_release_ms, ci_uint32,
+"Packet buffers are allocated on demand in sets, up to EF_MAX_PACKETS.  When "
+"this option is non-zero, a packet set that has been completely unused for "
+"this many milliseconds is returned to the operating system, so that a "
+"stack sized for a rare burst does not hold the memory indefinitely.  Sets "
+"are only released while the stack retains at least a full set of free "
+"packets above EF_FREE_PACKETS_LOW_WATERMARK, so that it does not "
+"immediately have to allocate again.  Sets backed by huge pages, stacks "
+"using AF_XDP and stacks with EF_PREALLOC_PACKETS are never shrunk.  "
+"See also the max_packets_total module option, which limits the number "
+"of packet buffers allocated by all the stacks on the host.",
+           , , 0, MIN, MAX, time:msec)
+
 /* Max is currently 2^21 EPs.
  * We allocate ep in pages, EP_BUF_PER_PAGE=4 ep per page, so min is 4.
  * 7 synrecv states consume one endpoint, but we also use aux buffers for
@@ -1076,6 +1223,18 @@ CI_CFG_OPT("EF_MAX_ENDPOINTS", max_ep_bufs, ci_uint32,
            , , CI_CFG_NETIF_MAX_ENDPOINTS, 4, CI_CFG_NETIF_MAX_ENDPOINTS_MAX,
            count)
 
+CI_CFG_OPT("EF_FILTER_TABLE_BUCKETS", filter_table_buckets, ci_uint32,
+"Selects the layout of the software filter tables that map incoming "
+"packets to sockets:\n"
+"  0 - open addressing with double hashing (default);\n"
+"  1 - buckets of several entries, each in a single cache line.\n"
+"With buckets, a lookup usually touches just one cache line of the table "
+"however full it is, and closing sockets does not leave tombstones that "
+"lengthen later lookups.  This can help stacks with very many sockets, "
+"especially with a high rate of connection churn.  The table_* statistics "
+"shown by onload_stackdump report the probe lengths.",
+           1, , 0, 0, 1, yesno)
+
 
 CI_CFG_OPT("EF_ENDPOINT_PACKET_RESERVE", endpoint_packet_reserve, ci_uint16,
 "This option enables reservation of packets per endpoint.  No other endpoints"
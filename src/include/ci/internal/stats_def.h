@@ -238,6 +238,9 @@ OO_STAT("Multicast loop-back sends.",
         ci_uint32, udp_send_mcast_loop, count)
 OO_STAT("Multicast loop-back send was dropped due to RX packet buffer limit.",
         ci_uint32, udp_send_mcast_loop_drop, count)
+OO_STAT("Number of TCP loopback segments placed directly in the receive "
+        "queue of the peer socket (EF_TCP_LOOPBACK_DIRECT).",
+        ci_uint32, tcp_loopback_direct, count)
 OO_STAT("Number of active opens that reached established.",
         ci_uint32, active_opens, count)
 OO_STAT(HANDOVER_DESCRIPTION(socket),
@@ -290,6 +293,12 @@ OO_STAT("Number of entries in software-filter hash table.",
         ci_uint32, table_n_entries, val)
 OO_STAT("Number of slots occupied in software-filter hash table.",
         ci_uint32, table_n_slots, val)
+OO_STAT("Number of entries in the software-filter table that are not in "
+        "their home bucket (EF_FILTER_TABLE_BUCKETS only).",
+        ci_uint32, table_n_spilled, val)
+OO_STAT("Number of software-filter table lookups that went beyond the home "
+        "bucket (EF_FILTER_TABLE_BUCKETS only).",
+        ci_uint32, table_lookup_spills, count)
 #if CI_CFG_IPV6
 OO_STAT("Max hops in the IPv6 software-filter hash table lookup.",
         ci_uint32, ipv6_table_max_hops, val)
@@ -300,6 +309,12 @@ OO_STAT("Number of entries in IPv6 software-filter hash table.",
         ci_uint32, ipv6_table_n_entries, val)
 OO_STAT("Number of slots occupied in IPv6 software-filter hash table.",
         ci_uint32, ipv6_table_n_slots, val)
+OO_STAT("Number of entries in the IPv6 software-filter table that are not "
+        "in their home bucket (EF_FILTER_TABLE_BUCKETS only).",
+        ci_uint32, ipv6_table_n_spilled, val)
+OO_STAT("Number of IPv6 software-filter table lookups that went beyond the "
+        "home bucket (EF_FILTER_TABLE_BUCKETS only).",
+        ci_uint32, ipv6_table_lookup_spills, count)
 #endif
 OO_STAT("Number of retransmit timeouts, across all TCP sockets that stack "
         "has had.",
@@ -447,6 +462,12 @@ OO_STAT("Number of times accept() was accelerated.",
         ci_uint32, ul_accepts, count)
 OO_STAT("Number of times accept() returned EAGAIN.",
         ci_uint32, accept_eagain, count)
+OO_STAT("Number of times an accept sub-queue was skipped because its lock "
+        "could not be taken within a bounded spin.  See EF_TCP_ACCEPTQ_SHARDS.",
+        ci_uint32, acceptq_shard_lock_timeouts, count)
+OO_STAT("Number of times an accept sub-queue lock was taken over from a "
+        "process that died holding it.  See EF_TCP_ACCEPTQ_SHARDS.",
+        ci_uint32, acceptq_shard_lock_steals, count)
 OO_STAT("Number of failed aux-buffer allocations.",
         ci_uint32, aux_alloc_fails, count)
 OO_STAT("Number of failed bucket-aux-buffer allocations.",
@@ -586,6 +607,25 @@ OO_STAT("Number of attempts to allocate packet buffer set which have failed "
         "unlikely for this to increment multiple times.  To resolve this, "
         "make huge pages available, or look into EF_PACKET_BUFFER_MODE.",
         ci_uint32, bufset_alloc_nospace, count)
+OO_STAT("Number of attempts to allocate packet buffer set which have been "
+        "refused because all the stacks on the host together have reached "
+        "the max_packets_total module option.  Unlike bufset_alloc_nospace "
+        "this is not permanent: the stack will be able to grow again once "
+        "other stacks release their idle packet sets.",
+        ci_uint32, bufset_alloc_budget, count)
+OO_STAT("Number of packet sets returned to the OS after being unused for "
+        "EF_PACKET_SET_IDLE_RELEASE_MS.",
+        ci_uint32, bufset_released, count)
+OO_STAT("Highest number of packet sets allocated at any one time.",
+        ci_uint32, bufset_hwm, val)
+OO_STAT("Number of 2MB chunks of shared stack state (including socket "
+        "buffers) which have been allocated as huge pages.  Each is mapped "
+        "with a single TLB entry only where transparent huge pages allow; see "
+        "shmbuf_huge_maps.  See EF_STATE_HUGE_PAGES.",
+        ci_uint32, shmbuf_huge_allocs, val)
+OO_STAT("Number of times a chunk of shared stack state has been mapped to "
+        "user level with a single huge page table entry.",
+        ci_uint32, shmbuf_huge_maps, count)
 OO_STAT("Something has requested a larger MSS than we can support in a "
         "single packet buffer; so we've reduced it.  The maximum mss has "
         "multiple possibilities depending on card version.  "
@@ -679,6 +719,20 @@ OO_STAT("Number of loops x sockets spent in epoll_wait() busy-waiting, "
         "with EF_UL_EPOLL=2",
         ci_uint64, spin_epoll_kernel, count)
 #endif
+OO_STAT("Number of blocking receives and epoll_wait() calls that got their "
+        "event while spinning.",
+        ci_uint32, spin_wait_hits, count)
+OO_STAT("Number of blocking receives and epoll_wait() calls that spun until "
+        "their spin budget expired and then blocked.",
+        ci_uint32, spin_wait_misses, count)
+OO_STAT("Number of blocking receives and epoll_wait() calls that blocked "
+        "without spinning, because EF_SPIN_ADAPTIVE expected them to wait "
+        "longer than the spin timeout.",
+        ci_uint32, spin_wait_skips, count)
+OO_STAT("Cycles spent spinning in blocking receives and epoll_wait() calls.  "
+        "Compare with spin_wait_hits to see how much spinning it takes to "
+        "catch each event.",
+        ci_uint64, spin_wait_cycles, count)
 #if CI_CFG_FD_CACHING
 OO_STAT("Number of sockets cached over lifetime of the stack",
         ci_uint32, sockcache_cached, count)
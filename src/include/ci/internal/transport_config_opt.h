@@ -458,6 +458,11 @@
 /* Maximum number of retransmit for SYN-ACKs */
 #define CI_CFG_TCP_SYNACK_RETRANS_MAX 10
 
+/* Maximum number of accept sub-queues per listening socket; see
+ * EF_TCP_ACCEPTQ_SHARDS.  Set to 0 to compile out.
+ */
+#define CI_CFG_TCP_ACCEPTQ_SHARDS 8
+
 /* Enable inspection of packets before delivery */
 #define CI_CFG_ZC_RECV_FILTER    1
 
@@ -484,6 +489,17 @@
 #define CI_CFG_DUMPQUEUE_LEN 128
 #endif /* CI_CFG_TCPDUMP */
 
+/* Per-stack flight recorder of hot-path events; see EF_FLIGHT_RECORDER */
+#define CI_CFG_FLIGHT_RECORDER 1
+
+#if CI_CFG_FLIGHT_RECORDER
+/* Number of events kept, should be 2^x */
+#define CI_CFG_FLIGHT_RECORDER_LEN 1024
+#endif
+
+/* Per-phase cycle accounting in the poll loop; see EF_POLL_PROFILE */
+#define CI_CFG_POLL_PROFILE 1
+
 
 /* Support for reducing ACK rate at high throughput to improve efficiency */
 #define CI_CFG_DYNAMIC_ACK_RATE 1
@@ -1531,6 +1531,141 @@ extern int
 ef_vi_receive_set_discards(ef_vi* vi, unsigned discard_err_flags);
 
 
+/**********************************************************************
+ * Batched receive ****************************************************
+ **********************************************************************/
+
+/*! \brief Maximum number of events that ef_vi_receive_burst() polls at
+**         once.
+*/
+#define EF_VI_RX_BURST_EVS 32
+
+/*! \brief Flags for an ef_vi_rx_pkt */
+enum ef_vi_rx_pkt_flags {
+  /** Packet starts in this buffer */
+  EF_VI_RX_PKT_F_SOP      = 0x1,
+  /** Packet continues in the next buffer */
+  EF_VI_RX_PKT_F_CONT     = 0x2,
+  /** Packet would have been discarded; see ef_vi_rx_pkt::discard */
+  EF_VI_RX_PKT_F_DISCARD  = 0x4,
+  /** ef_vi_rx_pkt::ts and ef_vi_rx_pkt::ts_flags are valid */
+  EF_VI_RX_PKT_F_TS       = 0x8,
+  /** ef_vi_rx_pkt::user_mark is valid */
+  EF_VI_RX_PKT_F_MARK     = 0x10,
+  /** Buffer is owned by the NIC: ef_vi_rx_pkt::id is a packet id which
+   ** must be passed to efct_vi_rxpkt_release() */
+  EF_VI_RX_PKT_F_REF      = 0x20,
+};
+
+/*! \brief A received packet, as returned by ef_vi_receive_burst() */
+typedef struct {
+  /** First byte of the packet, after any prefix */
+  const void*   data;
+  /** The DMA id passed to ef_vi_receive_init(), the buffer number for
+   ** AF_XDP, or the packet id with EF_VI_RX_PKT_F_REF */
+  uint32_t      id;
+  /** Length of the packet, not including any prefix */
+  uint16_t      len;
+  /** Flags from ::ef_vi_rx_pkt_flags */
+  uint16_t      flags;
+  /** Value assigned by the NIC filter, with EF_VI_RX_PKT_F_MARK */
+  uint32_t      user_mark;
+  /** EF_VI_DISCARD_RX_* flags, with EF_VI_RX_PKT_F_DISCARD */
+  uint16_t      discard;
+  /** EF_VI_SYNC_FLAG_* flags, with EF_VI_RX_PKT_F_TS */
+  uint16_t      ts_flags;
+  /** Timestamp, with EF_VI_RX_PKT_F_TS */
+  ef_timespec   ts;
+} ef_vi_rx_pkt;
+
+/*! \brief Flags for ef_vi_rx_burst_init() */
+enum ef_vi_rx_burst_flags {
+  /** Retrieve hardware timestamps */
+  EF_VI_RX_BURST_TIMESTAMPS = 0x1,
+  /** Retrieve user marks (SN1000-series with full prefix, and X3-series) */
+  EF_VI_RX_BURST_USER_MARK  = 0x2,
+};
+
+/*! \brief State for ef_vi_receive_burst()
+**
+** Users should not access this structure directly, but should initialise
+** it with ef_vi_rx_burst_init().
+*/
+typedef struct {
+  char*         buf_base;
+  size_t        buf_stride;
+  unsigned      dma_ofs;
+  unsigned      flags;
+
+  /* Events polled but not yet fully returned: [evs_i, evs_n). */
+  int           evs_i;
+  int           evs_n;
+  /* Packets already returned from evs[evs_i]. */
+  int           ev_pkts;
+  /* DMA ids unbundled from an RX_MULTI event in evs[evs_i]. */
+  int           ids_n;
+  ef_request_id ids[EF_VI_RECEIVE_BATCH];
+  ef_event      evs[EF_VI_RX_BURST_EVS];
+} ef_vi_rx_burst;
+
+
+/*! \brief Initialise state for ef_vi_receive_burst()
+**
+** \param rb         The state to initialise.
+** \param buf_base   Address of the packet buffer with DMA id 0.
+** \param buf_stride Distance between the packet buffers with consecutive
+**                   DMA ids.
+** \param dma_ofs    Offset within each packet buffer of the address passed
+**                   to ef_vi_receive_init().
+** \param flags      Flags from ::ef_vi_rx_burst_flags.
+**
+** ef_vi_receive_burst() locates the data for DMA id N at
+** buf_base + N * buf_stride + dma_ofs, so the application must number its
+** receive buffers in this way.  For AF_XDP, buf_base must be the start of
+** the UMEM, buf_stride must be ef_vi_receive_buffer_len(), and dma_ofs is
+** ignored.  Packets received by an X3-series adapter are not in application
+** buffers, so these parameters are not used.
+*/
+extern void ef_vi_rx_burst_init(ef_vi_rx_burst* rb, void* buf_base,
+                                size_t buf_stride, unsigned dma_ofs,
+                                unsigned flags);
+
+
+/*! \brief Poll for received packets, in the same form on all adapters
+**
+** \param vi        The virtual interface to poll.
+** \param rb        State initialised with ef_vi_rx_burst_init().
+** \param pkts      Array that is updated with received packets.
+** \param max_pkts  Size of the pkts array.
+** \param evs       Array that is updated with events which are not for
+**                  received packets, such as TX completions.
+** \param evs_len   On entry the size of the evs array, which must be at
+**                  least EF_VI_EVENT_POLL_MIN_EVS; on return the number of
+**                  events stored in it.
+**
+** \return The number of packets stored in pkts.
+**
+** This function polls the event queue, unbundles RX_MULTI and RX_MULTI_PKTS
+** events, reads lengths, discard flags, timestamps and user marks from the
+** packet prefix or event as needed, and fills in one ::ef_vi_rx_pkt for each
+** received buffer.  The packet headers are prefetched, so that processing
+** the first packets overlaps with fetching the rest.
+**
+** Events which do not fit in \p pkts are held in \p rb, and returned by the
+** next call.  Packed-stream events are not supported, and are returned in
+** \p evs.
+**
+** Buffers received with EF_VI_RX_PKT_F_REF must be released with
+** efct_vi_rxpkt_release() once the application has finished with them.
+** Other buffers may be reposted once processed, as with ef_eventq_poll().
+**
+** ef_eventq_poll() must not be called on \p vi while \p rb holds events.
+*/
+extern int ef_vi_receive_burst(ef_vi* vi, ef_vi_rx_burst* rb,
+                               ef_vi_rx_pkt* pkts, int max_pkts,
+                               ef_event* evs, int* evs_len);
+
+
 /**********************************************************************
  * Transmit interface *************************************************
  **********************************************************************/
@@ -0,0 +1,324 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+
+/**************************************************************************\
+*//*! \file
+** \brief     Zero-copy fan-out of received packets to multiple consumers.
+*//*
+\**************************************************************************/
+
+/*
+ * A single producer receives packets with ef_vi into buffers that are in a
+ * region of memory shared with one or more consumer processes, and
+ * publishes a reference to each packet on a ring in that region.  Each
+ * consumer reads the references from the ring and accesses the packet data
+ * in place.  A buffer is returned to the producer once every consumer that
+ * it was delivered to has released it.
+ *
+ * The shared region is provided by the caller (e.g. from shm_open() or
+ * SysV shm with huge pages).  The producer lays it out with
+ * ef_fanout_producer_init() and registers the packet buffers it contains
+ * with ef_memreg_alloc().  Consumers map the same region and call
+ * ef_fanout_consumer_attach().
+ *
+ * The producer tags each packet, and a packet is delivered only to the
+ * consumers whose filter has a bit in common with its tag.
+ *
+ * When the slowest consumer falls a whole ring behind, the producer either
+ * refuses to publish (::EF_FANOUT_POLICY_BLOCK), or moves that consumer
+ * forward so that it loses the oldest packets (::EF_FANOUT_POLICY_DROP_SLOW).
+ * A consumer that has died or stopped making progress can be evicted with
+ * ef_fanout_consumer_evict(), which also returns the buffers it holds.
+ *
+ * The producer functions must be called from a single thread.  Each
+ * consumer must likewise use its ef_fanout from a single thread.
+ */
+
+#ifndef __EFAB_FANOUT_H__
+#define __EFAB_FANOUT_H__
+
+#include <etherfabric/base.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \brief Maximum number of consumers attached to a fan-out at once */
+#define EF_FANOUT_MAX_CONSUMERS  32
+
+/*! \brief What the producer does when the slowest consumer is a whole ring
+**         behind */
+enum ef_fanout_policy {
+  /** ef_fanout_publish() fails with -EAGAIN */
+  EF_FANOUT_POLICY_BLOCK,
+  /** Consumers that are behind skip the oldest packets */
+  EF_FANOUT_POLICY_DROP_SLOW,
+};
+
+/*! \brief Parameters for ef_fanout_producer_init() */
+struct ef_fanout_params {
+  /** Number of packet buffers */
+  unsigned n_bufs;
+  /** Size of each packet buffer.  Must divide 4096, and be a multiple of
+   ** EF_VI_DMA_ALIGN. */
+  unsigned buf_size;
+  /** Number of entries in the ring.  Must be a power of 2. */
+  unsigned ring_size;
+  /** One of ::ef_fanout_policy */
+  unsigned policy;
+};
+
+/*! \brief A packet delivered to a consumer */
+struct ef_fanout_pkt {
+  /** Buffer holding the packet, to pass to ef_fanout_consumer_release() */
+  uint32_t buf_id;
+  /** Offset of the packet within the buffer */
+  uint16_t ofs;
+  /** Length of the packet */
+  uint16_t len;
+  /** Tag given to ef_fanout_publish() */
+  uint32_t tag;
+};
+
+/*! \brief Statistics for a consumer */
+struct ef_fanout_consumer_stats {
+  /** Packets received by the consumer */
+  uint64_t n_pkts;
+  /** Packets the consumer lost because it was too slow */
+  uint64_t n_dropped;
+  /** Number of ring entries the consumer has still to read */
+  unsigned lag;
+};
+
+struct ef_fanout_shm;
+
+/*! \brief A process's handle on a fan-out.
+**
+** Users should not access this structure.
+*/
+typedef struct ef_fanout {
+  struct ef_fanout_shm* shm;
+  char*                 bufs;
+  unsigned              n_bufs;
+  unsigned              buf_size;
+  unsigned              ring_mask;
+  /* Consumer: our slot, or -1 for the producer. */
+  int                   consumer_i;
+  /* Producer: buffers we own that are not posted or published. */
+  uint32_t*             free_ids;
+  unsigned              free_n;
+  /* Producer: published buffers in publish order, to be reclaimed. */
+  uint32_t*             held;
+  unsigned              held_n;
+  /* Producer: lower bound on the tail of the slowest consumer. */
+  uint64_t              min_tail;
+  /* Producer: consumers we deliver to, and their filters. */
+  uint32_t              active;
+  uint32_t              filters[EF_FANOUT_MAX_CONSUMERS];
+} ef_fanout;
+
+
+/*! \brief Return the size of the shared region needed for a fan-out
+**
+** \param params Parameters of the fan-out.
+**
+** \return The number of bytes needed.
+*/
+extern size_t ef_fanout_mem_size(const struct ef_fanout_params* params);
+
+/*! \brief Lay out a fan-out in a shared region and take the producer role
+**
+** \param fo     The ef_fanout to initialize.
+** \param mem    Start of the shared region.  This must be page-aligned.
+** \param len    Length of the shared region; at least
+**               ef_fanout_mem_size().
+** \param params Parameters of the fan-out.
+**
+** \return 0 on success, or a negative error code.
+**
+** All the buffers are initially owned by the producer, and can be got with
+** ef_fanout_buf_alloc().  Consumers can attach once this returns.
+*/
+extern int ef_fanout_producer_init(ef_fanout* fo, void* mem, size_t len,
+                                   const struct ef_fanout_params* params);
+
+/*! \brief Release the producer's private resources
+**
+** \param fo The ef_fanout.
+**
+** The shared region is not touched, so consumers must be stopped first.
+*/
+extern void ef_fanout_producer_fini(ef_fanout* fo);
+
+/*! \brief Return the part of the shared region that holds packet buffers
+**
+** \param fo      The ef_fanout.
+** \param len_out Set to the length of the buffer area.
+**
+** \return The start of the buffer area.
+**
+** The buffer area is page-aligned, and its length is a multiple of 4096, so
+** it can be passed to ef_memreg_alloc().  The DMA address of a buffer is
+** then ef_memreg_dma_addr(mr, ef_fanout_buf_offset(fo, id)).
+*/
+extern void* ef_fanout_bufs(ef_fanout* fo, size_t* len_out);
+
+/*! \brief Return the offset of a buffer within the buffer area */
+ef_vi_inline size_t ef_fanout_buf_offset(const ef_fanout* fo, unsigned id)
+{
+  return (size_t) id * fo->buf_size;
+}
+
+/*! \brief Return a pointer to a buffer */
+ef_vi_inline void* ef_fanout_buf_ptr(const ef_fanout* fo, unsigned id)
+{
+  return fo->bufs + ef_fanout_buf_offset(fo, id);
+}
+
+/*! \brief Return a pointer to the data of a delivered packet */
+ef_vi_inline void* ef_fanout_pkt_ptr(const ef_fanout* fo,
+                                     const struct ef_fanout_pkt* pkt)
+{
+  return (char*) ef_fanout_buf_ptr(fo, pkt->buf_id) + pkt->ofs;
+}
+
+/*! \brief Get a free buffer, e.g. to post to the receive ring
+**
+** \param fo The ef_fanout.
+**
+** \return The id of the buffer, or -ENOBUFS if there are no free buffers.
+**
+** Buffers are reclaimed once all the consumers that they were delivered to
+** have released them.  Buffers held by a consumer that has died are only
+** reclaimed once it is evicted with ef_fanout_consumer_evict().
+*/
+extern int ef_fanout_buf_alloc(ef_fanout* fo);
+
+/*! \brief Give back a buffer that has not been published
+**
+** \param fo The ef_fanout.
+** \param id The buffer.
+*/
+extern void ef_fanout_buf_free(ef_fanout* fo, unsigned id);
+
+/*! \brief Publish a packet to the consumers
+**
+** \param fo  The ef_fanout.
+** \param id  The buffer holding the packet.
+** \param ofs Offset of the packet within the buffer.
+** \param len Length of the packet.
+** \param tag The packet is delivered to consumers whose filter has any bit
+**            in common with this.
+**
+** \return The number of consumers that the packet was delivered to, or
+**         -EAGAIN if the slowest consumer is a whole ring behind and the
+**         policy is ::EF_FANOUT_POLICY_BLOCK.
+**
+** If the packet is not delivered to any consumer, or on failure, the
+** buffer goes back to the producer's free pool.
+*/
+extern int ef_fanout_publish(ef_fanout* fo, unsigned id, unsigned ofs,
+                             unsigned len, uint32_t tag);
+
+/*! \brief Attach or detach consumers that have asked to
+**
+** \param fo The ef_fanout.
+**
+** This is done by ef_fanout_publish(), so only needs to be called when the
+** producer has nothing to publish.
+*/
+extern void ef_fanout_producer_poll(ef_fanout* fo);
+
+/*! \brief Return the consumer that is furthest behind
+**
+** \param fo      The ef_fanout.
+** \param lag_out Set to the number of ring entries that the consumer has
+**                still to read.
+**
+** \return The consumer's index, or -1 if no consumers are attached.
+*/
+extern int ef_fanout_slowest(ef_fanout* fo, unsigned* lag_out);
+
+/*! \brief Forcibly detach a consumer that has died or is stuck
+**
+** \param fo         The producer's ef_fanout.
+** \param consumer_i The consumer's index, e.g. from ef_fanout_slowest().
+**
+** \return 0 on success, or -ENOENT if the consumer is not attached.
+**
+** The consumer stops receiving packets, and its share of every buffer is
+** released at once, including packets that it has got but not released.
+** It must not use the data of those packets any more; if it is still
+** alive, ef_fanout_consumer_get() fails with -ENOTCONN and it should call
+** ef_fanout_consumer_detach().  Its slot cannot be reused until then, so a
+** fan-out can evict at most ::EF_FANOUT_MAX_CONSUMERS consumers that died
+** without detaching.
+*/
+extern int ef_fanout_consumer_evict(ef_fanout* fo, int consumer_i);
+
+/*! \brief Get the statistics of a consumer
+**
+** \param fo         The ef_fanout (producer's or consumer's).
+** \param consumer_i The consumer's index.
+** \param stats_out  Set to the statistics.
+**
+** \return 0 on success, or -ENOENT if the consumer is not attached.
+*/
+extern int ef_fanout_consumer_stats(ef_fanout* fo, int consumer_i,
+                                    struct ef_fanout_consumer_stats*
+                                    stats_out);
+
+/*! \brief Attach to a fan-out as a consumer
+**
+** \param fo     The ef_fanout to initialize.
+** \param mem    Start of the shared region in this process.
+** \param len    Length of the shared region.
+** \param filter Receive packets whose tag has any bit in common with this.
+**
+** \return The consumer's index on success, -ENOENT if the producer has
+**         not initialized the region, or -EBUSY if there are already
+**         ::EF_FANOUT_MAX_CONSUMERS consumers.
+**
+** The consumer receives packets published after the producer next calls
+** ef_fanout_publish() or ef_fanout_producer_poll().
+*/
+extern int ef_fanout_consumer_attach(ef_fanout* fo, void* mem, size_t len,
+                                     uint32_t filter);
+
+/*! \brief Detach a consumer
+**
+** \param fo The consumer's ef_fanout.
+**
+** All packets got with ef_fanout_consumer_get() must have been released.
+** Packets not yet got are released by the producer.  This must also be
+** called by a consumer that has been evicted.
+*/
+extern void ef_fanout_consumer_detach(ef_fanout* fo);
+
+/*! \brief Get packets delivered to a consumer
+**
+** \param fo       The consumer's ef_fanout.
+** \param pkts     Array to fill in.
+** \param max_pkts Size of the array.
+**
+** \return The number of packets got, or -ENOTCONN if the producer has
+**         evicted this consumer.
+**
+** Each packet must be released with ef_fanout_consumer_release() when the
+** consumer has finished with its data.
+*/
+extern int ef_fanout_consumer_get(ef_fanout* fo, struct ef_fanout_pkt* pkts,
+                                  int max_pkts);
+
+/*! \brief Release a packet got with ef_fanout_consumer_get()
+**
+** \param fo     The consumer's ef_fanout.
+** \param buf_id The packet's buffer.
+*/
+extern void ef_fanout_consumer_release(ef_fanout* fo, unsigned buf_id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* __EFAB_FANOUT_H__ */
@@ -0,0 +1,209 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+
+/**************************************************************************\
+*//*! \file
+** \brief     Zero-copy forwarding of packets between virtual interfaces.
+*//*
+\**************************************************************************/
+
+/*
+ * An ef_fwd forwards packets received on one virtual interface (a "port")
+ * out of another without copying them: each receive buffer is transmitted
+ * from where it was received, and goes back on a receive ring when the
+ * transmit completes.
+ *
+ * All ports use one pool of packet buffers, which the application
+ * allocates and registers with every port's protection domain (or once,
+ * if the ports share a protection domain).  Receives, transmits and
+ * refills are done in batches, with one doorbell per batch.
+ *
+ * An optional hook is called for each packet.  It can rewrite the headers
+ * in place, move the start of the packet into the headroom in front of it,
+ * choose the port to send it on, or drop it.
+ *
+ * Packets received by X3-series adapters are not in application buffers,
+ * so are copied into a buffer from the pool before they are forwarded.
+ * Packets that span more than one buffer are dropped.
+ */
+
+#ifndef __EFAB_FORWARD_H__
+#define __EFAB_FORWARD_H__
+
+#include <etherfabric/ef_vi.h>
+#include <etherfabric/memreg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \brief Maximum number of ports of an ef_fwd */
+#define EF_FWD_MAX_PORTS  8
+
+/*! \brief Maximum number of packets handled per port per ef_fwd_poll() */
+#define EF_FWD_BATCH      32
+
+/*! \brief A packet being forwarded, as passed to an ::ef_fwd_hook */
+struct ef_fwd_pkt {
+  /** Start of the packet.  The hook may move this back into the headroom
+   ** given to ef_fwd_init(), or forward. */
+  char*               data;
+  /** Length of the packet.  The hook may change this, but the packet must
+   ** stay within its buffer. */
+  unsigned            len;
+  /** Port the packet was received on */
+  int                 rx_port;
+  /** Port to send the packet on.  Initially the port given to
+   ** ef_fwd_port_add() for rx_port. */
+  int                 tx_port;
+  /** The packet as received, including any timestamp and user mark */
+  const ef_vi_rx_pkt* rx;
+};
+
+/*! \brief Called for each packet before it is sent
+**
+** \param arg The argument given to ef_fwd_set_hook().
+** \param pkt The packet, which may be modified.
+**
+** \return 0 to send the packet, or non-zero to drop it.
+*/
+typedef int ef_fwd_hook(void* arg, struct ef_fwd_pkt* pkt);
+
+/*! \brief Statistics for a port of an ef_fwd */
+struct ef_fwd_port_stats {
+  /** Packets received */
+  uint64_t rx_pkts;
+  /** Packets received with a discard flag set, or spanning buffers */
+  uint64_t rx_discards;
+  /** Packets sent */
+  uint64_t tx_pkts;
+  /** Packets dropped because this port's transmit ring was full */
+  uint64_t tx_full;
+  /** Packets dropped by the hook, or with no port to send on */
+  uint64_t hook_drops;
+  /** Times the receive ring could not be refilled for lack of buffers */
+  uint64_t rx_refill_starved;
+  /** Packets the NIC failed to send */
+  uint64_t tx_errors;
+};
+
+struct ef_fwd_port {
+  ef_vi*                   vi;
+  ef_memreg*               mr;
+  int                      default_tx_port;
+  int                      tx_pending;
+  ef_vi_rx_burst           rb;
+  struct ef_fwd_port_stats stats;
+};
+
+/*! \brief A forwarding engine
+**
+** Users should not access this structure.
+*/
+typedef struct ef_fwd {
+  char*              bufs;
+  unsigned           buf_size;
+  unsigned           n_bufs;
+  unsigned           headroom;
+  unsigned           refill_batch;
+  ef_fwd_hook*       hook;
+  void*              hook_arg;
+  /* Buffers not on a receive or transmit ring (LIFO). */
+  uint32_t*          free_ids;
+  unsigned           free_n;
+  int                n_ports;
+  struct ef_fwd_port ports[EF_FWD_MAX_PORTS];
+} ef_fwd;
+
+
+/*! \brief Initialize a forwarding engine
+**
+** \param fwd      The ef_fwd to initialize.
+** \param bufs     Packet buffer memory, which must be registered with each
+**                 port's protection domain.
+** \param buf_size Size of each packet buffer.  Must divide 4096.
+** \param n_bufs   Number of packet buffers.
+** \param headroom Space to leave in front of each received packet for the
+**                 hook to add headers.  Rounded up to EF_VI_DMA_ALIGN.
+**
+** \return 0 on success, or a negative error code.
+**
+** There should be enough buffers to fill the receive and transmit rings of
+** all the ports.
+*/
+extern int ef_fwd_init(ef_fwd* fwd, void* bufs, unsigned buf_size,
+                       unsigned n_bufs, unsigned headroom);
+
+/*! \brief Free the resources of a forwarding engine
+**
+** \param fwd The ef_fwd.
+**
+** The virtual interfaces and registered memory are not freed.
+*/
+extern void ef_fwd_fini(ef_fwd* fwd);
+
+/*! \brief Add a port to a forwarding engine
+**
+** \param fwd     The ef_fwd.
+** \param vi      The virtual interface to receive and send on.
+** \param mr      The registration of the engine's buffers for the
+**                virtual interface's protection domain.
+** \param tx_port Port to send packets received on this port to, unless the
+**                hook says otherwise.  May be this port, or a port not yet
+**                added.  -1 to drop them unless the hook chooses a port.
+**
+** Buffers are posted to the port's receive ring, if it has one, whatever
+** \p tx_port is.
+**
+** \return The index of the new port, or a negative error code.
+*/
+extern int ef_fwd_port_add(ef_fwd* fwd, ef_vi* vi, ef_memreg* mr,
+                           int tx_port);
+
+/*! \brief Set the hook called for each packet
+**
+** \param fwd  The ef_fwd.
+** \param hook The hook, or NULL to forward packets unmodified.
+** \param arg  Argument passed to the hook.
+*/
+extern void ef_fwd_set_hook(ef_fwd* fwd, ef_fwd_hook* hook, void* arg);
+
+/*! \brief Fill the receive rings of the ports that receive
+**
+** \param fwd The ef_fwd.
+**
+** Call this once all the ports are added, before ef_fwd_poll().
+*/
+extern void ef_fwd_fill(ef_fwd* fwd);
+
+/*! \brief Receive and forward packets on all ports
+**
+** \param fwd The ef_fwd.
+**
+** \return The number of packets received.
+**
+** Each port's event queue is polled once.  Received packets are passed to
+** the hook and queued on their transmit ports, which are then pushed.
+** Completed transmits return their buffers to the pool, and the receive
+** rings are refilled from it.
+*/
+extern int ef_fwd_poll(ef_fwd* fwd);
+
+/*! \brief Get the statistics of a port
+**
+** \param fwd    The ef_fwd.
+** \param port_i The port.
+**
+** \return The port's statistics.
+*/
+ef_vi_inline const struct ef_fwd_port_stats*
+ef_fwd_port_stats(const ef_fwd* fwd, int port_i)
+{
+  return &fwd->ports[port_i].stats;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* __EFAB_FORWARD_H__ */
@@ -0,0 +1,204 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+
+/**************************************************************************\
+*//*! \file
+** \brief     Receive spread over multiple cores with RSS.
+*//*
+\**************************************************************************/
+
+/*
+ * An ef_rss receives on a virtual interface set, with one worker thread per
+ * virtual interface.  The adapter spreads packets over the set with RSS,
+ * and each worker polls its own virtual interface and passes batches of
+ * received packets to a callback.
+ *
+ * Each worker can be pinned to a CPU.  Packet buffers are allocated per
+ * NUMA node: the workers on a node share one allocation and registration,
+ * which is touched first by one of them so that it is local to the node.
+ * Each worker refills its receive ring from its own part of it.
+ *
+ * The buffers of a batch are given back to the adapter when the callback
+ * returns, so the callback must copy anything it wants to keep.
+ */
+
+#ifndef __EFAB_RSS_H__
+#define __EFAB_RSS_H__
+
+#include <etherfabric/ef_vi.h>
+#include <etherfabric/vi.h>
+#include <etherfabric/memreg.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \brief Maximum number of packets passed to the callback at once */
+#define EF_RSS_BATCH  32
+
+/*! \brief Called by a worker with a batch of received packets
+**
+** \param arg      The argument given in ef_rss_params.
+** \param worker_i The worker that received the packets.
+** \param pkts     The packets.  Packets with discard flags set, and packets
+**                 that span more than one buffer, are not included.
+** \param n_pkts   The number of packets, at least 1.
+*/
+typedef void ef_rss_rx_fn(void* arg, int worker_i, const ef_vi_rx_pkt* pkts,
+                          int n_pkts);
+
+/*! \brief Parameters for ef_rss_alloc() */
+struct ef_rss_params {
+  /** Number of workers, and of virtual interfaces in the set */
+  int              n_workers;
+  /** CPU to pin each worker to, or NULL to leave them unpinned */
+  const int*       cpus;
+  /** Receive queue capacity of each virtual interface, or -1 for the
+   ** default */
+  int              rxq_capacity;
+  /** Flags for the virtual interfaces */
+  enum ef_vi_flags vi_flags;
+  /** Flags from ::ef_vi_rx_burst_flags */
+  unsigned         rx_burst_flags;
+  /** Callback for received packets */
+  ef_rss_rx_fn*    rx_fn;
+  /** Argument for the callback */
+  void*            rx_arg;
+};
+
+/*! \brief Statistics for a worker of an ef_rss */
+struct ef_rss_worker_stats {
+  /** Packets passed to the callback */
+  uint64_t rx_pkts;
+  /** Bytes passed to the callback */
+  uint64_t rx_bytes;
+  /** Packets with a discard flag set, or spanning buffers */
+  uint64_t rx_discards;
+  /** Times the event queue was polled */
+  uint64_t polls;
+  /** Times the event queue was polled and found empty */
+  uint64_t idle_polls;
+};
+
+struct ef_rss_pool;
+
+struct ef_rss_worker {
+  ef_vi                      vi;
+  ef_vi_rx_burst             rb;
+  struct ef_rss_pool*        pool;
+  size_t                     pool_ofs;
+  int                        cpu;
+  int                        n_bufs;
+  int*                       free_ids;
+  int                        free_n;
+  pthread_t                  thread;
+  struct ef_rss*             rss;
+  struct ef_rss_worker_stats stats;
+} __attribute__((aligned(EF_VI_DMA_ALIGN)));
+
+/*! \brief A set of receive workers
+**
+** Users should not access this structure.
+*/
+typedef struct ef_rss {
+  ef_driver_handle      dh;
+  struct ef_pd*         pd;
+  ef_vi_set             vi_set;
+  struct ef_rss_params  params;
+  int                   n_pools;
+  struct ef_rss_pool*   pools;
+  struct ef_rss_worker* workers;
+  pthread_mutex_t       lock;
+  pthread_cond_t        cond;
+  int                   n_ready;
+  int                   start_rc;
+  volatile int          stop;
+  int                   running;
+} ef_rss;
+
+
+/*! \brief Allocate a set of receive workers
+**
+** \param rss    The ef_rss to initialize.
+** \param dh     The driver handle for the set and its virtual interfaces.
+** \param pd     The protection domain to allocate the set from.
+** \param params Parameters.  The array of CPUs is copied.
+**
+** \return 0 on success, or a negative error code.
+**
+** The virtual interface set and its virtual interfaces are allocated, but
+** the workers are not started, and no filters are added.
+*/
+extern int ef_rss_alloc(ef_rss* rss, ef_driver_handle dh, struct ef_pd* pd,
+                        const struct ef_rss_params* params);
+
+/*! \brief Start the workers
+**
+** \param rss The ef_rss.
+**
+** \return 0 on success, or a negative error code.
+**
+** Each worker pins itself to its CPU, sets up its packet buffers and fills
+** its receive ring.  This function returns when all the workers are ready
+** to receive, so filters should be added after it returns.
+*/
+extern int ef_rss_start(ef_rss* rss);
+
+/*! \brief Add a filter to the virtual interface set
+**
+** \param rss         The ef_rss.
+** \param filter_spec The filter to add.
+**
+** \return 0 on success, or a negative error code.
+*/
+extern int ef_rss_filter_add(ef_rss* rss, const ef_filter_spec* filter_spec);
+
+/*! \brief Stop the workers
+**
+** \param rss The ef_rss.
+**
+** Returns when all the workers have exited.  Must not be called from the
+** callback.
+*/
+extern void ef_rss_stop(ef_rss* rss);
+
+/*! \brief Free a set of receive workers
+**
+** \param rss The ef_rss.
+**
+** The workers are stopped if running, and the virtual interfaces, the set
+** and the packet buffers are freed.  The protection domain is not freed.
+*/
+extern void ef_rss_free(ef_rss* rss);
+
+/*! \brief Get the virtual interface of a worker
+**
+** \param rss      The ef_rss.
+** \param worker_i The worker.
+**
+** \return The virtual interface.
+*/
+ef_vi_inline ef_vi* ef_rss_worker_vi(ef_rss* rss, int worker_i)
+{
+  return &rss->workers[worker_i].vi;
+}
+
+/*! \brief Get the statistics of a worker
+**
+** \param rss      The ef_rss.
+** \param worker_i The worker.
+**
+** \return The worker's statistics.
+*/
+ef_vi_inline const struct ef_rss_worker_stats*
+ef_rss_worker_stats(const ef_rss* rss, int worker_i)
+{
+  return &rss->workers[worker_i].stats;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* __EFAB_RSS_H__ */
@@ -91,6 +91,7 @@ struct oo_epoll1_shared {
   ci_uint32             flag; /**< seq << 1 | event */
 #define OO_EPOLL1_FLAG_EVENT     1
 #define OO_EPOLL1_FLAG_SEQ_SHIFT 1
+  struct oo_spin_adapt  spin_adapt; /**< EF_SPIN_ADAPTIVE history, for UL */
 };
 
 #define OO_EPOLL_IOC_BASE 99
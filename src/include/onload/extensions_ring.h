@@ -0,0 +1,185 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+/**************************************************************************\
+** <L5_PRIVATE L5_HEADER>
+** Description: Onload submission/completion ring API
+** </L5_PRIVATE>
+\**************************************************************************/
+
+#ifndef __ONLOAD_EXTENSIONS_RING_H__
+#define __ONLOAD_EXTENSIONS_RING_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**********************************************************************
+ * Submission/completion rings
+ *
+ * A ring lets an application drive send, receive and accept operations on
+ * many sockets with one call.  The application writes operations into the
+ * submission queue (SQ) and reaps their results from the completion queue
+ * (CQ).  Both queues are plain memory shared between the application and
+ * the Onload library; no system call is needed to add or reap an entry.
+ *
+ * Operations are processed in batches, either by onload_ring_enter() on
+ * the application's thread or, for rings allocated with
+ * ONLOAD_RING_F_POLLER, by a dedicated poller thread.  A batch enters the
+ * Onload library once, looks up each socket once and then attempts every
+ * outstanding operation without blocking.
+ *
+ * An operation that cannot make progress (a receive with no data, an
+ * accept with no connection, a send into a full send queue) stays
+ * outstanding inside the ring and is retried by later batches.  Its
+ * submission queue entry may be reused as soon as it has been consumed.
+ * Operations of the same kind on the same socket complete in the order
+ * they were submitted; otherwise operations may complete in any order, so
+ * use user_data to match them up.
+ *
+ * Any file descriptor may be used, including ones that Onload does not
+ * accelerate, but only accelerated sockets avoid system calls.  Sockets do
+ * not need to be non-blocking.  A listening socket that is also accepted
+ * on outside the ring should be non-blocking, as otherwise a connection
+ * taken by the other caller may cause the ring to block in accept().
+ *
+ * The application must not use a ring from more than one thread at a time.
+ */
+
+enum onload_ring_opcode {
+  ONLOAD_RING_OP_NOP = 0,
+  /* send(fd, buf, len, msg_flags) */
+  ONLOAD_RING_OP_SEND = 1,
+  /* recv(fd, buf, len, msg_flags) */
+  ONLOAD_RING_OP_RECV = 2,
+  /* accept4(fd, buf, &len, msg_flags); buf may be NULL */
+  ONLOAD_RING_OP_ACCEPT = 3,
+};
+
+struct onload_ring_sqe {
+  /* Copied unchanged into the completion. */
+  uint64_t user_data;
+  /* SEND/RECV: the data buffer.  ACCEPT: buffer for the peer address. */
+  void*    buf;
+  /* Length of [buf] in bytes. */
+  uint32_t len;
+  int32_t  fd;
+  /* SEND/RECV: MSG_* flags; MSG_DONTWAIT is always added.
+   * ACCEPT: SOCK_NONBLOCK and/or SOCK_CLOEXEC for the new socket. */
+  uint32_t msg_flags;
+  uint8_t  opcode;          /* enum onload_ring_opcode */
+  uint8_t  reserved[3];     /* must be zero */
+};
+
+struct onload_ring_cqe {
+  uint64_t user_data;
+  /* SEND/RECV: bytes transferred.  ACCEPT: the new file descriptor.
+   * On failure: -errno. */
+  int32_t  res;
+  /* ACCEPT: length of the peer address.  Otherwise zero. */
+  uint32_t len;
+};
+
+struct onload_ring {
+  /* The application fills sqes[sq_tail & sq_mask] and then advances
+   * sq_tail.  Onload advances sq_head as it consumes entries. */
+  struct onload_ring_sqe* sqes;
+  unsigned                sq_mask;
+  unsigned                sq_head;
+  unsigned                sq_tail;
+
+  /* Onload fills cqes[cq_tail & cq_mask] and then advances cq_tail.
+   * The application advances cq_head as it reaps entries. */
+  struct onload_ring_cqe* cqes;
+  unsigned                cq_mask;
+  unsigned                cq_head;
+  unsigned                cq_tail;
+
+  /* Private to Onload. */
+  void*                   priv;
+};
+
+
+/* Process the ring from a dedicated thread rather than in
+ * onload_ring_enter(). */
+#define ONLOAD_RING_F_POLLER  0x1
+
+
+/* Allocate a ring whose submission queue has [entries] entries, rounded
+ * up to a power of two.  The completion queue is twice that size, and at
+ * most that many operations are outstanding at once.
+ *
+ * Returns 0 on success, or -errno:
+ *  -EINVAL: bad [entries] or [flags];
+ *  -ENOMEM: out of memory;
+ *  -ENOSYS: Onload is not present.
+ */
+extern int onload_ring_alloc(unsigned entries, unsigned flags,
+                             struct onload_ring** ring_out);
+
+/* Free a ring.  Outstanding operations are abandoned. */
+extern int onload_ring_free(struct onload_ring* ring);
+
+/* Process submitted and outstanding operations until at least
+ * [min_complete] completions are waiting to be reaped or [timeout_ms]
+ * milliseconds have elapsed.  A timeout of -1 waits indefinitely and 0
+ * makes a single pass.  While waiting, the thread spins and blocks as
+ * poll() does on the sockets with outstanding operations.  It returns
+ * early once no operation is outstanding.
+ *
+ * For a ring with a poller thread this only waits for completions, blocking
+ * until the poller thread completes an operation.
+ *
+ * Returns the number of completions waiting to be reaped, or -errno:
+ *  -EINTR: interrupted by a signal;
+ *  -ENOSYS: Onload is not present.
+ */
+extern int onload_ring_enter(struct onload_ring* ring, unsigned min_complete,
+                             int timeout_ms);
+
+
+/* Return the next free submission queue entry, zeroed, or NULL if the
+ * submission queue is full. */
+static inline struct onload_ring_sqe*
+onload_ring_get_sqe(struct onload_ring* ring)
+{
+  unsigned head = __atomic_load_n(&ring->sq_head, __ATOMIC_ACQUIRE);
+  struct onload_ring_sqe* sqe;
+  if( ring->sq_tail - head > ring->sq_mask )
+    return NULL;
+  sqe = &ring->sqes[ring->sq_tail & ring->sq_mask];
+  __builtin_memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+/* Pass the entry returned by onload_ring_get_sqe() to Onload. */
+static inline void onload_ring_submit_sqe(struct onload_ring* ring)
+{
+  __atomic_store_n(&ring->sq_tail, ring->sq_tail + 1, __ATOMIC_RELEASE);
+}
+
+/* Return the oldest completion, or NULL if there is none. */
+static inline struct onload_ring_cqe*
+onload_ring_peek_cqe(struct onload_ring* ring)
+{
+  unsigned tail = __atomic_load_n(&ring->cq_tail, __ATOMIC_ACQUIRE);
+  if( ring->cq_head == tail )
+    return NULL;
+  return &ring->cqes[ring->cq_head & ring->cq_mask];
+}
+
+/* Release the completion returned by onload_ring_peek_cqe(). */
+static inline void onload_ring_cqe_seen(struct onload_ring* ring)
+{
+  __atomic_store_n(&ring->cq_head, ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ONLOAD_EXTENSIONS_RING_H__ */
@@ -6,10 +6,25 @@
 /* Shared memory buffers are allocated as distinct chunks of virtual memory
  * areas.  They are mapped to UL in a continuous way, but in-kernel
  * addressess are not continuous.
+ *
+ * With OO_SHMBUF_FLAG_HUGE, each chunk is backed by a single compound page
+ * if possible, so that it can be mapped to UL with a huge (PMD) mapping.
+ * Chunks for which the compound page cannot be allocated fall back to
+ * vmalloc memory.
  */
+#if defined(CONFIG_TRANSPARENT_HUGEPAGE) && \
+    defined(EFRM_HAVE_VMF_INSERT_PFN_PMD) && \
+    (defined(EFRM_HAVE_HUGE_FAULT_PE_SIZE) || \
+     defined(EFRM_HAVE_HUGE_FAULT_ORDER))
+#define OO_SHMBUF_HAVE_HUGE_FAULT 1
+#endif
+
+#define OO_SHMBUF_FLAG_HUGE 1
+
 struct oo_shmbuf {
   int max;
   int order;
+  int flags;
 
   /* Number of chunks allocated */
   int num;
@@ -20,6 +35,10 @@ struct oo_shmbuf {
   void** addrs;
 #define OO_SHMBUF_INIT_CHUNK ((void*)1UL)
 
+  /* Compound page backing each chunk, or NULL if it is vmalloc memory.
+   * Only allocated with OO_SHMBUF_FLAG_HUGE. */
+  struct page** pages;
+
   /* Lock for the num field above */
   struct mutex lock;
 };
@@ -66,12 +85,29 @@ static inline long oo_shmbuf_size(struct oo_shmbuf* sh)
   return sh->max * oo_shmbuf_chunk_size(sh);
 }
 
+static inline int oo_shmbuf_chunk_is_huge(const struct oo_shmbuf* sh, int idx)
+{
+  return sh->pages != NULL && sh->pages[idx] != NULL;
+}
+
+static inline int oo_shmbuf_huge_chunks(const struct oo_shmbuf* sh)
+{
+  int i, n = 0;
+  for( i = 0; i < sh->num; i++ )
+    n += oo_shmbuf_chunk_is_huge(sh, i);
+  return n;
+}
+
 extern int oo_shmbuf_alloc(struct oo_shmbuf* sh, int order,
-                           int max, int init_num);
+                           int max, int init_num, int flags);
 extern void oo_shmbuf_free(struct oo_shmbuf* sh);
 extern int oo_shmbuf_add(struct oo_shmbuf* sh);
 extern int oo_shmbuf_fault(struct oo_shmbuf* sh, struct vm_area_struct* vma,
                            unsigned long off);
+#ifdef OO_SHMBUF_HAVE_HUGE_FAULT
+extern vm_fault_t oo_shmbuf_huge_fault(struct oo_shmbuf* sh,
+                                       struct vm_fault* vmf);
+#endif
 
 
 #endif /* __ONLOAD_OO_SHMBUF_H__ */
@@ -33,6 +33,18 @@ typedef struct {
 } oo_atomic_t;
 
 
+/* History of the waits of blocking calls on a socket or epoll set, for
+ * EF_SPIN_ADAPTIVE.  Times are in cycles, and [wait_avg] is zero until the
+ * first wait completes.
+ */
+struct oo_spin_adapt {
+  ci_uint32 wait_avg;  /* smoothed time from start of wait to event */
+  ci_uint32 wait_dev;  /* smoothed mean deviation of the above */
+  ci_uint32 n_skips;   /* consecutive waits that did not spin */
+  ci_uint32 reserved;
+};
+
+
 #include <onload/pkt_p.h>
 #include <onload/state_p.h>
 #include <onload/sock_p.h>
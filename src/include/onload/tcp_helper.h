@@ -261,6 +261,20 @@ typedef struct tcp_helper_resource_s {
   struct delayed_work      timer;
 #endif
 
+  /*! Private onloadfs file that all user-level mappings of packet sets
+   * of this stack are attached to, so that they can be revoked without
+   * touching any other stack when a set is released; see
+   * tcp_helper_pkt_sets_shrink().  The file holds a stack reference but
+   * this pointer does not: it is cleared when the file is released.
+   * Protected by pkt_file_mutex.
+   */
+  struct file*          pkt_file;
+  struct mutex          pkt_file_mutex;
+  /*! Highest value pkt_sets_n has reached */
+  int                   pkt_sets_hwm;
+  /*! Jiffies since when the last packet set has been releasable, or 0 */
+  unsigned long         pkt_sets_idle_since;
+
   /*! tcp_helper endpoint(s) to be closed at next calling of
    * linux_tcp_helper_fop_close() or if tcp_helper_resource is released
    */
@@ -286,6 +300,10 @@ typedef struct tcp_helper_resource_s {
   /* Don't block on the shared lock when resetting a stack. */
 # define OO_THR_AFLAG_DONT_BLOCK_SHARED   0x10
 
+  /* Allocate a packet set from the work queue, with the shared lock
+   * deferred by OO_THR_AFLAG_UNLOCK_UNTRUSTED, because it may sleep. */
+# define OO_THR_AFLAG_MORE_BUFS           0x20
+
   /*! Spinlock.  Protects:
    *    - ep_tobe_closed / closed_eps
    *    - non_atomic_list
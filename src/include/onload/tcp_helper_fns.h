@@ -231,7 +231,24 @@ extern int efab_tcp_helper_map_usermem(tcp_helper_resource_t* trs,
 extern void efab_tcp_helper_unmap_usermem(tcp_helper_resource_t* trs,
                                           struct oo_iobufs_usermem* ioum);
 
-extern int efab_tcp_helper_more_bufs(tcp_helper_resource_t* trs);
+/* [may_sleep] tells whether the caller is in a context that may sleep.
+ * Reusing the id of a released packet set needs to sleep, so otherwise
+ * that is deferred with CI_EPLOCK_NETIF_NEED_PKT_SET.
+ */
+extern int efab_tcp_helper_more_bufs(tcp_helper_resource_t* trs,
+                                     int may_sleep);
+
+/* Get a reference to the stack's private file that user-level mappings
+ * of packet sets are attached to, so that they can be revoked if a set
+ * is released.  The file is created on first use.
+ */
+extern struct file* tcp_helper_pkt_file_get(tcp_helper_resource_t* trs);
+
+/* Called when a stack file is released, to forget it if it is the
+ * stack's packet set file.
+ */
+extern void tcp_helper_pkt_file_release(tcp_helper_resource_t* trs,
+                                        struct file* filp);
 
 extern int efab_tcp_helper_more_socks(tcp_helper_resource_t* trs);
 
@@ -287,6 +304,24 @@ extern int tcp_helper_cluster_alloc_thr(const char* name,
                                         tcp_helper_resource_t** thr_out);
 
 
+#if ! CI_CFG_UL_INTERRUPT_HELPER
+/* Pool of pre-created stacks for EF_STACK_POOL: see tcp_helper_pool.c */
+struct seq_file;
+extern int oo_stack_pool_adopt(ci_resource_onload_alloc_t* alloc,
+                               const ci_netif_config_opts* opts,
+                               int ifindices_len,
+                               tcp_helper_resource_t** rs_out);
+extern void oo_stack_pool_register(ci_resource_onload_alloc_t* alloc,
+                                   const ci_netif_config_opts* opts,
+                                   int ifindices_len,
+                                   tcp_helper_resource_t* thr,
+                                   unsigned create_us);
+extern void oo_stack_pool_ctor(void);
+extern void oo_stack_pool_dtor(void);
+extern int oo_stack_pool_show(struct seq_file* seq);
+#endif
+
+
 /*--------------------------------------------------------------------
  *!
  * Called by kernel code to get the shared user/kernel mode netif lock
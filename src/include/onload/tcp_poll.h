@@ -167,11 +167,27 @@ ci_udp_poll_events(ci_netif* ni, ci_udp_state* us)
 
 #include <onload/oo_pipe.h>
 
+ci_inline unsigned
+oo_eventfd_poll_events(struct oo_pipe* p)
+{
+  ci_uint64 count = p->efd_count;
+  unsigned events = 0;
+
+  if( count != 0 )
+    events |= POLLIN | POLLRDNORM;
+  if( count < OO_EVENTFD_MAX )
+    events |= POLLOUT | POLLWRNORM;
+
+  return events;
+}
+
 ci_inline unsigned
 oo_pipe_poll_read_events(struct oo_pipe* p)
 {
   unsigned events = 0;
 
+  if( p->aflags & CI_PFD_AFLAG_EVENTFD )
+    return oo_eventfd_poll_events(p);
   if( oo_pipe_data_len(p) )
     events |= POLLIN | POLLRDNORM;
   if( p->aflags & (CI_PFD_AFLAG_CLOSED << CI_PFD_AFLAG_WRITER_SHIFT) )
@@ -193,5 +209,30 @@ oo_pipe_poll_write_events(struct oo_pipe* p)
   return events;
 }
 
+/* Events of an end of an AF_UNIX socketpair, which reads from [rx] and
+ * writes to [tx].  A closed writer of [rx] is a shutdown for receive, and
+ * a closed reader of [tx] a shutdown for send.
+ */
+ci_inline unsigned
+oo_unix_stream_poll_events(struct oo_pipe* rx, struct oo_pipe* tx)
+{
+  int rcv_shut = rx->aflags &
+                 (CI_PFD_AFLAG_CLOSED << CI_PFD_AFLAG_WRITER_SHIFT);
+  int snd_shut = tx->aflags &
+                 (CI_PFD_AFLAG_CLOSED << CI_PFD_AFLAG_READER_SHIFT);
+  unsigned events = 0;
+
+  if( oo_pipe_data_len(rx) || rcv_shut )
+    events |= POLLIN | POLLRDNORM;
+  if( rcv_shut )
+    events |= POLLRDHUP;
+  if( rcv_shut && snd_shut )
+    events |= POLLHUP;
+  if( oo_pipe_is_writable(tx) || snd_shut )
+    events |= POLLOUT | POLLWRNORM | POLLWRBAND;
+
+  return events;
+}
+
 
 #endif  /* __ONLOAD_TCP_POLL_H__ */
@@ -0,0 +1,233 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+
+/*! \cidoxg_lib_ciapp */
+#include <ci/app.h>
+#include <math.h>
+#include <stdint.h>
+
+
+static int ci_hist_index(const ci_hist* h, ci_int64 v)
+{
+  int b = h->sub_bucket_bits;
+  int e;
+
+  if( v < 0 )
+    v = 0;
+  else if( v > h->highest )
+    v = h->highest;
+  if( v < (1ll << b) )
+    return (int) v;
+  e = 63 - __builtin_clzll(v) - (b - 1);
+  return (1 << b) + (e - 1) * (1 << (b - 1)) +
+         (int) ((v >> e) - (1ll << (b - 1)));
+}
+
+
+static ci_int64 ci_hist_index_lowest(const ci_hist* h, int i)
+{
+  int b = h->sub_bucket_bits;
+  int half = 1 << (b - 1);
+  int e;
+
+  if( i < (1 << b) )
+    return i;
+  e = (i - (1 << b)) / half + 1;
+  return (ci_int64) ((i - (1 << b)) % half + half) << e;
+}
+
+
+static ci_int64 ci_hist_index_highest(const ci_hist* h, int i)
+{
+  int b = h->sub_bucket_bits;
+  int e;
+
+  if( i < (1 << b) )
+    return i;
+  e = (i - (1 << b)) / (1 << (b - 1)) + 1;
+  return ci_hist_index_lowest(h, i) + (1ll << e) - 1;
+}
+
+
+int ci_hist_init(ci_hist* h, ci_int64 highest, int precision_bits)
+{
+  ci_assert_ge(precision_bits, 2);
+  ci_assert_le(precision_bits, 20);
+  ci_assert_gt(highest, 0);
+
+  memset(h, 0, sizeof(*h));
+  h->sub_bucket_bits = precision_bits;
+  h->highest = highest;
+  h->counts_len = ci_hist_index(h, highest) + 1;
+  h->counts = calloc(h->counts_len, sizeof(h->counts[0]));
+  if( h->counts == NULL )
+    return -ENOMEM;
+  ci_hist_reset(h);
+  return 0;
+}
+
+
+void ci_hist_fini(ci_hist* h)
+{
+  free(h->counts);
+  h->counts = NULL;
+}
+
+
+void ci_hist_reset(ci_hist* h)
+{
+  memset(h->counts, 0, h->counts_len * sizeof(h->counts[0]));
+  h->total = 0;
+  h->min = INT64_MAX;
+  h->max = 0;
+  h->sum = 0;
+}
+
+
+void ci_hist_record_n(ci_hist* h, ci_int64 value, ci_uint64 n)
+{
+  if( value < 0 )
+    value = 0;
+  h->counts[ci_hist_index(h, value)] += n;
+  h->total += n;
+  h->sum += (double) value * n;
+  if( value < h->min )
+    h->min = value;
+  if( value > h->max )
+    h->max = value;
+}
+
+
+void ci_hist_record(ci_hist* h, ci_int64 value)
+{
+  ci_int64 missed;
+
+  if( h->n_warmups > 0 ) {
+    --h->n_warmups;
+    return;
+  }
+  ci_hist_record_n(h, value, 1);
+  if( h->expected_interval <= 0 )
+    return;
+  for( missed = value - h->expected_interval;
+       missed >= h->expected_interval;
+       missed -= h->expected_interval )
+    ci_hist_record_n(h, missed, 1);
+}
+
+
+void ci_hist_add(ci_hist* dst, const ci_hist* src)
+{
+  int i;
+
+  ci_assert_equal(dst->counts_len, src->counts_len);
+  ci_assert_equal(dst->sub_bucket_bits, src->sub_bucket_bits);
+
+  for( i = 0; i < src->counts_len; ++i )
+    dst->counts[i] += src->counts[i];
+  dst->total += src->total;
+  dst->sum += src->sum;
+  if( src->total ) {
+    dst->min = CI_MIN(dst->min, src->min);
+    dst->max = CI_MAX(dst->max, src->max);
+  }
+}
+
+
+static ci_int64 ci_hist_clamp(const ci_hist* h, ci_int64 v)
+{
+  if( v < h->min )
+    return h->min;
+  if( v > h->max )
+    return h->max;
+  return v;
+}
+
+
+ci_int64 ci_hist_percentile(const ci_hist* h, double percentile)
+{
+  ci_uint64 target, cum = 0;
+  int i;
+
+  if( h->total == 0 )
+    return 0;
+  target = (ci_uint64) ceil(percentile / 100.0 * h->total);
+  if( target < 1 )
+    target = 1;
+  else if( target > h->total )
+    target = h->total;
+  for( i = 0; i < h->counts_len; ++i )
+    if( (cum += h->counts[i]) >= target )
+      break;
+  return ci_hist_clamp(h, ci_hist_index_highest(h, i));
+}
+
+
+void ci_hist_dump_summary(const ci_hist* h, FILE* f,
+                          const char* prefix, double div)
+{
+  fprintf(f, "%sn=%llu mean=%.3lf min=%.3lf p50=%.3lf p90=%.3lf p99=%.3lf "
+          "p99.9=%.3lf p99.99=%.3lf max=%.3lf\n",
+          prefix ? prefix : "", (unsigned long long) h->total,
+          ci_hist_mean(h) / div,
+          (h->total ? h->min : 0) / div,
+          ci_hist_percentile(h, 50) / div,
+          ci_hist_percentile(h, 90) / div,
+          ci_hist_percentile(h, 99) / div,
+          ci_hist_percentile(h, 99.9) / div,
+          ci_hist_percentile(h, 99.99) / div,
+          h->max / div);
+}
+
+
+/* Percentile levels are generated as in HdrHistogram: each halving of the
+ * distance to 100% is covered by this many reporting steps.
+ */
+#define CI_HIST_TICKS_PER_HALF_DISTANCE  5
+
+
+int ci_hist_write_hgrm(const ci_hist* h, FILE* f, double div)
+{
+  double mean = ci_hist_mean(h);
+  double var = 0, pct = 0;
+  ci_uint64 cum = 0;
+  int i = -1;
+
+  fprintf(f, "%12s %14s %10s %14s\n\n",
+          "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+
+  while( h->total && cum < h->total && pct < 100.0 ) {
+    ci_uint64 target = (ci_uint64) ceil(pct / 100.0 * h->total);
+    double half_distance;
+    if( target < 1 )
+      target = 1;
+    while( cum < target )
+      cum += h->counts[++i];
+    fprintf(f, "%12.3f %2.12f %10llu %14.2f\n",
+            ci_hist_clamp(h, ci_hist_index_highest(h, i)) / div,
+            pct / 100.0, (unsigned long long) cum, 100.0 / (100.0 - pct));
+    half_distance = pow(2, floor(log2(100.0 / (100.0 - pct))) + 1);
+    pct += 100.0 / (half_distance * CI_HIST_TICKS_PER_HALF_DISTANCE);
+  }
+  fprintf(f, "%12.3f %2.12f %10llu\n", h->max / div, 1.0,
+          (unsigned long long) h->total);
+
+  for( i = 0; i < h->counts_len; ++i )
+    if( h->counts[i] ) {
+      double mid = (ci_hist_index_lowest(h, i) +
+                    ci_hist_index_highest(h, i)) / 2.0;
+      var += h->counts[i] * (mid - mean) * (mid - mean);
+    }
+  if( h->total )
+    var /= h->total;
+
+  fprintf(f, "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n",
+          mean / div, sqrt(var) / div);
+  fprintf(f, "#[Max     = %12.3f, Total count    = %12llu]\n",
+          h->max / div, (unsigned long long) h->total);
+  fprintf(f, "#[Buckets = %12d, SubBuckets     = %12d]\n",
+          h->counts_len, 1 << h->sub_bucket_bits);
+  return ferror(f) ? -EIO : 0;
+}
+
+/*! \cidoxg_end */
@@ -14,6 +14,7 @@ LIB_SRCS	:= \
 		iarray_median.c \
 		iarray_mode.c \
 		iarray_variance.c \
+		histogram.c \
 		qsort_compare_int.c \
 		testpattern.c \
 		select.c \
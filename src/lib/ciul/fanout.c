@@ -0,0 +1,569 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+
+/*! \cidoxg_lib_ef */
+#include "ef_vi_internal.h"
+#include <etherfabric/fanout.h>
+#include <stdlib.h>
+
+
+#define EF_FANOUT_MAGIC    0xefa40001u
+
+#define CACHE_LINE         64
+
+/* States of a consumer slot.  The consumer moves its slot from FREE to
+ * CLAIMED to ATTACH, from ACTIVE to DETACH, and from EVICTED to FREE.  The
+ * producer moves it from ATTACH to ACTIVE, from DETACH to FREE, and from
+ * ACTIVE to EVICTED.
+ */
+enum {
+  SLOT_FREE = 0,
+  SLOT_CLAIMED,
+  SLOT_ATTACH,
+  SLOT_ACTIVE,
+  SLOT_DETACH,
+  SLOT_EVICTED,
+};
+
+struct ef_fanout_ent {
+  uint32_t          buf_id;
+  uint16_t          ofs;
+  uint16_t          len;
+  uint32_t          tag;
+  /* Bitmask of the consumers the packet was delivered to. */
+  uint32_t          consumers;
+};
+
+/* For each buffer there is a bitmask in the shared region of the consumers
+ * that still hold it.  The buffer goes back to the producer's free pool
+ * when this reaches zero.  Keeping the holders rather than a count lets the
+ * producer drop the share of a consumer that it evicts.
+ */
+
+struct ef_fanout_slot {
+  /* Next ring entry for the consumer to read.  Normally moved by the
+   * consumer, but the producer moves it under EF_FANOUT_POLICY_DROP_SLOW,
+   * so both change it with compare-and-swap.  Whoever moves it past an
+   * entry owns the reference that the entry holds on its buffer.
+   */
+  volatile uint64_t tail;
+  volatile uint32_t state;
+  uint32_t          filter;
+  volatile uint64_t n_pkts;
+  volatile uint64_t n_dropped;
+} __attribute__((aligned(CACHE_LINE)));
+
+struct ef_fanout_shm {
+  volatile uint32_t magic;
+  uint32_t          n_bufs;
+  uint32_t          buf_size;
+  uint32_t          ring_size;
+  uint32_t          policy;
+  /* Set by consumers when a slot needs attention from the producer. */
+  volatile uint32_t ctl_pending;
+  uint64_t          ring_ofs;
+  uint64_t          refs_ofs;
+  uint64_t          bufs_ofs;
+
+  /* Number of entries ever published. */
+  volatile uint64_t head __attribute__((aligned(CACHE_LINE)));
+
+  struct ef_fanout_slot slots[EF_FANOUT_MAX_CONSUMERS];
+};
+
+
+#define ROUND_UP_TO(x, align)  (((x) + (align) - 1) & ~((size_t) (align) - 1))
+
+
+static void fanout_layout(const struct ef_fanout_params* params,
+                          uint64_t* ring_ofs, uint64_t* refs_ofs,
+                          uint64_t* bufs_ofs, size_t* bufs_len)
+{
+  size_t ofs = ROUND_UP_TO(sizeof(struct ef_fanout_shm), CACHE_LINE);
+  *ring_ofs = ofs;
+  ofs += (size_t) params->ring_size * sizeof(struct ef_fanout_ent);
+  ofs = ROUND_UP_TO(ofs, CACHE_LINE);
+  *refs_ofs = ofs;
+  ofs += (size_t) params->n_bufs * sizeof(uint32_t);
+  *bufs_ofs = ROUND_UP_TO(ofs, EF_VI_NIC_PAGE_SIZE);
+  *bufs_len = ROUND_UP_TO((size_t) params->n_bufs * params->buf_size,
+                          EF_VI_NIC_PAGE_SIZE);
+}
+
+
+static void fanout_map(ef_fanout* fo, void* mem)
+{
+  struct ef_fanout_shm* shm = mem;
+  fo->shm = shm;
+  fo->bufs = (char*) mem + shm->bufs_ofs;
+  fo->n_bufs = shm->n_bufs;
+  fo->buf_size = shm->buf_size;
+  fo->ring_mask = shm->ring_size - 1;
+}
+
+
+ef_vi_inline struct ef_fanout_ent* fanout_ent(ef_fanout* fo, uint64_t seq)
+{
+  struct ef_fanout_ent* ring = (void*) ((char*) fo->shm + fo->shm->ring_ofs);
+  return &ring[seq & fo->ring_mask];
+}
+
+
+ef_vi_inline uint32_t* fanout_refs(ef_fanout* fo)
+{
+  return (void*) ((char*) fo->shm + fo->shm->refs_ofs);
+}
+
+
+ef_vi_inline void fanout_put_ref(ef_fanout* fo, unsigned buf_id, int slot_i)
+{
+  __atomic_and_fetch(&fanout_refs(fo)[buf_id], ~(1u << slot_i),
+                     __ATOMIC_RELEASE);
+}
+
+
+size_t ef_fanout_mem_size(const struct ef_fanout_params* params)
+{
+  uint64_t ring_ofs, refs_ofs, bufs_ofs;
+  size_t bufs_len;
+  fanout_layout(params, &ring_ofs, &refs_ofs, &bufs_ofs, &bufs_len);
+  return bufs_ofs + bufs_len;
+}
+
+
+int ef_fanout_producer_init(ef_fanout* fo, void* mem, size_t len,
+                            const struct ef_fanout_params* params)
+{
+  struct ef_fanout_shm* shm = mem;
+  size_t bufs_len;
+  unsigned i;
+
+  if( params->n_bufs == 0 || params->ring_size == 0 ||
+      (params->ring_size & (params->ring_size - 1)) ||
+      params->buf_size < EF_VI_DMA_ALIGN ||
+      params->buf_size % EF_VI_DMA_ALIGN ||
+      EF_VI_NIC_PAGE_SIZE % params->buf_size ||
+      params->policy > EF_FANOUT_POLICY_DROP_SLOW ||
+      ((uintptr_t) mem & (EF_VI_NIC_PAGE_SIZE - 1)) ||
+      len < ef_fanout_mem_size(params) )
+    return -EINVAL;
+
+  memset(fo, 0, sizeof(*fo));
+  fo->free_ids = malloc(params->n_bufs * sizeof(fo->free_ids[0]));
+  fo->held = malloc(params->n_bufs * sizeof(fo->held[0]));
+  if( fo->free_ids == NULL || fo->held == NULL ) {
+    free(fo->free_ids);
+    free(fo->held);
+    return -ENOMEM;
+  }
+
+  memset(shm, 0, sizeof(*shm));
+  shm->n_bufs = params->n_bufs;
+  shm->buf_size = params->buf_size;
+  shm->ring_size = params->ring_size;
+  shm->policy = params->policy;
+  fanout_layout(params, &shm->ring_ofs, &shm->refs_ofs, &shm->bufs_ofs,
+                &bufs_len);
+  fanout_map(fo, mem);
+  fo->consumer_i = -1;
+  memset(fanout_refs(fo), 0, params->n_bufs * sizeof(uint32_t));
+
+  for( i = 0; i < params->n_bufs; ++i )
+    fo->free_ids[i] = params->n_bufs - 1 - i;
+  fo->free_n = params->n_bufs;
+
+  __atomic_store_n(&shm->magic, EF_FANOUT_MAGIC, __ATOMIC_RELEASE);
+  return 0;
+}
+
+
+void ef_fanout_producer_fini(ef_fanout* fo)
+{
+  EF_VI_ASSERT(fo->consumer_i < 0);
+  fo->shm->magic = 0;
+  free(fo->free_ids);
+  free(fo->held);
+  fo->free_ids = fo->held = NULL;
+}
+
+
+void* ef_fanout_bufs(ef_fanout* fo, size_t* len_out)
+{
+  *len_out = ROUND_UP_TO((size_t) fo->n_bufs * fo->buf_size,
+                         EF_VI_NIC_PAGE_SIZE);
+  return fo->bufs;
+}
+
+
+/* Move buffers that all their consumers have released back to the free
+ * pool, keeping the rest in [held] in publish order.  A buffer held for a
+ * long time by one consumer does not hold back the buffers published
+ * after it.
+ */
+static void fanout_reclaim(ef_fanout* fo)
+{
+  uint32_t* refs = fanout_refs(fo);
+  unsigned i, n = 0;
+
+  for( i = 0; i < fo->held_n; ++i ) {
+    uint32_t id = fo->held[i];
+    if( __atomic_load_n(&refs[id], __ATOMIC_ACQUIRE) == 0 )
+      fo->free_ids[fo->free_n++] = id;
+    else
+      fo->held[n++] = id;
+  }
+  fo->held_n = n;
+}
+
+
+int ef_fanout_buf_alloc(ef_fanout* fo)
+{
+  EF_VI_ASSERT(fo->consumer_i < 0);
+  if( fo->free_n == 0 ) {
+    fanout_reclaim(fo);
+    if( fo->free_n == 0 )
+      return -ENOBUFS;
+  }
+  return fo->free_ids[--fo->free_n];
+}
+
+
+void ef_fanout_buf_free(ef_fanout* fo, unsigned id)
+{
+  EF_VI_ASSERT(fo->consumer_i < 0);
+  EF_VI_ASSERT(id < fo->n_bufs);
+  EF_VI_ASSERT(fo->free_n < fo->n_bufs);
+  fo->free_ids[fo->free_n++] = id;
+}
+
+
+/* Drop the references held by consumer [slot_i] on the entries in
+ * [from, to).  The caller has already moved the consumer's tail past them.
+ */
+static unsigned fanout_put_refs(ef_fanout* fo, int slot_i,
+                                uint64_t from, uint64_t to)
+{
+  unsigned n = 0;
+  for( ; from != to; ++from ) {
+    struct ef_fanout_ent* ent = fanout_ent(fo, from);
+    if( ent->consumers & (1u << slot_i) ) {
+      fanout_put_ref(fo, ent->buf_id, slot_i);
+      ++n;
+    }
+  }
+  return n;
+}
+
+
+/* A consumer in [fo->active] stays there until we see it ask to detach,
+ * so it is delivered to, and holds back the ring, until then.  A consumer
+ * that has asked to detach no longer moves its tail, so its unread
+ * packets are released here.
+ */
+void ef_fanout_producer_poll(ef_fanout* fo)
+{
+  struct ef_fanout_shm* shm = fo->shm;
+  int i;
+
+  EF_VI_ASSERT(fo->consumer_i < 0);
+  if( ! __atomic_exchange_n(&shm->ctl_pending, 0, __ATOMIC_ACQUIRE) )
+    return;
+
+  for( i = 0; i < EF_FANOUT_MAX_CONSUMERS; ++i ) {
+    struct ef_fanout_slot* slot = &shm->slots[i];
+    uint32_t state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+    switch( state ) {
+    case SLOT_ATTACH:
+      /* Tails only move forward, so [min_tail] stays a lower bound. */
+      slot->tail = shm->head;
+      slot->n_pkts = 0;
+      slot->n_dropped = 0;
+      /* The consumer may give up before we get here. */
+      if( __atomic_compare_exchange_n(&slot->state, &state, SLOT_ACTIVE, 0,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_RELAXED) ) {
+        fo->filters[i] = slot->filter;
+        fo->active |= 1u << i;
+      }
+      break;
+    case SLOT_DETACH:
+      fanout_put_refs(fo, i, slot->tail, shm->head);
+      slot->tail = shm->head;
+      fo->active &= ~(1u << i);
+      __atomic_store_n(&slot->state, SLOT_FREE, __ATOMIC_RELEASE);
+      break;
+    }
+  }
+}
+
+
+/* Find the slowest consumer, and the lowest tail. */
+static int fanout_find_slowest(ef_fanout* fo, uint64_t* tail_out)
+{
+  struct ef_fanout_shm* shm = fo->shm;
+  uint64_t min_tail = shm->head;
+  uint32_t active = fo->active;
+  int slowest = -1;
+
+  while( active ) {
+    int i = __builtin_ctz(active);
+    uint64_t tail = shm->slots[i].tail;
+    active &= active - 1;
+    if( slowest < 0 || tail < min_tail ) {
+      min_tail = tail;
+      slowest = i;
+    }
+  }
+  *tail_out = min_tail;
+  return slowest;
+}
+
+
+/* Move every consumer that is more than [limit] behind forward so that it
+ * is [limit] behind, releasing the packets it skips.
+ */
+static void fanout_drop_slow(ef_fanout* fo, uint64_t limit)
+{
+  struct ef_fanout_shm* shm = fo->shm;
+  uint64_t head = shm->head;
+  uint32_t active = fo->active;
+
+  while( active ) {
+    int i = __builtin_ctz(active);
+    struct ef_fanout_slot* slot = &shm->slots[i];
+    uint64_t tail, new_tail = head - limit;
+    active &= active - 1;
+    do {
+      tail = slot->tail;
+      if( head - tail <= limit )
+        break;
+    } while( ! __atomic_compare_exchange_n(&slot->tail, &tail, new_tail,
+                                           0, __ATOMIC_ACQ_REL,
+                                           __ATOMIC_RELAXED) );
+    if( head - tail > limit )
+      slot->n_dropped += fanout_put_refs(fo, i, tail, new_tail);
+  }
+}
+
+
+int ef_fanout_publish(ef_fanout* fo, unsigned id, unsigned ofs,
+                      unsigned len, uint32_t tag)
+{
+  struct ef_fanout_shm* shm = fo->shm;
+  uint64_t head = shm->head;
+  struct ef_fanout_ent* ent;
+  uint32_t active, consumers = 0;
+  int n = 0;
+
+  EF_VI_ASSERT(fo->consumer_i < 0);
+  EF_VI_ASSERT(id < fo->n_bufs);
+  EF_VI_ASSERT(ofs + len <= fo->buf_size);
+
+  if( shm->ctl_pending )
+    ef_fanout_producer_poll(fo);
+
+  if( head - fo->min_tail > fo->ring_mask ) {
+    fanout_find_slowest(fo, &fo->min_tail);
+    if( head - fo->min_tail > fo->ring_mask ) {
+      if( shm->policy == EF_FANOUT_POLICY_BLOCK ) {
+        ef_fanout_buf_free(fo, id);
+        return -EAGAIN;
+      }
+      /* Make room for a quarter of the ring at once, so that we don't
+       * have to do this for every packet while a consumer is behind.
+       */
+      fanout_drop_slow(fo, (fo->ring_mask + 1) - (fo->ring_mask + 1) / 4);
+      fanout_find_slowest(fo, &fo->min_tail);
+      EF_VI_ASSERT(head - fo->min_tail <= fo->ring_mask);
+    }
+  }
+
+  for( active = fo->active; active; active &= active - 1 ) {
+    int i = __builtin_ctz(active);
+    if( fo->filters[i] & tag ) {
+      consumers |= 1u << i;
+      ++n;
+    }
+  }
+
+  if( n == 0 ) {
+    ef_fanout_buf_free(fo, id);
+    return 0;
+  }
+
+  ent = fanout_ent(fo, head);
+  ent->buf_id = id;
+  ent->ofs = ofs;
+  ent->len = len;
+  ent->tag = tag;
+  ent->consumers = consumers;
+  fanout_refs(fo)[id] = consumers;
+  fo->held[fo->held_n++] = id;
+  __atomic_store_n(&shm->head, head + 1, __ATOMIC_RELEASE);
+  return n;
+}
+
+
+int ef_fanout_slowest(ef_fanout* fo, unsigned* lag_out)
+{
+  uint64_t tail;
+  int slowest;
+
+  EF_VI_ASSERT(fo->consumer_i < 0);
+  slowest = fanout_find_slowest(fo, &tail);
+  *lag_out = fo->shm->head - tail;
+  return slowest;
+}
+
+
+/* The consumer may be dead, or may be stuck somewhere and carry on later,
+ * so we must not change anything that it could still look at except its
+ * tail and state.  Its bit is never set again while the slot is EVICTED,
+ * so a late ef_fanout_consumer_release() is harmless.
+ */
+int ef_fanout_consumer_evict(ef_fanout* fo, int consumer_i)
+{
+  struct ef_fanout_shm* shm = fo->shm;
+  struct ef_fanout_slot* slot;
+  uint32_t state = SLOT_ACTIVE;
+  unsigned i;
+
+  EF_VI_ASSERT(fo->consumer_i < 0);
+  if( consumer_i < 0 || consumer_i >= EF_FANOUT_MAX_CONSUMERS ||
+      ! (fo->active & (1u << consumer_i)) )
+    return -ENOENT;
+  slot = &shm->slots[consumer_i];
+  /* If it has asked to detach, ef_fanout_producer_poll() cleans up. */
+  if( ! __atomic_compare_exchange_n(&slot->state, &state, SLOT_EVICTED, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_RELAXED) )
+    return -ENOENT;
+  fo->active &= ~(1u << consumer_i);
+  __atomic_store_n(&slot->tail, shm->head, __ATOMIC_RELEASE);
+
+  /* Drop its share of every buffer, whether it has got the packet yet or
+   * not. */
+  for( i = 0; i < fo->held_n; ++i )
+    fanout_put_ref(fo, fo->held[i], consumer_i);
+  return 0;
+}
+
+
+int ef_fanout_consumer_stats(ef_fanout* fo, int consumer_i,
+                             struct ef_fanout_consumer_stats* stats_out)
+{
+  struct ef_fanout_slot* slot;
+
+  if( consumer_i < 0 || consumer_i >= EF_FANOUT_MAX_CONSUMERS )
+    return -ENOENT;
+  slot = &fo->shm->slots[consumer_i];
+  if( slot->state != SLOT_ACTIVE )
+    return -ENOENT;
+  stats_out->n_pkts = slot->n_pkts;
+  stats_out->n_dropped = slot->n_dropped;
+  stats_out->lag = fo->shm->head - slot->tail;
+  return 0;
+}
+
+
+int ef_fanout_consumer_attach(ef_fanout* fo, void* mem, size_t len,
+                              uint32_t filter)
+{
+  struct ef_fanout_shm* shm = mem;
+  int i;
+
+  if( len < sizeof(*shm) ||
+      __atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != EF_FANOUT_MAGIC ||
+      len < shm->bufs_ofs + (size_t) shm->n_bufs * shm->buf_size )
+    return -ENOENT;
+
+  for( i = 0; i < EF_FANOUT_MAX_CONSUMERS; ++i ) {
+    uint32_t state = SLOT_FREE;
+    if( __atomic_compare_exchange_n(&shm->slots[i].state, &state,
+                                    SLOT_CLAIMED, 0, __ATOMIC_ACQ_REL,
+                                    __ATOMIC_RELAXED) )
+      break;
+  }
+  if( i == EF_FANOUT_MAX_CONSUMERS )
+    return -EBUSY;
+
+  memset(fo, 0, sizeof(*fo));
+  fanout_map(fo, mem);
+  fo->consumer_i = i;
+  shm->slots[i].filter = filter;
+  __atomic_store_n(&shm->slots[i].state, SLOT_ATTACH, __ATOMIC_RELEASE);
+  __atomic_store_n(&shm->ctl_pending, 1, __ATOMIC_RELEASE);
+  return i;
+}
+
+
+void ef_fanout_consumer_detach(ef_fanout* fo)
+{
+  struct ef_fanout_slot* slot = &fo->shm->slots[fo->consumer_i];
+  uint32_t state, next;
+
+  EF_VI_ASSERT(fo->consumer_i >= 0);
+  state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+  do {
+    EF_VI_ASSERT(state == SLOT_ATTACH || state == SLOT_ACTIVE ||
+                 state == SLOT_EVICTED);
+    /* If the producer hasn't seen our request to attach yet, or has
+     * evicted us, we have no references to release.
+     */
+    next = state == SLOT_ACTIVE ? SLOT_DETACH : SLOT_FREE;
+  } while( ! __atomic_compare_exchange_n(&slot->state, &state, next, 0,
+                                         __ATOMIC_ACQ_REL,
+                                         __ATOMIC_ACQUIRE) );
+  if( next == SLOT_DETACH )
+    __atomic_store_n(&fo->shm->ctl_pending, 1, __ATOMIC_RELEASE);
+  fo->consumer_i = -1;
+}
+
+
+int ef_fanout_consumer_get(ef_fanout* fo, struct ef_fanout_pkt* pkts,
+                           int max_pkts)
+{
+  struct ef_fanout_slot* slot = &fo->shm->slots[fo->consumer_i];
+  uint32_t bit = 1u << fo->consumer_i;
+  uint64_t head, tail, seq;
+  uint32_t state;
+  int n;
+
+  EF_VI_ASSERT(fo->consumer_i >= 0);
+  state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+  if( state != SLOT_ACTIVE )
+    return state == SLOT_EVICTED ? -ENOTCONN : 0;
+
+  do {
+    head = __atomic_load_n(&fo->shm->head, __ATOMIC_ACQUIRE);
+    tail = slot->tail;
+    n = 0;
+    for( seq = tail; seq != head && n < max_pkts; ++seq ) {
+      const struct ef_fanout_ent* ent = fanout_ent(fo, seq);
+      if( ent->consumers & bit ) {
+        pkts[n].buf_id = ent->buf_id;
+        pkts[n].ofs = ent->ofs;
+        pkts[n].len = ent->len;
+        pkts[n].tag = ent->tag;
+        ++n;
+      }
+    }
+    if( seq == tail )
+      return 0;
+    /* If the producer moved our tail while we were reading, the entries
+     * may have been overwritten, and their references are no longer ours.
+     */
+  } while( ! __atomic_compare_exchange_n(&slot->tail, &tail, seq, 0,
+                                         __ATOMIC_ACQ_REL,
+                                         __ATOMIC_RELAXED) );
+
+  slot->n_pkts += n;
+  return n;
+}
+
+
+void ef_fanout_consumer_release(ef_fanout* fo, unsigned buf_id)
+{
+  EF_VI_ASSERT(buf_id < fo->n_bufs);
+  fanout_put_ref(fo, buf_id, fo->consumer_i);
+}
+
+/*! \cidoxg_end */
@@ -0,0 +1,286 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+
+/*! \cidoxg_lib_ef */
+#include "ef_vi_internal.h"
+#include <etherfabric/forward.h>
+#include <etherfabric/efct_vi.h>
+#include <stdlib.h>
+
+
+#define FWD_REFILL_BATCH  16
+
+
+int ef_fwd_init(ef_fwd* fwd, void* bufs, unsigned buf_size,
+                unsigned n_bufs, unsigned headroom)
+{
+  unsigned i;
+
+  headroom = EF_VI_ALIGN_FWD(headroom, EF_VI_DMA_ALIGN);
+  if( n_bufs == 0 || buf_size == 0 || EF_VI_NIC_PAGE_SIZE % buf_size ||
+      headroom + EF_VI_DMA_ALIGN > buf_size )
+    return -EINVAL;
+
+  memset(fwd, 0, sizeof(*fwd));
+  fwd->free_ids = malloc(n_bufs * sizeof(fwd->free_ids[0]));
+  if( fwd->free_ids == NULL )
+    return -ENOMEM;
+  fwd->bufs = bufs;
+  fwd->buf_size = buf_size;
+  fwd->n_bufs = n_bufs;
+  fwd->headroom = headroom;
+  fwd->refill_batch = FWD_REFILL_BATCH;
+
+  /* Hand out low-numbered buffers first, to keep the working set small. */
+  for( i = 0; i < n_bufs; ++i )
+    fwd->free_ids[i] = n_bufs - 1 - i;
+  fwd->free_n = n_bufs;
+  return 0;
+}
+
+
+void ef_fwd_fini(ef_fwd* fwd)
+{
+  free(fwd->free_ids);
+  fwd->free_ids = NULL;
+}
+
+
+int ef_fwd_port_add(ef_fwd* fwd, ef_vi* vi, ef_memreg* mr, int tx_port)
+{
+  struct ef_fwd_port* port;
+
+  if( fwd->n_ports == EF_FWD_MAX_PORTS )
+    return -ENOSPC;
+  if( tx_port < -1 || tx_port >= EF_FWD_MAX_PORTS )
+    return -EINVAL;
+
+  port = &fwd->ports[fwd->n_ports];
+  memset(port, 0, sizeof(*port));
+  port->vi = vi;
+  port->mr = mr;
+  port->default_tx_port = tx_port;
+  ef_vi_rx_burst_init(&port->rb, fwd->bufs, fwd->buf_size, fwd->headroom, 0);
+  return fwd->n_ports++;
+}
+
+
+void ef_fwd_set_hook(ef_fwd* fwd, ef_fwd_hook* hook, void* arg)
+{
+  fwd->hook = hook;
+  fwd->hook_arg = arg;
+}
+
+
+ef_vi_inline void fwd_buf_free(ef_fwd* fwd, unsigned id)
+{
+  EF_VI_ASSERT(id < fwd->n_bufs);
+  EF_VI_ASSERT(fwd->free_n < fwd->n_bufs);
+  fwd->free_ids[fwd->free_n++] = id;
+}
+
+
+ef_vi_inline char* fwd_buf(ef_fwd* fwd, unsigned id)
+{
+  return fwd->bufs + (size_t) id * fwd->buf_size;
+}
+
+
+/* Whatever its default TX port, the hook may forward packets received on
+ * any port, so every port with a receive ring is kept filled.  A port that
+ * only sends has no receive space, and so gets no buffers.
+ */
+ef_vi_inline int fwd_port_needs_refill(const struct ef_fwd_port* port)
+{
+  return port->vi->nic_type.arch != EF_VI_ARCH_EFCT &&
+         ef_vi_receive_capacity(port->vi) != 0;
+}
+
+
+/* Post buffers to the receive ring in batches, with one doorbell. */
+static void fwd_refill(ef_fwd* fwd, struct ef_fwd_port* port)
+{
+  ef_vi* vi = port->vi;
+  int posted = 0, i;
+
+  while( ef_vi_receive_space(vi) >= fwd->refill_batch ) {
+    if( fwd->free_n < fwd->refill_batch ) {
+      ++port->stats.rx_refill_starved;
+      break;
+    }
+    for( i = 0; i < fwd->refill_batch; ++i ) {
+      unsigned id = fwd->free_ids[--fwd->free_n];
+      ef_vi_receive_init(vi, ef_memreg_dma_addr(port->mr,
+                                                (size_t) id * fwd->buf_size +
+                                                fwd->headroom), id);
+    }
+    posted = 1;
+  }
+  if( posted )
+    ef_vi_receive_push(vi);
+}
+
+
+void ef_fwd_fill(ef_fwd* fwd)
+{
+  int i;
+  for( i = 0; i < fwd->n_ports; ++i )
+    if( fwd_port_needs_refill(&fwd->ports[i]) )
+      fwd_refill(fwd, &fwd->ports[i]);
+}
+
+
+/* Queue a packet for sending.  The buffer is now owned by the TX ring, or
+ * has been freed.
+ */
+static void fwd_tx(ef_fwd* fwd, struct ef_fwd_port* rx_port, unsigned id,
+                   const ef_vi_rx_pkt* rx, char* data, unsigned len)
+{
+  struct ef_fwd_port* tx_port;
+  int tx_port_i = rx_port->default_tx_port;
+  char* buf = fwd_buf(fwd, id);
+  int rc;
+
+  if( fwd->hook != NULL ) {
+    struct ef_fwd_pkt pkt;
+    pkt.data = data;
+    pkt.len = len;
+    pkt.rx_port = rx_port - fwd->ports;
+    pkt.tx_port = tx_port_i;
+    pkt.rx = rx;
+    if( fwd->hook(fwd->hook_arg, &pkt) != 0 ||
+        pkt.data < buf || pkt.data + pkt.len > buf + fwd->buf_size )
+      tx_port_i = -1;
+    else
+      tx_port_i = pkt.tx_port;
+    data = pkt.data;
+    len = pkt.len;
+  }
+  if(unlikely( tx_port_i < 0 || tx_port_i >= fwd->n_ports )) {
+    ++rx_port->stats.hook_drops;
+    fwd_buf_free(fwd, id);
+    return;
+  }
+  tx_port = &fwd->ports[tx_port_i];
+
+  rc = ef_vi_transmit_init(tx_port->vi,
+                           ef_memreg_dma_addr(tx_port->mr, data - fwd->bufs),
+                           len, id);
+  if(likely( rc == 0 )) {
+    ++tx_port->tx_pending;
+  }
+  else {
+    /* The TX ring is full.  Dropping is better than holding up receive. */
+    ++tx_port->stats.tx_full;
+    fwd_buf_free(fwd, id);
+  }
+}
+
+
+/* The packet is in a buffer owned by the NIC, so copy it into one of ours
+ * so that it can be sent.
+ */
+static void fwd_rx_ref(ef_fwd* fwd, struct ef_fwd_port* port,
+                       const ef_vi_rx_pkt* rx)
+{
+  unsigned len = rx->len;
+  char* data;
+  unsigned id;
+
+  if( fwd->free_n == 0 || fwd->headroom + len > fwd->buf_size ) {
+    ++port->stats.rx_discards;
+    efct_vi_rxpkt_release(port->vi, rx->id);
+    return;
+  }
+  id = fwd->free_ids[--fwd->free_n];
+  data = fwd_buf(fwd, id) + fwd->headroom;
+  memcpy(data, rx->data, len);
+  efct_vi_rxpkt_release(port->vi, rx->id);
+  fwd_tx(fwd, port, id, rx, data, len);
+}
+
+
+static void fwd_handle_evs(ef_fwd* fwd, struct ef_fwd_port* port,
+                           const ef_event* evs, int n_evs)
+{
+  ef_request_id ids[EF_VI_TRANSMIT_BATCH];
+  int i, j, n;
+
+  for( i = 0; i < n_evs; ++i )
+    switch( EF_EVENT_TYPE(evs[i]) ) {
+    case EF_EVENT_TYPE_TX:
+      n = ef_vi_transmit_unbundle(port->vi, &evs[i], ids);
+      for( j = 0; j < n; ++j )
+        fwd_buf_free(fwd, ids[j]);
+      port->stats.tx_pkts += n;
+      break;
+    case EF_EVENT_TYPE_TX_ERROR:
+      n = ef_vi_transmit_unbundle(port->vi, &evs[i], ids);
+      for( j = 0; j < n; ++j )
+        fwd_buf_free(fwd, ids[j]);
+      port->stats.tx_errors += n;
+      break;
+    default:
+      break;
+    }
+}
+
+
+int ef_fwd_poll(ef_fwd* fwd)
+{
+  ef_vi_rx_pkt pkts[EF_FWD_BATCH];
+  ef_event evs[EF_FWD_BATCH];
+  int port_i, total = 0;
+
+  for( port_i = 0; port_i < fwd->n_ports; ++port_i ) {
+    struct ef_fwd_port* port = &fwd->ports[port_i];
+    int n_evs = EF_FWD_BATCH;
+    int n_pkts, i;
+
+    n_pkts = ef_vi_receive_burst(port->vi, &port->rb, pkts, EF_FWD_BATCH,
+                                 evs, &n_evs);
+    fwd_handle_evs(fwd, port, evs, n_evs);
+    if( n_pkts == 0 )
+      continue;
+    total += n_pkts;
+    port->stats.rx_pkts += n_pkts;
+
+    for( i = 0; i < n_pkts; ++i ) {
+      const ef_vi_rx_pkt* rx = &pkts[i];
+      if( rx->flags & EF_VI_RX_PKT_F_REF ) {
+        if( rx->flags & EF_VI_RX_PKT_F_DISCARD ) {
+          ++port->stats.rx_discards;
+          efct_vi_rxpkt_release(port->vi, rx->id);
+        }
+        else {
+          fwd_rx_ref(fwd, port, rx);
+        }
+      }
+      else if(unlikely( (rx->flags & (EF_VI_RX_PKT_F_DISCARD |
+                                      EF_VI_RX_PKT_F_SOP |
+                                      EF_VI_RX_PKT_F_CONT)) !=
+                        EF_VI_RX_PKT_F_SOP )) {
+        ++port->stats.rx_discards;
+        fwd_buf_free(fwd, rx->id);
+      }
+      else {
+        fwd_tx(fwd, port, rx->id, rx, (char*) rx->data, rx->len);
+      }
+    }
+
+    /* One doorbell per TX ring for the whole batch. */
+    for( i = 0; i < fwd->n_ports; ++i )
+      if( fwd->ports[i].tx_pending ) {
+        ef_vi_transmit_push(fwd->ports[i].vi);
+        fwd->ports[i].tx_pending = 0;
+      }
+  }
+
+  for( port_i = 0; port_i < fwd->n_ports; ++port_i )
+    if( fwd_port_needs_refill(&fwd->ports[port_i]) )
+      fwd_refill(fwd, &fwd->ports[port_i]);
+
+  return total;
+}
+
+/*! \cidoxg_end */
@@ -47,10 +47,14 @@ LIB_SRCS	+=		\
 		vi_discard.c	\
 		capabilities.c	\
 		smartnic_exts.c	\
-		ctpio.c
+		ctpio.c		\
+		rx_burst.c	\
+		fanout.c	\
+		forward.c	\
+		rss.c
 
 # librt is needed on old glibc, e.g. on RHEL 6
-MMAKE_DIR_LINKFLAGS	:= $(MMAKE_DIR_LINKFLAGS) -lrt
+MMAKE_DIR_LINKFLAGS	:= $(MMAKE_DIR_LINKFLAGS) -lrt -lpthread
 endif
 
 ifdef MMAKE_USE_KBUILD
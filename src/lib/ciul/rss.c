@@ -0,0 +1,378 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+
+/*! \cidoxg_lib_ef */
+#define _GNU_SOURCE
+#include "ef_vi_internal.h"
+#include <etherfabric/rss.h>
+#include <etherfabric/pd.h>
+#include <etherfabric/efct_vi.h>
+#include "logging.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <sched.h>
+#include <dirent.h>
+#include <sys/mman.h>
+
+
+#define RSS_PKT_BUF_SIZE   2048
+#define RSS_REFILL_BATCH   16
+#define RSS_HUGE_PAGE      (2ul * 1024 * 1024)
+
+
+/* Packet buffers shared by the workers on a NUMA node. */
+struct ef_rss_pool {
+  int       node;
+  int       n_workers;
+  char*     mem;
+  size_t    len;
+  int       hugetlb;
+  int       ready;
+  int       rc;
+  ef_memreg mr;
+};
+
+
+/* The NUMA node of a CPU, from sysfs, or 0 if it can't be found. */
+static int rss_cpu_node(int cpu)
+{
+  char path[64];
+  struct dirent* ent;
+  DIR* dir;
+  int node = 0;
+
+  if( cpu < 0 )
+    return 0;
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+  if( (dir = opendir(path)) == NULL )
+    return 0;
+  while( (ent = readdir(dir)) != NULL )
+    if( sscanf(ent->d_name, "node%d", &node) == 1 )
+      break;
+  closedir(dir);
+  return node;
+}
+
+
+int ef_rss_alloc(ef_rss* rss, ef_driver_handle dh, struct ef_pd* pd,
+                 const struct ef_rss_params* params)
+{
+  int n = params->n_workers;
+  int i, j, rc;
+
+  if( n < 1 || params->rx_fn == NULL )
+    return -EINVAL;
+
+  memset(rss, 0, sizeof(*rss));
+  rss->dh = dh;
+  rss->pd = pd;
+  rss->params = *params;
+  rss->params.cpus = NULL;
+  rc = -ENOMEM;
+  rss->workers = calloc(n, sizeof(rss->workers[0]));
+  rss->pools = calloc(n, sizeof(rss->pools[0]));
+  if( rss->workers == NULL || rss->pools == NULL )
+    goto fail1;
+  pthread_mutex_init(&rss->lock, NULL);
+  pthread_cond_init(&rss->cond, NULL);
+
+  /* Group the workers by the node of their CPU. */
+  for( i = 0; i < n; ++i ) {
+    struct ef_rss_worker* w = &rss->workers[i];
+    int node;
+    w->rss = rss;
+    w->cpu = params->cpus ? params->cpus[i] : -1;
+    node = rss_cpu_node(w->cpu);
+    for( j = 0; j < rss->n_pools; ++j )
+      if( rss->pools[j].node == node )
+        break;
+    if( j == rss->n_pools )
+      rss->pools[rss->n_pools++].node = node;
+    w->pool = &rss->pools[j];
+    ++w->pool->n_workers;
+  }
+
+  rc = ef_vi_set_alloc_from_pd(&rss->vi_set, dh, pd, dh, n);
+  if( rc < 0 )
+    goto fail1;
+  for( i = 0; i < n; ++i ) {
+    rc = ef_vi_alloc_from_set(&rss->workers[i].vi, dh, &rss->vi_set, dh, i,
+                              -1, params->rxq_capacity, 0, NULL, -1,
+                              params->vi_flags);
+    if( rc < 0 )
+      goto fail2;
+  }
+  return 0;
+
+ fail2:
+  while( --i >= 0 )
+    ef_vi_free(&rss->workers[i].vi, dh);
+  ef_vi_set_free(&rss->vi_set, dh);
+ fail1:
+  free(rss->workers);
+  free(rss->pools);
+  return rc;
+}
+
+
+/* Allocate the buffers of all the workers on a node.  The first of them to
+ * start does this, so that the memory is local to the node.
+ */
+static int rss_pool_init(ef_rss* rss, struct ef_rss_pool* pool)
+{
+  struct ef_rss_worker* w;
+  size_t len = 0;
+  int i;
+
+  for( i = 0; i < rss->params.n_workers; ++i ) {
+    w = &rss->workers[i];
+    if( w->pool != pool )
+      continue;
+    w->pool_ofs = len;
+    len += (size_t) w->n_bufs * RSS_PKT_BUF_SIZE;
+  }
+  pool->len = EF_VI_ALIGN_FWD(len, RSS_HUGE_PAGE);
+  pool->mem = mmap(NULL, pool->len, PROT_READ | PROT_WRITE,
+                   MAP_ANONYMOUS | MAP_PRIVATE | MAP_HUGETLB, -1, 0);
+  if( pool->mem != MAP_FAILED ) {
+    pool->hugetlb = 1;
+  }
+  else if( posix_memalign((void**) &pool->mem, RSS_HUGE_PAGE,
+                          pool->len) != 0 ) {
+    pool->mem = NULL;
+    return -ENOMEM;
+  }
+  /* Fault the memory in from this CPU. */
+  memset(pool->mem, 0, pool->len);
+  return ef_memreg_alloc(&pool->mr, rss->dh, rss->pd, rss->dh,
+                         pool->mem, pool->len);
+}
+
+
+static void rss_refill(struct ef_rss_worker* w)
+{
+  int i, id;
+
+  if( ef_vi_receive_space(&w->vi) < RSS_REFILL_BATCH ||
+      w->free_n < RSS_REFILL_BATCH )
+    return;
+  do {
+    for( i = 0; i < RSS_REFILL_BATCH; ++i ) {
+      id = w->free_ids[--w->free_n];
+      ef_vi_receive_init(&w->vi,
+                         ef_memreg_dma_addr(&w->pool->mr, w->pool_ofs +
+                                            (size_t) id * RSS_PKT_BUF_SIZE),
+                         id);
+    }
+  } while( ef_vi_receive_space(&w->vi) >= RSS_REFILL_BATCH &&
+           w->free_n >= RSS_REFILL_BATCH );
+  ef_vi_receive_push(&w->vi);
+}
+
+
+static int rss_worker_init(struct ef_rss_worker* w)
+{
+  ef_rss* rss = w->rss;
+  struct ef_rss_pool* pool = w->pool;
+  int i, rc;
+
+  if( w->cpu >= 0 ) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(w->cpu, &cpus);
+    if( sched_setaffinity(0, sizeof(cpus), &cpus) < 0 )
+      return -errno;
+  }
+
+  w->free_ids = malloc(w->n_bufs * sizeof(w->free_ids[0]));
+  if( w->free_ids == NULL )
+    return -ENOMEM;
+  for( i = 0; i < w->n_bufs; ++i )
+    w->free_ids[i] = w->n_bufs - 1 - i;
+  w->free_n = w->n_bufs;
+
+  pthread_mutex_lock(&rss->lock);
+  if( ! pool->ready ) {
+    pool->rc = rss_pool_init(rss, pool);
+    pool->ready = 1;
+  }
+  rc = pool->rc;
+  pthread_mutex_unlock(&rss->lock);
+  if( rc < 0 )
+    return rc;
+
+  ef_vi_rx_burst_init(&w->rb, pool->mem + w->pool_ofs, RSS_PKT_BUF_SIZE, 0,
+                      rss->params.rx_burst_flags);
+  if( w->vi.nic_type.arch != EF_VI_ARCH_EFCT )
+    rss_refill(w);
+  return 0;
+}
+
+
+ef_vi_inline void rss_pkt_release(struct ef_rss_worker* w,
+                                  const ef_vi_rx_pkt* pkt)
+{
+  if( pkt->flags & EF_VI_RX_PKT_F_REF )
+    efct_vi_rxpkt_release(&w->vi, pkt->id);
+  else
+    w->free_ids[w->free_n++] = pkt->id;
+}
+
+
+static void rss_worker_poll(struct ef_rss_worker* w)
+{
+  ef_rss* rss = w->rss;
+  ef_vi_rx_pkt pkts[EF_RSS_BATCH];
+  ef_event evs[EF_RSS_BATCH];
+  int n_evs = EF_RSS_BATCH;
+  int worker_i = w - rss->workers;
+  int i, n, n_good;
+
+  n = ef_vi_receive_burst(&w->vi, &w->rb, pkts, EF_RSS_BATCH, evs, &n_evs);
+  ++w->stats.polls;
+  for( i = 0; i < n_evs; ++i )
+    if( EF_EVENT_TYPE(evs[i]) == EF_EVENT_TYPE_RESET )
+      LOGVV(ef_log("%s: worker %d: NIC reset", __FUNCTION__, worker_i));
+  if( n == 0 ) {
+    ++w->stats.idle_polls;
+    return;
+  }
+
+  /* Pass the good packets on, keeping them in order. */
+  for( i = 0, n_good = 0; i < n; ++i ) {
+    if(unlikely( (pkts[i].flags & (EF_VI_RX_PKT_F_DISCARD |
+                                   EF_VI_RX_PKT_F_SOP |
+                                   EF_VI_RX_PKT_F_CONT)) !=
+                 EF_VI_RX_PKT_F_SOP )) {
+      ++w->stats.rx_discards;
+      rss_pkt_release(w, &pkts[i]);
+      continue;
+    }
+    w->stats.rx_bytes += pkts[i].len;
+    if( n_good != i )
+      pkts[n_good] = pkts[i];
+    ++n_good;
+  }
+  if( n_good ) {
+    w->stats.rx_pkts += n_good;
+    rss->params.rx_fn(rss->params.rx_arg, worker_i, pkts, n_good);
+    for( i = 0; i < n_good; ++i )
+      rss_pkt_release(w, &pkts[i]);
+  }
+  rss_refill(w);
+}
+
+
+static void* rss_worker_fn(void* arg)
+{
+  struct ef_rss_worker* w = arg;
+  ef_rss* rss = w->rss;
+  int rc;
+
+  rc = rss_worker_init(w);
+
+  pthread_mutex_lock(&rss->lock);
+  if( rc < 0 && rss->start_rc == 0 )
+    rss->start_rc = rc;
+  ++rss->n_ready;
+  pthread_cond_broadcast(&rss->cond);
+  /* Don't receive until all the workers are ready, so that a failed start
+   * can be unwound.
+   */
+  while( rss->n_ready < rss->params.n_workers )
+    pthread_cond_wait(&rss->cond, &rss->lock);
+  rc = rss->start_rc;
+  pthread_mutex_unlock(&rss->lock);
+
+  if( rc == 0 )
+    while( ! rss->stop )
+      rss_worker_poll(w);
+  return NULL;
+}
+
+
+int ef_rss_start(ef_rss* rss)
+{
+  int n = rss->params.n_workers;
+  int i, rc = 0;
+
+  if( rss->running )
+    return -EALREADY;
+  for( i = 0; i < n; ++i ) {
+    struct ef_rss_worker* w = &rss->workers[i];
+    w->n_bufs = EF_VI_ALIGN_FWD(ef_vi_receive_capacity(&w->vi) +
+                                RSS_REFILL_BATCH, RSS_REFILL_BATCH);
+  }
+
+  rss->stop = 0;
+  rss->n_ready = 0;
+  rss->start_rc = 0;
+  for( i = 0; i < n; ++i ) {
+    rc = -pthread_create(&rss->workers[i].thread, NULL, rss_worker_fn,
+                         &rss->workers[i]);
+    if( rc < 0 )
+      break;
+  }
+
+  pthread_mutex_lock(&rss->lock);
+  if( i < n ) {
+    /* Let the workers that did start see the failure. */
+    rss->start_rc = rc;
+    rss->n_ready += n - i;
+    pthread_cond_broadcast(&rss->cond);
+  }
+  while( rss->n_ready < n )
+    pthread_cond_wait(&rss->cond, &rss->lock);
+  rc = rss->start_rc;
+  pthread_mutex_unlock(&rss->lock);
+
+  rss->running = i;
+  if( rc < 0 )
+    ef_rss_stop(rss);
+  return rc;
+}
+
+
+int ef_rss_filter_add(ef_rss* rss, const ef_filter_spec* filter_spec)
+{
+  return ef_vi_set_filter_add(&rss->vi_set, rss->dh, filter_spec, NULL);
+}
+
+
+void ef_rss_stop(ef_rss* rss)
+{
+  int i;
+
+  rss->stop = 1;
+  for( i = 0; i < rss->running; ++i )
+    pthread_join(rss->workers[i].thread, NULL);
+  rss->running = 0;
+}
+
+
+void ef_rss_free(ef_rss* rss)
+{
+  int i;
+
+  ef_rss_stop(rss);
+  for( i = 0; i < rss->params.n_workers; ++i ) {
+    ef_vi_free(&rss->workers[i].vi, rss->dh);
+    free(rss->workers[i].free_ids);
+  }
+  ef_vi_set_free(&rss->vi_set, rss->dh);
+  for( i = 0; i < rss->n_pools; ++i ) {
+    struct ef_rss_pool* pool = &rss->pools[i];
+    if( pool->mem == NULL )
+      continue;
+    if( pool->rc == 0 )
+      ef_memreg_free(&pool->mr, rss->dh);
+    if( pool->hugetlb )
+      munmap(pool->mem, pool->len);
+    else
+      free(pool->mem);
+  }
+  free(rss->workers);
+  free(rss->pools);
+}
+
+/*! \cidoxg_end */
@@ -0,0 +1,259 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+
+/*! \cidoxg_lib_ef */
+#include "ef_vi_internal.h"
+#include <etherfabric/efct_vi.h>
+
+
+void ef_vi_rx_burst_init(ef_vi_rx_burst* rb, void* buf_base,
+                         size_t buf_stride, unsigned dma_ofs, unsigned flags)
+{
+  memset(rb, 0, sizeof(*rb));
+  rb->buf_base = buf_base;
+  rb->buf_stride = buf_stride;
+  rb->dma_ofs = dma_ofs;
+  rb->flags = flags;
+  rb->ids_n = -1;
+}
+
+
+ef_vi_inline char* rx_burst_dma_ptr(const ef_vi_rx_burst* rb, uint32_t id)
+{
+  return rb->buf_base + id * rb->buf_stride + rb->dma_ofs;
+}
+
+
+ef_vi_inline void rx_burst_next_ev(ef_vi_rx_burst* rb)
+{
+  ++rb->evs_i;
+  rb->ev_pkts = 0;
+  rb->ids_n = -1;
+}
+
+
+static unsigned ef10_discard_flags(unsigned subtype)
+{
+  switch( subtype ) {
+  case EF_EVENT_RX_DISCARD_CSUM_BAD:
+    return EF_VI_DISCARD_RX_L4_CSUM_ERR;
+  case EF_EVENT_RX_DISCARD_INNER_CSUM_BAD:
+    return EF_VI_DISCARD_RX_INNER_L4_CSUM_ERR;
+  case EF_EVENT_RX_DISCARD_CRC_BAD:
+    return EF_VI_DISCARD_RX_ETH_FCS_ERR;
+  case EF_EVENT_RX_DISCARD_TRUNC:
+    return EF_VI_DISCARD_RX_ETH_LEN_ERR;
+  default:
+    return 0;
+  }
+}
+
+
+/* Fill in metadata which comes from the prefix of the first buffer of a
+ * packet.  [dma] is the start of the buffer, including the prefix. */
+ef_vi_inline void rx_burst_prefix_meta(ef_vi* vi, const ef_vi_rx_burst* rb,
+                                       ef_vi_rx_pkt* p, const void* dma)
+{
+  if( rb->flags & EF_VI_RX_BURST_TIMESTAMPS ) {
+    unsigned ts_flags;
+    if( ef_vi_receive_get_timestamp_with_sync_flags(vi, dma, &p->ts,
+                                                    &ts_flags) == 0 ) {
+      p->ts_flags = ts_flags;
+      p->flags |= EF_VI_RX_PKT_F_TS;
+    }
+  }
+  if( (rb->flags & EF_VI_RX_BURST_USER_MARK) &&
+      vi->nic_type.arch == EF_VI_ARCH_EF100 ) {
+    uint8_t user_flag;
+    ef_vi_receive_get_user_data(vi, dma, &p->user_mark, &user_flag);
+    p->flags |= EF_VI_RX_PKT_F_MARK;
+  }
+}
+
+
+/* Single buffer from an RX or RX_DISCARD event. */
+static void rx_burst_rx(ef_vi* vi, const ef_vi_rx_burst* rb,
+                        const ef_event* ev, ef_vi_rx_pkt* p)
+{
+  uint32_t id = ev->rx.rq_id;
+
+  p->id = id;
+  p->flags = 0;
+  p->discard = 0;
+  if( ev->rx.flags & EF_EVENT_FLAG_SOP )
+    p->flags |= EF_VI_RX_PKT_F_SOP;
+  if( ev->rx.flags & EF_EVENT_FLAG_CONT )
+    p->flags |= EF_VI_RX_PKT_F_CONT;
+  if( EF_EVENT_TYPE(*ev) == EF_EVENT_TYPE_RX_DISCARD ) {
+    p->flags |= EF_VI_RX_PKT_F_DISCARD;
+    p->discard = ef10_discard_flags(ev->rx_discard.subtype);
+  }
+
+  if( vi->nic_type.arch == EF_VI_ARCH_AF_XDP ) {
+    /* The buffer number and the offset of the data within the buffer
+     * come from the descriptor, not from ef_vi_receive_init(). */
+    p->data = rb->buf_base + id * rb->buf_stride + ev->rx.ofs;
+    p->len = ev->rx.len;
+  }
+  else if( p->flags & EF_VI_RX_PKT_F_SOP ) {
+    const char* dma = rx_burst_dma_ptr(rb, id);
+    p->data = dma + vi->rx_prefix_len;
+    p->len = ev->rx.len - vi->rx_prefix_len;
+    if( vi->rx_prefix_len )
+      rx_burst_prefix_meta(vi, rb, p, dma);
+  }
+  else {
+    p->data = rx_burst_dma_ptr(rb, id);
+    p->len = ev->rx.len - vi->rx_prefix_len;
+  }
+  __builtin_prefetch(p->data);
+}
+
+
+/* Buffers whose ids are already in p[].id, and whose length and status
+ * are in the prefix.  The ids have been collected first so that all the
+ * prefixes can be prefetched before any of them is read.
+ */
+static void rx_burst_prefixed(ef_vi* vi, const ef_vi_rx_burst* rb,
+                              ef_vi_rx_pkt* p, int n, unsigned discard)
+{
+  int i;
+
+  for( i = 0; i < n; ++i )
+    __builtin_prefetch(rx_burst_dma_ptr(rb, p[i].id));
+
+  for( i = 0; i < n; ++i ) {
+    const char* dma = rx_burst_dma_ptr(rb, p[i].id);
+    uint16_t len;
+    unsigned discard_flags = discard;
+
+    ef_vi_receive_get_bytes(vi, dma, &len);
+    if( vi->nic_type.arch == EF_VI_ARCH_EF100 )
+      ef_vi_receive_get_discard_flags(vi, dma, &discard_flags);
+    p[i].data = dma + vi->rx_prefix_len;
+    p[i].len = len;
+    p[i].flags = EF_VI_RX_PKT_F_SOP;
+    p[i].discard = discard_flags;
+    if( discard_flags )
+      p[i].flags |= EF_VI_RX_PKT_F_DISCARD;
+    rx_burst_prefix_meta(vi, rb, &p[i], dma);
+  }
+}
+
+
+/* Packet from an RX_REF or RX_REF_DISCARD event. */
+static void rx_burst_ref(ef_vi* vi, const ef_vi_rx_burst* rb,
+                         const ef_event* ev, ef_vi_rx_pkt* p)
+{
+  p->id = ev->rx_ref.pkt_id;
+  p->data = efct_vi_rxpkt_get(vi, p->id);
+  __builtin_prefetch(p->data);
+  p->len = ev->rx_ref.len;
+  p->flags = EF_VI_RX_PKT_F_SOP | EF_VI_RX_PKT_F_REF;
+  p->discard = 0;
+  if( EF_EVENT_TYPE(*ev) == EF_EVENT_TYPE_RX_REF_DISCARD ) {
+    p->flags |= EF_VI_RX_PKT_F_DISCARD;
+    p->discard = ev->rx_ref_discard.flags;
+  }
+  if( rb->flags & EF_VI_RX_BURST_TIMESTAMPS ) {
+    unsigned ts_flags;
+    if( efct_vi_rxpkt_get_timestamp(vi, p->id, &p->ts, &ts_flags) == 0 ) {
+      p->ts_flags = ts_flags;
+      p->flags |= EF_VI_RX_PKT_F_TS;
+    }
+  }
+  if( rb->flags & EF_VI_RX_BURST_USER_MARK ) {
+    p->user_mark = ev->rx_ref.user;
+    p->flags |= EF_VI_RX_PKT_F_MARK;
+  }
+}
+
+
+int ef_vi_receive_burst(ef_vi* vi, ef_vi_rx_burst* rb,
+                        ef_vi_rx_pkt* pkts, int max_pkts,
+                        ef_event* evs, int* evs_len)
+{
+  int max_evs = *evs_len;
+  int n_pkts = 0, n_evs = 0;
+
+  EF_VI_ASSERT(max_evs >= EF_VI_EVENT_POLL_MIN_EVS);
+
+  while( n_pkts < max_pkts ) {
+    const ef_event* ev;
+    int n, i;
+
+    if( rb->evs_i == rb->evs_n ) {
+      /* Any of the events may be one that we have to hand back, so don't
+       * poll more than there is room for.  ef_eventq_poll() needs room for
+       * at least EF_VI_EVENT_POLL_MIN_EVS. */
+      n = max_evs - n_evs;
+      if( n > EF_VI_RX_BURST_EVS )
+        n = EF_VI_RX_BURST_EVS;
+      if( n < EF_VI_EVENT_POLL_MIN_EVS )
+        break;
+      rb->evs_i = 0;
+      rb->evs_n = ef_eventq_poll(vi, rb->evs, n);
+      if( rb->evs_n == 0 )
+        break;
+    }
+
+    ev = &rb->evs[rb->evs_i];
+    switch( EF_EVENT_TYPE(*ev) ) {
+    case EF_EVENT_TYPE_RX:
+    case EF_EVENT_TYPE_RX_DISCARD:
+      rx_burst_rx(vi, rb, ev, &pkts[n_pkts++]);
+      rx_burst_next_ev(rb);
+      break;
+
+    case EF_EVENT_TYPE_RX_MULTI:
+    case EF_EVENT_TYPE_RX_MULTI_DISCARD:
+      if( rb->ids_n < 0 )
+        rb->ids_n = ef_vi_receive_unbundle(vi, ev, rb->ids);
+      n = rb->ids_n - rb->ev_pkts;
+      if( n > max_pkts - n_pkts )
+        n = max_pkts - n_pkts;
+      for( i = 0; i < n; ++i )
+        pkts[n_pkts + i].id = rb->ids[rb->ev_pkts + i];
+      rx_burst_prefixed(vi, rb, &pkts[n_pkts], n,
+                        EF_EVENT_TYPE(*ev) == EF_EVENT_TYPE_RX_MULTI_DISCARD ?
+                        ef10_discard_flags(ev->rx_multi_discard.subtype) : 0);
+      n_pkts += n;
+      rb->ev_pkts += n;
+      if( rb->ev_pkts == rb->ids_n )
+        rx_burst_next_ev(rb);
+      break;
+
+    case EF_EVENT_TYPE_RX_MULTI_PKTS:
+      n = ev->rx_multi_pkts.n_pkts - rb->ev_pkts;
+      if( n > max_pkts - n_pkts )
+        n = max_pkts - n_pkts;
+      for( i = 0; i < n; ++i )
+        pkts[n_pkts + i].id = ef_vi_rxq_next_desc_id(vi);
+      rx_burst_prefixed(vi, rb, &pkts[n_pkts], n, 0);
+      n_pkts += n;
+      rb->ev_pkts += n;
+      if( rb->ev_pkts == ev->rx_multi_pkts.n_pkts )
+        rx_burst_next_ev(rb);
+      break;
+
+    case EF_EVENT_TYPE_RX_REF:
+    case EF_EVENT_TYPE_RX_REF_DISCARD:
+      rx_burst_ref(vi, rb, ev, &pkts[n_pkts++]);
+      rx_burst_next_ev(rb);
+      break;
+
+    default:
+      if( n_evs == max_evs )
+        goto out;
+      evs[n_evs++] = *ev;
+      rx_burst_next_ev(rb);
+      break;
+    }
+  }
+
+ out:
+  *evs_len = n_evs;
+  return n_pkts;
+}
+
+/*! \cidoxg_end */
@@ -959,7 +959,7 @@ efab_tcp_helper_more_bufs_rsop(ci_private_t* priv, void *unused)
 {
   if (priv->thr == NULL)
     return -EINVAL;
-  return efab_tcp_helper_more_bufs(priv->thr);
+  return efab_tcp_helper_more_bufs(priv->thr, 1);
 }
 static int
 efab_tcp_helper_more_socks_rsop(ci_private_t* priv, void *unused)
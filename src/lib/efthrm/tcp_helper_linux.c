@@ -187,20 +187,42 @@ static ssize_t linux_tcp_helper_fop_write_iov_pipe(struct file *filp,
   return ci_pipe_write(&trs->netif, SP_TO_PIPE(&trs->netif, priv->sock_id),
                        iov, iovlen);
 }
+/* Only the reader file of an AF_UNIX socketpair can be written: the data
+ * goes to the other direction of the pair. */
+static ssize_t
+linux_tcp_helper_fop_write_iov_pipe_reader(struct file *filp,
+                                           const struct iovec *iov,
+                                           unsigned long iovlen)
+{
+  ci_private_t* priv = filp->private_data;
+  tcp_helper_resource_t* trs = efab_priv_to_thr(priv);
+  struct oo_pipe* p = SP_TO_PIPE(&trs->netif, priv->sock_id);
+
+  if( ! (p->aflags & CI_PFD_AFLAG_UNIX_STREAM) )
+    return -EOPNOTSUPP;
+  return ci_pipe_write(&trs->netif, SP_TO_PIPE(&trs->netif, p->unix_peer),
+                       iov, iovlen);
+}
 #ifdef EFRM_HAVE_FOP_READ_ITER
 DEFINE_FOP_RW_ITER(linux_tcp_helper_fop_read_iov_pipe, \
                    linux_tcp_helper_fop_read_iter_pipe)
 DEFINE_FOP_RW_ITER(linux_tcp_helper_fop_write_iov_pipe, \
                    linux_tcp_helper_fop_write_iter_pipe)
+DEFINE_FOP_RW_ITER(linux_tcp_helper_fop_write_iov_pipe_reader, \
+                   linux_tcp_helper_fop_write_iter_pipe_reader)
 #else
 DEFINE_FOP_READ(linux_tcp_helper_fop_read_iov_pipe, \
                 linux_tcp_helper_fop_read_pipe)
 DEFINE_FOP_WRITE(linux_tcp_helper_fop_write_iov_pipe, \
                  linux_tcp_helper_fop_write_pipe)
+DEFINE_FOP_WRITE(linux_tcp_helper_fop_write_iov_pipe_reader, \
+                 linux_tcp_helper_fop_write_pipe_reader)
 DEFINE_FOP_AIO_RW(linux_tcp_helper_fop_read_iov_pipe, \
                   linux_tcp_helper_fop_aio_read_pipe)
 DEFINE_FOP_AIO_RW(linux_tcp_helper_fop_write_iov_pipe, \
                   linux_tcp_helper_fop_aio_write_pipe)
+DEFINE_FOP_AIO_RW(linux_tcp_helper_fop_write_iov_pipe_reader, \
+                  linux_tcp_helper_fop_aio_write_pipe_reader)
 #endif
 
 
@@ -216,12 +238,6 @@ static ssize_t linux_tcp_helper_fop_read_notsupp(struct file *filp, char *buf,
 {
   return -EOPNOTSUPP;
 }
-static ssize_t linux_tcp_helper_fop_write_notsupp(struct file *filp,
-                                                  const char *buf,
-                                                  size_t len, loff_t *off)
-{
-  return -EOPNOTSUPP;
-}
 static ssize_t linux_tcp_helper_fop_aio_rw_notsupp(struct kiocb *iocb, 
                                              const struct iovec *iov, 
                                              unsigned long iovlen, loff_t pos)
@@ -241,7 +257,17 @@ static unsigned linux_tcp_helper_fop_poll_pipe_reader(struct file* filp,
   struct oo_pipe* pipe = SP_TO_PIPE(&trs->netif, priv->sock_id);
 
   poll_wait(filp, &TCP_HELPER_WAITQ(trs, priv->sock_id)->wq, wait);
-  ci_atomic32_or(&pipe->b.wake_request, CI_SB_FLAG_WAKE_RX);
+  /* An eventfd and an end of a socketpair are both read and written
+   * through the reader file.  Space in the other direction of a socketpair
+   * is signalled by a TX wake of this pipe. */
+  ci_atomic32_or(&pipe->b.wake_request,
+                 (pipe->aflags &
+                  (CI_PFD_AFLAG_EVENTFD | CI_PFD_AFLAG_UNIX_STREAM)) ?
+                 CI_SB_FLAG_WAKE_RX | CI_SB_FLAG_WAKE_TX : CI_SB_FLAG_WAKE_RX);
+  if( pipe->aflags & CI_PFD_AFLAG_UNIX_STREAM )
+    return oo_unix_stream_poll_events(pipe,
+                                      SP_TO_PIPE(&trs->netif,
+                                                 pipe->unix_peer));
   return oo_pipe_poll_read_events(pipe);
 }
 
@@ -378,36 +404,87 @@ static int linux_tcp_helper_fop_close(struct inode* inode, struct file* filp)
   return rc;
 }
 
+/* Marks one end of a pipe as closed.  Returns true if the other end was
+ * already closed, and so the endpoint should be freed. */
+static int oo_pipe_close_end(tcp_helper_resource_t* trs,
+                             tcp_helper_endpoint_t* ep, int shift)
+{
+  unsigned ep_aflags;
+
+  /* Set flag to indicate that we've closed one end of the pipe. */
+  ep_aflags = tcp_helper_endpoint_set_aflags(ep, OO_THR_EP_AFLAG_PEER_CLOSED);
+
+  if( ! (ep_aflags & OO_THR_EP_AFLAG_PEER_CLOSED) ) {
+    /* Other end is still open -- signal it. */
+    struct oo_pipe* p = SP_TO_PIPE(&trs->netif, ep->id);
+    ci_atomic32_or(&p->aflags, CI_PFD_AFLAG_CLOSED << shift);
+    oo_pipe_wake_peer(&trs->netif, p, CI_SB_FLAG_WAKE_RX | CI_SB_FLAG_WAKE_TX);
+    return 0;
+  }
+  return 1;
+}
+
+/* The other direction of the AF_UNIX socketpair that [p] is part of, or
+ * NULL if the link in the shared state does not look right. */
+static tcp_helper_endpoint_t*
+oo_pipe_unix_peer_ep(tcp_helper_resource_t* trs, tcp_helper_endpoint_t* ep,
+                     struct oo_pipe* p)
+{
+  citp_waitable_obj* wo;
+
+  if( ! IS_VALID_SOCK_P(&trs->netif, p->unix_peer) )
+    return NULL;
+  wo = SP_TO_WAITABLE_OBJ(&trs->netif, p->unix_peer);
+  if( wo->waitable.state != CI_TCP_STATE_PIPE ||
+      ! (wo->pipe.aflags & CI_PFD_AFLAG_UNIX_STREAM) ||
+      ! OO_SP_EQ(wo->pipe.unix_peer, ep->id) )
+    return NULL;
+  return ci_trs_ep_get(trs, p->unix_peer);
+}
+
 static int linux_tcp_helper_fop_close_pipe(struct inode* inode,
                                            struct file* filp)
 {
   ci_private_t* priv = filp->private_data;
   tcp_helper_resource_t* trs = efab_priv_to_thr(priv);
   tcp_helper_endpoint_t* ep = ci_trs_ep_get(trs, priv->sock_id);
-  unsigned ep_aflags;
+  struct oo_pipe* p = SP_TO_PIPE(&trs->netif, ep->id);
   int rc;
 
   OO_DEBUG_TCPH(ci_log("%s:", __FUNCTION__));
   ci_assert_equal(SP_TO_WAITABLE(&trs->netif, ep->id)->state,
                   CI_TCP_STATE_PIPE);
 
-  /* Set flag to indicate that we've closed one end of the pipe. */
-  ep_aflags = tcp_helper_endpoint_set_aflags(ep, OO_THR_EP_AFLAG_PEER_CLOSED);
-
-  if( ! (ep_aflags & OO_THR_EP_AFLAG_PEER_CLOSED) ) {
-    /* Other end is still open -- signal it. */
-    struct oo_pipe* p = SP_TO_PIPE(&trs->netif, ep->id);
-    ci_atomic32_or(&p->aflags,
-                   CI_PFD_AFLAG_CLOSED <<
-                   ((priv->fd_flags & OO_FDFLAG_EP_PIPE_READ) ?
-                    CI_PFD_AFLAG_READER_SHIFT : CI_PFD_AFLAG_WRITER_SHIFT));
-    oo_pipe_wake_peer(&trs->netif, p, CI_SB_FLAG_WAKE_RX | CI_SB_FLAG_WAKE_TX);
+  if( p->aflags & CI_PFD_AFLAG_UNIX_STREAM ) {
+    /* Each end of a socketpair is the reader file of one pipe, and stands
+     * for the writer of the other.  The writer files are closed when the
+     * pair is created, and are not counted. */
+    tcp_helper_endpoint_t* peer_ep;
+
+    if( ! (priv->fd_flags & OO_FDFLAG_EP_PIPE_READ) )
+      goto release;
+    /* Close our writer end first: until our reader end is closed below,
+     * the peer pipe can still be woken through this one. */
+    peer_ep = oo_pipe_unix_peer_ep(trs, ep, p);
+    if( peer_ep == NULL ) {
+      LOG_E(ci_log("%s: [%d:%d] bad socketpair peer %d", __FUNCTION__,
+                   trs->id, OO_SP_FMT(ep->id), OO_SP_FMT(p->unix_peer)));
+    }
+    else if( oo_pipe_close_end(trs, peer_ep, CI_PFD_AFLAG_WRITER_SHIFT) ) {
+      peer_ep->file_ptr = NULL;
+      efab_tcp_helper_close_endpoint(trs, peer_ep->id, 0);
+    }
   }
-  else {
+
+  if( oo_pipe_close_end(trs, ep,
+                        (priv->fd_flags & OO_FDFLAG_EP_PIPE_READ) ?
+                        CI_PFD_AFLAG_READER_SHIFT :
+                        CI_PFD_AFLAG_WRITER_SHIFT) ) {
     /* Both ends now closed. */
     generic_tcp_helper_close(priv);
   }
 
+ release:
   rc = oo_fop_release(inode, filp);
   OO_DEBUG_TCPH(ci_log("%s: rc=%d", __FUNCTION__, rc));
   return rc;
@@ -992,12 +1069,12 @@ struct file_operations linux_tcp_helper_fops_pipe_reader =
 #if ! CI_CFG_UL_INTERRUPT_HELPER
 #ifdef EFRM_HAVE_FOP_READ_ITER
   CI_STRUCT_MBR(read_iter, linux_tcp_helper_fop_read_iter_pipe),
-  CI_STRUCT_MBR(write_iter, linux_tcp_helper_fop_rw_iter_notsupp),
+  CI_STRUCT_MBR(write_iter, linux_tcp_helper_fop_write_iter_pipe_reader),
 #else
   CI_STRUCT_MBR(read, linux_tcp_helper_fop_read_pipe),
-  CI_STRUCT_MBR(write, linux_tcp_helper_fop_write_notsupp),
+  CI_STRUCT_MBR(write, linux_tcp_helper_fop_write_pipe_reader),
   CI_STRUCT_MBR(aio_read, linux_tcp_helper_fop_aio_read_pipe),
-  CI_STRUCT_MBR(aio_write, linux_tcp_helper_fop_aio_rw_notsupp),
+  CI_STRUCT_MBR(aio_write, linux_tcp_helper_fop_aio_write_pipe_reader),
 #endif
 #endif /* ! CI_CFG_UL_INTERRUPT_HELPER */
   CI_STRUCT_MBR(poll, linux_tcp_helper_fop_poll_pipe_reader),
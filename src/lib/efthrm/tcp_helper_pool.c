@@ -0,0 +1,522 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+/**************************************************************************\
+** <L5_PRIVATE L5_SOURCE>
+** Description: Pool of pre-created stacks (EF_STACK_POOL)
+** </L5_PRIVATE>
+\**************************************************************************/
+
+/* Creating a stack takes tens of milliseconds: VIs, event queues, packet
+ * sets and filters are all allocated synchronously while the application
+ * waits for its first socket.  When a process asks for an unnamed stack
+ * with EF_STACK_POOL=N, this module remembers the "profile" of the request
+ * (options, flags, credentials, CPU affinity and NUMA node) and keeps up to
+ * N stacks of that profile built in advance, so that the next process with
+ * the same profile adopts one instead of waiting.
+ *
+ * Pooled stacks are built by the "onload-pool" kernel thread, which
+ * temporarily takes on the credentials and CPU affinity of the process that
+ * registered the profile, so that the stack's memory and interrupts are
+ * placed as they would have been for that process.  A pooled stack is held
+ * by an OO_THR_REF_APP reference, which is handed to the adopting process as
+ * if the stack had just been created for it.
+ *
+ * The pool thread cannot change its namespaces, so only processes in the
+ * initial namespaces use the pool.
+ *
+ * Named stacks are never pooled because their names must be unique, nor are
+ * clustered stacks, which have EF_CLUSTER_HOT_RESTART, nor stacks on NICs
+ * with shared RX queues, which need a memfd from the creating process.
+ */
+
+#include <ci/internal/transport_config_opt.h>
+#include <onload_kernel_compat.h>
+#include <onload/linux_onload_internal.h>
+#include <onload/linux_onload.h>
+#include <onload/tcp_helper_fns.h>
+#include <ci/efrm/sysdep_linux.h>
+#include <ci/efrm/efrm_client.h>
+#include <ci/driver/efab/hardware.h>
+#include <onload/nic.h>
+#include <linux/kthread.h>
+#include <linux/cred.h>
+#include <linux/seq_file.h>
+
+
+#if ! CI_CFG_UL_INTERRUPT_HELPER
+
+static unsigned stack_pool_max = 8;
+module_param(stack_pool_max, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(stack_pool_max,
+                 "Maximum number of pre-created stacks kept for all "
+                 "EF_STACK_POOL profiles together.  0 disables the stack "
+                 "pool.");
+
+/* A profile that has not been used for this long loses its stacks. */
+#define OO_STACK_POOL_IDLE_SECS  600
+
+/* Upper bound on EF_STACK_POOL, which comes from user space. */
+#define OO_STACK_POOL_MAX_DEPTH  16
+
+
+struct oo_stack_pool {
+  ci_dllink                link;       /* in oo_stack_pools */
+
+  /* The profile. */
+  ci_netif_config_opts     opts;
+  int                      in_flags;
+  const struct cred*       cred;
+  bool                     may_inject;
+  struct cpumask           cpus;       /* CPU affinity of the process */
+  int                      numa_node;  /* NUMA node of the process */
+
+  /* Stacks ready for adoption, each holding an OO_THR_REF_APP. */
+  tcp_helper_resource_t*   thr[OO_STACK_POOL_MAX_DEPTH];
+  unsigned                 n_thr;
+  unsigned                 depth;      /* EF_STACK_POOL */
+  unsigned long            last_used;  /* jiffies */
+  bool                     backoff;    /* last build failed */
+
+  /* Metrics, shown in /proc/driver/onload/stack_pool. */
+  unsigned                 hits;
+  unsigned                 misses;
+  unsigned                 builds;
+  unsigned                 build_fails;
+  ci_uint64                build_us_total;
+  ci_uint64                miss_us_total;
+  unsigned                 build_us_last;
+};
+
+
+/* Protects the list of profiles and their contents.  Profiles are only
+ * freed by the pool thread, so it may use a profile without the mutex.
+ */
+static DEFINE_MUTEX(oo_stack_pool_mutex);
+static ci_dllist oo_stack_pools;
+static unsigned oo_stack_pool_n_thr;
+static struct task_struct* oo_stack_pool_task;
+static DECLARE_WAIT_QUEUE_HEAD(oo_stack_pool_wq);
+static bool oo_stack_pool_kicked;
+
+static int oo_stack_pool_thread(void* unused);
+
+
+static bool oo_stack_pool_nic_ok(tcp_helper_resource_t* thr)
+{
+  int intf_i;
+
+  OO_STACK_FOR_EACH_INTF_I(&thr->netif, intf_i) {
+    struct efhw_nic* nic =
+      efrm_client_get_nic(thr->nic[intf_i].thn_oo_nic->efrm_client);
+    if( efhw_nic_max_shared_rxqs(nic) )
+      return false;
+  }
+  return true;
+}
+
+
+/* Is the current process in the namespaces of the pool thread? */
+static bool oo_stack_pool_ns_is_initial(void)
+{
+#ifdef EFRM_DO_NAMESPACES
+  return current->nsproxy->net_ns == &init_net &&
+         ci_get_pid_ns(current->nsproxy) == &init_pid_ns &&
+         current_user_ns() == &init_user_ns;
+#else
+  return true;
+#endif
+}
+
+
+static const struct cpumask* oo_stack_pool_current_cpus(void)
+{
+#ifdef EFRM_TASK_HAS_CPUMASK
+/* >= 5.3, backported to RHEL8 */
+  return &current->cpus_mask;
+#else
+  return &current->cpus_allowed;
+#endif
+}
+
+
+static bool oo_stack_pool_matches(struct oo_stack_pool* pool,
+                                  ci_resource_onload_alloc_t* alloc,
+                                  const ci_netif_config_opts* opts)
+{
+  const struct cred* cred = current_cred();
+
+  return pool->in_flags == alloc->in_flags &&
+         oo_stack_pool_ns_is_initial() &&
+         pool->numa_node == numa_node_id() &&
+         cpumask_equal(&pool->cpus, oo_stack_pool_current_cpus()) &&
+         uid_eq(pool->cred->uid, cred->uid) &&
+         uid_eq(pool->cred->euid, cred->euid) &&
+         gid_eq(pool->cred->egid, cred->egid) &&
+         pool->cred->user_ns == cred->user_ns &&
+         pool->may_inject == !!ci_in_egroup(inject_kernel_gid) &&
+         memcmp(&pool->opts, opts, sizeof(*opts)) == 0;
+}
+
+
+static struct oo_stack_pool*
+oo_stack_pool_find(ci_resource_onload_alloc_t* alloc,
+                   const ci_netif_config_opts* opts)
+{
+  struct oo_stack_pool* pool;
+
+  ci_assert(mutex_is_locked(&oo_stack_pool_mutex));
+  CI_DLLIST_FOR_EACH2(struct oo_stack_pool, pool, link, &oo_stack_pools)
+    if( oo_stack_pool_matches(pool, alloc, opts) )
+      return pool;
+  return NULL;
+}
+
+
+static void oo_stack_pool_kick(void)
+{
+  ci_assert(mutex_is_locked(&oo_stack_pool_mutex));
+  oo_stack_pool_kicked = true;
+  wake_up(&oo_stack_pool_wq);
+}
+
+
+static bool oo_stack_pool_eligible(ci_resource_onload_alloc_t* alloc,
+                                   const ci_netif_config_opts* opts,
+                                   int ifindices_len)
+{
+  return opts->stack_pool != 0 && stack_pool_max != 0 &&
+         ifindices_len < 0 && alloc->in_name[0] == '\0';
+}
+
+
+int oo_stack_pool_adopt(ci_resource_onload_alloc_t* alloc,
+                        const ci_netif_config_opts* opts,
+                        int ifindices_len,
+                        tcp_helper_resource_t** rs_out)
+{
+  struct oo_stack_pool* pool;
+  tcp_helper_resource_t* thr = NULL;
+
+  if( ! oo_stack_pool_eligible(alloc, opts, ifindices_len) )
+    return -ENOENT;
+
+  mutex_lock(&oo_stack_pool_mutex);
+  pool = oo_stack_pool_find(alloc, opts);
+  if( pool != NULL ) {
+    pool->last_used = jiffies;
+    if( pool->n_thr != 0 ) {
+      thr = pool->thr[--pool->n_thr];
+      --oo_stack_pool_n_thr;
+      ++pool->hits;
+    }
+    else {
+      ++pool->misses;
+    }
+    pool->backoff = false;
+    oo_stack_pool_kick();
+  }
+  mutex_unlock(&oo_stack_pool_mutex);
+
+  if( thr == NULL )
+    return -ENOENT;
+
+  /* The pool thread built the stack, but it belongs to the process that
+   * adopts it: this is what stackdump shows and orphan handling checks. */
+#ifdef EFRM_DO_NAMESPACES
+  thr->netif.state->pid = task_pid_nr_ns(current,
+                                         ci_netif_get_pidns(&thr->netif));
+#else
+  thr->netif.state->pid = task_pid_vnr(current);
+#endif
+
+  alloc->out_netif_mmap_bytes = thr->mem_mmap_bytes;
+  alloc->out_nic_set = thr->netif.nic_set;
+  *rs_out = thr;
+  OO_DEBUG_TCPH(ci_log("%s: [%d] adopted from pool", __FUNCTION__,
+                       thr->id));
+  return 0;
+}
+
+
+void oo_stack_pool_register(ci_resource_onload_alloc_t* alloc,
+                            const ci_netif_config_opts* opts,
+                            int ifindices_len,
+                            tcp_helper_resource_t* thr,
+                            unsigned create_us)
+{
+  struct oo_stack_pool* pool;
+
+  if( ! oo_stack_pool_eligible(alloc, opts, ifindices_len) ||
+      ! oo_stack_pool_nic_ok(thr) )
+    return;
+  if( ! oo_stack_pool_ns_is_initial() )
+    return;
+
+  mutex_lock(&oo_stack_pool_mutex);
+  if( oo_stack_pool_task == NULL ) {
+    struct task_struct* task = kthread_run(oo_stack_pool_thread, NULL,
+                                           "onload-pool");
+    if( IS_ERR(task) ) {
+      ci_log("%s: failed to start pool thread (%ld)", __FUNCTION__,
+             PTR_ERR(task));
+      goto out;
+    }
+    oo_stack_pool_task = task;
+  }
+
+  pool = oo_stack_pool_find(alloc, opts);
+  if( pool == NULL ) {
+    pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+    if( pool == NULL )
+      goto out;
+    pool->opts = *opts;
+    pool->in_flags = alloc->in_flags;
+    pool->cred = get_current_cred();
+    pool->may_inject = !!ci_in_egroup(inject_kernel_gid);
+    cpumask_copy(&pool->cpus, oo_stack_pool_current_cpus());
+    pool->numa_node = numa_node_id();
+    pool->depth = CI_MIN(opts->stack_pool, OO_STACK_POOL_MAX_DEPTH);
+    /* oo_stack_pool_adopt() counts the misses after this one. */
+    pool->misses = 1;
+    ci_dllist_push(&oo_stack_pools, &pool->link);
+  }
+  pool->last_used = jiffies;
+  pool->miss_us_total += create_us;
+  oo_stack_pool_kick();
+ out:
+  mutex_unlock(&oo_stack_pool_mutex);
+}
+
+
+/*--------------------------------------------------------------------
+ *
+ * The pool thread
+ *
+ *--------------------------------------------------------------------*/
+
+/* Allocate the stack's packet buffers now, rather than on the adopting
+ * process's first sends and receives.  The adopting process still maps
+ * them itself. */
+static void oo_stack_pool_prefault(tcp_helper_resource_t* thr)
+{
+  ci_netif* ni = &thr->netif;
+
+  if( NI_OPTS(ni).prefault_packets == 0 ||
+      ! efab_tcp_helper_netif_try_lock(thr, 0) )
+    return;
+  while( ni->packets->n_pkts_allocated < NI_OPTS(ni).prefault_packets &&
+         efab_tcp_helper_more_bufs(thr, 1) == 0 )
+    ;
+  efab_tcp_helper_netif_unlock(thr, 0);
+}
+
+
+/* Used only by the pool thread: its own CPU affinity, restored after each
+ * build, and the affinity it builds with. */
+static struct cpumask oo_stack_pool_thread_cpus;
+static struct cpumask oo_stack_pool_build_cpus;
+
+
+/* Move the pool thread to where the registering process ran: packet and
+ * socket memory come from the node the thread runs on, and the interrupt
+ * affinity is derived from the thread's CPU mask.  Within a mask that spans
+ * several nodes, prefer the CPUs of the process's own node. */
+static void oo_stack_pool_place(struct oo_stack_pool* pool)
+{
+  struct cpumask* cpus = &oo_stack_pool_build_cpus;
+
+  if( ! cpumask_and(cpus, &pool->cpus, cpumask_of_node(pool->numa_node)) )
+    cpumask_copy(cpus, &pool->cpus);
+  if( set_cpus_allowed_ptr(current, cpus) != 0 )
+    OO_DEBUG_TCPH(ci_log("%s: failed to move to the profile's CPUs",
+                         __FUNCTION__));
+}
+
+
+static int oo_stack_pool_build(struct oo_stack_pool* pool,
+                               tcp_helper_resource_t** thr_out)
+{
+  ci_resource_onload_alloc_t alloc;
+  const struct cred* old_cred;
+  int rc;
+
+  memset(&alloc, 0, sizeof(alloc));
+  alloc.in_flags = pool->in_flags;
+  alloc.in_memfd = -1;
+
+  oo_stack_pool_place(pool);
+  old_cred = override_creds(pool->cred);
+
+  rc = tcp_helper_rm_alloc(&alloc, &pool->opts, -1, NULL, thr_out);
+  if( rc == 0 )
+    oo_stack_pool_prefault(*thr_out);
+
+  revert_creds(old_cred);
+  set_cpus_allowed_ptr(current, &oo_stack_pool_thread_cpus);
+  return rc;
+}
+
+
+/* Returns a profile that wants another stack, or NULL. */
+static struct oo_stack_pool* oo_stack_pool_next_to_fill(void)
+{
+  struct oo_stack_pool* pool;
+
+  pool = NULL;
+  mutex_lock(&oo_stack_pool_mutex);
+  if( oo_stack_pool_n_thr < stack_pool_max ) {
+    CI_DLLIST_FOR_EACH2(struct oo_stack_pool, pool, link, &oo_stack_pools)
+      if( pool->n_thr < pool->depth && ! pool->backoff )
+        break;
+  }
+  mutex_unlock(&oo_stack_pool_mutex);
+  return pool;
+}
+
+
+static void oo_stack_pool_fill(struct oo_stack_pool* pool)
+{
+  tcp_helper_resource_t* thr;
+  ktime_t start = ktime_get();
+  unsigned us;
+  int rc;
+
+  rc = oo_stack_pool_build(pool, &thr);
+  us = ktime_us_delta(ktime_get(), start);
+
+  mutex_lock(&oo_stack_pool_mutex);
+  if( rc == 0 ) {
+    ++pool->builds;
+    pool->build_us_total += us;
+    pool->build_us_last = us;
+    if( pool->n_thr < pool->depth ) {
+      pool->thr[pool->n_thr++] = thr;
+      ++oo_stack_pool_n_thr;
+      thr = NULL;
+    }
+  }
+  else {
+    ++pool->build_fails;
+    pool->backoff = true;
+    OO_DEBUG_ERR(ci_log("%s: failed to build stack rc=%d", __FUNCTION__,
+                        rc));
+  }
+  mutex_unlock(&oo_stack_pool_mutex);
+
+  if( rc == 0 && thr != NULL )
+    oo_thr_ref_drop(thr->ref, OO_THR_REF_APP);
+}
+
+
+static void oo_stack_pool_free(struct oo_stack_pool* pool)
+{
+  unsigned i;
+
+  for( i = 0; i < pool->n_thr; ++i )
+    oo_thr_ref_drop(pool->thr[i]->ref, OO_THR_REF_APP);
+  put_cred(pool->cred);
+  kfree(pool);
+}
+
+
+/* Free the profiles that have been idle for too long, or all of them. */
+static void oo_stack_pool_expire(bool all)
+{
+  struct oo_stack_pool *pool, *next;
+  ci_dllist expired;
+
+  ci_dllist_init(&expired);
+  mutex_lock(&oo_stack_pool_mutex);
+  CI_DLLIST_FOR_EACH3(struct oo_stack_pool, pool, link, &oo_stack_pools,
+                      next)
+    if( all || time_after(jiffies, pool->last_used +
+                                   OO_STACK_POOL_IDLE_SECS * HZ) ) {
+      ci_dllist_remove(&pool->link);
+      ci_dllist_push(&expired, &pool->link);
+      oo_stack_pool_n_thr -= pool->n_thr;
+    }
+  mutex_unlock(&oo_stack_pool_mutex);
+
+  while( ci_dllist_not_empty(&expired) ) {
+    pool = CI_CONTAINER(struct oo_stack_pool, link,
+                        ci_dllist_pop(&expired));
+    oo_stack_pool_free(pool);
+  }
+}
+
+
+static int oo_stack_pool_thread(void* unused)
+{
+  struct oo_stack_pool* pool;
+
+  cpumask_copy(&oo_stack_pool_thread_cpus, oo_stack_pool_current_cpus());
+
+  while( ! kthread_should_stop() ) {
+    mutex_lock(&oo_stack_pool_mutex);
+    oo_stack_pool_kicked = false;
+    mutex_unlock(&oo_stack_pool_mutex);
+
+    while( ! kthread_should_stop() &&
+           (pool = oo_stack_pool_next_to_fill()) != NULL )
+      oo_stack_pool_fill(pool);
+    oo_stack_pool_expire(false);
+
+    wait_event_interruptible_timeout(oo_stack_pool_wq,
+                                     oo_stack_pool_kicked ||
+                                     kthread_should_stop(),
+                                     OO_STACK_POOL_IDLE_SECS * HZ / 4);
+  }
+
+  oo_stack_pool_expire(true);
+  return 0;
+}
+
+
+/*--------------------------------------------------------------------
+ *
+ * Driver load/unload and /proc/driver/onload/stack_pool
+ *
+ *--------------------------------------------------------------------*/
+
+void oo_stack_pool_ctor(void)
+{
+  ci_dllist_init(&oo_stack_pools);
+}
+
+
+void oo_stack_pool_dtor(void)
+{
+  /* No new profiles can be registered: the driver is going away. */
+  if( oo_stack_pool_task != NULL ) {
+    kthread_stop(oo_stack_pool_task);
+    oo_stack_pool_task = NULL;
+  }
+  ci_assert(ci_dllist_is_empty(&oo_stack_pools));
+}
+
+
+int oo_stack_pool_show(struct seq_file* seq)
+{
+  struct oo_stack_pool* pool;
+
+  mutex_lock(&oo_stack_pool_mutex);
+  seq_printf(seq, "stacks: %u max: %u\n", oo_stack_pool_n_thr,
+             stack_pool_max);
+  CI_DLLIST_FOR_EACH2(struct oo_stack_pool, pool, link, &oo_stack_pools) {
+    ci_uint64 build_us = pool->builds == 0 ? 0 :
+                         div_u64(pool->build_us_total, pool->builds);
+    ci_uint64 miss_us = pool->misses == 0 ? 0 :
+                        div_u64(pool->miss_us_total, pool->misses);
+    seq_printf(seq, "profile: euid=%u ready=%u/%u hits=%u misses=%u "
+               "builds=%u build_fails=%u build_us_avg=%llu "
+               "build_us_last=%u miss_us_avg=%llu\n",
+               from_kuid_munged(current_user_ns(), pool->cred->euid),
+               pool->n_thr, pool->depth, pool->hits, pool->misses,
+               pool->builds, pool->build_fails, build_us,
+               pool->build_us_last, miss_us);
+  }
+  mutex_unlock(&oo_stack_pool_mutex);
+  return 0;
+}
+
+#endif /* ! CI_CFG_UL_INTERRUPT_HELPER */
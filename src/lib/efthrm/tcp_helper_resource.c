@@ -92,6 +92,19 @@ MODULE_PARM_DESC(max_packets_per_stack,
                  "option are not applied retrospectively to stacks already "
                  "existing before the change.");
 
+static unsigned max_packets_total = 0;
+module_param(max_packets_total, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(max_packets_total,
+                 "Limit the number of packet buffers that all Onload stacks "
+                 "on the host together can allocate.  Stacks grow their "
+                 "packet pools on demand up to EF_MAX_PACKETS; when this "
+                 "limit is reached they cannot grow until other stacks "
+                 "release packet sets (see EF_PACKET_SET_IDLE_RELEASE_MS).  "
+                 "Zero means no limit.");
+
+/* Number of packet sets allocated by all stacks. */
+static atomic_t oo_pkt_sets_total = ATOMIC_INIT(0);
+
 static int allow_insecure_setuid_sharing;
 module_param(allow_insecure_setuid_sharing, int, S_IRUGO | S_IWUSR);
 MODULE_PARM_DESC(allow_insecure_setuid_sharing,
@@ -1931,7 +1944,7 @@ static int deferred_vis(tcp_helper_resource_t* trs)
     }
 
     /* All buffers need to be allocated before AF_XDP sockets are usable. */
-    while( (rc = efab_tcp_helper_more_bufs(trs)) == 0 );
+    while( (rc = efab_tcp_helper_more_bufs(trs, 1)) == 0 );
     if( rc != -ENOSPC )
       return rc;
   }
@@ -2013,6 +2026,7 @@ static void release_pkts(tcp_helper_resource_t* trs)
   for (i = 0; i < ni->pkt_sets_n; i++)
     oo_iobufset_pages_release(ni->pkt_bufs[i]);
   vfree(ni->pkt_bufs);
+  atomic_sub(ni->pkt_sets_n, &oo_pkt_sets_total);
 }
 
 
@@ -2204,6 +2218,7 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
   int no_active_wild_pools, no_active_wild_table_entries;
 #endif
   int no_seq_table_entries;
+  int no_udp_ipcache_entries;
   unsigned vi_state_bytes;
   unsigned dma_addrs_bytes;
 #if CI_CFG_PIO
@@ -2243,6 +2258,13 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
     no_seq_table_entries = 0;
   }
 
+  if( NI_OPTS(ni).udp_send_ipcache_size > 0 )
+    no_udp_ipcache_entries =
+      1u << ci_log2_ge(NI_OPTS(ni).udp_send_ipcache_size,
+                       ci_log2_ge(CI_UDP_IPCACHE_WAYS, 0));
+  else
+    no_udp_ipcache_entries = 0;
+
   /* pkt_sets_n should be zeroed before possible NIC reset */
   if( NI_OPTS(ni).max_packets > max_packets_per_stack ) {
     OO_DEBUG_ERR(ci_log("WARNING: EF_MAX_PACKETS reduced from %d to %d due to "
@@ -2284,14 +2306,32 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
   }
 #endif
 
-  filter_table_size = sizeof(ci_netif_filter_table) +
-    sizeof(ci_netif_filter_table_entry_fast) * (no_table_entries - 1);
-  filter_table_ext_size = sizeof(ci_netif_filter_table_entry_ext) *
-                          no_table_entries;
+  if( NI_OPTS(ni).filter_table_buckets ) {
+    /* The IPv4 buckets hold everything that the extra state would, and the
+     * IPv6 buckets are followed by the full local addresses. */
+    CI_BUILD_ASSERT(sizeof(ci_netif_filter_bucket) == CI_CACHE_LINE_SIZE);
+    CI_BUILD_ASSERT(CI_CFG_NETIF_MAX_ENDPOINTS_MAX <=
+                    CI_FILTER_BUCKET_ID_MASK + 1);
+    filter_table_size = CI_MEMBER_OFFSET(ci_netif_filter_table, table) +
+      sizeof(ci_netif_filter_bucket) * ci_netif_filter_n_buckets(ni);
+    filter_table_ext_size = 0;
+#if CI_CFG_IPV6
+    ip6_filter_table_size = CI_MEMBER_OFFSET(ci_ip6_netif_filter_table, table) +
+      (sizeof(ci_netif_filter_bucket) +
+       sizeof(ci_ip6_addr_t) * CI_FILTER_BUCKET_SLOTS) *
+      ci_ip6_netif_filter_n_buckets(ni);
+#endif
+  }
+  else {
+    filter_table_size = sizeof(ci_netif_filter_table) +
+      sizeof(ci_netif_filter_table_entry_fast) * (no_table_entries - 1);
+    filter_table_ext_size = sizeof(ci_netif_filter_table_entry_ext) *
+                            no_table_entries;
 #if CI_CFG_IPV6
-  ip6_filter_table_size = sizeof(ci_ip6_netif_filter_table) +
-    sizeof(ci_ip6_netif_filter_table_entry) * (no_table_entries - 1);
+    ip6_filter_table_size = sizeof(ci_ip6_netif_filter_table) +
+      sizeof(ci_ip6_netif_filter_table_entry) * (no_table_entries - 1);
 #endif
+  }
 
   /* Allocate shmbuf for netif state.  When calculating the size, it's
    * important that the sizes of the sub-buffers are accumulated in the order
@@ -2320,6 +2360,8 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
 #endif
   sz = CI_ROUND_UP(sz, __alignof__(ci_tcp_prev_seq_t));
   sz += sizeof(ci_tcp_prev_seq_t) * no_seq_table_entries;
+  sz = CI_ROUND_UP(sz, __alignof__(ci_udp_ipcache_entry));
+  sz += sizeof(ci_udp_ipcache_entry) * no_udp_ipcache_entries;
   sz = CI_ROUND_UP(sz, __alignof__(struct oo_deferred_pkt));
   sz += sizeof(struct oo_deferred_pkt) * NI_OPTS(ni).defer_arp_pkts;
   sz = CI_ROUND_UP(sz, __alignof__(ci_netif_filter_table));
@@ -2366,7 +2408,8 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
    * for the sockets).  These pages get zeroed, so all fields in the shared
    * state can be assumed to have been zero-initialised. */
   rc = oo_shmbuf_alloc(&ni->shmbuf, OO_SHARED_BUFFER_CHUNK_ORDER, i,
-                       sz / OO_SHARED_BUFFER_CHUNK_SIZE);
+                       sz / OO_SHARED_BUFFER_CHUNK_SIZE,
+                       NI_OPTS(ni).state_huge_pages ? OO_SHMBUF_FLAG_HUGE : 0);
   if( rc < 0 ) {
     OO_DEBUG_ERR(ci_log("%s: failed to alloc shmbuf for shared state and "
                         "socket buffers (%d)", __FUNCTION__, rc));
@@ -2433,6 +2476,11 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
   ns->seq_table_entries_n = no_seq_table_entries;
   ns_ofs += sizeof(ci_tcp_prev_seq_t) * ns->seq_table_entries_n;
 
+  ns_ofs = CI_ROUND_UP(ns_ofs, __alignof__(ci_udp_ipcache_entry));
+  ns->udp_ipcache_ofs = ns_ofs;
+  ns->udp_ipcache_entries_n = no_udp_ipcache_entries;
+  ns_ofs += sizeof(ci_udp_ipcache_entry) * ns->udp_ipcache_entries_n;
+
   ns_ofs = CI_ROUND_UP(ns_ofs, __alignof__(struct oo_deferred_pkt));
   ns->deferred_pkts_ofs = ns_ofs;
   ns_ofs += sizeof(struct oo_deferred_pkt) * NI_OPTS(ni).defer_arp_pkts;
@@ -2473,6 +2521,7 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
   ni->active_wild_table = (void*) ((char*) ns + ns->active_wild_ofs);
 #endif
   ni->seq_table = (void*) ((char*) ns + ns->seq_table_ofs);
+  ni->udp_ipcache = (void*) ((char*) ns + ns->udp_ipcache_ofs);
   ni->deferred_pkts = (void*) ((char*) ns + ns->deferred_pkts_ofs);
   ni->filter_table = (void*) ((char*) ns + ns->table_ofs);
   ni->filter_table_ext = (void*) ((char*) ns + ns->table_ext_ofs);
@@ -3307,6 +3356,14 @@ static void tcp_helper_do_non_atomic(struct work_struct *data)
   if( trs->trs_aflags & OO_THR_AFLAG_UNLOCK_UNTRUSTED ) {
     ci_atomic32_and(&trs->trs_aflags, ~OO_THR_AFLAG_UNLOCK_UNTRUSTED);
     need_unlock_shared = 1;
+    if( trs->trs_aflags & OO_THR_AFLAG_MORE_BUFS ) {
+      ci_atomic32_and(&trs->trs_aflags, ~OO_THR_AFLAG_MORE_BUFS);
+      ef_eplock_clear_flags(&trs->netif.state->lock,
+                            CI_EPLOCK_NETIF_NEED_PKT_SET);
+      /* Don't bounce back here from every unlock if it keeps failing. */
+      if( efab_tcp_helper_more_bufs(trs, 1) < 0 )
+        ci_frc64(&trs->netif.packets->grow_refused_frc);
+    }
   }
 
   /* Handle the deferred actions with stolen locks: both shared and trusted
@@ -3447,8 +3504,21 @@ tcp_helper_rm_alloc_proxy(ci_resource_onload_alloc_t* alloc,
   else
 #endif
   {
+#if ! CI_CFG_UL_INTERRUPT_HELPER
+    ktime_t start;
+
+    if( oo_stack_pool_adopt(alloc, opts, ifindices_len, rs_out) == 0 )
+      return 0;
+    start = ktime_get();
+    rc = tcp_helper_rm_alloc(alloc, opts, ifindices_len, NULL, rs_out);
+    if( rc == 0 )
+      oo_stack_pool_register(alloc, opts, ifindices_len, *rs_out,
+                             ktime_us_delta(ktime_get(), start));
+    return rc;
+#else
     return tcp_helper_rm_alloc(alloc, opts, ifindices_len,
                                NULL, rs_out);
+#endif
   }
 }
 
@@ -4561,6 +4631,10 @@ int tcp_helper_rm_alloc(ci_resource_onload_alloc_t* alloc,
   /* Allocate hardware resources */
   ni->ep_tbl = NULL;
   ni->flags = alloc->in_flags;
+  rs->pkt_file = NULL;
+  mutex_init(&rs->pkt_file_mutex);
+  rs->pkt_sets_hwm = 0;
+  rs->pkt_sets_idle_since = 0;
   ci_assert( ! (alloc->in_flags & CI_NETIF_FLAG_IN_DL_CONTEXT) );
   rc = allocate_netif_hw_resources(alloc, thc, rs);
   if( rc < 0 ) goto fail6;
@@ -4586,6 +4660,12 @@ int tcp_helper_rm_alloc(ci_resource_onload_alloc_t* alloc,
   ni->keuid = ci_geteuid();
   ni->error_flags = 0;
   ci_netif_state_init(&rs->netif, oo_timesync_cpu_khz, alloc->in_name);
+  ni->state->stats.shmbuf_huge_allocs = oo_shmbuf_huge_chunks(&ni->shmbuf);
+#ifndef OO_SHMBUF_HAVE_HUGE_FAULT
+  if( NI_OPTS(ni).state_huge_pages )
+    NI_LOG(ni, RESOURCE_WARNINGS, "%s: EF_STATE_HUGE_PAGES is not supported "
+           "by this kernel", __func__);
+#endif
   OO_STACK_FOR_EACH_INTF_I(&rs->netif, intf_i) {
     nic = efrm_client_get_nic(rs->nic[intf_i].thn_oo_nic->efrm_client);
     if( nic->devtype.arch == EFHW_ARCH_AF_XDP )
@@ -6002,6 +6082,10 @@ efab_tcp_driver_ctor()
 
   efab_tcp_driver.load_numa_node = numa_node_id();
 
+#if ! CI_CFG_UL_INTERRUPT_HELPER
+  oo_stack_pool_ctor();
+#endif
+
   return 0;
 
 fail_timesync:
@@ -6027,6 +6111,9 @@ efab_tcp_driver_stop(void)
 {
   OO_DEBUG_TCPH(ci_log("%s: kill stacks", __FUNCTION__));
 
+#if ! CI_CFG_UL_INTERRUPT_HELPER
+  oo_stack_pool_dtor();
+#endif
   thr_table_dtor(&efab_tcp_driver.thr_table);
 
   flush_workqueue(CI_GLOBAL_WORKQUEUE);
@@ -6147,6 +6234,7 @@ int efab_tcp_helper_more_socks(tcp_helper_resource_t* trs)
     OO_DEBUG_ERR(ci_log("%s: demand failed (%d)", __FUNCTION__, rc));
     return rc;
   }
+  ni->state->stats.shmbuf_huge_allocs = oo_shmbuf_huge_chunks(&ni->shmbuf);
 
   return install_socks(trs, ni->ep_tbl_n,
                        EP_BUF_PER_PAGE << OO_SHARED_BUFFER_CHUNK_ORDER);
@@ -6650,8 +6738,88 @@ void efab_tcp_helper_unmap_usermem(tcp_helper_resource_t* trs,
 }
 
 
+/* Account for one more packet set against the max_packets_total budget.
+ * Returns false if the budget is exhausted.
+ */
+static int oo_pkt_sets_budget_take(void)
+{
+  unsigned max_sets = DIV_ROUND_UP(max_packets_total, PKTS_PER_SET);
+
+  if( atomic_inc_return(&oo_pkt_sets_total) > max_sets &&
+      max_packets_total != 0 ) {
+    atomic_dec(&oo_pkt_sets_total);
+    return 0;
+  }
+  return 1;
+}
+
+
+struct file* tcp_helper_pkt_file_get(tcp_helper_resource_t* trs)
+{
+  ci_private_t* priv;
+  struct file* file;
+  int rc;
+
+  mutex_lock(&trs->pkt_file_mutex);
+  file = trs->pkt_file;
+  if( file != NULL ) {
+    /* The file may be in the middle of release, waiting for the mutex to
+     * forget itself.  In that case replace it. */
+    rcu_read_lock();
+    if( ! get_file_rcu(file) )
+      file = NULL;
+    rcu_read_unlock();
+  }
+  if( file == NULL ) {
+    rc = oo_thr_ref_get(trs->ref, OO_THR_REF_APP);
+    if( rc == 0 ) {
+      rc = onload_alloc_file(trs, OO_SP_NULL, 0, OO_FDFLAG_STACK, &priv);
+      if( rc == 0 ) {
+        file = priv->_filp;
+        trs->pkt_file = file;
+      }
+      else {
+        oo_thr_ref_drop(trs->ref, OO_THR_REF_APP);
+      }
+    }
+    if( rc != 0 )
+      file = ERR_PTR(rc);
+  }
+  mutex_unlock(&trs->pkt_file_mutex);
+  return file;
+}
+
+
+void tcp_helper_pkt_file_release(tcp_helper_resource_t* trs,
+                                 struct file* filp)
+{
+  mutex_lock(&trs->pkt_file_mutex);
+  if( trs->pkt_file == filp )
+    trs->pkt_file = NULL;
+  mutex_unlock(&trs->pkt_file_mutex);
+}
+
+
+/* Zap any user-level PTEs for packet set [bufset_id], so that subsequent
+ * accesses fault in whatever ni->pkt_bufs[bufset_id] points to then.
+ * Holding pkt_file_mutex keeps the file from being freed under us.
+ */
+static void tcp_helper_pkt_set_unmap(tcp_helper_resource_t* trs,
+                                     int bufset_id)
+{
+  off_t off = OO_MMAP_MAKE_OFFSET(OO_MMAP_TYPE_NETIF,
+                                  CI_NETIF_MMAP_ID_PKTSET(bufset_id));
+
+  mutex_lock(&trs->pkt_file_mutex);
+  if( trs->pkt_file != NULL )
+    unmap_mapping_range(trs->pkt_file->f_mapping, off,
+                        CI_CFG_PKT_BUF_SIZE * PKTS_PER_SET, 1);
+  mutex_unlock(&trs->pkt_file_mutex);
+}
+
+
 int
-efab_tcp_helper_more_bufs(tcp_helper_resource_t* trs)
+efab_tcp_helper_more_bufs(tcp_helper_resource_t* trs, int may_sleep)
 {
   struct oo_iobufset* iobrs[CI_CFG_MAX_INTERFACES];
   struct oo_buffer_pages* pages;
@@ -6668,16 +6836,29 @@ efab_tcp_helper_more_bufs(tcp_helper_resource_t* trs)
   if( ni->pkt_sets_n == ni->pkt_sets_max )
     return -ENOSPC;
 
-  if( ni->flags & CI_NETIF_FLAG_IN_DL_CONTEXT ) {
+  /* If a set with this id has been allocated and released before then we
+   * have to revoke any stale user mappings of it, which can sleep. */
+  if( (ni->flags & CI_NETIF_FLAG_IN_DL_CONTEXT) ||
+      (ni->pkt_sets_n < trs->pkt_sets_hwm && ! may_sleep) ) {
     ef_eplock_holder_set_flag(&ni->state->lock,
                               CI_EPLOCK_NETIF_NEED_PKT_SET);
     return -EBUSY;
   }
 
+  if( ! oo_pkt_sets_budget_take() ) {
+    ci_frc64(&ni->packets->grow_refused_frc);
+    if( ++ni->state->stats.bufset_alloc_budget == 1 )
+      NI_LOG(ni, RESOURCE_WARNINGS,
+             FN_FMT "Failed to allocate packet buffers: max_packets_total=%u "
+             "reached", FN_PRI_ARGS(ni), max_packets_total);
+    return -ENOBUFS;
+  }
+
   hw_addrs = ci_vmalloc(sizeof(uint64_t) * (1 << HW_PAGES_PER_SET_S) *
                         CI_CFG_MAX_INTERFACES);
   if( hw_addrs == NULL ) {
     ci_log("%s: [%d] out of memory", __func__, trs->id);
+    atomic_dec(&oo_pkt_sets_total);
     return -ENOMEM;
   }
 
@@ -6698,6 +6879,7 @@ efab_tcp_helper_more_bufs(tcp_helper_resource_t* trs)
              FN_FMT "Failed to allocate packet buffers (%d)",
              FN_PRI_ARGS(&trs->netif), rc);
     }
+    atomic_dec(&oo_pkt_sets_total);
     ci_vfree(hw_addrs);
     return rc;
   }
@@ -6706,6 +6888,9 @@ efab_tcp_helper_more_bufs(tcp_helper_resource_t* trs)
     ci_assert(iobrs[intf_i] != NULL);
   ci_assert(pages != NULL);
 
+  if( ni->pkt_sets_n < trs->pkt_sets_hwm )
+    tcp_helper_pkt_set_unmap(trs, ni->pkt_sets_n);
+
   /* Install the new buffer allocation, protecting against multi-threads. */
   ci_irqlock_lock(&THR_TABLE.lock, &lock_flags);
   ci_assert_le(ni->pkt_sets_n, ni->pkt_sets_max);
@@ -6715,6 +6900,7 @@ efab_tcp_helper_more_bufs(tcp_helper_resource_t* trs)
     OO_STACK_FOR_EACH_INTF_I(ni, intf_i)
       oo_iobufset_resource_release(iobrs[intf_i], 0);
     oo_iobufset_pages_release(pages);
+    atomic_dec(&oo_pkt_sets_total);
     ci_vfree(hw_addrs);
     return -ENOSPC;
   }
@@ -6741,6 +6927,11 @@ efab_tcp_helper_more_bufs(tcp_helper_resource_t* trs)
 
   ni->packets->sets_n = ni->pkt_sets_n;
   ni->packets->n_pkts_allocated = ni->pkt_sets_n << CI_CFG_PKTS_PER_SET_S;
+  ni->packets->grow_refused_frc = 0;
+  if( ni->pkt_sets_n > trs->pkt_sets_hwm )
+    trs->pkt_sets_hwm = ni->pkt_sets_n;
+  if( ni->pkt_sets_n > ni->state->stats.bufset_hwm )
+    ni->state->stats.bufset_hwm = ni->pkt_sets_n;
 
   ni->packets->set[bufset_id].free = OO_PP_NULL;
   ni->packets->set[bufset_id].n_free = PKTS_PER_SET;
@@ -7276,6 +7467,90 @@ ci_netif_collect_periodic_metrics(ci_netif* ni)
     ni->state->stats.lowest_free_pkts = free_pkts;
 }
 
+/* Return the last packet set to the OS once it has been unused for
+ * EF_PACKET_SET_IDLE_RELEASE_MS.  At most one set is released per call and
+ * the idle period then starts again, so that a stack shrinks gradually.
+ * Only the last set can go, as packet ids and DMA address indices are
+ * allocated contiguously.
+ */
+static void tcp_helper_pkt_sets_shrink(tcp_helper_resource_t* trs)
+{
+  ci_netif* ni = &trs->netif;
+  int bufset_id = ni->pkt_sets_n - 1;
+  oo_pktbuf_set* set = &ni->packets->set[bufset_id];
+  int set_pkts = PKTS_PER_SET;
+  int n_free_after = ni->packets->n_free - set_pkts;
+  struct oo_buffer_pages* pages;
+  ci_irqlock_state_t lock_flags;
+  int i, best, intf_i;
+
+  ci_assert(ci_netif_is_locked(ni));
+
+  /* Hysteresis: keep a whole set of free packets above the low watermark,
+   * and more than half of the remaining packets free, so that
+   * oo_want_proactive_packet_allocation() does not immediately ask for the
+   * set back.
+   */
+  if( bufset_id <= 0 || set->n_free != set_pkts ||
+#ifdef OO_DO_HUGE_PAGES
+      set->shm_id >= 0 ||
+#endif
+      n_free_after < NI_OPTS(ni).free_packets_low + set_pkts ||
+      n_free_after <= (ni->packets->n_pkts_allocated - set_pkts) / 2 ) {
+    trs->pkt_sets_idle_since = 0;
+    return;
+  }
+  if( trs->pkt_sets_idle_since == 0 ) {
+    trs->pkt_sets_idle_since = jiffies;
+    return;
+  }
+  if( time_before(jiffies, trs->pkt_sets_idle_since +
+                  msecs_to_jiffies(NI_OPTS(ni).pkt_set_idle_release_ms)) )
+    return;
+
+  if( ni->packets->id == bufset_id ) {
+    /* Move allocation to the emptiest of the remaining sets, unless that
+     * would immediately make us want another set. */
+    best = 0;
+    for( i = 1; i < bufset_id; ++i )
+      if( ni->packets->set[i].n_free > ni->packets->set[best].n_free )
+        best = i;
+    if( ci_netif_pkt_set_is_underfilled(ni, best) )
+      return;
+    ci_netif_pkt_set_change(ni, best, 0);
+  }
+  trs->pkt_sets_idle_since = 0;
+
+  /* Unpublish the set before revoking user mappings, so that a racing
+   * fault cannot map these pages in again. */
+  ci_irqlock_lock(&THR_TABLE.lock, &lock_flags);
+  pages = ni->pkt_bufs[bufset_id];
+  ni->pkt_bufs[bufset_id] = NULL;
+  --ni->pkt_sets_n;
+  ci_irqlock_unlock(&THR_TABLE.lock, &lock_flags);
+
+  ni->packets->sets_n = ni->pkt_sets_n;
+  ni->packets->n_pkts_allocated = ni->pkt_sets_n << CI_CFG_PKTS_PER_SET_S;
+  ni->packets->n_free -= set_pkts;
+  ni->dma_addr_next = set->dma_addr_base;
+  set->free = OO_PP_NULL;
+  set->n_free = 0;
+
+  tcp_helper_pkt_set_unmap(trs, bufset_id);
+  OO_STACK_FOR_EACH_INTF_I(ni, intf_i) {
+    oo_iobufset_resource_release(ni->nic_hw[intf_i].pkt_rs[bufset_id],
+                                 intfs_suspended(trs) & (1 << intf_i));
+    ni->nic_hw[intf_i].pkt_rs[bufset_id] = NULL;
+  }
+  oo_iobufset_pages_release(pages);
+  atomic_dec(&oo_pkt_sets_total);
+
+  ++ni->state->stats.bufset_released;
+  OO_DEBUG_SHM(ci_log("[%d] released idle bufset id %d, n_freepkts=%d",
+                      NI_ID(ni), bufset_id, ni->packets->n_free));
+  CHECK_FREEPKTS(ni);
+}
+
 static void
 linux_tcp_timer_do(tcp_helper_resource_t* rs, unsigned long* next_timer)
 {
@@ -7310,6 +7585,16 @@ linux_tcp_timer_do(tcp_helper_resource_t* rs, unsigned long* next_timer)
     }
     ci_netif_collect_periodic_metrics(ni);
   }
+
+  /* AF_XDP umem only ever grows, and EF_PREALLOC_PACKETS asks for all the
+   * packets to be kept. */
+  if( NI_OPTS(ni).pkt_set_idle_release_ms != 0 && ni->pkt_sets_n > 1 &&
+      ! NI_OPTS(ni).prealloc_packets &&
+      ! (ni->flags & CI_NETIF_FLAG_AF_XDP) &&
+      efab_tcp_helper_netif_try_lock(rs, 0) ) {
+    tcp_helper_pkt_sets_shrink(rs);
+    efab_tcp_helper_netif_unlock(rs, 0);
+  }
 }
 
 static void
@@ -7983,8 +8268,16 @@ efab_tcp_helper_netif_lock_callback(eplock_helper_t* epl, ci_uint64 lock_val,
         (!orphaned && oo_want_proactive_packet_allocation(ni)) ) {
       OO_DEBUG_TCPH(ci_log("%s: [%u] NEED_PKT_SET now",
                            __FUNCTION__, thr->id));
-      efab_tcp_helper_more_bufs(thr);
       flags_set &=~ CI_EPLOCK_NETIF_NEED_PKT_SET;
+      /* Reusing the id of a released packet set may sleep, and we do not
+       * know that this context can.  Hand the lock to the work item to do
+       * it.  (In DL context the flag is deferred on the next loop.) */
+      if( efab_tcp_helper_more_bufs(thr, 0) == -EBUSY && ! in_dl_context ) {
+        ef_eplock_holder_set_flags(&ni->state->lock, flags_set);
+        tcp_helper_defer_dl2work(thr, OO_THR_AFLAG_UNLOCK_UNTRUSTED |
+                                      OO_THR_AFLAG_MORE_BUFS);
+        return 0;
+      }
     }
 
     /* Monitor the number of socket buffers.
@@ -15,6 +15,7 @@
 
 #include <onload/extensions.h>
 #include <onload/extensions_zc.h>
+#include <onload/extensions_ring.h>
 
 unsigned int onload_ext_version[] = 
   {ONLOAD_EXT_VERSION_MAJOR,
@@ -346,3 +347,22 @@ onload_socket_unicast_nonaccel(int domain, int type, int protocol)
   return socket(domain, type, protocol);
 }
 
+__attribute__((weak))
+int onload_ring_alloc(unsigned entries, unsigned flags,
+                      struct onload_ring** ring_out)
+{
+  return -ENOSYS;
+}
+
+__attribute__((weak))
+int onload_ring_free(struct onload_ring* ring)
+{
+  return -ENOSYS;
+}
+
+__attribute__((weak))
+int onload_ring_enter(struct onload_ring* ring, unsigned min_complete,
+                      int timeout_ms)
+{
+  return -ENOSYS;
+}
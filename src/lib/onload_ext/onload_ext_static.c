@@ -14,6 +14,7 @@
 #define _GNU_SOURCE
 #include <onload/extensions.h>
 #include <onload/extensions_zc.h>
+#include <onload/extensions_ring.h>
 #include <dlfcn.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -266,3 +267,13 @@ wrap_with_fn(int, onload_socket_unicast_nonaccel,
              (int domain, int type, int protocol),
              (domain, type, protocol), socket)
 
+wrap(int, onload_ring_alloc, (unsigned entries, unsigned flags,
+                              struct onload_ring** ring_out),
+     (entries, flags, ring_out), -ENOSYS)
+
+wrap(int, onload_ring_free, (struct onload_ring* ring),
+     (ring), -ENOSYS)
+
+wrap(int, onload_ring_enter, (struct onload_ring* ring, unsigned min_complete,
+                              int timeout_ms),
+     (ring, min_complete, timeout_ms), -ENOSYS)
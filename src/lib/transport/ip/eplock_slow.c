@@ -51,6 +51,8 @@ int __ef_eplock_lock_slow(ci_netif *ni, long timeout, int maybe_wedged)
   ci_assert_equal(maybe_wedged, 0);
 #endif
 
+  ci_netif_flight_rec(ni, OO_FR_LOCK_CONTEND, 0, 0);
+
 #ifndef __KERNEL__
   /* Limit to user-level for now.  Could allow spinning in kernel if we did
    * not rely on user-level accessible state for spin timeout.
@@ -62,14 +64,18 @@ int __ef_eplock_lock_slow(ci_netif *ni, long timeout, int maybe_wedged)
     while( now_frc - start_frc < ni->state->buzz_cycles ) {
       ci_spinloop_pause();
       ci_frc64(&now_frc);
-      if( ef_eplock_trylock(&ni->state->lock) )
+      if( ef_eplock_trylock(&ni->state->lock) ) {
+        ci_netif_flight_rec(ni, OO_FR_LOCK_GOT, 0, 0);
         return 0;
+      }
     }
   }
 #endif
 
   while( 1 ) {
     rc = __oo_eplock_lock(ni, &timeout, maybe_wedged);
+    if( rc == 0 )
+      ci_netif_flight_rec(ni, OO_FR_LOCK_GOT, 0, 0);
     if( rc == 0 || rc == -ETIMEDOUT )
       return rc;
 
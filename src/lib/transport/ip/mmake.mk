@@ -10,6 +10,7 @@ LIB_SRCS	:=		\
 		netif_tx.c	\
 		netif_table.c	\
 		netif_table_ip6.c	\
+		netif_table_bucket.c	\
 		netif_pkt.c	\
 		tcp_misc.c	\
 		tcp_rx.c	\
@@ -571,6 +571,7 @@ static void ci_netif_mem_pressure_enter_critical(ci_netif* ni, int intf_i)
     return;
 
   CITP_STATS_NETIF_INC(ni, memory_pressure_enter);
+  ci_netif_flight_rec(ni, OO_FR_MEM_PRESSURE, 1, 0);
   ni->state->mem_pressure |= OO_MEM_PRESSURE_CRITICAL;
   ni->state->rxq_limit = 2*CI_CFG_RX_DESC_BATCH;
   ci_netif_mem_pressure_pkt_pool_use(ni);
@@ -584,6 +585,7 @@ static void ci_netif_mem_pressure_exit_critical(ci_netif* ni)
   ci_netif_mem_pressure_pkt_pool_fill(ni);
   ni->state->rxq_limit = NI_OPTS(ni).rxq_limit;
   ni->state->mem_pressure &= ~OO_MEM_PRESSURE_CRITICAL;
+  ci_netif_flight_rec(ni, OO_FR_MEM_PRESSURE, 0, 0);
 }
 
 
@@ -1039,6 +1041,14 @@ int oo_want_proactive_packet_allocation(ci_netif* ni)
   if( pkt_sets_n(ni) == pkt_sets_max(ni) )
     return 0;
 
+  /* The host-wide packet budget has refused us recently; there is no point
+   * in asking again on every unlock.  Allocation from the slow path is
+   * still attempted when we actually run out. */
+  if( ni->packets->grow_refused_frc != 0 &&
+      ci_frc64_get() - ni->packets->grow_refused_frc <
+      (ci_uint64) IPTIMER_STATE(ni)->khz * 100 )
+    return 0;
+
   /* We need to have a decent number of free packets. */
   if( ni->packets->n_free > NI_OPTS(ni).free_packets_low ) {
     /* But these free packets may be distributed between sets in
@@ -1082,6 +1092,7 @@ ci_uint64 ci_netif_unlock_slow_common(ci_netif* ni, ci_uint64 lock_val,
 {
   ci_uint64 set_flags = 0;
   ci_uint64 test_val;
+  ci_uint64 prof = ci_netif_prof_start(ni);
 
   /* Do this first, because ci_netif_purge_deferred_socket_list() acts on the
    * lock directly. */
@@ -1189,6 +1200,7 @@ ci_uint64 ci_netif_unlock_slow_common(ci_netif* ni, ci_uint64 lock_val,
     ci_netif_merge_atomic_counters(ni);
 
   ef_eplock_holder_set_flags(&ni->state->lock, set_flags);
+  ci_netif_prof_end(ni, OO_PROF_DEFERRED, prof);
 
   /* Returns good reflection on current lock value. */
   return lock_val | set_flags;
@@ -533,6 +533,87 @@ void ci_netif_dump_timeoutq(ci_netif* ni)
 }
 
 
+#if CI_CFG_FLIGHT_RECORDER
+
+static const char* const flight_rec_frozen_str[] = {
+  "no", "disabled", "slow poll", "by user",
+};
+
+
+void ci_netif_dump_flight_recorder(ci_netif* ni)
+{
+  const struct oo_flight_rec* fr = &ni->state->flight_rec;
+  ci_uint32 n = fr->n;
+  ci_uint32 frozen = fr->frozen;
+  unsigned khz = IPTIMER_STATE(ni)->khz;
+  ci_uint64 last_frc;
+  ci_uint32 i;
+
+  log("flight recorder: stack=%d events=%u frozen=%s", NI_ID(ni), n,
+      frozen < CI_ARRAY_SIZE(flight_rec_frozen_str) ?
+      flight_rec_frozen_str[frozen] : "?");
+  if( n == 0 || khz == 0 )
+    return;
+
+  /* Times are in microseconds relative to the last event. */
+  last_frc = fr->ring[(n - 1) & (CI_CFG_FLIGHT_RECORDER_LEN - 1)].frc;
+  i = n > CI_CFG_FLIGHT_RECORDER_LEN ? n - CI_CFG_FLIGHT_RECORDER_LEN : 0;
+  for( ; i != n; ++i ) {
+    const struct oo_flight_rec_ev* ev =
+      &fr->ring[i & (CI_CFG_FLIGHT_RECORDER_LEN - 1)];
+    ci_int64 ns = (ci_int64) (ev->frc - last_frc) * 1000000 / khz;
+    const char* sign = ns < 0 ? "-" : " ";
+    ci_uint64 abs_ns = ns < 0 ? -ns : ns;
+    char t[32];
+
+    snprintf(t, sizeof(t), "%s%llu.%03u", sign,
+             (unsigned long long) (abs_ns / 1000),
+             (unsigned) (abs_ns % 1000));
+    switch( ev->type ) {
+    case OO_FR_NONE:
+      break;
+    case OO_FR_POLL:
+      log("  %14s poll         evs=%u usec=%u", t, ev->a, ev->b);
+      break;
+    case OO_FR_LOCK_CONTEND:
+      log("  %14s lock_contend", t);
+      break;
+    case OO_FR_LOCK_GOT:
+      log("  %14s lock_got", t);
+      break;
+    case OO_FR_WAKE:
+      log("  %14s wake         sock=%u%s%s", t, ev->b,
+          (ev->a & CI_SB_FLAG_WAKE_RX) ? " rx" : "",
+          (ev->a & CI_SB_FLAG_WAKE_TX) ? " tx" : "");
+      break;
+    case OO_FR_RETRANS:
+      log("  %14s retrans      sock=%u n=%u", t, ev->b, ev->a);
+      break;
+    case OO_FR_RX_DISCARD:
+      log("  %14s rx_discard   intf=%u type=%u", t, ev->b, ev->a);
+      break;
+    case OO_FR_RX_DROP:
+      log("  %14s rx_drop      sock=%u %s", t, ev->b,
+          ev->a ? "mem_pressure" : "overflow");
+      break;
+    case OO_FR_MEM_PRESSURE:
+      log("  %14s mem_pressure %s", t, ev->a ? "enter" : "exit");
+      break;
+    case OO_FR_FREEZE:
+      log("  %14s freeze       %s poll_usec=%u", t,
+          ev->a < CI_ARRAY_SIZE(flight_rec_frozen_str) ?
+          flight_rec_frozen_str[ev->a] : "?", ev->b);
+      break;
+    default:
+      log("  %14s ?%u a=%u b=%u", t, ev->type, ev->a, ev->b);
+      break;
+    }
+  }
+}
+
+#endif
+
+
 void ci_netif_dump_reap_list(ci_netif* ni, int verbose)
 {
   struct oo_p_dllink_state reap_list =
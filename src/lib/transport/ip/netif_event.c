@@ -336,12 +336,16 @@ static void handle_rx_pkt(ci_netif* netif, struct ci_netif_poll_state* ps,
 
       /* Demux to appropriate protocol. */
       if( ip->ip_protocol == IPPROTO_TCP ) {
+        ci_uint64 prof = ci_netif_prof_start(netif);
         ci_tcp_handle_rx(netif, ps, pkt, (ci_tcp_hdr*) payload, ip_paylen);
+        ci_netif_prof_end(netif, OO_PROF_TCP_RX, prof);
         CI_IPV4_STATS_INC_IN_DELIVERS( netif );
         return;
       }
       else if(CI_LIKELY( ip->ip_protocol == IPPROTO_UDP )) {
+        ci_uint64 prof = ci_netif_prof_start(netif);
         ci_udp_handle_rx(netif, pkt, (ci_udp_hdr*) payload, ip_paylen);
+        ci_netif_prof_end(netif, OO_PROF_UDP_RX, prof);
         CI_IPV4_STATS_INC_IN_DELIVERS( netif );
         return;
       }
@@ -402,14 +406,18 @@ static void handle_rx_pkt(ci_netif* netif, struct ci_netif_poll_state* ps,
       oo_tcpdump_dump_pkt(netif, pkt);
 
     if( ip6_hdr->next_hdr == IPPROTO_TCP ) {
+      ci_uint64 prof = ci_netif_prof_start(netif);
       ci_tcp_handle_rx(netif, ps, pkt, (ci_tcp_hdr*) payload,
                        CI_BSWAP_BE16(ip6_hdr->payload_len));
+      ci_netif_prof_end(netif, OO_PROF_TCP_RX, prof);
       CI_IP_STATS_INC_IN6_DELIVERS( netif );
       return;
     }
     else if( ip6_hdr->next_hdr == IPPROTO_UDP ) {
+      ci_uint64 prof = ci_netif_prof_start(netif);
       ci_udp_handle_rx(netif, pkt, (ci_udp_hdr*) payload,
                        CI_BSWAP_BE16(ip6_hdr->payload_len));
+      ci_netif_prof_end(netif, OO_PROF_UDP_RX, prof);
       CI_IP_STATS_INC_IN6_DELIVERS( netif );
       return;
     }
@@ -723,8 +731,10 @@ ci_inline void __handle_rx_pkt(ci_netif* ni, struct ci_netif_poll_state* ps,
     }
 #endif
     if( oo_xdp_check_pkt(ni, pkt) ) {
+      ci_uint64 prof = ci_netif_prof_start(ni);
       ci_parse_rx_vlan(*pkt);
       handle_rx_pkt(ni, ps, *pkt);
+      ci_netif_prof_end(ni, OO_PROF_RX, prof);
     }
   }
 }
@@ -1359,6 +1369,7 @@ static void __handle_rx_discard(ci_netif* ni, struct ci_netif_poll_state* ps,
   }
 
   pkt = PKT_CHK(ni, pp);
+  ci_netif_flight_rec(ni, OO_FR_RX_DISCARD, discard_type, intf_i);
 
   if( discard_type == EF_EVENT_RX_DISCARD_CSUM_BAD && !is_frag )
     handled = handle_rx_csum_bad(ni, ps, pkt, frame_len);
@@ -1489,6 +1500,8 @@ static void process_post_poll_list(ci_netif* ni)
         sb->sb_flags = 0;
       }
       else {
+        ci_netif_flight_rec(ni, OO_FR_WAKE,
+                            sb->sb_flags & sb->wake_request, W_ID(sb));
 #ifdef __KERNEL__
         /* In realtime kernel, citp_waitable_wakeup() from NAPI context is
          * harmful */
@@ -1756,6 +1769,82 @@ void ci_netif_tx_pkt_complete(ci_netif* ni, struct ci_netif_poll_state* ps,
   __ci_netif_tx_pkt_complete(ni, ps, pkt, NULL);
 }
 
+#define RX_PREFETCH_MAX   16
+#define RX_PREFETCH_NONE  ((unsigned) -1)
+
+/* Returns the filter-table index prefetched for [pkt], or RX_PREFETCH_NONE
+ * if it is not a packet that we know how to look up early.  Nothing here
+ * is trusted: the packet is validated properly when it is handled.
+ */
+static unsigned rx_prefetch_filter(ci_netif* ni, ci_ip_pkt_fmt* pkt)
+{
+  const ci_uint16* p_ether_type = &(oo_ether_hdr(pkt)->ether_type);
+  const ci_ip4_hdr* ip;
+  const ci_uint16* ports;
+
+  if( *p_ether_type == CI_ETHERTYPE_8021Q )
+    p_ether_type += 2;
+  if( *p_ether_type != CI_ETHERTYPE_IP )
+    return RX_PREFETCH_NONE;
+  ip = (const ci_ip4_hdr*) (p_ether_type + 1);
+  if( ip->ip_ihl_version != CI_IP4_IHL_VERSION(sizeof(*ip)) )
+    return RX_PREFETCH_NONE;
+  ports = (const ci_uint16*) (ip + 1);
+
+  /* Look up what most packets will match: a connection for TCP and a bound
+   * socket for UDP. */
+  if( ip->ip_protocol == IPPROTO_TCP )
+    return ci_netif_filter_prefetch_entry(ni, ip->ip_daddr_be32, ports[1],
+                                          ip->ip_saddr_be32, ports[0],
+                                          IPPROTO_TCP);
+  if( ip->ip_protocol == IPPROTO_UDP )
+    return ci_netif_filter_prefetch_entry(ni, ip->ip_daddr_be32, ports[1],
+                                          0, 0, IPPROTO_UDP);
+  return RX_PREFETCH_NONE;
+}
+
+
+/* Handling each received packet in turn stalls first on its headers, then
+ * on the filter table and then on the socket state.  With many active
+ * sockets all three are likely to miss.  Before handling a batch of events
+ * we therefore issue the prefetches for all of its packets a stage at a
+ * time, so that the misses overlap with each other and with the handling
+ * of the earlier packets in the batch.
+ *
+ * Only single-buffer RX events are considered.  Packets in RX_MULTI events
+ * are not known until the event is unbundled, and those already have their
+ * headers prefetched as they are unbundled.
+ */
+static void ci_netif_rx_prefetch(ci_netif* ni, const ef_event* ev, int n_evs)
+{
+  ci_ip_pkt_fmt* pkts[RX_PREFETCH_MAX];
+  unsigned hash1[RX_PREFETCH_MAX];
+  oo_pkt_p pp;
+  int i, n = 0;
+
+  for( i = 0; i < n_evs && n < RX_PREFETCH_MAX; ++i )
+    if( EF_EVENT_TYPE(ev[i]) == EF_EVENT_TYPE_RX &&
+        (ev[i].rx.flags & (EF_EVENT_FLAG_SOP | EF_EVENT_FLAG_CONT))
+                                                      == EF_EVENT_FLAG_SOP ) {
+      OO_PP_INIT(ni, pp, EF_EVENT_RX_RQ_ID(ev[i]));
+      pkts[n] = PKT_CHK(ni, pp);
+      ci_prefetch(pkts[n]);
+      ci_prefetch(pkts[n]->dma_start);
+      ++n;
+    }
+
+  /* A lone packet gains nothing over the one-packet lag in the caller. */
+  if( n < 2 )
+    return;
+
+  for( i = 0; i < n; ++i )
+    hash1[i] = rx_prefetch_filter(ni, pkts[i]);
+  for( i = 0; i < n; ++i )
+    if( hash1[i] != RX_PREFETCH_NONE )
+      ci_netif_filter_prefetch_sock(ni, hash1[i]);
+}
+
+
 static int ci_netif_poll_evq(ci_netif* ni, struct ci_netif_poll_state* ps,
                              int intf_i, int n_evs)
 {
@@ -1797,7 +1886,11 @@ static int ci_netif_poll_evq(ci_netif* ni, struct ci_netif_poll_state* ps,
     }
     else
 #endif
+    {
+      ci_uint64 prof = ci_netif_prof_start(ni);
       n_evs = ef_eventq_poll(evq, ev, 16);
+      ci_netif_prof_end(ni, OO_PROF_EVQ, prof);
+    }
     /* The 16 above is a heuristic. We want a big number for efficiency, but
      * if we go too big then we can totally drain the rxq in one go (made even
      * easier when rx merging is on). We don't refill until after this
@@ -1809,6 +1902,9 @@ static int ci_netif_poll_evq(ci_netif* ni, struct ci_netif_poll_state* ps,
       break;
 
 have_events:
+    if( NI_OPTS(ni).rx_prefetch && evq->nic_type.arch != EF_VI_ARCH_AF_XDP )
+      ci_netif_rx_prefetch(ni, ev, n_evs);
+
     /* This loop is implemented with a 1 packet lag on processing (i.e.
      * __handle_rx_pkt() is called for the packet from the previous loop
      * iteration just as the next packet is being picked up, due to a
@@ -1861,6 +1957,7 @@ have_events:
         ef_request_id *ids = ni->tx_events;
         int n_ids, j;
         ef_vi* vi = CI_NETIF_TX_VI(ni, intf_i, ev[i].tx.q_id);
+        ci_uint64 prof = ci_netif_prof_start(ni);
         CITP_STATS_NETIF_INC(ni, tx_evs);
         n_ids = ef_vi_transmit_unbundle(vi, &ev[i], ids);
         ci_assert_ge(n_ids, 0);
@@ -1871,6 +1968,7 @@ have_events:
           ++ni->state->nic[intf_i].tx_dmaq_done_seq;
           __ci_netif_tx_pkt_complete(ni, ps, pkt, &ev[i]);
         }
+        ci_netif_prof_end(ni, OO_PROF_TX_COMPLETE, prof);
         completed_tx = 1;
       }
 
@@ -1920,11 +2018,13 @@ have_events:
       }
 
       else if( EF_EVENT_TYPE(ev[i]) == EF_EVENT_TYPE_TX_WITH_TIMESTAMP ) {
+        ci_uint64 prof = ci_netif_prof_start(ni);
         CITP_STATS_NETIF_INC(ni, tx_evs);
         OO_PP_INIT(ni, pp, ev[i].tx_timestamp.rq_id);
         pkt = PKT_CHK(ni, pp);
         ++ni->state->nic[intf_i].tx_dmaq_done_seq;
         __ci_netif_tx_pkt_complete(ni, ps, pkt, &ev[i]);
+        ci_netif_prof_end(ni, OO_PROF_TX_COMPLETE, prof);
         completed_tx = 1;
       }
 
@@ -2022,6 +2122,7 @@ static int ci_netif_poll_intf(ci_netif* ni, int intf_i, int max_evs)
   struct ci_netif_poll_state ps;
   int total_evs = 0;
   int rc;
+  ci_uint64 prof;
 
 #if defined(__KERNEL__) || ! defined(NDEBUG)
   if( ! ci_netif_may_poll_in_kernel(ni, intf_i) )
@@ -2036,19 +2137,26 @@ static int ci_netif_poll_intf(ci_netif* ni, int intf_i, int max_evs)
     rc = ci_netif_poll_evq(ni, &ps, intf_i, 0);
     if( rc > 0 ) {
       total_evs += rc;
+      prof = ci_netif_prof_start(ni);
       process_post_poll_list(ni);
+      ci_netif_prof_end(ni, OO_PROF_POST_POLL, prof);
     }
     else
       break;
   } while( total_evs < max_evs );
 
-  if( ps.tx_pkt_free_list_n )
+  if( ps.tx_pkt_free_list_n ) {
+    prof = ci_netif_prof_start(ni);
     ci_netif_poll_free_pkts(ni, &ps);
+    ci_netif_prof_end(ni, OO_PROF_TX_COMPLETE, prof);
+  }
 
   /* The following steps probably aren't needed if we haven't handled any
    * events, but that is a rare case and so not worth testing for.
    */
+  prof = ci_netif_prof_start(ni);
   ci_netif_rx_post_all_batch(ni, intf_i);
+  ci_netif_prof_end(ni, OO_PROF_RX_REFILL, prof);
 
   if( ci_netif_dmaq_not_empty(ni, intf_i) )
     ci_netif_dmaq_shove1(ni, intf_i);
@@ -2221,6 +2329,28 @@ free_out:
 #endif
 
 
+/* Turn a loopback packet that has been "transmitted" into a received one. */
+void ci_netif_loopback_pkt_to_rx(ci_netif* ni, ci_ip_pkt_fmt* pkt)
+{
+  oo_offbuf_init(&pkt->buf, PKT_START(pkt), pkt->buf_len);
+  pkt->intf_i = OO_INTF_I_LOOPBACK;
+  ci_assert_nflags(pkt->flags, CI_PKT_FLAG_RX);
+  pkt->flags &= CI_PKT_FLAG_NONB_POOL;
+  pkt->flags |= CI_PKT_FLAG_RX;
+  ++ni->state->n_rx_pkts;
+  pkt->tstamp_frc = IPTIMER_STATE(ni)->frc;
+  if( oo_tcpdump_check(ni, pkt, OO_INTF_I_LOOPBACK) )
+    oo_tcpdump_dump_pkt(ni, pkt);
+  pkt->next = OO_PP_NULL;
+#if CI_CFG_IPV6
+  if( oo_pkt_ether_type(pkt) == CI_ETHERTYPE_IP6 )
+    pkt->flags |= CI_PKT_FLAG_IS_IP6;
+  else
+    pkt->flags &=~ CI_PKT_FLAG_IS_IP6;
+#endif
+}
+
+
 void ci_netif_loopback_pkts_send(ci_netif* ni)
 {
   ci_ip_pkt_fmt* pkt;
@@ -2261,23 +2391,7 @@ void ci_netif_loopback_pkts_send(ci_netif* ni)
                   OO_SP_FMT(pkt->pf.tcp_tx.lo.tx_sock),
                   OO_SP_FMT(pkt->pf.tcp_tx.lo.rx_sock)));
 
-    oo_offbuf_init(&pkt->buf, PKT_START(pkt), pkt->buf_len);
-    pkt->intf_i = OO_INTF_I_LOOPBACK;
-    ci_assert_nflags(pkt->flags, CI_PKT_FLAG_RX);
-    pkt->flags &= CI_PKT_FLAG_NONB_POOL;
-    pkt->flags |= CI_PKT_FLAG_RX;
-    ++ni->state->n_rx_pkts;
-    pkt->tstamp_frc = IPTIMER_STATE(ni)->frc;
-    if( oo_tcpdump_check(ni, pkt, OO_INTF_I_LOOPBACK) )
-      oo_tcpdump_dump_pkt(ni, pkt);
-    pkt->next = OO_PP_NULL;
-#if CI_CFG_IPV6
-  if( oo_pkt_ether_type(pkt) == CI_ETHERTYPE_IP6 )
-    pkt->flags |= CI_PKT_FLAG_IS_IP6;
-  else
-    pkt->flags &=~ CI_PKT_FLAG_IS_IP6;
-#endif
-
+    ci_netif_loopback_pkt_to_rx(ni, pkt);
     ip = oo_ipx_hdr(pkt);
     af = oo_pkt_af(pkt);
     ci_tcp_handle_rx(ni, NULL, pkt, PKT_IPX_TCP_HDR(af, pkt),
@@ -2289,6 +2403,10 @@ void ci_netif_loopback_pkts_send(ci_netif* ni)
 int ci_netif_poll_n(ci_netif* netif, int max_evs)
 {
   int intf_i, n_evs_handled = 0;
+  ci_uint64 prof_poll, prof;
+#if CI_CFG_FLIGHT_RECORDER
+  ci_uint64 start_frc;
+#endif
 
 #if defined(__KERNEL__) || ! defined(NDEBUG)
   if( netif->error_flags )
@@ -2304,7 +2422,11 @@ int ci_netif_poll_n(ci_netif* netif, int max_evs)
   CITP_STATS_NETIF_INC(netif, u_polls);
 #endif
 
+  prof_poll = ci_netif_prof_start(netif);
   ci_ip_time_resync(IPTIMER_STATE(netif));
+#if CI_CFG_FLIGHT_RECORDER
+  start_frc = IPTIMER_STATE(netif)->frc;
+#endif
 #if CI_CFG_UL_INTERRUPT_HELPER && ! defined(__KERNEL__)
   ci_netif_handle_actions(netif);
 #endif
@@ -2328,8 +2450,12 @@ int ci_netif_poll_n(ci_netif* netif, int max_evs)
   }
 
   while( OO_PP_NOT_NULL(netif->state->looppkts) ) {
+    prof = ci_netif_prof_start(netif);
     ci_netif_loopback_pkts_send(netif);
+    ci_netif_prof_end(netif, OO_PROF_LOOPBACK, prof);
+    prof = ci_netif_prof_start(netif);
     process_post_poll_list(netif);
+    ci_netif_prof_end(netif, OO_PROF_POST_POLL, prof);
   }
   ci_assert_equal(netif->state->n_looppkts, 0);
   --netif->state->in_poll;
@@ -2355,7 +2481,9 @@ int ci_netif_poll_n(ci_netif* netif, int max_evs)
 
   /* Timer code can't use in-poll wakeup, since endpoints are out of
    * post-poll list.  So, poll timers after --in_poll. */
+  prof = ci_netif_prof_start(netif);
   ci_ip_timer_poll(netif);
+  ci_netif_prof_end(netif, OO_PROF_TIMERS, prof);
 
   /* Timers MUST NOT send via loopback. */
   ci_assert(OO_PP_IS_NULL(netif->state->looppkts));
@@ -2380,6 +2508,11 @@ int ci_netif_poll_n(ci_netif* netif, int max_evs)
 
   netif->state->poll_work_outstanding = 0;
 
+#if CI_CFG_FLIGHT_RECORDER
+  ci_netif_flight_rec_poll(netif, start_frc, n_evs_handled);
+#endif
+  ci_netif_prof_end(netif, OO_PROF_POLL, prof_poll);
+
   /* returns the number of events handled */
   return n_evs_handled;
 }
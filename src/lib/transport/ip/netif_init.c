@@ -106,11 +106,16 @@ void ci_netif_state_init(ci_netif* ni, int cpu_khz, const char* name)
     oo_p_dllink_add(ni, list, link);
   }
 
-  ci_netif_filter_init(ni, ci_log2_le(ci_netif_filter_table_size(ni)));
+  if( NI_OPTS(ni).filter_table_buckets ) {
+    ci_netif_filter_bucket_init(ni);
+  }
+  else {
+    ci_netif_filter_init(ni, ci_log2_le(ci_netif_filter_table_size(ni)));
 #if CI_CFG_IPV6
-  ci_ip6_netif_filter_init(ni->ip6_filter_table,
-                           ci_log2_le(NI_OPTS(ni).max_ep_bufs) + 1);
+    ci_ip6_netif_filter_init(ni->ip6_filter_table,
+                             ci_log2_le(NI_OPTS(ni).max_ep_bufs) + 1);
 #endif
+  }
 
   oo_p_dllink_init(ni, oo_p_dllink_ptr(ni,
                    &nis->timeout_q[OO_TIMEOUT_Q_TIMEWAIT]));
@@ -175,6 +180,13 @@ void ci_netif_state_init(ci_netif* ni, int cpu_khz, const char* name)
             __oo_usec_to_cycles64(cpu_khz,
                                   NI_OPTS(ni).kernel_packets_timer_usec);
 #endif
+#if CI_CFG_FLIGHT_RECORDER
+  nis->flight_rec.freeze_cycles =
+            __oo_usec_to_cycles64(cpu_khz,
+                                  NI_OPTS(ni).flight_recorder_freeze_usec);
+  if( ! NI_OPTS(ni).flight_recorder )
+    nis->flight_rec.frozen = OO_FR_FROZEN_DISABLED;
+#endif
 
   ci_ip_timer_state_init(ni, cpu_khz);
   nis->last_spin_poll_frc = IPTIMER_STATE(ni)->frc;
@@ -742,6 +754,8 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
       opts->int_driven = 0;
   }
 
+  if( (s = getenv("EF_SPIN_ADAPTIVE")) )
+    opts->spin_adaptive = atoi(s);
   if( (s = getenv("EF_INT_DRIVEN")) )
     opts->int_driven = atoi(s);
 #if CI_CFG_WANT_BPF_NATIVE
@@ -814,6 +828,8 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
   else if( opts->poll_in_kernel )
     opts->evs_per_poll = 192;     /* See EF_EVS_PER_POLL documentation */
 #endif
+  if( (s = getenv("EF_RX_PREFETCH")) )
+    opts->rx_prefetch = atoi(s);
   if( (s = getenv("EF_TCP_TCONST_MSL")) )
     opts->msl_seconds = atoi(s);
   if( (s = getenv("EF_TCP_FIN_TIMEOUT")) )
@@ -849,14 +865,20 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
   }
   if ( (s = getenv("EF_PREALLOC_PACKETS")) )
     opts->prealloc_packets = atoi(s);
+  if ( (s = getenv("EF_PACKET_SET_IDLE_RELEASE_MS")) )
+    opts->pkt_set_idle_release_ms = atoi(s);
   if ( (s = getenv("EF_RXQ_MIN")) )
     opts->rxq_min = atoi(s);
   if ( (s = getenv("EF_MIN_FREE_PACKETS")) )
     opts->min_free_packets = atoi(s);
   if( (s = getenv("EF_PREFAULT_PACKETS")) )
     opts->prefault_packets = atoi(s);
+  if( (s = getenv("EF_STACK_POOL")) )
+    opts->stack_pool = atoi(s);
   if ( (s = getenv("EF_MAX_ENDPOINTS")) )
     opts->max_ep_bufs = atoi(s);
+  if( (s = getenv("EF_FILTER_TABLE_BUCKETS")) )
+    opts->filter_table_buckets = atoi(s);
   if ( (s = getenv("EF_ENDPOINT_PACKET_RESERVE")) )
     opts->endpoint_packet_reserve = atoi(s);
   if ( (s = getenv("EF_DEFER_ARP_MAX")) )
@@ -874,6 +896,8 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
     opts->huge_pages = 0;
   }
 #endif
+  if ( (s = getenv("EF_STATE_HUGE_PAGES")) )
+    opts->state_huge_pages = atoi(s);
   if ( (s = getenv("EF_COMPOUND_PAGES_MODE")) )
     opts->compound_pages = atoi(s);
   if ( (s = getenv("EF_RXQ_SIZE")) )
@@ -888,10 +912,22 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
     opts->send_poll_thresh = atoi(s);
   if ( (s = getenv("EF_SEND_POLL_MAX_EVS")) )
     opts->send_poll_max_events = atoi(s);
+#if CI_CFG_FLIGHT_RECORDER
+  if( (s = getenv("EF_FLIGHT_RECORDER")) )
+    opts->flight_recorder = atoi(s);
+  if( (s = getenv("EF_FLIGHT_RECORDER_FREEZE_USEC")) )
+    opts->flight_recorder_freeze_usec = atoi(s);
+#endif
+#if CI_CFG_POLL_PROFILE
+  if( (s = getenv("EF_POLL_PROFILE")) )
+    opts->poll_profile = atoi(s);
+#endif
   if ( (s = getenv("EF_DEFER_WORK_LIMIT")) )
     opts->defer_work_limit = atoi(s);
   if( (s = getenv("EF_UDP_SEND_UNLOCK_THRESH")) )
     opts->udp_send_unlock_thresh = atoi(s);
+  if( (s = getenv("EF_UDP_SEND_IPCACHE_SIZE")) )
+    opts->udp_send_ipcache_size = atoi(s);
   if( (s = getenv("EF_UDP_PORT_HANDOVER_MIN")) )
     opts->udp_port_handover_min = atoi(s);
   if( (s = getenv("EF_UDP_PORT_HANDOVER_MAX")) )
@@ -958,6 +994,8 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
     opts->tcp_sndbuf_mode = atoi(s);
   if( (s = getenv("EF_TCP_COMBINE_SENDS_MODE")) )
     opts->tcp_combine_sends_mode = atoi(s);
+  if( (s = getenv("EF_TCP_SEND_ZC_THRESH")) )
+    opts->tcp_send_zc_thresh = atoi(s);
   if( (s = getenv("EF_TCP_SEND_NONBLOCK_NO_PACKETS_MODE")) )
     opts->tcp_nonblock_no_pkts_mode = atoi(s);
   if( (s = getenv("EF_TCP_RCVBUF_STRICT")) )
@@ -986,6 +1024,10 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
     opts->udp_send_unlocked = atoi(s);
   if( (s = getenv("EF_UDP_SEND_NONBLOCK_NO_PACKETS_MODE")) )
     opts->udp_nonblock_no_pkts_mode = atoi(s);
+  if( (s = getenv("EF_UDP_RECVMMSG_BATCH")) )
+    opts->udp_recvmmsg_batch = atoi(s);
+  if( (s = getenv("EF_UDP_SENDMMSG_BATCH")) )
+    opts->udp_sendmmsg_batch = atoi(s);
   if( (s = getenv("EF_UNCONFINE_SYN")) )
     opts->unconfine_syn = atoi(s) != 0;
   if( (s = getenv("EF_BINDTODEVICE_HANDOVER")) )
@@ -1005,6 +1047,8 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
       opts->tcp_client_loopback == CITP_TCP_LOOPBACK_SAMESTACK )
     opts->tcp_client_loopback = CITP_TCP_LOOPBACK_OFF;
 #endif
+  if( (s = getenv("EF_TCP_LOOPBACK_DIRECT")) )
+    opts->tcp_loopback_direct = atoi(s);
 
   if( (s = getenv("EF_TCP_RX_CHECKS")) ) {
     unsigned v;
@@ -1018,6 +1062,8 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
 
   if( (s = getenv("EF_ACCEPTQ_MIN_BACKLOG")) )
     opts->acceptq_min_backlog = atoi(s);
+  if( (s = getenv("EF_TCP_ACCEPTQ_SHARDS")) )
+    opts->tcp_acceptq_shards = atoi(s);
 
   if ( (s = getenv("EF_TCP_SNDBUF")) )
     opts->tcp_sndbuf_user = atoi(s);
@@ -1659,6 +1705,8 @@ static void netif_tcp_helper_build2(ci_netif* ni)
 #endif
   ni->seq_table =
     (ci_tcp_prev_seq_t*) ((char*) ni->state + ni->state->seq_table_ofs);
+  ni->udp_ipcache =
+    (ci_udp_ipcache_entry*) ((char*) ni->state + ni->state->udp_ipcache_ofs);
   ni->deferred_pkts =
     (struct oo_deferred_pkt*) ((char*) ni->state +
                                ni->state->deferred_pkts_ofs);
@@ -2245,6 +2293,7 @@ static int netif_tcp_helper_build(ci_netif* ni)
     for( i = 0; i < ni->state->max_ep_bufs; ++ i )
       ni->eps[i] = ref;
   }
+  ni->zc_usermem = NULL;
 
   /* For diagnostic purposes, mark the stack as lacking a mapping of init_net's
    * cplane if such is the case.  We couldn't set this flag in ci_netif_init()
@@ -152,6 +152,10 @@ ci_netif_filter_lookup(ci_netif* netif, int af_space,
 {
   int rc = -ENOENT;
 
+  if( NI_OPTS(netif).filter_table_buckets )
+    return ci_netif_filter_bucket_lookup(netif, af_space, laddr, lport,
+                                         raddr, rport, protocol);
+
 #if CI_CFG_IPV6
   if( IS_AF_SPACE_IP6(af_space) ) {
     rc = ci_ip6_netif_filter_lookup(netif, laddr, lport,
@@ -189,6 +193,45 @@ ci_netif_filter_hash(ci_netif* ni, ci_addr_t laddr, unsigned lport,
 }
 
 
+unsigned
+ci_netif_filter_prefetch_entry(ci_netif* ni, unsigned laddr, unsigned lport,
+                               unsigned raddr, unsigned rport,
+                               unsigned protocol)
+{
+  ci_netif_filter_table* tbl = ni->filter_table;
+  unsigned hash1;
+
+  if( NI_OPTS(ni).filter_table_buckets )
+    return ci_netif_filter_bucket_prefetch_entry(ni, laddr, lport,
+                                                 raddr, rport, protocol);
+
+  hash1 = __onload_hash1(tbl->table_size_mask, laddr, lport,
+                         raddr, rport, protocol);
+  ci_prefetch(&tbl->table[hash1]);
+  return hash1;
+}
+
+
+void ci_netif_filter_prefetch_sock(ci_netif* ni, unsigned hash1)
+{
+  ci_netif_filter_table_entry_fast* entry;
+
+  if( NI_OPTS(ni).filter_table_buckets ) {
+    ci_netif_filter_bucket_prefetch_sock(ni, hash1);
+    return;
+  }
+
+  entry = &ni->filter_table->table[hash1];
+  /* Only the entry at the preferred location is worth chasing: anything
+   * else means walking the probe sequence, which is the lookup's job. */
+  if( STATE(entry) == OCCUPIED_PREFERRED ) {
+    ci_sock_cmn* s = ID_TO_SOCK(ni, __ID(entry));
+    ci_prefetch(s);
+    ci_prefetch(&s->pkt);
+  }
+}
+
+
 ci_inline int /*bool*/
 handle_entry(ci_netif* ni, ci_netif_filter_table_entry_fast* entry,
              ci_netif_filter_table_entry_ext* entry_ext,
@@ -244,6 +287,12 @@ ci_netif_filter_for_each_match(ci_netif* ni,
   unsigned first, table_size_mask;
   ci_netif_filter_table_entry_fast* entry;
 
+  if( NI_OPTS(ni).filter_table_buckets )
+    return ci_netif_filter_bucket_for_each_match(ni, laddr, lport,
+                                                 raddr, rport, protocol,
+                                                 intf_i, vlan, callback,
+                                                 callback_arg, hash_out);
+
   tbl = ni->filter_table;
   table_size_mask = tbl->table_size_mask;
 
@@ -519,6 +568,11 @@ ci_netif_filter_insert(ci_netif* netif, oo_sp tcp_id, int af_space,
   ci_assert(netif);
   ci_assert(ci_netif_is_locked(netif));
 
+  if( NI_OPTS(netif).filter_table_buckets )
+    return ci_netif_filter_bucket_insert(netif, tcp_id, af_space,
+                                         laddr, lport, raddr, rport,
+                                         protocol);
+
 #if CI_CFG_IPV6
   if( IS_AF_SPACE_IP6(af_space) ) {
     ci_assert(netif->ip6_filter_table);
@@ -561,6 +615,12 @@ ci_netif_filter_remove(ci_netif* netif, oo_sp sock_p, int af_space,
 
   ci_assert(netif);
 
+  if( NI_OPTS(netif).filter_table_buckets ) {
+    ci_netif_filter_bucket_remove(netif, sock_p, af_space,
+                                  laddr, lport, raddr, rport, protocol);
+    return;
+  }
+
 #if CI_CFG_IPV6
   if( IS_AF_SPACE_IP6(af_space) ) {
     ci_assert(netif->ip6_filter_table);
@@ -653,6 +713,10 @@ __ci_netif_filter_lookup(ci_netif* netif, int af_space,
 {
   int rc;
 
+  if( NI_OPTS(netif).filter_table_buckets )
+    return __ci_netif_filter_bucket_lookup(netif, af_space, laddr, lport,
+                                           raddr, rport, protocol);
+
 #if CI_CFG_IPV6
   if( IS_AF_SPACE_IP6(af_space) ) {
     rc = __ci_ip6_netif_filter_lookup(netif, laddr, lport, raddr, rport,
@@ -686,6 +750,11 @@ void ci_netif_filter_dump(ci_netif* ni)
   ci_assert(ni);
   tbl = ni->filter_table;
 
+  if( NI_OPTS(ni).filter_table_buckets ) {
+    ci_netif_filter_bucket_dump(ni);
+    return;
+  }
+
   log("++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++");
 #if CI_CFG_STATS_NETIF
   log(FN_FMT "size=%d n_entries=%i n_slots=%i max=%i mean=%i", FN_PRI_ARGS(ni),
@@ -27,6 +27,64 @@ void ci_ip6_netif_filter_dump(ci_netif* ni);
 #endif
 
 
+/* Bucketised tables, used instead of the above when EF_FILTER_TABLE_BUCKETS
+ * is set.  See netif_table_bucket.c. */
+int
+ci_netif_filter_bucket_for_each_match(ci_netif* ni,
+                                      unsigned laddr, unsigned lport,
+                                      unsigned raddr, unsigned rport,
+                                      unsigned protocol, int intf_i, int vlan,
+                                      int (*callback)(ci_sock_cmn*, void*),
+                                      void* callback_arg,
+                                      ci_uint32* hash_out) CI_HF;
+#if CI_CFG_IPV6
+int
+ci_netif_filter_bucket_for_each_match_ip6(ci_netif* ni,
+                                          const ci_addr_t* laddr_ptr,
+                                          unsigned lport,
+                                          const ci_addr_t* raddr_ptr,
+                                          unsigned rport, unsigned protocol,
+                                          int intf_i, int vlan,
+                                          int (*callback)(ci_sock_cmn*, void*),
+                                          void* callback_arg,
+                                          ci_uint32* hash_out) CI_HF;
+#endif
+
+oo_sp
+ci_netif_filter_bucket_lookup(ci_netif* ni, int af_space,
+                              ci_addr_t laddr, unsigned lport,
+                              ci_addr_t raddr, unsigned rport,
+                              unsigned protocol) CI_HF;
+
+ci_sock_cmn*
+__ci_netif_filter_bucket_lookup(ci_netif* ni, int af_space,
+                                ci_addr_t laddr, unsigned lport,
+                                ci_addr_t raddr, unsigned rport,
+                                unsigned protocol) CI_HF;
+
+int
+ci_netif_filter_bucket_insert(ci_netif* ni, oo_sp sock_id, int af_space,
+                              const ci_addr_t laddr, unsigned lport,
+                              const ci_addr_t raddr, unsigned rport,
+                              unsigned protocol) CI_HF;
+
+void
+ci_netif_filter_bucket_remove(ci_netif* ni, oo_sp sock_id, int af_space,
+                              const ci_addr_t laddr, unsigned lport,
+                              const ci_addr_t raddr, unsigned rport,
+                              unsigned protocol) CI_HF;
+
+unsigned
+ci_netif_filter_bucket_prefetch_entry(ci_netif* ni,
+                                      unsigned laddr, unsigned lport,
+                                      unsigned raddr, unsigned rport,
+                                      unsigned protocol) CI_HF;
+
+void ci_netif_filter_bucket_prefetch_sock(ci_netif* ni, unsigned h) CI_HF;
+
+void ci_netif_filter_bucket_dump(ci_netif* ni) CI_HF;
+
+
 ci_inline int ci_sock_intf_check(ci_netif* ni, ci_sock_cmn* s,
                                  int intf_i, int vlan)
 {
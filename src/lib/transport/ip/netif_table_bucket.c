@@ -0,0 +1,795 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+/**************************************************************************\
+*//*! \file
+**  \brief  Bucketised software filter tables (EF_FILTER_TABLE_BUCKETS).
+**
+** The layout is described next to ci_netif_filter_bucket.  An entry lives
+** in its home bucket (h & table_size_mask) unless that is full, in which
+** case it goes in the nearest following bucket that has a free slot.  A
+** lookup compares the tag of each slot in the home bucket against the tag
+** from its hash in one go, and only examines the sockets whose tags match.
+** It goes on to the following buckets only if some entry for the home
+** bucket has spilled into them.
+*//*
+\**************************************************************************/
+
+/*! \cidoxg_lib_transport_ip */
+
+#include <ci/internal/transport_config_opt.h>
+#include "ip_internal.h"
+#include <onload/hash.h>
+#include "netif_table.h"
+
+#if !defined(__KERNEL__) && (defined(__x86_64__) || defined(__i386__))
+#include <emmintrin.h>
+#define BUCKET_SSE2  1
+#else
+#define BUCKET_SSE2  0
+#endif
+
+
+#define TAG_MASK   (~CI_FILTER_BUCKET_ID_MASK)
+#define SLOTS_MASK ((1u << CI_FILTER_BUCKET_SLOTS) - 1)
+
+
+/* The existing hashes are cheap but mix poorly, which matters more here as
+ * the low bits choose the bucket and the high bits make the tag. */
+ci_inline ci_uint32
+bucket_hash(unsigned laddr, unsigned lport, unsigned raddr, unsigned rport,
+            unsigned protocol)
+{
+  ci_uint32 h = raddr * 0x9e3779b1u;
+  h = (h ^ laddr) * 0x85ebca6bu;
+  h = (h ^ (rport << 16 | lport) ^ protocol) * 0xc2b2ae35u;
+  return h ^ (h >> 16);
+}
+
+ci_inline ci_uint32 bucket_tag(ci_uint32 h)
+{
+  ci_uint32 tag = h & TAG_MASK;
+  return tag != 0 ? tag : 1u << CI_FILTER_BUCKET_ID_BITS;
+}
+
+#define SLOT_ID(b, i)  ((b)->slot[i] & CI_FILTER_BUCKET_ID_MASK)
+
+
+/* Returns a bitmask of the slots in [b] whose tag is [tag].  Free slots
+ * never match, as tags are non-zero. */
+ci_inline unsigned
+bucket_tag_matches(const ci_netif_filter_bucket* b, ci_uint32 tag)
+{
+#if BUCKET_SSE2
+  /* The second load covers the spill counters as well as the last slots,
+   * but those lanes are masked out of the result. */
+  __m128i mask = _mm_set1_epi32((int) TAG_MASK);
+  __m128i want = _mm_set1_epi32((int) tag);
+  __m128i lo = _mm_load_si128((const __m128i*) &b->slot[0]);
+  __m128i hi = _mm_load_si128((const __m128i*) &b->slot[4]);
+  CI_BUILD_ASSERT(CI_FILTER_BUCKET_SLOTS <= 8);
+  lo = _mm_cmpeq_epi32(_mm_and_si128(lo, mask), want);
+  hi = _mm_cmpeq_epi32(_mm_and_si128(hi, mask), want);
+  return (_mm_movemask_ps(_mm_castsi128_ps(lo)) |
+          _mm_movemask_ps(_mm_castsi128_ps(hi)) << 4) & SLOTS_MASK;
+#else
+  unsigned i, matches = 0;
+  for( i = 0; i < CI_FILTER_BUCKET_SLOTS; ++i )
+    if( (b->slot[i] & TAG_MASK) == tag )
+      matches |= 1u << i;
+  return matches;
+#endif
+}
+
+
+ci_inline ci_netif_filter_bucket* ip4_buckets(ci_netif* ni)
+{
+  return (ci_netif_filter_bucket*) ni->filter_table->table;
+}
+
+#if CI_CFG_IPV6
+ci_inline ci_netif_filter_bucket* ip6_buckets(ci_netif* ni)
+{
+  return (ci_netif_filter_bucket*) ni->ip6_filter_table->table;
+}
+
+/* Full local address of the entry in slot [i] of bucket [b_i]. */
+ci_inline ci_ip6_addr_t* ip6_laddr(ci_netif* ni, unsigned b_i, int i)
+{
+  ci_ip6_addr_t* laddrs = (ci_ip6_addr_t*)
+    (ip6_buckets(ni) + ni->ip6_filter_table->table_size_mask + 1);
+  return &laddrs[b_i * CI_FILTER_BUCKET_SLOTS + i];
+}
+
+ci_inline unsigned ip6_addr_fold(const ci_addr_t* addr)
+{
+  return addr == NULL ? 0 : onload_addr_xor(*addr);
+}
+#endif
+
+
+#if OO_DO_STACK_POLL
+
+/**********************************************************************
+ * Operations common to both tables.
+ */
+
+static int
+bucket_insert(ci_netif_filter_bucket* buckets, unsigned mask, ci_uint32 h,
+              oo_sp sock_id, unsigned laddr, unsigned lport,
+              unsigned* b_i_out, int* slot_out, unsigned* dist_out)
+{
+  ci_netif_filter_bucket* home = &buckets[h & mask];
+  unsigned max_dist = CI_MIN(mask, 0xffffu);
+  unsigned dist, b_i;
+  int i;
+
+  ci_assert_nflags(OO_SP_TO_INT(sock_id), TAG_MASK);
+
+  for( dist = 0; dist <= max_dist; ++dist ) {
+    ci_netif_filter_bucket* b;
+    b_i = (h + dist) & mask;
+    b = &buckets[b_i];
+    for( i = 0; i < CI_FILTER_BUCKET_SLOTS; ++i )
+      if( b->slot[i] == 0 ) {
+        b->slot[i] = bucket_tag(h) | OO_SP_TO_INT(sock_id);
+        b->laddr[i] = laddr;
+        b->lport[i] = lport;
+        if( dist > 0 ) {
+          ++home->n_spilled;
+          if( dist > home->max_dist )
+            home->max_dist = dist;
+        }
+        *b_i_out = b_i;
+        *slot_out = i;
+        *dist_out = dist;
+        return 0;
+      }
+  }
+
+  return -ENOBUFS;
+}
+
+
+/* Finds the slot holding [sock_id] for [laddr].  Returns the distance from
+ * the home bucket, or -1 if there is no such entry. */
+static int
+bucket_find_id(ci_netif_filter_bucket* buckets, unsigned mask, ci_uint32 h,
+               oo_sp sock_id, unsigned laddr, unsigned* b_i_out,
+               int* slot_out)
+{
+  ci_uint32 want = bucket_tag(h) | OO_SP_TO_INT(sock_id);
+  unsigned dist, max_dist = buckets[h & mask].max_dist;
+  int i;
+
+  for( dist = 0; dist <= max_dist; ++dist ) {
+    unsigned b_i = (h + dist) & mask;
+    ci_netif_filter_bucket* b = &buckets[b_i];
+    for( i = 0; i < CI_FILTER_BUCKET_SLOTS; ++i )
+      if( b->slot[i] == want && b->laddr[i] == laddr ) {
+        *b_i_out = b_i;
+        *slot_out = i;
+        return dist;
+      }
+  }
+  return -1;
+}
+
+
+static void
+bucket_remove(ci_netif_filter_bucket* buckets, unsigned mask, ci_uint32 h,
+              unsigned b_i, int i, unsigned dist)
+{
+  ci_netif_filter_bucket* home = &buckets[h & mask];
+
+  buckets[b_i].slot[i] = 0;
+  if( dist > 0 ) {
+    ci_assert_gt(home->n_spilled, 0);
+    if( --home->n_spilled == 0 )
+      home->max_dist = 0;
+  }
+}
+
+
+static void
+bucket_table_full(ci_netif* ni, oo_sp sock_id)
+{
+  ci_sock_cmn* s = SP_TO_SOCK_CMN(ni, sock_id);
+  if( ! (s->s_flags & CI_SOCK_FLAG_SW_FILTER_FULL) ) {
+    LOG_E(ci_log(FN_FMT "%d FULL (buckets)", FN_PRI_ARGS(ni),
+                 OO_SP_FMT(sock_id)));
+    s->s_flags |= CI_SOCK_FLAG_SW_FILTER_FULL;
+  }
+  CITP_STATS_NETIF_INC(ni, sw_filter_insert_table_full);
+}
+
+
+/**********************************************************************
+ * IPv4
+ */
+
+#define IP4_HASH(laddr, lport, raddr, rport, protocol)  \
+  bucket_hash((laddr), (lport), (raddr), (rport), (protocol))
+
+
+int
+ci_netif_filter_bucket_for_each_match(ci_netif* ni,
+                                      unsigned laddr, unsigned lport,
+                                      unsigned raddr, unsigned rport,
+                                      unsigned protocol, int intf_i, int vlan,
+                                      int (*callback)(ci_sock_cmn*, void*),
+                                      void* callback_arg, ci_uint32* hash_out)
+{
+  ci_netif_filter_bucket* buckets = ip4_buckets(ni);
+  unsigned mask = ni->filter_table->table_size_mask;
+  ci_uint32 h = IP4_HASH(laddr, lport, raddr, rport, protocol);
+  ci_uint32 tag = bucket_tag(h);
+  ci_netif_filter_bucket* b = &buckets[h & mask];
+  unsigned dist = 0, max_dist = b->max_dist;
+  unsigned matches, m;
+  int i;
+
+  if( hash_out != NULL )
+    *hash_out = __onload_hash3(laddr, lport, raddr, rport, protocol);
+
+  while( 1 ) {
+    matches = bucket_tag_matches(b, tag);
+    OO_FOR_EACH_BIT(matches, m, i) {
+      ci_sock_cmn* s = ID_TO_SOCK(ni, SLOT_ID(b, i));
+      /* See handle_entry() for why sock_raddr_be32() is safe for sockets
+       * bound to :: */
+      if( ((laddr    - b->laddr[i]       ) |
+           (lport    - b->lport[i]       ) |
+           (raddr    - sock_raddr_be32(s)) |
+           (rport    - sock_rport_be16(s)) |
+           (protocol - sock_protocol(s)  )) == 0 &&
+          CI_LIKELY((s->rx_bind2dev_ifindex == CI_IFID_BAD ||
+                     ci_sock_intf_check(ni, s, intf_i, vlan))) &&
+          callback(s, callback_arg) != 0 )
+        return 1;
+    }
+    if( dist == max_dist )
+      break;
+    if( dist++ == 0 )
+      CITP_STATS_NETIF_INC(ni, table_lookup_spills);
+    b = &buckets[(h + dist) & mask];
+  }
+  return 0;
+}
+
+
+/* Returns the socket id, or -ENOENT. */
+static int
+ci_ip4_netif_filter_bucket_lookup(ci_netif* ni,
+                                  unsigned laddr, unsigned lport,
+                                  unsigned raddr, unsigned rport,
+                                  unsigned protocol)
+{
+  ci_netif_filter_bucket* buckets = ip4_buckets(ni);
+  unsigned mask = ni->filter_table->table_size_mask;
+  ci_uint32 h = IP4_HASH(laddr, lport, raddr, rport, protocol);
+  ci_uint32 tag = bucket_tag(h);
+  unsigned dist, max_dist = buckets[h & mask].max_dist;
+  unsigned matches, m;
+  int i;
+
+  ci_assert(ci_netif_is_locked(ni));
+
+  for( dist = 0; dist <= max_dist; ++dist ) {
+    ci_netif_filter_bucket* b = &buckets[(h + dist) & mask];
+    matches = bucket_tag_matches(b, tag);
+    OO_FOR_EACH_BIT(matches, m, i) {
+      ci_sock_cmn* s = ID_TO_SOCK(ni, SLOT_ID(b, i));
+      if( ((laddr    - b->laddr[i]       ) |
+           (lport    - b->lport[i]       ) |
+           (raddr    - sock_raddr_be32(s)) |
+           (rport    - sock_rport_be16(s)) |
+           (protocol - sock_protocol(s)  )) == 0 )
+        return SLOT_ID(b, i);
+    }
+  }
+  return -ENOENT;
+}
+
+
+static int
+ci_ip4_netif_filter_bucket_insert(ci_netif* ni, oo_sp sock_id,
+                                  unsigned laddr, unsigned lport,
+                                  unsigned raddr, unsigned rport,
+                                  unsigned protocol)
+{
+  unsigned mask = ni->filter_table->table_size_mask;
+  ci_uint32 h = IP4_HASH(laddr, lport, raddr, rport, protocol);
+  unsigned b_i, dist;
+  int i, rc;
+
+  rc = bucket_insert(ip4_buckets(ni), mask, h, sock_id, laddr, lport,
+                     &b_i, &i, &dist);
+  if( rc < 0 ) {
+    bucket_table_full(ni, sock_id);
+    return rc;
+  }
+
+  LOG_TC(ci_log(FN_FMT "%d INSERT %s %s:%u->%s:%u at=%u:%d dist=%u",
+                FN_PRI_ARGS(ni), OO_SP_FMT(sock_id),
+                CI_IP_PROTOCOL_STR(protocol),
+                ip_addr_str(laddr), (unsigned) CI_BSWAP_BE16(lport),
+                ip_addr_str(raddr), (unsigned) CI_BSWAP_BE16(rport),
+                b_i, i, dist));
+
+#if CI_CFG_STATS_NETIF
+  /* Hops are buckets visited. */
+  if( dist + 1 > ni->state->stats.table_max_hops )
+    ni->state->stats.table_max_hops = dist + 1;
+  if( ni->state->stats.table_mean_hops == 0 )
+    ni->state->stats.table_mean_hops = 1;
+  ni->state->stats.table_mean_hops =
+    (ni->state->stats.table_mean_hops * 9 + dist + 1) / 10;
+  ++ni->state->stats.table_n_slots;
+  ++ni->state->stats.table_n_entries;
+  if( dist > 0 )
+    ++ni->state->stats.table_n_spilled;
+#endif
+  return 0;
+}
+
+
+static void
+ci_ip4_netif_filter_bucket_remove(ci_netif* ni, oo_sp sock_id,
+                                  unsigned laddr, unsigned lport,
+                                  unsigned raddr, unsigned rport,
+                                  unsigned protocol)
+{
+  unsigned mask = ni->filter_table->table_size_mask;
+  ci_uint32 h = IP4_HASH(laddr, lport, raddr, rport, protocol);
+  unsigned b_i;
+  int i, dist;
+
+  LOG_TC(ci_log("%s: [%d:%d] REMOVE %s %s:%u->%s:%u",
+                __FUNCTION__, NI_ID(ni), OO_SP_FMT(sock_id),
+                CI_IP_PROTOCOL_STR(protocol),
+                ip_addr_str(laddr), (unsigned) CI_BSWAP_BE16(lport),
+                ip_addr_str(raddr), (unsigned) CI_BSWAP_BE16(rport)));
+
+  /* As with the default table, removing an entry that is not there is
+   * allowed. */
+  dist = bucket_find_id(ip4_buckets(ni), mask, h, sock_id, laddr, &b_i, &i);
+  if( dist < 0 )
+    return;
+  bucket_remove(ip4_buckets(ni), mask, h, b_i, i, dist);
+
+  CITP_STATS_NETIF(--ni->state->stats.table_n_slots);
+  CITP_STATS_NETIF(--ni->state->stats.table_n_entries);
+  if( dist > 0 )
+    CITP_STATS_NETIF(--ni->state->stats.table_n_spilled);
+}
+
+
+/**********************************************************************
+ * IPv6
+ */
+
+#if CI_CFG_IPV6
+
+#define IP6_HASH(laddr_ptr, lport, raddr_ptr, rport, protocol)          \
+  bucket_hash(ip6_addr_fold(laddr_ptr), (lport),                        \
+              ip6_addr_fold(raddr_ptr), (rport), (protocol))
+
+
+int
+ci_netif_filter_bucket_for_each_match_ip6(ci_netif* ni,
+                                          const ci_addr_t* laddr_ptr,
+                                          unsigned lport,
+                                          const ci_addr_t* raddr_ptr,
+                                          unsigned rport, unsigned protocol,
+                                          int intf_i, int vlan,
+                                          int (*callback)(ci_sock_cmn*, void*),
+                                          void* callback_arg,
+                                          ci_uint32* hash_out)
+{
+  ci_netif_filter_bucket* buckets = ip6_buckets(ni);
+  unsigned mask = ni->ip6_filter_table->table_size_mask;
+  unsigned lfold = ip6_addr_fold(laddr_ptr);
+  ci_uint32 h = IP6_HASH(laddr_ptr, lport, raddr_ptr, rport, protocol);
+  ci_uint32 tag = bucket_tag(h);
+  unsigned dist = 0, max_dist = buckets[h & mask].max_dist;
+  unsigned matches, m;
+  int i;
+
+  if( hash_out != NULL )
+    *hash_out = __onload_hash3(lfold, lport, ip6_addr_fold(raddr_ptr),
+                               rport, protocol);
+
+  while( 1 ) {
+    unsigned b_i = (h + dist) & mask;
+    ci_netif_filter_bucket* b = &buckets[b_i];
+    matches = bucket_tag_matches(b, tag);
+    OO_FOR_EACH_BIT(matches, m, i) {
+      ci_sock_cmn* s = ID_TO_SOCK(ni, SLOT_ID(b, i));
+      if( b->laddr[i] == lfold && b->lport[i] == lport &&
+          protocol == sock_protocol(s) &&
+          memcmp(laddr_ptr, ip6_laddr(ni, b_i, i),
+                 sizeof(ci_ip6_addr_t)) == 0 &&
+          ( (raddr_ptr == NULL && !(s->s_flags & CI_SOCK_FLAG_CONNECTED)) ||
+            (raddr_ptr != NULL &&
+             memcmp(raddr_ptr, sock_ip6_raddr(s),
+                    sizeof(ci_ip6_addr_t)) == 0 &&
+             rport == sock_rport_be16(s)) ) &&
+          CI_LIKELY((s->rx_bind2dev_ifindex == CI_IFID_BAD ||
+                     ci_sock_intf_check(ni, s, intf_i, vlan))) &&
+          callback(s, callback_arg) != 0 )
+        return 1;
+    }
+    if( dist == max_dist )
+      break;
+    if( dist++ == 0 )
+      CITP_STATS_NETIF_INC(ni, ipv6_table_lookup_spills);
+  }
+  return 0;
+}
+
+
+static int
+ci_ip6_netif_filter_bucket_lookup(ci_netif* ni,
+                                  ci_addr_t laddr, unsigned lport,
+                                  ci_addr_t raddr, unsigned rport,
+                                  unsigned protocol)
+{
+  ci_netif_filter_bucket* buckets = ip6_buckets(ni);
+  unsigned mask = ni->ip6_filter_table->table_size_mask;
+  unsigned lfold = ip6_addr_fold(&laddr);
+  ci_uint32 h = IP6_HASH(&laddr, lport, &raddr, rport, protocol);
+  ci_uint32 tag = bucket_tag(h);
+  unsigned dist, max_dist = buckets[h & mask].max_dist;
+  unsigned matches, m;
+  int i;
+
+  ci_assert(ci_netif_is_locked(ni));
+
+  for( dist = 0; dist <= max_dist; ++dist ) {
+    unsigned b_i = (h + dist) & mask;
+    ci_netif_filter_bucket* b = &buckets[b_i];
+    matches = bucket_tag_matches(b, tag);
+    OO_FOR_EACH_BIT(matches, m, i) {
+      ci_sock_cmn* s = ID_TO_SOCK(ni, SLOT_ID(b, i));
+      if( b->laddr[i] == lfold && b->lport[i] == lport &&
+          rport == sock_rport_be16(s) && protocol == sock_protocol(s) &&
+          memcmp(laddr.ip6, ip6_laddr(ni, b_i, i), sizeof(laddr)) == 0 &&
+          memcmp(raddr.ip6, sock_ip6_raddr(s), sizeof(raddr)) == 0 )
+        return SLOT_ID(b, i);
+    }
+  }
+  return -ENOENT;
+}
+
+
+static int
+ci_ip6_netif_filter_bucket_insert(ci_netif* ni, oo_sp sock_id,
+                                  const ci_addr_t laddr, unsigned lport,
+                                  const ci_addr_t raddr, unsigned rport,
+                                  unsigned protocol)
+{
+  unsigned mask = ni->ip6_filter_table->table_size_mask;
+  ci_uint32 h = IP6_HASH(&laddr, lport, &raddr, rport, protocol);
+  unsigned b_i, dist;
+  int i, rc;
+
+  rc = bucket_insert(ip6_buckets(ni), mask, h, sock_id,
+                     ip6_addr_fold(&laddr), lport, &b_i, &i, &dist);
+  if( rc < 0 ) {
+    bucket_table_full(ni, sock_id);
+    return rc;
+  }
+  memcpy(ip6_laddr(ni, b_i, i), laddr.ip6, sizeof(ci_ip6_addr_t));
+
+  LOG_TC(ci_log(FN_FMT "%d INSERT %s " IPX_PORT_FMT "->" IPX_PORT_FMT
+                " at=%u:%d dist=%u", FN_PRI_ARGS(ni), OO_SP_FMT(sock_id),
+                CI_IP_PROTOCOL_STR(protocol),
+                IPX_ARG(AF_IP(laddr)), (unsigned) CI_BSWAP_BE16(lport),
+                IPX_ARG(AF_IP(raddr)), (unsigned) CI_BSWAP_BE16(rport),
+                b_i, i, dist));
+
+#if CI_CFG_STATS_NETIF
+  if( dist + 1 > ni->state->stats.ipv6_table_max_hops )
+    ni->state->stats.ipv6_table_max_hops = dist + 1;
+  if( ni->state->stats.ipv6_table_mean_hops == 0 )
+    ni->state->stats.ipv6_table_mean_hops = 1;
+  ni->state->stats.ipv6_table_mean_hops =
+    (ni->state->stats.ipv6_table_mean_hops * 9 + dist + 1) / 10;
+  ++ni->state->stats.ipv6_table_n_slots;
+  ++ni->state->stats.ipv6_table_n_entries;
+  if( dist > 0 )
+    ++ni->state->stats.ipv6_table_n_spilled;
+#endif
+  return 0;
+}
+
+
+static void
+ci_ip6_netif_filter_bucket_remove(ci_netif* ni, oo_sp sock_id,
+                                  const ci_addr_t laddr, unsigned lport,
+                                  const ci_addr_t raddr, unsigned rport,
+                                  unsigned protocol)
+{
+  ci_netif_filter_bucket* buckets = ip6_buckets(ni);
+  unsigned mask = ni->ip6_filter_table->table_size_mask;
+  ci_uint32 h = IP6_HASH(&laddr, lport, &raddr, rport, protocol);
+  ci_uint32 want = bucket_tag(h) | OO_SP_TO_INT(sock_id);
+  unsigned lfold = ip6_addr_fold(&laddr);
+  unsigned dist, max_dist = buckets[h & mask].max_dist;
+  int i;
+
+  LOG_TC(ci_log("%s: [%d:%d] REMOVE %s " IPX_PORT_FMT "->" IPX_PORT_FMT,
+                __FUNCTION__, NI_ID(ni), OO_SP_FMT(sock_id),
+                CI_IP_PROTOCOL_STR(protocol),
+                IPX_ARG(AF_IP(laddr)), (unsigned) CI_BSWAP_BE16(lport),
+                IPX_ARG(AF_IP(raddr)), (unsigned) CI_BSWAP_BE16(rport)));
+
+  /* The folded local address is not enough to tell apart the entries of a
+   * socket, so this can't use bucket_find_id(). */
+  for( dist = 0; dist <= max_dist; ++dist ) {
+    unsigned b_i = (h + dist) & mask;
+    ci_netif_filter_bucket* b = &buckets[b_i];
+    for( i = 0; i < CI_FILTER_BUCKET_SLOTS; ++i )
+      if( b->slot[i] == want && b->laddr[i] == lfold &&
+          memcmp(laddr.ip6, ip6_laddr(ni, b_i, i),
+                 sizeof(ci_ip6_addr_t)) == 0 ) {
+        bucket_remove(buckets, mask, h, b_i, i, dist);
+        CITP_STATS_NETIF(--ni->state->stats.ipv6_table_n_slots);
+        CITP_STATS_NETIF(--ni->state->stats.ipv6_table_n_entries);
+        if( dist > 0 )
+          CITP_STATS_NETIF(--ni->state->stats.ipv6_table_n_spilled);
+        return;
+      }
+  }
+}
+
+#endif /* CI_CFG_IPV6 */
+
+
+/**********************************************************************
+ * Entry points, dispatched to from netif_table.c.
+ */
+
+oo_sp
+ci_netif_filter_bucket_lookup(ci_netif* ni, int af_space,
+                              ci_addr_t laddr, unsigned lport,
+                              ci_addr_t raddr, unsigned rport,
+                              unsigned protocol)
+{
+  int rc = -ENOENT;
+
+#if CI_CFG_IPV6
+  if( IS_AF_SPACE_IP6(af_space) ) {
+    rc = ci_ip6_netif_filter_bucket_lookup(ni, laddr, lport, raddr, rport,
+                                           protocol);
+    if( rc >= 0 )
+      return OO_SP_FROM_INT(ni, rc);
+  }
+
+  if( IS_AF_SPACE_IP4(af_space) )
+#endif
+    rc = ci_ip4_netif_filter_bucket_lookup(ni, laddr.ip4, lport,
+                                           raddr.ip4, rport, protocol);
+  if( rc >= 0 )
+    return OO_SP_FROM_INT(ni, rc);
+  return OO_SP_NULL;
+}
+
+
+ci_sock_cmn*
+__ci_netif_filter_bucket_lookup(ci_netif* ni, int af_space,
+                                ci_addr_t laddr, unsigned lport,
+                                ci_addr_t raddr, unsigned rport,
+                                unsigned protocol)
+{
+  int rc;
+
+  /* Full match, then wildcard, as __ci_netif_filter_lookup(). */
+#if CI_CFG_IPV6
+  if( IS_AF_SPACE_IP6(af_space) ) {
+    rc = ci_ip6_netif_filter_bucket_lookup(ni, laddr, lport, raddr, rport,
+                                           protocol);
+    if( rc < 0 )
+      rc = ci_ip6_netif_filter_bucket_lookup(ni, laddr, lport, addr_any, 0,
+                                             protocol);
+    if( rc >= 0 )
+      return ID_TO_SOCK(ni, rc);
+  }
+
+  if( IS_AF_SPACE_IP4(af_space) )
+#endif
+  {
+    rc = ci_ip4_netif_filter_bucket_lookup(ni, laddr.ip4, lport,
+                                           raddr.ip4, rport, protocol);
+    if( rc < 0 )
+      rc = ci_ip4_netif_filter_bucket_lookup(ni, laddr.ip4, lport, 0, 0,
+                                             protocol);
+    if( rc >= 0 )
+      return ID_TO_SOCK(ni, rc);
+  }
+
+  return NULL;
+}
+
+
+int
+ci_netif_filter_bucket_insert(ci_netif* ni, oo_sp sock_id, int af_space,
+                              const ci_addr_t laddr, unsigned lport,
+                              const ci_addr_t raddr, unsigned rport,
+                              unsigned protocol)
+{
+  int rc;
+
+  ci_assert(ci_netif_is_locked(ni));
+
+#if CI_CFG_IPV6
+  if( IS_AF_SPACE_IP6(af_space) ) {
+    rc = ci_ip6_netif_filter_bucket_insert(ni, sock_id, laddr, lport,
+                                           CI_IPX_ADDR_IS_ANY(raddr) ?
+                                           addr_any : raddr,
+                                           rport, protocol);
+    if( rc < 0 )
+      return rc;
+  }
+
+  if( IS_AF_SPACE_IP4(af_space) )
+#endif
+  {
+    rc = ci_ip4_netif_filter_bucket_insert(ni, sock_id, laddr.ip4, lport,
+                                           raddr.ip4, rport, protocol);
+    if( rc < 0 )
+      return rc;
+  }
+
+  return 0;
+}
+
+
+void
+ci_netif_filter_bucket_remove(ci_netif* ni, oo_sp sock_id, int af_space,
+                              const ci_addr_t laddr, unsigned lport,
+                              const ci_addr_t raddr, unsigned rport,
+                              unsigned protocol)
+{
+  ci_assert(ci_netif_is_locked(ni)
+#ifdef __KERNEL__
+            /* release_ep_tbl might be called without the stack lock.
+             * Do not complain about this. */
+            || netif2tcp_helper_resource(ni)->ref[OO_THR_REF_BASE] == 0
+#endif
+            );
+
+#if CI_CFG_IPV6
+  if( IS_AF_SPACE_IP6(af_space) )
+    ci_ip6_netif_filter_bucket_remove(ni, sock_id, laddr, lport,
+                                      CI_IPX_ADDR_IS_ANY(raddr) ?
+                                      addr_any : raddr,
+                                      rport, protocol);
+
+  if( IS_AF_SPACE_IP4(af_space) )
+#endif
+    ci_ip4_netif_filter_bucket_remove(ni, sock_id, laddr.ip4, lport,
+                                      raddr.ip4, rport, protocol);
+}
+
+
+unsigned
+ci_netif_filter_bucket_prefetch_entry(ci_netif* ni,
+                                      unsigned laddr, unsigned lport,
+                                      unsigned raddr, unsigned rport,
+                                      unsigned protocol)
+{
+  ci_uint32 h = IP4_HASH(laddr, lport, raddr, rport, protocol);
+  ci_prefetch(&ip4_buckets(ni)[h & ni->filter_table->table_size_mask]);
+  return h;
+}
+
+
+void ci_netif_filter_bucket_prefetch_sock(ci_netif* ni, unsigned h)
+{
+  ci_netif_filter_bucket* b =
+    &ip4_buckets(ni)[h & ni->filter_table->table_size_mask];
+  unsigned matches = bucket_tag_matches(b, bucket_tag(h));
+
+  /* A tag match is very likely the socket that the lookup will find. */
+  if( matches != 0 ) {
+    ci_sock_cmn* s = ID_TO_SOCK(ni, SLOT_ID(b, __builtin_ctz(matches)));
+    ci_prefetch(s);
+    ci_prefetch(&s->pkt);
+  }
+}
+
+
+/**********************************************************************
+ * Debug.
+ */
+
+static void
+bucket_table_dump(ci_netif* ni, ci_netif_filter_bucket* buckets,
+                  unsigned mask, int is_ip6)
+{
+  unsigned b_i;
+  int i;
+
+  for( b_i = 0; b_i <= mask; ++b_i ) {
+    ci_netif_filter_bucket* b = &buckets[b_i];
+    if( b->n_spilled != 0 )
+      log("%08u n_spilled=%u max_dist=%u", b_i, b->n_spilled, b->max_dist);
+    for( i = 0; i < CI_FILTER_BUCKET_SLOTS; ++i ) {
+      ci_sock_cmn* s;
+      ci_addr_t laddr, raddr;
+      if( b->slot[i] == 0 )
+        continue;
+      s = ID_TO_SOCK(ni, SLOT_ID(b, i));
+      raddr = sock_raddr(s);
+#if CI_CFG_IPV6
+      if( is_ip6 )
+        laddr = CI_ADDR_FROM_IP6(ip6_laddr(ni, b_i, i));
+      else
+#endif
+        laddr = CI_ADDR_FROM_IP4(b->laddr[i]);
+      log("%08u:%d id=%-8d tag=%03x %s " IPX_PORT_FMT " " IPX_PORT_FMT,
+          b_i, i, SLOT_ID(b, i), b->slot[i] >> CI_FILTER_BUCKET_ID_BITS,
+          CI_IP_PROTOCOL_STR(sock_protocol(s)),
+          IPX_ARG(AF_IP(laddr)), CI_BSWAP_BE16(b->lport[i]),
+          IPX_ARG(AF_IP(raddr)), CI_BSWAP_BE16(sock_rport_be16(s)));
+    }
+  }
+}
+
+
+void ci_netif_filter_bucket_dump(ci_netif* ni)
+{
+  log("++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++");
+#if CI_CFG_STATS_NETIF
+  log(FN_FMT "buckets=%u n_entries=%i n_spilled=%i max=%i mean=%i "
+      "lookup_spills=%u", FN_PRI_ARGS(ni),
+      ni->filter_table->table_size_mask + 1,
+      ni->state->stats.table_n_entries, ni->state->stats.table_n_spilled,
+      ni->state->stats.table_max_hops, ni->state->stats.table_mean_hops,
+      ni->state->stats.table_lookup_spills);
+#endif
+  bucket_table_dump(ni, ip4_buckets(ni), ni->filter_table->table_size_mask,
+                    0);
+#if CI_CFG_IPV6
+  log("++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++");
+#if CI_CFG_STATS_NETIF
+  log(FN_FMT "buckets=%u n_entries=%i n_spilled=%i max=%i mean=%i "
+      "lookup_spills=%u", FN_PRI_ARGS(ni),
+      ni->ip6_filter_table->table_size_mask + 1,
+      ni->state->stats.ipv6_table_n_entries,
+      ni->state->stats.ipv6_table_n_spilled,
+      ni->state->stats.ipv6_table_max_hops,
+      ni->state->stats.ipv6_table_mean_hops,
+      ni->state->stats.ipv6_table_lookup_spills);
+#endif
+  bucket_table_dump(ni, ip6_buckets(ni),
+                    ni->ip6_filter_table->table_size_mask, 1);
+#endif
+  log("++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++");
+}
+
+#endif /* OO_DO_STACK_POLL */
+
+
+#ifdef __ci_driver__
+
+void ci_netif_filter_bucket_init(ci_netif* ni)
+{
+  unsigned n = ci_netif_filter_n_buckets(ni);
+
+  ci_assert(CI_IS_POW2(n));
+  ni->filter_table->table_size_mask = n - 1;
+  memset(ip4_buckets(ni), 0, sizeof(ci_netif_filter_bucket) * n);
+#if CI_CFG_IPV6
+  n = ci_ip6_netif_filter_n_buckets(ni);
+  ci_assert(CI_IS_POW2(n));
+  ni->ip6_filter_table->table_size_mask = n - 1;
+  memset(ip6_buckets(ni), 0,
+         (sizeof(ci_netif_filter_bucket) +
+          sizeof(ci_ip6_addr_t) * CI_FILTER_BUCKET_SLOTS) * n);
+#endif
+}
+
+#endif /* __ci_driver__ */
+/*! \cidoxg_end */
@@ -124,6 +124,13 @@ ci_netif_filter_for_each_match_ip6(ci_netif* ni,
   ci_addr_t raddr = raddr_ptr == NULL ? addr_any : *((ci_addr_t*)raddr_ptr);
 #endif
 
+  if( NI_OPTS(ni).filter_table_buckets )
+    return ci_netif_filter_bucket_for_each_match_ip6(ni, laddr_ptr, lport,
+                                                     raddr_ptr, rport,
+                                                     protocol, intf_i, vlan,
+                                                     callback, callback_arg,
+                                                     hash_out);
+
   ip6_tbl = ni->ip6_filter_table;
   table_size_mask = ip6_tbl->table_size_mask;
 
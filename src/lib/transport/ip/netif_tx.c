@@ -388,6 +388,34 @@ void __ci_netif_send(ci_netif* netif, ci_ip_pkt_fmt* pkt)
 }
 
 
+/* Queue [pkt] for transmit without posting it to the hardware.  Packets
+ * queued in this way are posted together, with a single doorbell, by
+ * ci_netif_send_batch_push(), which the caller must call for each
+ * interface it has queued packets on before dropping the stack lock.
+ */
+void ci_netif_send_batch_add(ci_netif* netif, ci_ip_pkt_fmt* pkt)
+{
+  ci_assert(ci_netif_is_locked(netif));
+  ci_assert_ge(pkt->intf_i, 0);
+  ci_assert_lt(pkt->intf_i, CI_CFG_MAX_INTERFACES);
+  ci_assert_equal(pkt->q_id, CI_Q_ID_NORMAL);
+  ci_assert_nflags(pkt->flags, CI_PKT_FLAG_INDIRECT);
+
+  __ci_netif_dmaq_insert_prep_pkt(netif, pkt);
+  LOG_NT(log("%s: [%d] id=%d nseg=%d", __FUNCTION__, NI_ID(netif),
+             OO_PKT_FMT(pkt), pkt->n_buffers));
+  __ci_netif_dmaq_put(netif, ci_netif_dmaq(netif, pkt->intf_i), pkt);
+}
+
+
+void ci_netif_send_batch_push(ci_netif* netif, int intf_i)
+{
+  ci_assert(ci_netif_is_locked(netif));
+  if( ci_netif_dmaq_not_empty(netif, intf_i) )
+    ci_netif_dmaq_shove2(netif, intf_i, 0 /*is_fresh*/);
+}
+
+
 /* Transmit the given packet right now, failing if it can't be done
  * (ci_netif_send() will put deferrals on to the dmaq for later). This is a
  * low-level function used by VIs which are used for communicating with
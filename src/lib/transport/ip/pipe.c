@@ -175,6 +175,19 @@ ci_inline void __oo_pipe_wake_peer(ci_netif* ni, struct oo_pipe* p,
     p->b.sb_flags |= wake;
     citp_waitable_wakeup(ni, &p->b);
   }
+
+  /* The writer of one direction of a socketpair polls and sleeps on the
+   * other direction, so that is where it must see space being freed. */
+  if( (wake & CI_SB_FLAG_WAKE_TX) &&
+      (p->aflags & CI_PFD_AFLAG_UNIX_STREAM) ) {
+    struct oo_pipe* peer = SP_TO_PIPE(ni, p->unix_peer);
+    ++peer->b.sleep_seq.rw.tx;
+    ci_mb();
+    if( peer->b.wake_request & CI_SB_FLAG_WAKE_TX ) {
+      peer->b.sb_flags |= CI_SB_FLAG_WAKE_TX;
+      citp_waitable_wakeup(ni, &peer->b);
+    }
+  }
 }
 
 
@@ -186,6 +199,16 @@ void oo_pipe_wake_peer(ci_netif* ni, struct oo_pipe* p, unsigned wake)
 #endif
 
 
+/* Marks an end of [p] as closed before its file is, as shutdown() of a
+ * socketpair does.  [shift] is CI_PFD_AFLAG_READER_SHIFT or
+ * CI_PFD_AFLAG_WRITER_SHIFT. */
+void ci_pipe_shutdown(ci_netif* ni, struct oo_pipe* p, int shift)
+{
+  ci_atomic32_or(&p->aflags, CI_PFD_AFLAG_CLOSED << shift);
+  __oo_pipe_wake_peer(ni, p, CI_SB_FLAG_WAKE_RX | CI_SB_FLAG_WAKE_TX);
+}
+
+
 #if OO_DO_STACK_POLL
 ci_inline ci_uint8* pipe_get_point(ci_netif* ni, struct oo_pipe *p,
                                    ci_ip_pkt_fmt* pkt, ci_uint32 offset)
@@ -327,8 +350,146 @@ oo_pipe_move_read_ptr(ci_netif* ni, struct oo_pipe* p, ci_ip_pkt_fmt** pkt,
 }
 
 
-int ci_pipe_read(ci_netif* ni, struct oo_pipe* p,
-                 const struct iovec *iov, size_t iovlen)
+/* An eventfd is a pipe with no buffers, whose count is kept in efd_count.
+ * Neither reads nor writes take a lock: the count is changed with
+ * compare-and-swap, and the peer is woken as for a pipe, which only goes
+ * into the kernel when something is asleep on the eventfd.
+ */
+ci_inline int oo_eventfd_ready(struct oo_pipe* p, int is_read, ci_uint64 val)
+{
+  ci_uint64 count = OO_ACCESS_ONCE(p->efd_count);
+  return is_read ? count != 0 : count <= OO_EVENTFD_MAX - val;
+}
+
+
+/* Waits until a read can take from the count, or a write can add [val] to
+ * it.  Returns 0 when it can, or -1 with errno set.
+ */
+static int oo_eventfd_wait(ci_netif* ni, struct oo_pipe* p, int is_read,
+                           ci_uint64 val)
+{
+  ci_bits why = is_read ? CI_SB_FLAG_WAKE_RX : CI_SB_FLAG_WAKE_TX;
+  ci_uint64 sleep_seq;
+  int rc;
+
+  if( oo_eventfd_ready(p, is_read, val) )
+    return 0;
+
+  if( p->aflags & (CI_PFD_AFLAG_NONBLOCK << CI_PFD_AFLAG_READER_SHIFT) ) {
+    CI_SET_ERROR(rc, EAGAIN);
+    return rc;
+  }
+
+#ifndef __KERNEL__
+  if( is_read &&
+      (oo_per_thread_get()->spinstate & (1 << ONLOAD_SPIN_PIPE_RECV)) ) {
+    ci_uint64 now_frc, start_frc;
+    ci_uint64 schedule_frc;
+    citp_signal_info* si = citp_signal_get_specific_inited();
+    ci_uint64 max_spin_cycles = p->b.spin_cycles;
+
+    ci_frc64(&now_frc);
+    start_frc = now_frc;
+    schedule_frc = now_frc;
+    do {
+      rc = OO_SPINLOOP_PAUSE_CHECK_SIGNALS(ni, now_frc, &schedule_frc,
+                                           false, NULL, si);
+      if( rc < 0 ) {
+        CI_SET_ERROR(rc, -rc);
+        return rc;
+      }
+      if( oo_eventfd_ready(p, is_read, val) )
+        return 0;
+      ci_frc64(&now_frc);
+#if CI_CFG_SPIN_STATS
+      ni->state->stats.spin_pipe_read++;
+#endif
+    } while( now_frc - start_frc < max_spin_cycles );
+  }
+#endif
+
+  while( 1 ) {
+    sleep_seq = p->b.sleep_seq.all;
+    ci_rmb();
+    if( oo_eventfd_ready(p, is_read, val) )
+      return 0;
+    rc = ci_sock_sleep(ni, &p->b, why, 0, sleep_seq, 0);
+    if( rc < 0 ) {
+      CI_SET_ERROR(rc, -rc);
+      return rc;
+    }
+  }
+}
+
+
+int ci_eventfd_read(ci_netif* ni, struct oo_pipe* p,
+                    const struct iovec *iov, size_t iovlen)
+{
+  ci_uint64 count, val;
+  int rc;
+
+  ci_assert(p->aflags & CI_PFD_AFLAG_EVENTFD);
+
+  if( iovlen == 0 || iov[0].iov_len < sizeof(val) ) {
+    CI_SET_ERROR(rc, EINVAL);
+    return rc;
+  }
+
+  do {
+    if( (rc = oo_eventfd_wait(ni, p, 1, 0)) < 0 )
+      return rc;
+    count = OO_ACCESS_ONCE(p->efd_count);
+    val = (p->aflags & CI_PFD_AFLAG_EFD_SEMAPHORE) ? 1 : count;
+  } while( count == 0 ||
+           ! ci_cas64u_succeed(&p->efd_count, count, count - val) );
+
+  __oo_pipe_wake_peer(ni, p, CI_SB_FLAG_WAKE_TX);
+
+  if(CI_UNLIKELY( do_copy_read(iov[0].iov_base, &val, sizeof(val)) != 0 )) {
+    CI_SET_ERROR(rc, EFAULT);
+    return rc;
+  }
+  return sizeof(val);
+}
+
+
+int ci_eventfd_write(ci_netif* ni, struct oo_pipe* p,
+                     const struct iovec *iov, size_t iovlen)
+{
+  ci_uint64 count, val;
+  int rc;
+
+  ci_assert(p->aflags & CI_PFD_AFLAG_EVENTFD);
+
+  if( iovlen == 0 || iov[0].iov_len < sizeof(val) ) {
+    CI_SET_ERROR(rc, EINVAL);
+    return rc;
+  }
+  if(CI_UNLIKELY( do_copy_write(&val, iov[0].iov_base, sizeof(val)) != 0 )) {
+    CI_SET_ERROR(rc, EFAULT);
+    return rc;
+  }
+  if( val > OO_EVENTFD_MAX ) {
+    CI_SET_ERROR(rc, EINVAL);
+    return rc;
+  }
+
+  do {
+    if( (rc = oo_eventfd_wait(ni, p, 0, val)) < 0 )
+      return rc;
+    count = OO_ACCESS_ONCE(p->efd_count);
+  } while( count > OO_EVENTFD_MAX - val ||
+           ! ci_cas64u_succeed(&p->efd_count, count, count + val) );
+
+  __oo_pipe_wake_peer(ni, p, CI_SB_FLAG_WAKE_RX);
+  return sizeof(val);
+}
+
+
+/* As ci_pipe_read(), but MSG_DONTWAIT in [flags] makes the read
+ * non-blocking. */
+int ci_pipe_recv(ci_netif* ni, struct oo_pipe* p,
+                 const struct iovec *iov, size_t iovlen, int flags)
 {
   int bytes_available;
   int rc;
@@ -350,8 +511,9 @@ int ci_pipe_read(ci_netif* ni, struct oo_pipe* p,
   bytes_available = oo_pipe_data_len(p);
   if( bytes_available == 0 ) {
     if( (rc = oo_pipe_read_wait(ni, p,
-                                p->aflags & (CI_PFD_AFLAG_NONBLOCK <<
-                                             CI_PFD_AFLAG_READER_SHIFT))) != 1 )
+                                (flags & MSG_DONTWAIT) ||
+                                (p->aflags & (CI_PFD_AFLAG_NONBLOCK <<
+                                              CI_PFD_AFLAG_READER_SHIFT)))) != 1 )
       goto out;
   }
 
@@ -420,6 +582,16 @@ int ci_pipe_read(ci_netif* ni, struct oo_pipe* p,
 }
 
 
+int ci_pipe_read(ci_netif* ni, struct oo_pipe* p,
+                 const struct iovec *iov, size_t iovlen)
+{
+  /* The kernel's read() of an eventfd comes here. */
+  if( p->aflags & CI_PFD_AFLAG_EVENTFD )
+    return ci_eventfd_read(ni, p, iov, iovlen);
+  return ci_pipe_recv(ni, p, iov, iovlen, 0);
+}
+
+
 ci_inline void oo_pipe_signal(ci_netif* ni)
 {
 #ifndef __KERNEL__
@@ -1750,9 +1922,10 @@ int ci_pipe_zc_move(ci_netif* ni, struct oo_pipe* pipe_src,
 #endif
 
 
-int ci_pipe_write(ci_netif* ni, struct oo_pipe* p,
-                  const struct iovec *iov,
-                  size_t iovlen)
+/* As ci_pipe_write(), but MSG_DONTWAIT in [flags] makes the write
+ * non-blocking, and MSG_NOSIGNAL suppresses SIGPIPE. */
+int ci_pipe_send(ci_netif* ni, struct oo_pipe* p,
+                 const struct iovec *iov, size_t iovlen, int flags)
 {
   int total_bytes = 0, rc;
   int i;
@@ -1792,7 +1965,8 @@ int ci_pipe_write(ci_netif* ni, struct oo_pipe* p,
     /* send sigpipe: not sure if anything can be done
      * in case of failure*/
     CI_SET_ERROR(rc, EPIPE);
-    oo_pipe_signal(ni);
+    if( ! (flags & MSG_NOSIGNAL) )
+      oo_pipe_signal(ni);
     goto out;
   }
 
@@ -1866,8 +2040,9 @@ int ci_pipe_write(ci_netif* ni, struct oo_pipe* p,
         }
         ci_assert_nequal(pkt, NULL);
         p->write_ptr.pp_wait = pkt->next;
-        if( p->aflags &
-            (CI_PFD_AFLAG_NONBLOCK << CI_PFD_AFLAG_WRITER_SHIFT) ) {
+        if( (flags & MSG_DONTWAIT) ||
+            (p->aflags &
+             (CI_PFD_AFLAG_NONBLOCK << CI_PFD_AFLAG_WRITER_SHIFT)) ) {
           /* Since we're non-blocking, [add] is the total count of bytes we've
            * written. */
           if( add > 0 )
@@ -1886,7 +2061,7 @@ int ci_pipe_write(ci_netif* ni, struct oo_pipe* p,
 
       if( total_bytes )
         __oo_pipe_wake_peer(ni, p, CI_SB_FLAG_WAKE_RX);
-      rc = oo_pipe_wait_write(ni, p, 0, &stack_locked);
+      rc = oo_pipe_wait_write(ni, p, flags, &stack_locked);
       if (rc != 0) {
         if( total_bytes ) {
           /* Partial write followed by failed wait is success. */
@@ -1934,6 +2109,14 @@ int ci_pipe_write(ci_netif* ni, struct oo_pipe* p,
 }
 
 
+int ci_pipe_write(ci_netif* ni, struct oo_pipe* p,
+                  const struct iovec *iov,
+                  size_t iovlen)
+{
+  return ci_pipe_send(ni, p, iov, iovlen, 0);
+}
+
+
 #if OO_DO_STACK_POLL
 static void oo_pipe_free_bufs(ci_netif* ni, struct oo_pipe* p)
 {
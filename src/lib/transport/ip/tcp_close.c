@@ -674,6 +674,16 @@ void ci_tcp_listen_shutdown_queues(ci_netif* netif, ci_tcp_socket_listen* tls)
     ci_tcp_state* ats;    /* accepted ts */
 
     w = ci_tcp_acceptq_get(netif, tls);
+    if( w == NULL ) {
+      /* An accept sub-queue that is not empty is locked by a thread that
+       * is accepting from it.  The lock is held only briefly, or taken
+       * over once its holder is found to be dead, so try again.  A
+       * concurrent accept() emptying the sub-queues ends the loop. */
+#ifdef __KERNEL__
+      cond_resched();
+#endif
+      continue;
+    }
 
 #if defined(__KERNEL__) && CI_CFG_ENDPOINT_MOVE
     if( w->sb_aflags & CI_SB_AFLAG_MOVED_AWAY ) {
@@ -21,6 +21,7 @@
 
 #ifndef __KERNEL__
 #include <ci/internal/efabcfg.h>
+#include <signal.h>
 #endif
 
 #if OO_DO_STACK_POLL
@@ -1606,6 +1607,17 @@ int ci_tcp_listen_init(ci_netif *ni, ci_tcp_socket_listen *tls)
   tls->acceptq_n_in = tls->acceptq_n_out = 0;
   tls->acceptq_put = CI_ILL_END;
   tls->acceptq_get = OO_SP_NULL;
+#if CI_CFG_TCP_ACCEPTQ_SHARDS
+  tls->acceptq_shards_n = NI_OPTS(ni).tcp_acceptq_shards;
+  for( i = 0; i < CI_CFG_TCP_ACCEPTQ_SHARDS; ++i ) {
+    tls->acceptq_shard[i].put = CI_ILL_END;
+    tls->acceptq_shard[i].get = OO_SP_NULL;
+    tls->acceptq_shard[i].lock = 0;
+    tls->acceptq_shard[i].n_in = tls->acceptq_shard[i].n_out = 0;
+    tls->acceptq_shard[i].swizzle = OO_SP_NULL;
+    tls->acceptq_shard[i].swizzle_next = OO_SP_NULL;
+  }
+#endif
   tls->n_listenq = 0;
   tls->n_listenq_new = 0;
 
@@ -1641,6 +1653,89 @@ int ci_tcp_listen_init(ci_netif *ni, ci_tcp_socket_listen *tls)
 }
 
 
+#if CI_CFG_TCP_ACCEPTQ_SHARDS
+ci_uint32 ci_tcp_acceptq_shard_owner(void)
+{
+#ifdef __KERNEL__
+  return task_tgid_vnr(current);
+#else
+  return getpid();
+#endif
+}
+
+
+static int ci_tcp_acceptq_shard_owner_dead(ci_uint32 owner)
+{
+#ifdef __KERNEL__
+  struct task_struct* task;
+
+  rcu_read_lock();
+  task = pid_task(find_vpid(owner), PIDTYPE_PID);
+  rcu_read_unlock();
+  return task == NULL;
+#else
+  return kill(owner, 0) < 0 && errno == ESRCH;
+#endif
+}
+
+
+int ci_tcp_acceptq_shard_lock_slow(ci_netif* ni, ci_tcp_acceptq_shard* sh,
+                                   ci_uint32 owner)
+{
+  ci_uint32 holder = 0;
+  unsigned i;
+
+  for( i = 0; i < CI_TCP_ACCEPTQ_SHARD_LOCK_SPINS; ++i ) {
+    ci_spinloop_pause();
+    holder = sh->lock;
+    if( holder == 0 && ci_cas32u_succeed(&sh->lock, 0, owner) )
+      return 1;
+  }
+
+  if( holder != 0 && holder != owner &&
+      ci_tcp_acceptq_shard_owner_dead(holder) &&
+      ci_cas32u_succeed(&sh->lock, holder, owner) ) {
+    CITP_STATS_NETIF_INC(ni, acceptq_shard_lock_steals);
+    ci_tcp_acceptq_shard_repair(ni, sh);
+    return 1;
+  }
+  CITP_STATS_NETIF_INC(ni, acceptq_shard_lock_timeouts);
+  return 0;
+}
+
+
+/* The holder may have been stopped anywhere in
+ * __ci_tcp_acceptq_shard_swizzle(): before taking [put], in which case
+ * [swizzle] is still on it, or part way through moving [swizzle] to [get].
+ * Popping a connection is a single store and needs no repair.
+ */
+void ci_tcp_acceptq_shard_repair(ci_netif* ni, ci_tcp_acceptq_shard* sh)
+{
+  ci_int32 p;
+
+  if( OO_SP_IS_NULL(sh->swizzle) )
+    return;
+
+  for( p = sh->put; p >= 0;
+       p = OO_SP_TO_INT(SP_TO_WAITABLE(ni, OO_SP_FROM_INT(ni, p))->wt_next) )
+    if( OO_SP_EQ(OO_SP_FROM_INT(ni, p), sh->swizzle) ) {
+      sh->swizzle = OO_SP_NULL;
+      return;
+    }
+
+  if( ! OO_SP_EQ(sh->swizzle_next, sh->swizzle) ) {
+    if( OO_SP_EQ(sh->get, sh->swizzle) )
+      /* Moved to [get], but [swizzle] not advanced. */
+      sh->swizzle = sh->swizzle_next;
+    else
+      /* Not moved yet, but wt_next may already be overwritten. */
+      SP_TO_WAITABLE(ni, sh->swizzle)->wt_next = sh->swizzle_next;
+  }
+  __ci_tcp_acceptq_shard_swizzle(ni, sh);
+}
+#endif
+
+
 #ifdef __KERNEL__
 int ci_tcp_connect_lo_samestack(ci_netif *ni, ci_tcp_state *ts, oo_sp tls_id,
                                 int *stack_locked)
@@ -1720,6 +1815,9 @@ int ci_tcp_connect_lo_toconn(ci_netif *c_ni, oo_sp c_id, ci_addr_t dst,
 
   tls->acceptq_max = 1;
   rc = ci_tcp_listen_init(c_ni, tls);
+#if CI_CFG_TCP_ACCEPTQ_SHARDS
+  tls->acceptq_shards_n = 0;
+#endif
   if( rc != 0 ) {
     citp_waitable_obj_free(c_ni, &tls->s.b);
     ci_netif_unlock(c_ni);
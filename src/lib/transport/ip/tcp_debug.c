@@ -689,6 +689,15 @@ void ci_tcp_socket_listen_dump(ci_netif* ni, ci_tcp_socket_listen* tls,
          tls->n_buckets);
   logger(log_arg, "%s  acceptq: max=%d n=%d accepted=%d", pf,
          tls->acceptq_max, ci_tcp_acceptq_n(tls), tls->acceptq_n_out);
+#if CI_CFG_TCP_ACCEPTQ_SHARDS
+  {
+    unsigned i;
+    for( i = 0; i < tls->acceptq_shards_n; ++i )
+      logger(log_arg, "%s  acceptq[%u]: n=%d accepted=%d", pf, i,
+             tls->acceptq_shard[i].n_in - tls->acceptq_shard[i].n_out,
+             tls->acceptq_shard[i].n_out);
+  }
+#endif
   logger(log_arg, "%s  defer_accept=%d", pf, tls->c.tcp_defer_accept);
 #if CI_CFG_FD_CACHING
   logger(log_arg, "%s  sockcache: n=%d sock_n=%d cache=%s pending=%s connected=%s",
@@ -842,6 +851,9 @@ void ci_tcp_state_dump(ci_netif* ni, ci_tcp_state* ts,
   logger(log_arg, "%s  tmpl: send_fast=%u send_slow=%u active=%u", pf,
          stats.tx_tmpl_send_fast, stats.tx_tmpl_send_slow,
          stats.tx_tmpl_active);
+  if( stats.tx_zc_sends | stats.tx_zc_unregistered )
+    logger(log_arg, "%s  tx: zc_sends=%u zc_unregistered=%u", pf,
+           stats.tx_zc_sends, stats.tx_zc_unregistered);
 #if CI_CFG_TCP_OFFLOAD_RECYCLER
   logger(log_arg, "%s  plugin: stream_id=%x ddr_base=%"PRIx64
                   " ddr_size=%"PRIx64,
@@ -23,7 +23,9 @@
 
 int ci_tcp_helper_more_bufs(ci_netif* ni)
 {
-  return efab_tcp_helper_more_bufs(netif2tcp_helper_resource(ni));
+  /* We may be called from any context here, so leave anything that needs
+   * to sleep to the unlock path. */
+  return efab_tcp_helper_more_bufs(netif2tcp_helper_resource(ni), 0);
 }
 
 int ci_tcp_helper_more_socks(ci_netif* ni)
@@ -631,7 +631,7 @@ static int ci_tcp_recvmsg_spin(ci_netif* ni, ci_tcp_state* ts,
   ci_uint64 now_frc;
   ci_uint64 schedule_frc = start_frc;
   citp_signal_info* si = citp_signal_get_specific_inited();
-  ci_uint64 max_spin = ts->s.b.spin_cycles;
+  ci_uint64 max_spin = ci_sock_spin_budget(ni, &ts->s.b, ts->s.b.spin_cycles);
   int rc, spin_limit_by_so = 0;
 
   /* Cache the next expected packet buffer to save work within the loop.
@@ -647,6 +647,9 @@ static int ci_tcp_recvmsg_spin(ci_netif* ni, ci_tcp_state* ts,
   const uint32_t poison = CI_PKT_RX_POISON;
   const volatile uint32_t* future = ci_netif_intf_rx_future(ni, intf_i, &poison);
 
+  if( max_spin == 0 )
+    return 0;
+
   if( ts->s.so.rcvtimeo_msec ) {
     ci_uint64 max_so_spin = (ci_uint64)ts->s.so.rcvtimeo_msec *
         IPTIMER_STATE(ni)->khz;
@@ -700,6 +703,8 @@ static int ci_tcp_recvmsg_spin(ci_netif* ni, ci_tcp_state* ts,
   rc = spin_limit_by_so ? -EAGAIN : 0;
  out:
   ni->state->is_spinner = 0;
+  ci_frc64(&now_frc);
+  ci_sock_spin_done(ni, &ts->s.b, start_frc, now_frc, rc > 0);
   return rc;
 }
 #endif
@@ -752,6 +757,7 @@ static inline int ci_tcp_recvmsg_impl(const ci_tcp_recvmsg_args* a,
   ci_uint64             start_frc = 0; /* suppress compiler warning */
 #ifndef __KERNEL__
   unsigned              tcp_recv_spin = 0;
+  int                   spin_adapt_pending = 0;
 #endif
   ci_uint32             timeout = ts->s.so.rcvtimeo_msec;
   struct tcp_recv_info  rinf;
@@ -903,8 +909,15 @@ static inline int ci_tcp_recvmsg_impl(const ci_tcp_recvmsg_args* a,
     }
 
     tcp_recv_spin = 0;
+    spin_adapt_pending = NI_OPTS(ni).spin_adaptive;
     if( timeout ) {
       ci_uint32 spin_ms = NI_OPTS(ni).spin_usec >> 10;
+      if( NI_OPTS(ni).spin_adaptive ) {
+        /* We may have spun for less than EF_SPIN_USEC, or not at all. */
+        ci_uint64 now_frc;
+        ci_frc64(&now_frc);
+        spin_ms = (now_frc - start_frc) / IPTIMER_STATE(ni)->khz;
+      }
       if( spin_ms < timeout )
         timeout -= spin_ms;
       else {
@@ -936,6 +949,16 @@ static inline int ci_tcp_recvmsg_impl(const ci_tcp_recvmsg_args* a,
     rc2 = ci_sock_sleep(ni, &ts->s.b, CI_SB_FLAG_WAKE_RX,
                         CI_SLEEP_SOCK_LOCKED | CI_SLEEP_SOCK_RQ,
                         sleep_seq, &timeout);
+#ifndef __KERNEL__
+    if( rc2 == 0 && spin_adapt_pending ) {
+      /* Woken after spinning in vain, so let the adaptive spin know how
+       * long this wait really was. */
+      ci_uint64 now_frc;
+      ci_frc64(&now_frc);
+      oo_spin_adapt_update(&ts->s.b.spin_adapt, now_frc - start_frc);
+      spin_adapt_pending = 0;
+    }
+#endif
     if( rc2 == 0 )
       rc2 = ci_sock_lock(ni, &ts->s.b);
     if( rc2 < 0 ) {
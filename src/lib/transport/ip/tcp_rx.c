@@ -2093,6 +2093,40 @@ void ci_tcp_rx_deliver2(ci_tcp_state* ts, ci_netif* netif,
 }
 
 
+/* EF_TCP_LOOPBACK_DIRECT: append [pkt], an in-order data segment from the
+ * loopback peer of [ts], to the receive queue.  This is what the fast path
+ * of ci_tcp_rx_deliver_to_conn() does, without looking at the headers and
+ * without scheduling an ACK: the sender has already taken this data as
+ * acknowledged.  The caller has checked that [ts] can use the fast path.
+ */
+void ci_tcp_rx_loopback_direct(ci_netif* ni, ci_tcp_state* ts,
+                               ci_ip_pkt_fmt* pkt, int pay_len)
+{
+  ci_tcp_hdr* tcp = PKT_IPX_TCP_HDR(oo_pkt_af(pkt), pkt);
+
+  ci_assert(ci_netif_is_locked(ni));
+  ci_assert(ts->s.b.state & CI_TCP_STATE_ACCEPT_DATA);
+  ci_assert(ci_ip_queue_is_empty(&ts->rob));
+  ci_assert_equal(pkt->pf.tcp_rx.end_seq, tcp_rcv_nxt(ts) + pay_len);
+
+  CI_IP_SOCK_STATS_ADD_RXBYTE(ts, pay_len);
+  ++ts->stats.rx_pkts;
+  ts->t_last_recv_payload = ci_tcp_time_now(ni);
+  pkt->pf.tcp_rx.pay_len = pay_len;
+
+  oo_offbuf_init(&pkt->buf, (char*) tcp + CI_TCP_HDR_LEN(tcp), pay_len);
+  ci_tcp_rx_enqueue_packet(ni, ts, pkt);
+
+  if( ni->state->in_poll ) {
+    ci_netif_put_on_post_poll(ni, &ts->s.b);
+    ci_tcp_wake(ni, ts, CI_SB_FLAG_WAKE_RX);
+  }
+  else {
+    ci_tcp_wake_not_in_poll(ni, ts, CI_SB_FLAG_WAKE_RX);
+  }
+}
+
+
 /*
  * Clean up re-order buffer starting from the packet pkt. This packet
  * should be the first packet of some block. If the first block can be
@@ -192,16 +192,71 @@ static void ci_ip_tcp_list_to_dmaq_striping(ci_netif* ni, ci_tcp_state* ts,
 }
 #endif
 
+/* EF_TCP_LOOPBACK_DIRECT: returns the peer of [ts] if it is a connected
+ * socket that may be given data directly, else NULL. */
+static ci_tcp_state* ci_tcp_loopback_direct_peer(ci_netif* ni,
+                                                 ci_tcp_state* ts)
+{
+  citp_waitable* w_peer;
+  ci_tcp_state* peer;
+
+  if( ! NI_OPTS(ni).tcp_loopback_direct || OO_SP_IS_NULL(ts->local_peer) )
+    return NULL;
+  w_peer = ID_TO_WAITABLE(ni, ts->local_peer);
+  if( ~w_peer->state & CI_TCP_STATE_TCP_CONN )
+    return NULL;
+  peer = (ci_tcp_state*) w_peer;
+  if( peer->local_peer != S_SP(ts) || ci_tcp_is_pluginized(peer) )
+    return NULL;
+  return peer;
+}
+
+
+/* Put [pkt] straight into the receive queue of [peer] if it is an in-order
+ * data segment that the peer's fast receive path would accept.  Returns
+ * false if it must go via the loopback queue instead. */
+static int ci_tcp_loopback_direct(ci_netif* ni, ci_tcp_state* ts,
+                                  ci_tcp_state* peer, ci_ip_pkt_fmt* pkt)
+{
+  const ci_tcp_hdr* tcp = TX_PKT_IPX_TCP(ipcache_af(&ts->s.pkt), pkt);
+  ci_uint32 start_seq = pkt->pf.tcp_tx.start_seq;
+  ci_uint32 end_seq = pkt->pf.tcp_tx.end_seq;
+
+  if( (tcp->tcp_flags & ~(CI_TCP_FLAG_ACK | CI_TCP_FLAG_PSH)) ||
+      ! SEQ_LT(start_seq, end_seq) ||
+      start_seq != tcp_rcv_nxt(peer) ||
+      SEQ_LT(tcp_rcv_wnd_right_edge_sent(peer), end_seq) ||
+      peer->fast_path_check == ~CI_TCP_FAST_PATH_MASK ||
+      pkt->n_buffers != 1 ||
+      (ni->state->mem_pressure & OO_MEM_PRESSURE_CRITICAL) )
+    return 0;
+
+  LOG_NT(ci_log(NS_FMT "loopback direct pkt %d to %d",
+                NS_PRI_ARGS(ni, &ts->s), OO_PKT_FMT(pkt), S_FMT(peer)));
+  /* tcp_rx.end_seq aliases tcp_tx.end_seq. */
+  ci_netif_loopback_pkt_to_rx(ni, pkt);
+  ci_tcp_rx_loopback_direct(ni, peer, pkt, SEQ_SUB(end_seq, start_seq));
+  /* The data is in the peer's receive queue, which is all that an ACK
+   * would tell us. */
+  ts->snd_una = end_seq;
+  CITP_STATS_NETIF_INC(ni, tcp_loopback_direct);
+  return 1;
+}
+
+
 static void ci_ip_send_tcp_list_loopback(ci_netif* ni, ci_tcp_state* ts,
                                          oo_pkt_p head_id,
                                          ci_ip_pkt_fmt* tail_pkt)
 {
   ci_ip_pkt_fmt* pkt;
+  ci_tcp_state* direct_peer;
   oo_pkt_p pp;
+  int n_queued = 0;
   
   ci_assert(ci_netif_is_locked(ni));
   ci_assert(ts->s.pkt.flags & CI_IP_CACHE_IS_LOCALROUTE);
 
+  direct_peer = ci_tcp_loopback_direct_peer(ni, ts);
   pp = head_id;
   do {
     pkt = PKT_CHK(ni, pp);
@@ -212,6 +267,10 @@ static void ci_ip_send_tcp_list_loopback(ci_netif* ni, ci_tcp_state* ts,
       ci_netif_pkt_release(ni, pkt);
       continue;
     }
+    if( direct_peer != NULL &&
+        ci_tcp_loopback_direct(ni, ts, direct_peer, pkt) )
+      continue;
+    ++n_queued;
     pkt->next = ni->state->looppkts;
     ni->state->looppkts = OO_PKT_ID(pkt);
     ni->state->n_looppkts++;
@@ -228,7 +287,7 @@ static void ci_ip_send_tcp_list_loopback(ci_netif* ni, ci_tcp_state* ts,
      * Loopback in-packet ACK value is ignored - deliver it now! */
     if( SEQ_LE(ts->ack_trigger, ts->rcv_delivered) )
       ci_tcp_send_ack_loopback(ni, ts);
-    if( !ni->state->in_poll )
+    if( !ni->state->in_poll && n_queued != 0 )
       ci_netif_poll(ni);
   }
 }
@@ -938,6 +997,7 @@ int ci_tcp_retrans_one(ci_tcp_state* ts, ci_netif* netif, ci_ip_pkt_fmt* pkt)
 
   CITP_STATS_NETIF_INC(netif, retransmits);
   ++ts->stats.total_retrans;
+  ci_netif_flight_rec(netif, OO_FR_RETRANS, ts->stats.total_retrans, S_ID(ts));
 
   tcp = TX_PKT_IPX_TCP(af, pkt);
 
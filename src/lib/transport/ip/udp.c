@@ -296,6 +296,12 @@ void ci_udp_state_dump(ci_netif* ni, ci_udp_state* us, const char* pf,
          percent(uss.n_tx_cp_uc_lookup + uss.n_tx_cp_a_lookup,
                  uss.n_tx_onload_uc),
          OOFA_IPCACHE_STATE(ni, ipcache));
+  if( uss.n_tx_cp_cache_hit + uss.n_tx_cp_cache_miss )
+    logger(log_arg, "%s  snd: TO cache hit=%u(%u%%) miss=%u", pf,
+           uss.n_tx_cp_cache_hit,
+           percent(uss.n_tx_cp_cache_hit,
+                   uss.n_tx_cp_cache_hit + uss.n_tx_cp_cache_miss),
+           uss.n_tx_cp_cache_miss);
   logger(log_arg, "%s  snd: TO "OOF_IPCACHE_DETAIL, pf,
          OOFA_IPCACHE_DETAIL(ipcache));
   logger(log_arg, "%s  snd: TO "OOF_IPXPORT" => "OOF_IPXPORT, pf,
@@ -312,8 +318,9 @@ void ci_udp_state_dump(ci_netif* ni, ci_udp_state* us, const char* pf,
 
   logger(log_arg, "%s  snd: eagain=%d spin=%d block=%d", pf,
          uss.n_tx_eagain, uss.n_tx_spin, uss.n_tx_block);
-  logger(log_arg, "%s  snd: poll_avoids_full=%d fragments=%d confirm=%d", pf,
-         uss.n_tx_poll_avoids_full, uss.n_tx_fragments, uss.n_tx_msg_confirm);
+  logger(log_arg, "%s  snd: poll_avoids_full=%d fragments=%d confirm=%d "
+         "mmsg_batch=%d", pf, uss.n_tx_poll_avoids_full, uss.n_tx_fragments,
+         uss.n_tx_msg_confirm, uss.n_tx_mmsg_batch);
   logger(log_arg,
          "%s  snd: os_slow=%d os_late=%d unconnect_late=%d nomac=%u(%u%%)", pf,
          uss.n_tx_os_slow, uss.n_tx_os_late, uss.n_tx_unconnect_late,
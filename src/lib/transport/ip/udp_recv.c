@@ -680,6 +680,7 @@ struct recvmsg_spinstate {
   int spin_limit_by_so;
   ci_uint32 timeout;
 #ifndef __KERNEL__
+  int adapt_pending;
   uint32_t poison;
   const volatile uint32_t* future;
   citp_signal_info* si;
@@ -800,6 +801,7 @@ ci_udp_recvmsg_socklocked_spin(ci_netif* ni, ci_udp_state* us,
                                            &us->s.b, spin_state->si);
   }
   else {
+    ci_sock_spin_done(ni, &us->s.b, spin_state->start_frc, now_frc, 0);
     if( spin_state->spin_limit_by_so ) {
       ++us->stats.n_rx_eagain;
       return -EAGAIN;
@@ -807,6 +809,9 @@ ci_udp_recvmsg_socklocked_spin(ci_netif* ni, ci_udp_state* us,
 
     if( spin_state->timeout ) {
       ci_uint32 spin_ms = NI_OPTS(ni).spin_usec >> 10;
+      if( NI_OPTS(ni).spin_adaptive )
+        /* We may have spun for less than EF_SPIN_USEC. */
+        spin_ms = (now_frc - spin_state->start_frc) / IPTIMER_STATE(ni)->khz;
       if( spin_ms < spin_state->timeout )
         spin_state->timeout -= spin_ms;
       else {
@@ -934,7 +939,12 @@ ci_udp_recvmsg_common(ci_udp_recv_info *rinf)
       spin_state.poison = CI_PKT_RX_POISON;
       spin_state.future = &spin_state.poison;
       spin_state.schedule_frc = spin_state.start_frc;
-      spin_state.max_spin = us->s.b.spin_cycles;
+      spin_state.max_spin = ci_sock_spin_budget(ni, &us->s.b,
+                                                us->s.b.spin_cycles);
+      spin_state.adapt_pending = NI_OPTS(ni).spin_adaptive;
+      if( spin_state.max_spin == 0 )
+        /* EF_SPIN_ADAPTIVE expects a long wait, so don't spin. */
+        spin_state.do_spin = 0;
       if( us->s.so.rcvtimeo_msec ) {
         ci_uint64 max_so_spin = (ci_uint64)us->s.so.rcvtimeo_msec *
             IPTIMER_STATE(ni)->khz;
@@ -971,6 +981,20 @@ ci_udp_recvmsg_common(ci_udp_recv_info *rinf)
   CI_SET_ERROR(rc, -rc);
 
  out:
+#ifndef __KERNEL__
+  if( rc >= 0 && spin_state.do_spin > 0 ) {
+    ci_uint64 now_frc;
+    ci_frc64(&now_frc);
+    ci_sock_spin_done(ni, &us->s.b, spin_state.start_frc, now_frc, 1);
+  }
+  else if( rc >= 0 && spin_state.adapt_pending ) {
+    /* Blocked, so let the adaptive spin know how long this wait really
+     * was. */
+    ci_uint64 now_frc;
+    ci_frc64(&now_frc);
+    oo_spin_adapt_update(&us->s.b.spin_adapt, now_frc - spin_state.start_frc);
+  }
+#endif
   ni->state->is_spinner = 0;
   return rc;
 
@@ -1020,6 +1044,93 @@ int ci_udp_recvmsg(ci_udp_iomsg_args *a, ci_msghdr* msg, int flags)
 
 
 #ifndef __KERNEL__
+/* Receive up to [vlen] datagrams that are already in the receive queue in
+ * one pass, without polling, spinning or looking at the OS socket.  The
+ * socket lock must be held.  Returns the number of datagrams received, which
+ * is zero if the queue is empty or the fast path does not apply.
+ *
+ * The packets are not consumed one at a time with ci_udp_recv_q_get() and
+ * ci_udp_recv_q_deliver(): the queue is walked from [q->extract], and
+ * [q->extract] and [q->pkts_delivered] are only updated at the end.  Until
+ * [q->extract] moves, the reaper will not free any of the packets we are
+ * copying from.
+ */
+static int ci_udp_recvmmsg_batch(ci_udp_recv_info* rinf,
+                                 struct mmsghdr* mmsg, unsigned vlen)
+{
+  ci_netif* ni = rinf->a->ni;
+  ci_udp_state* us = rinf->a->us;
+  ci_udp_recv_q* q = &us->recv_q;
+  ci_ip_pkt_fmt* pkt;
+  ci_ip_pkt_fmt* last = NULL;
+  ci_iovec_ptr piov;
+  ci_msghdr* msg;
+  unsigned avail, delivered = 0;
+  int n = 0, rc;
+
+  ci_assert(rinf->sock_locked);
+
+  if( (rinf->flags & (MSG_PEEK | MSG_ERRQUEUE_CHK | MSG_OOB_CHK)) |
+      (us->udpflags & CI_UDPF_PEEK_FROM_OS) |
+#if CI_CFG_ZC_RECV_FILTER
+      (us->recv_q_filter != 0) |
+#endif
+      ni->state->rxq_low | us->s.so_error )
+    return 0;
+
+  avail = q->pkts_added - q->pkts_delivered;
+  if( avail == 0 )
+    return 0;
+  /* See ci_udp_recv_q_get(). */
+  ci_mb();
+
+  pkt = PKT_CHK_NNL(ni, q->extract);
+  if( pkt->rx_flags & CI_PKT_RX_FLAG_RECV_Q_CONSUMED )
+    pkt = PKT_CHK_NNL(ni, OO_ACCESS_ONCE(pkt->udp_rx_next));
+
+  while( 1 ) {
+    msg = &mmsg[n].msg_hdr;
+    if(CI_UNLIKELY( msg->msg_iovlen == 0 || msg->msg_iov == NULL ))
+      break;
+    ci_assert_nflags(pkt->rx_flags, CI_PKT_RX_FLAG_RECV_Q_CONSUMED);
+
+    rinf->msg_flags = 0;
+    if(CI_UNLIKELY( us->s.cmsg_flags != 0 ))
+      ci_ip_cmsg_recv(ni, us, pkt, msg, 0, &rinf->msg_flags);
+    else
+      msg->msg_controllen = 0;
+
+    ci_iovec_ptr_init_nz(&piov, msg->msg_iov, msg->msg_iovlen);
+    rc = oo_copy_pkt_to_iovec_no_adv(ni, pkt, &piov, pkt->pf.udp.pay_len);
+    if(CI_UNLIKELY( rc < 0 ))
+      break;
+    if(CI_UNLIKELY( rc < pkt->pf.udp.pay_len ))
+      rinf->msg_flags |= LOCAL_MSG_TRUNC;
+    ci_udp_recvmsg_fill_msghdr(ni, msg, pkt, &us->s);
+    msg->msg_flags = rinf->msg_flags;
+    mmsg[n].msg_len = rc;
+
+    pkt->rx_flags |= CI_PKT_RX_FLAG_RECV_Q_CONSUMED;
+    delivered += pkt->n_buffers;
+    last = pkt;
+    if( ++n == vlen || delivered == avail )
+      break;
+    pkt = PKT_CHK_NNL(ni, OO_ACCESS_ONCE(pkt->udp_rx_next));
+  }
+
+  if( last != NULL ) {
+    us->stamp = last->tstamp_frc;
+    us->future_intf_i = last->intf_i;
+    us->udpflags |= CI_UDPF_LAST_RECV_ON;
+    /* We must be done with the packets before they can be reaped. */
+    ci_mb();
+    q->extract = OO_PKT_P(last);
+    q->pkts_delivered += delivered;
+  }
+  return n;
+}
+
+
 int ci_udp_recvmmsg(ci_udp_iomsg_args *a, struct mmsghdr* mmsg, 
                     unsigned int vlen, int flags, 
                     const struct timespec* timeout)
@@ -1069,6 +1180,12 @@ int ci_udp_recvmmsg(ci_udp_iomsg_args *a, struct mmsghdr* mmsg,
 
     ++i;
 
+    /* Take whatever else is already queued without going round the full
+     * receive path for each datagram.
+     */
+    if( i < vlen && rinf.sock_locked && NI_OPTS(ni).udp_recvmmsg_batch )
+      i += ci_udp_recvmmsg_batch(&rinf, mmsg + i, vlen - i);
+
     if( timeout_msec >= 0 ) {
       struct timeval tv_after, tv_sub;
       gettimeofday(&tv_after, NULL);
@@ -216,12 +216,14 @@ int ci_udp_rx_deliver(ci_sock_cmn* s, void* opaque_arg)
     LOG_UR(log(FNS_FMT "OVERFLOW pay_len=%d",
                FNS_PRI_ARGS(ni, s), pkt->pf.udp.pay_len));
     ++us->stats.n_rx_overflow;
+    ci_netif_flight_rec(ni, OO_FR_RX_DROP, 0, S_ID(us));
   }
   else {
     LOG_UR(log(FNS_FMT "DROP (memory pressure) pay_len=%d",
                FNS_PRI_ARGS(ni, s), pkt->pf.udp.pay_len));
     CITP_STATS_NETIF_INC(ni, memory_pressure_drops);
     ++us->stats.n_rx_mem_drop;
+    ci_netif_flight_rec(ni, OO_FR_RX_DROP, 1, S_ID(us));
   }
   return 0;  /* continue delivering to other sockets */
 }
@@ -12,7 +12,9 @@
 \**************************************************************************/
   
 /*! \cidoxg_lib_transport_ip */
-  
+
+#define _GNU_SOURCE  /* for sendmmsg */
+
 #include "ip_internal.h"
 #include "udp_internal.h"
 #include "ip_tx.h"
@@ -23,6 +25,7 @@
 
 #ifndef __KERNEL__
 #include <ci/internal/efabcfg.h>
+#include <sys/socket.h>
 #endif
 
 
@@ -76,6 +79,10 @@ struct udp_send_info {
   int                   stack_locked;
   ci_uint32             timeout;
   int                   old_ipcache_updated;
+  /* When set, packets are queued by ci_netif_send_batch_add(), and the
+   * interfaces they were queued on are recorded in [tx_batch_intfs]. */
+  int                   tx_batch;
+  ci_uint32             tx_batch_intfs;
 };
 
 static bool ci_ipx_is_first_frag(int af, ci_ipx_hdr_t* ipx)
@@ -648,6 +655,118 @@ static void fixup_pkt_not_transmitted(ci_netif *ni, ci_ip_pkt_fmt* pkt)
 }
 
 
+/* Stack-wide cache of control plane lookups for unconnected sends.  It is
+ * set-associative, and is indexed by the destination together with the
+ * socket's local address and port.  See ci_udp_ipcache_entry.
+ */
+
+ci_inline ci_uint32 ci_udp_ipcache_stamp(ci_netif* ni)
+{
+  /* Zero marks a free entry. */
+  if(CI_UNLIKELY( ++ni->state->udp_ipcache_stamp == 0 ))
+    ++ni->state->udp_ipcache_stamp;
+  return ni->state->udp_ipcache_stamp;
+}
+
+
+ci_inline ci_udp_ipcache_entry*
+ci_udp_ipcache_set(ci_netif* ni, const struct oo_sock_cplane* sock_cp,
+                   const ci_ip_cached_hdrs* ipcache)
+{
+  unsigned sets_n = ni->state->udp_ipcache_entries_n / CI_UDP_IPCACHE_WAYS;
+  unsigned set = onload_hash3(sock_cp->laddr, sock_cp->lport_be16,
+                              ipcache_raddr(ipcache), ipcache->dport_be16,
+                              IPPROTO_UDP) & (sets_n - 1);
+  return &ni->udp_ipcache[set * CI_UDP_IPCACHE_WAYS];
+}
+
+
+ci_inline int
+ci_udp_ipcache_matches(const ci_udp_ipcache_entry* e,
+                       const struct oo_sock_cplane* sock_cp,
+                       const ci_ip_cached_hdrs* ipcache)
+{
+  return e->stamp != 0 &&
+         e->hdrs.dport_be16 == ipcache->dport_be16 &&
+         ipcache_af(&e->hdrs) == ipcache_af(ipcache) &&
+         CI_IPX_ADDR_EQ(ipcache_raddr(&e->hdrs), ipcache_raddr(ipcache)) &&
+         memcmp(&e->sock_cp, sock_cp, sizeof(*sock_cp)) == 0;
+}
+
+
+/* [ipcache] has had its destination set.  If the cache has a valid lookup
+ * for that destination from a socket with the same control plane inputs as
+ * [us], copy it into [ipcache] and return true.
+ */
+static int ci_udp_ipcache_lookup(ci_netif* ni, ci_udp_state* us,
+                                 ci_ip_cached_hdrs* ipcache)
+{
+  ci_udp_ipcache_entry* set;
+  int i;
+
+  ci_assert(ci_netif_is_locked(ni));
+
+  if( ni->state->udp_ipcache_entries_n == 0 )
+    return 0;
+
+  set = ci_udp_ipcache_set(ni, &us->s.cp, ipcache);
+  for( i = 0; i < CI_UDP_IPCACHE_WAYS; ++i ) {
+    if( ! ci_udp_ipcache_matches(&set[i], &us->s.cp, ipcache) )
+      continue;
+    if( ! oo_cp_ipcache_is_valid(ni, &set[i].hdrs) ) {
+      set[i].stamp = 0;
+      break;
+    }
+    set[i].stamp = ci_udp_ipcache_stamp(ni);
+    ci_ipcache_set_saddr(ipcache, ipcache_laddr(&set[i].hdrs));
+    cicp_ip_cache_update_from(ni, ipcache, &set[i].hdrs);
+    ++us->stats.n_tx_cp_cache_hit;
+    return 1;
+  }
+
+  ++us->stats.n_tx_cp_cache_miss;
+  return 0;
+}
+
+
+/* Remember the result of a control plane lookup in [ipcache], replacing any
+ * existing entry for the same destination, or else the least recently used
+ * entry in the set.
+ */
+static void ci_udp_ipcache_store(ci_netif* ni, ci_udp_state* us,
+                                 const ci_ip_cached_hdrs* ipcache)
+{
+  ci_udp_ipcache_entry* set;
+  ci_udp_ipcache_entry* victim = NULL;
+  ci_uint32 now;
+  int i;
+
+  ci_assert(ci_netif_is_locked(ni));
+
+  if( ni->state->udp_ipcache_entries_n == 0 ||
+      ipcache->status != retrrc_success )
+    return;
+
+  now = ci_udp_ipcache_stamp(ni);
+  set = ci_udp_ipcache_set(ni, &us->s.cp, ipcache);
+  for( i = 0; i < CI_UDP_IPCACHE_WAYS; ++i )
+    if( ci_udp_ipcache_matches(&set[i], &us->s.cp, ipcache) ) {
+      victim = &set[i];
+      break;
+    }
+  if( victim == NULL ) {
+    victim = &set[0];
+    for( i = 0; i < CI_UDP_IPCACHE_WAYS && victim->stamp != 0; ++i )
+      if( set[i].stamp == 0 || now - set[i].stamp > now - victim->stamp )
+        victim = &set[i];
+  }
+
+  victim->hdrs = *ipcache;
+  memcpy(&victim->sock_cp, &us->s.cp, sizeof(victim->sock_cp));
+  victim->stamp = now;
+}
+
+
 static void ci_udp_sendmsg_send(ci_netif* ni, ci_udp_state* us,
                                 ci_ip_pkt_fmt* pkt, int flags,
                                 struct udp_send_info* sinf)
@@ -694,6 +813,8 @@ static void ci_udp_sendmsg_send(ci_netif* ni, ci_udp_state* us,
         cicp_ip_cache_update_from(ni, ipcache, &sinf->ipcache);
         goto done_hdr_update;
       }
+      if( ci_udp_ipcache_lookup(ni, us, ipcache) )
+        goto done_hdr_update;
     }
 
     ++us->stats.n_tx_cp_uc_lookup;
@@ -702,6 +823,7 @@ static void ci_udp_sendmsg_send(ci_netif* ni, ci_udp_state* us,
      * footing cicp_user_retrieve(). */
     ci_ip_cache_invalidate(ipcache);
     cicp_user_retrieve(ni, ipcache, &us->s.cp);
+    ci_udp_ipcache_store(ni, us, ipcache);
   }
   else {
     /**********************************************************************
@@ -779,7 +901,13 @@ static void ci_udp_sendmsg_send(ci_netif* ni, ci_udp_state* us,
         oo_pkt_p next = pkt->next;
         prep_send_pkt(ni, us, pkt, ipcache);
         /* We've called ci_netif_pkt_hold() in ci_udp_sendmsg_fill(). */
-        ci_netif_send(ni, pkt);
+        if( sinf != NULL && sinf->tx_batch ) {
+          ci_netif_send_batch_add(ni, pkt);
+          sinf->tx_batch_intfs |= 1u << pkt->intf_i;
+        }
+        else {
+          ci_netif_send(ni, pkt);
+        }
         if( OO_PP_IS_NULL(next) )
           break;
         pkt = PKT_CHK(ni, next);
@@ -1541,6 +1669,7 @@ int ci_udp_sendmsg(ci_udp_iomsg_args *a,
   sinf.used_ipcache = 0;
   sinf.old_ipcache_updated = 0;
   sinf.timeout = us->s.so.sndtimeo_msec;
+  sinf.tx_batch = 0;
 
 #ifndef __KERNEL__
 #ifdef __i386__
@@ -1711,10 +1840,12 @@ int ci_udp_sendmsg(ci_udp_iomsg_args *a,
         ci_ipcache_set_daddr(&us->ephemeral_pkt, ipcache_raddr(&sinf.ipcache));
         us->ephemeral_pkt.dport_be16 = sinf.ipcache.dport_be16;
         ci_ip_cache_invalidate(&us->ephemeral_pkt);
+        ci_udp_ipcache_lookup(ni, us, &us->ephemeral_pkt);
       }
       if(CI_UNLIKELY( ! oo_cp_ipcache_is_valid(ni, &us->ephemeral_pkt) )) {
         ++us->stats.n_tx_cp_uc_lookup;
         cicp_user_retrieve(ni, &us->ephemeral_pkt, &us->s.cp);
+        ci_udp_ipcache_store(ni, us, &us->ephemeral_pkt);
         if( reuse_ipcache )
           sinf.old_ipcache_updated = 1;
       }
@@ -1768,5 +1899,197 @@ int ci_udp_sendmsg(ci_udp_iomsg_args *a,
     RET_WITH_ERRNO(-rc);
 }
 
+
+#ifndef __KERNEL__
+/* Send as many of the messages as possible with the stack lock held
+ * throughout, queuing the packets with ci_netif_send_batch_add() and then
+ * posting them with one doorbell per interface.  The control plane is
+ * consulted once for each run of messages to the same destination.
+ *
+ * Only datagrams that fit in a single IPv4 packet, with no control
+ * messages, and to a destination that resolves to an Onload interface are
+ * handled here.  We stop at the first message that is not, and return the
+ * number of messages sent so that the caller can send the rest one at a
+ * time.
+ */
+static unsigned ci_udp_sendmmsg_batch(ci_udp_iomsg_args* a,
+                                      struct mmsghdr* mmsg, unsigned vlen,
+                                      int flags)
+{
+  ci_netif* ni = a->ni;
+  ci_udp_state* us = a->us;
+  struct udp_send_info sinf;
+  struct oo_pkt_filler pf;
+  ci_iovec_ptr piov;
+  ci_ip_cached_hdrs* ipcache = NULL;
+  ci_addr_t daddr = addr_any;
+  ci_uint16 dport_be16 = 0;
+  unsigned i;
+  int j, intf_i;
+
+  if( ipcache_af(&us->s.pkt) != AF_INET )
+    return 0;
+
+  ci_netif_lock(ni);
+  /* Errors are reported, and sends that must be ordered after earlier
+   * sends via the kernel are made, by the one-at-a-time path. */
+  if( (us->s.so_error | us->s.tx_errno) ||
+      (us->udpflags & CI_UDPF_LAST_SEND_NOMAC) ) {
+    ci_netif_unlock(ni);
+    return 0;
+  }
+
+  sinf.rc = 0;
+  sinf.stack_locked = 1;
+  sinf.used_ipcache = 0;
+  sinf.old_ipcache_updated = 0;
+  sinf.timeout = us->s.so.sndtimeo_msec;
+  sinf.tx_batch = 1;
+  sinf.tx_batch_intfs = 0;
+
+  for( i = 0; i < vlen; ++i ) {
+    const struct msghdr* msg = &mmsg[i].msg_hdr;
+    unsigned long bytes_to_send = 0;
+
+    if( CMSG_FIRSTHDR(msg) != NULL ||
+        (msg->msg_iov == NULL && msg->msg_iovlen != 0) )
+      break;
+
+    if( msg->msg_namelen == 0 ) {
+      if( ! (us->s.s_flags & CI_SOCK_FLAG_CONNECTED) )
+        break;
+      if( ipcache != &us->s.pkt ) {
+        if( ! oo_cp_ipcache_is_valid(ni, &us->s.pkt) ||
+            us->s.pkt.status != retrrc_success )
+          break;
+        ipcache = &us->s.pkt;
+      }
+      ci_ipcache_set_daddr(&sinf.ipcache, addr_any);
+      sinf.ipcache.dport_be16 = 0;
+    }
+    else {
+      const struct sockaddr* sa = msg->msg_name;
+      ci_addr_t pkt_daddr;
+      ci_uint16 pkt_dport_be16;
+
+      if( sa == NULL || msg->msg_namelen < sizeof(struct sockaddr_in) ||
+          sa->sa_family != AF_INET ||
+          (CI_CFG_FAKE_IPV6 && us->s.domain != AF_INET) ||
+          udp_lport_be16(us) == 0 )
+        break;
+      pkt_daddr = ci_get_addr(sa);
+      pkt_dport_be16 = ci_get_port(sa);
+      if( CI_IPX_ADDR_IS_ANY(pkt_daddr) )
+        break;
+
+      if( ipcache != &us->ephemeral_pkt ||
+          pkt_dport_be16 != dport_be16 ||
+          ! CI_IPX_ADDR_EQ(pkt_daddr, daddr) ) {
+        /* First message to this destination in the batch. */
+        if( pkt_dport_be16 != us->ephemeral_pkt.dport_be16 ||
+            ! CI_IPX_ADDR_EQ(pkt_daddr, ipcache_raddr(&us->ephemeral_pkt)) ) {
+          ci_ipcache_set_daddr(&us->ephemeral_pkt, pkt_daddr);
+          us->ephemeral_pkt.dport_be16 = pkt_dport_be16;
+          ci_ip_cache_invalidate(&us->ephemeral_pkt);
+          ci_udp_ipcache_lookup(ni, us, &us->ephemeral_pkt);
+        }
+        if(CI_UNLIKELY( ! oo_cp_ipcache_is_valid(ni, &us->ephemeral_pkt) )) {
+          ++us->stats.n_tx_cp_uc_lookup;
+          cicp_user_retrieve(ni, &us->ephemeral_pkt, &us->s.cp);
+          ci_udp_ipcache_store(ni, us, &us->ephemeral_pkt);
+        }
+        if( us->ephemeral_pkt.status != retrrc_success ) {
+          ipcache = NULL;
+          break;
+        }
+        ipcache = &us->ephemeral_pkt;
+        daddr = pkt_daddr;
+        dport_be16 = pkt_dport_be16;
+      }
+      else {
+        ++us->stats.n_tx_cp_match;
+      }
+      ci_ipcache_set_daddr(&sinf.ipcache, pkt_daddr);
+      sinf.ipcache.dport_be16 = pkt_dport_be16;
+    }
+
+    for( j = 0; j < msg->msg_iovlen; ++j ) {
+      if( CI_IOVEC_BASE(&msg->msg_iov[j]) == NULL &&
+          CI_IOVEC_LEN(&msg->msg_iov[j]) > 0 )
+        break;
+      bytes_to_send += CI_IOVEC_LEN(&msg->msg_iov[j]);
+    }
+    if( j < msg->msg_iovlen ||
+        bytes_to_send > ipcache->mtu - sizeof(ci_ip4_hdr) -
+                        sizeof(ci_udp_hdr) ||
+        ! UDP_HAS_SENDQ_SPACE(us, bytes_to_send) )
+      break;
+
+    if( msg->msg_iovlen > 0 )
+      ci_iovec_ptr_init_nz(&piov, msg->msg_iov, msg->msg_iovlen);
+    else
+      ci_iovec_ptr_init(&piov, NULL, 0);
+    pf.alloc_pkt = NULL;
+    sinf.ipcache.mtu = ipcache->mtu;
+    if( ci_udp_sendmsg_fill(ni, us, &piov, bytes_to_send, flags, &pf,
+                            &sinf, false) < 0 )
+      break;
+    /* The lock may have been dropped to wait for packet buffers. */
+    if( ! sinf.stack_locked ) {
+      ci_netif_lock(ni);
+      sinf.stack_locked = 1;
+    }
+#if CI_CFG_TIMESTAMPING
+    if( us->s.timestamping_flags & ONLOAD_SOF_TIMESTAMPING_OPT_ID ) {
+      pf.pkt->ts_key = us->s.ts_key;
+      ci_atomic32_inc(&us->s.ts_key);
+    }
+#endif
+    TX_PKT_SET_DADDR(AF_INET, pf.pkt, ipcache_raddr(&sinf.ipcache));
+    TX_PKT_IPX_UDP(AF_INET, pf.pkt, false)->udp_dest_be16 =
+      sinf.ipcache.dport_be16;
+
+    ci_udp_sendmsg_send(ni, us, pf.pkt, flags, &sinf);
+    ci_netif_pkt_release(ni, pf.pkt);
+    if( sinf.rc < 0 )
+      /* Leave it to the caller to retry and report the error. */
+      break;
+    mmsg[i].msg_len = bytes_to_send;
+  }
+
+  for( intf_i = 0; sinf.tx_batch_intfs != 0; ++intf_i ) {
+    if( sinf.tx_batch_intfs & (1u << intf_i) ) {
+      ci_netif_send_batch_push(ni, intf_i);
+      sinf.tx_batch_intfs &=~ (1u << intf_i);
+    }
+  }
+  if( i > 1 )
+    ++us->stats.n_tx_mmsg_batch;
+  ci_netif_unlock(ni);
+  return i;
+}
+
+
+int ci_udp_sendmmsg(ci_udp_iomsg_args* a, struct mmsghdr* mmsg,
+                    unsigned vlen, int flags)
+{
+  unsigned i = 0;
+  int rc;
+
+  if( vlen > 1 && NI_OPTS(a->ni).udp_sendmmsg_batch &&
+      ! (flags & (MSG_MORE | MSG_OOB)) )
+    i = ci_udp_sendmmsg_batch(a, mmsg, vlen, flags);
+
+  for( ; i < vlen; ++i ) {
+    rc = ci_udp_sendmsg(a, &mmsg[i].msg_hdr, flags);
+    if( rc < 0 )
+      /* As for Linux, the error is reported only if nothing was sent. */
+      return i > 0 ? (int) i : rc;
+    mmsg[i].msg_len = rc;
+  }
+  return vlen;
+}
+#endif
+
 #endif
 /*! \cidoxg_end */
@@ -24,6 +24,7 @@ void citp_waitable_reinit(ci_netif* ni, citp_waitable* w)
   w->sleep_seq.all = 0;
   w->sigown = 0;
   w->spin_cycles = ni->state->sock_spin_cycles;
+  memset(&w->spin_adapt, 0, sizeof(w->spin_adapt));
 }
 
 
@@ -366,6 +367,11 @@ static void citp_waitable_dump2(ci_netif* ni, citp_waitable* w, const char* pf,
   else
     logger(log_arg, "%s  ul_poll: %"CI_PRIu64" spin cycles %u usec", pf,
          w->spin_cycles, oo_cycles64_to_usec(ni, w->spin_cycles));
+  if( w->spin_adapt.wait_avg != 0 )
+    logger(log_arg, "%s  spin_adapt: wait_avg=%u wait_dev=%u usec skips=%u",
+           pf, oo_cycles64_to_usec(ni, w->spin_adapt.wait_avg),
+           oo_cycles64_to_usec(ni, w->spin_adapt.wait_dev),
+           w->spin_adapt.n_skips);
 }
 
 
@@ -505,6 +511,9 @@ void citp_waitable_wake_not_in_poll(ci_netif* ni, citp_waitable* sb,
     ++sb->sleep_seq.rw.tx;
   ci_mb();
 
+  if( what & sb->wake_request )
+    ci_netif_flight_rec(ni, OO_FR_WAKE, what & sb->wake_request, W_ID(sb));
+
 #ifdef __KERNEL__
   if( what & sb->wake_request ) {
     sb->sb_flags |= what;
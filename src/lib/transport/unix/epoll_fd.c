@@ -1777,6 +1777,48 @@ citp_epoll_ctl_try_sync(struct citp_epoll_fd* ep, citp_fdinfo* fdi,
 }
 
 
+/* EF_SPIN_ADAPTIVE: returns how long epoll_wait() should spin, given the
+ * history of waits on this epoll set.  The spin statistics of an epoll set
+ * are counted in its home stack, if it has one.
+ */
+static ci_uint64 citp_epoll_spin_budget(struct citp_epoll_fd* ep)
+{
+  ci_uint64 budget;
+
+  if( ! CITP_OPTS.ul_spin_adaptive )
+    return citp.spin_cycles;
+  budget = oo_spin_adapt_budget(&ep->shared->spin_adapt, citp.spin_cycles);
+#if CI_CFG_EPOLL3
+  if( budget == 0 && ep->home_stack != NULL )
+    CITP_STATS_NETIF_INC(ep->home_stack, spin_wait_skips);
+#endif
+  return budget;
+}
+
+
+/* Accounts for an epoll_wait() that started waiting at [start_frc] and
+ * spun until [now_frc].  [hit] says whether it got events while spinning.
+ */
+static void citp_epoll_spin_done(struct citp_epoll_fd* ep,
+                                 ci_uint64 start_frc, ci_uint64 now_frc,
+                                 int hit)
+{
+#if CI_CFG_EPOLL3
+  ci_netif* ni = ep->home_stack;
+
+  if( ni != NULL ) {
+    if( hit )
+      CITP_STATS_NETIF_INC(ni, spin_wait_hits);
+    else
+      CITP_STATS_NETIF_INC(ni, spin_wait_misses);
+    CITP_STATS_NETIF_ADD(ni, spin_wait_cycles, now_frc - start_frc);
+  }
+#endif
+  if( hit && CITP_OPTS.ul_spin_adaptive )
+    oo_spin_adapt_update(&ep->shared->spin_adapt, now_frc - start_frc);
+}
+
+
 int citp_epoll_wait(citp_fdinfo* fdi, struct epoll_event*__restrict__ events,
                     struct citp_ordered_wait* ordering, int maxevents,
                     ci_int64 timeout_hr, const sigset_t *sigmask,
@@ -1789,6 +1831,8 @@ int citp_epoll_wait(citp_fdinfo* fdi, struct epoll_event*__restrict__ events,
   sigset_t sigsaved;
   int pwait_was_spinning = 0;
   int have_spin = 0;
+  int have_spin_budget = 0;
+  ci_uint64 spin_budget = 0;
 
   ci_assert_ge(timeout_hr, 0);
   ci_assert_le(timeout_hr, OO_EPOLL_MAX_TIMEOUT_HR);
@@ -1988,6 +2032,8 @@ int citp_epoll_wait(citp_fdinfo* fdi, struct epoll_event*__restrict__ events,
      * events are probably past the limit being used for ordering.  Tell caller
      * that it would be worth polling again.
      */
+    if( have_spin )
+      citp_epoll_spin_done(ep, base_poll_start_frc, eps.this_poll_frc, 1);
     if( have_spin && ordering ) {
       ordering->poll_again = 1;
       citp_epoll_find_timeout(&timeout_hr, &poll_start_frc);
@@ -2009,7 +2055,12 @@ no_events:
   }
 
   /* Blocking.  Shall we spin? */
-  if( KEEP_POLLING(eps.ul_epoll_spin, eps.this_poll_frc, base_poll_start_frc) ) {
+  if( eps.ul_epoll_spin && ! have_spin_budget ) {
+    spin_budget = citp_epoll_spin_budget(ep);
+    have_spin_budget = 1;
+  }
+  if( KEEP_POLLING_FOR(eps.ul_epoll_spin, eps.this_poll_frc,
+                       base_poll_start_frc, spin_budget) ) {
     if( !pwait_was_spinning && sigmask != NULL) {
       if( ep->avoid_spin_once ) {
         eps.ul_epoll_spin = 0;
@@ -2078,6 +2129,9 @@ no_events:
     goto poll_again;
   } /* endif ul_epoll_spin spinning*/
 
+  if( have_spin )
+    citp_epoll_spin_done(ep, base_poll_start_frc, eps.this_poll_frc, 0);
+
   /* Re-calculate timeout.  We should do it if we were spinning a lot. */
   if( eps.ul_epoll_spin && timeout_hr > 0 ) {
     timeout_hr -= eps.this_poll_frc - poll_start_frc;
@@ -2198,6 +2252,11 @@ no_events:
     ordering->next_timeout_hr = timeout_hr;
   }
 
+  /* Let the adaptive spin know how long we really waited. */
+  if( rc > 0 && have_spin_budget && CITP_OPTS.ul_spin_adaptive )
+    oo_spin_adapt_update(&ep->shared->spin_adapt,
+                         ci_frc64_get() - base_poll_start_frc);
+
   Log_POLL(ci_log("%s(%d): to kernel => %d (%d)", __FUNCTION__, fdi->fd,
                   rc, errno));
   return rc;
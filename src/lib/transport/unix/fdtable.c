@@ -48,6 +48,141 @@ static void dup2_complete(citp_fdinfo* prev_newfdi,
 			  citp_fdinfo_p prev_newfdip, int fdt_locked);
 
 
+/**********************************************************************
+ * Hazard slots (EF_FDS_DEFER_FREE).  See internal.h.
+ */
+
+struct citp_fdt_hazard citp_fdt_hazards[CITP_FDT_HAZARDS_MAX];
+volatile ci_uint32 citp_fdt_hazards_n;
+volatile unsigned citp_fdt_n_retired;
+__thread struct citp_fdt_hazard* citp_fdt_hazard_self;
+
+/* Retired fdinfos, linked through [retired_next].  Protected by the fdtable
+ * lock. */
+static citp_fdinfo* citp_fdt_retired;
+
+/* Given to threads when all slots are taken.  Its [fdi] is never NULL and
+ * never matches a real fdinfo, so its owners always take references. */
+static struct citp_fdt_hazard citp_fdt_hazard_none = {
+  .fdi = (citp_fdinfo*) &citp_fdt_hazard_none,
+};
+
+static pthread_once_t citp_fdt_hazard_once = PTHREAD_ONCE_INIT;
+static pthread_key_t citp_fdt_hazard_key;
+
+
+static void citp_fdt_hazard_thread_exit(void* arg)
+{
+  struct citp_fdt_hazard* hz = arg;
+  ci_assert_equal(hz->depth, 0);
+  hz->fdi = NULL;
+  ci_mb();
+  hz->in_use = 0;
+}
+
+
+static void citp_fdt_hazard_key_ctor(void)
+{
+  CI_TRY(pthread_key_create(&citp_fdt_hazard_key,
+                            citp_fdt_hazard_thread_exit));
+}
+
+
+void citp_fdt_hazard_claim(void)
+{
+  ci_uint32 i, n;
+
+  pthread_once(&citp_fdt_hazard_once, citp_fdt_hazard_key_ctor);
+  for( i = 0; i < CITP_FDT_HAZARDS_MAX; ++i ) {
+    struct citp_fdt_hazard* hz = &citp_fdt_hazards[i];
+    if( hz->in_use || ci_cas32_fail(&hz->in_use, 0, 1) )
+      continue;
+    do
+      n = citp_fdt_hazards_n;
+    while( n <= i && ci_cas32u_fail(&citp_fdt_hazards_n, n, i + 1) );
+    hz->depth = 0;
+    citp_fdt_hazard_self = hz;
+    pthread_setspecific(citp_fdt_hazard_key, hz);
+    return;
+  }
+  citp_fdt_hazard_self = &citp_fdt_hazard_none;
+}
+
+
+static int citp_fdt_hazard_held(citp_fdinfo* fdi)
+{
+  ci_uint32 i, n = citp_fdt_hazards_n;
+  for( i = 0; i < n; ++i )
+    if( citp_fdt_hazards[i].fdi == fdi )
+      return 1;
+  return 0;
+}
+
+
+static void citp_fdt_retired_unlink(citp_fdinfo* fdi)
+{
+  citp_fdinfo** p;
+  for( p = &citp_fdt_retired; *p != fdi; p = &(*p)->retired_next )
+    ci_assert(*p);
+  *p = fdi->retired_next;
+  fdi->retired = 0;
+  --citp_fdt_n_retired;
+}
+
+
+/* Called when [fdi]'s ref count reaches zero.  Returns true if a thread
+ * still has [fdi] in its hazard slot, in which case [fdi] is left on the
+ * retired list for that thread to reclaim.
+ */
+static int citp_fdinfo_defer_rcz(citp_fdinfo* fdi, int fdt_locked)
+{
+  int held;
+
+  ci_mb();
+  if( ! fdi->retired && ! citp_fdt_hazard_held(fdi) )
+    return 0;
+
+  if( ! fdt_locked )  CITP_FDTABLE_LOCK();
+  if( ! fdi->retired ) {
+    fdi->retired = 1;
+    fdi->retired_next = citp_fdt_retired;
+    citp_fdt_retired = fdi;
+    ++citp_fdt_n_retired;
+  }
+  /* The holder may have cleared its slot before it could see the list was
+   * non-empty, so look again now that it is. */
+  ci_mb();
+  held = citp_fdt_hazard_held(fdi);
+  if( ! held )
+    citp_fdt_retired_unlink(fdi);
+  if( ! fdt_locked )  CITP_FDTABLE_UNLOCK();
+  return held;
+}
+
+
+void citp_fdtable_reclaim(int fdt_locked)
+{
+  citp_fdinfo *fdi, *next, *done = NULL;
+
+  if( ! fdt_locked )  CITP_FDTABLE_LOCK();
+  ci_mb();
+  for( fdi = citp_fdt_retired; fdi != NULL; fdi = next ) {
+    next = fdi->retired_next;
+    if( oo_atomic_read(&fdi->ref_count) == 0 &&
+        ! citp_fdt_hazard_held(fdi) ) {
+      citp_fdt_retired_unlink(fdi);
+      fdi->retired_next = done;
+      done = fdi;
+    }
+  }
+  for( fdi = done; fdi != NULL; fdi = next ) {
+    next = fdi->retired_next;
+    __citp_fdinfo_ref_count_zero(fdi, 1);
+  }
+  if( ! fdt_locked )  CITP_FDTABLE_UNLOCK();
+}
+
+
 static void exit_with_status(int status)
 {
   /* oo_exit_hook() takes too long, we should exit ungraciously */
@@ -742,6 +877,10 @@ citp_fdtable_probe_restore(int fd, ci_ep_info_t * info, int print_banner,
 
     pipe_fdi->pipe = SP_TO_PIPE(ni, info->sock_id);
     pipe_fdi->ni = ni;
+    if( pipe_fdi->pipe->aflags & CI_PFD_AFLAG_EVENTFD )
+      proto = &citp_eventfd_protocol_impl;
+    else if( pipe_fdi->pipe->aflags & CI_PFD_AFLAG_UNIX_STREAM )
+      proto = &citp_unix_stream_protocol_impl;
   }
 
   citp_fdinfo_init(fdi, proto);
@@ -1029,6 +1168,7 @@ citp_fdtable_lookup_fast(citp_lib_context_t* ctx, unsigned fd)
   ** and the first [return] statement.
   */
   citp_fdinfo* fdi;
+  struct citp_fdt_hazard* hz;
 
   /* Try to avoid entering lib. */
   ctx->thread = NULL;
@@ -1054,6 +1194,25 @@ citp_fdtable_lookup_fast(citp_lib_context_t* ctx, unsigned fd)
 
 	return fdi;
       }
+      else if( CITP_OPTS.fds_defer_free &&
+               ((hz = citp_fdt_hazard_get())->fdi == NULL ||
+                hz->fdi == fdip_to_fdi(fdip)) ) {
+        /* Publish the fdinfo instead of taking a reference.  It cannot be
+         * freed once it is published and still in the table.
+         */
+        fdi = fdip_to_fdi(fdip);
+        if( hz->depth++ == 0 ) {
+          hz->fdi = fdi;
+          ci_mb();
+          if(CI_UNLIKELY( *p_fdip != fdip )) {
+            citp_fdt_hazard_release(hz, 0);
+            goto again;
+          }
+        }
+        if(CI_UNLIKELY( ! citp_fdinfo_is_consistent(fdi) ))
+          fdi = citp_reprobe_moved(fdi, CI_TRUE, CI_FALSE);
+        return fdi;
+      }
       else {
         /* Swap in the busy marker. */
 	if( fdip_cas_succeed(p_fdip, fdip, fdip_busy) ) {
@@ -1360,6 +1519,8 @@ static inline ci_netif* fdi_to_stack(citp_fdinfo* fdi)
     case CITP_UDP_SOCKET:
       return fdi_to_socket(fdi)->netif;
     case CITP_PIPE_FD:
+    case CITP_EVENTFD_FD:
+    case CITP_UNIX_STREAM_FD:
       return fdi_to_pipe_fdi(fdi)->ni;
     case CITP_PASSTHROUGH_FD:
       return fdi_to_alien_fdi(fdi)->netif;
@@ -1382,6 +1543,9 @@ void __citp_fdinfo_ref_count_zero(citp_fdinfo* fdi, int fdt_locked)
   ci_assert_lt(fdi->fd, citp_fdtable.inited_count);
   ci_assert_nequal(fdi_to_fdip(fdi), citp_fdtable.table[fdi->fd].fdip);
 
+  if( citp_fdt_hazards_n != 0 && citp_fdinfo_defer_rcz(fdi, fdt_locked) )
+    return;
+
   switch( fdi->on_ref_count_zero ) {
   case FDI_ON_RCZ_CLOSE:
 #if CI_CFG_FD_CACHING
@@ -1536,6 +1700,17 @@ void citp_fdtable_fork_hook(void)
       continue;
     }
   }
+
+  /* Likewise no-one will clear the hazard slots of the parent's other
+   * threads. */
+  for( fd = 0; fd < citp_fdt_hazards_n; ++fd ) {
+    struct citp_fdt_hazard* hz = &citp_fdt_hazards[fd];
+    if( hz != citp_fdt_hazard_self ) {
+      hz->fdi = NULL;
+      hz->depth = 0;
+      hz->in_use = 0;
+    }
+  }
 }
 
 
@@ -2053,6 +2228,8 @@ int citp_ep_dup3(unsigned fromfd, unsigned tofd, int flags)
             sleep(1);
           }
         }
+        if( citp_fdt_n_retired != 0 )
+          citp_fdtable_reclaim(0);
         ci_spinloop_pause();
         i++;
       }
@@ -2309,7 +2486,7 @@ int citp_reprobe_moved_common(citp_fdinfo* fdinfo, int from_fast_lookup,
  done:
   /* One refcount from the caller */
   if( from_fast_lookup )
-    citp_fdinfo_release_ref_fast(fdinfo);
+    __citp_fdinfo_release_ref_fast(fdinfo, 1);
   else
     citp_fdinfo_release_ref(fdinfo, 1);
 
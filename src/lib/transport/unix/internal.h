@@ -213,6 +213,8 @@ struct citp_protocol_impl_s {
 # define        CITP_EPOLL_FD        4
 # define        CITP_EPOLLB_FD       5
 # define        CITP_PIPE_FD         6
+# define        CITP_EVENTFD_FD      7
+# define        CITP_UNIX_STREAM_FD  8
 
   citp_fdops    ops;
 
@@ -322,6 +324,10 @@ struct citp_fdinfo_s {
    * architectures that allow byte- aligned access (e.g. x86).
    */
   char                 is_special;
+
+  /* Non-zero while on the retired list (see citp_fdt_hazard). */
+  char                 retired;
+  citp_fdinfo*         retired_next;
 };
 
 
@@ -399,15 +405,83 @@ ci_inline void citp_fdinfo_release_ref(citp_fdinfo* fdinfo,
     __citp_fdinfo_ref_count_zero(fdinfo, fdt_locked);
 }
 
+/* With EF_FDS_DEFER_FREE, citp_fdtable_lookup_fast() does not take a
+ * reference to the fdinfo it returns.  Instead the thread publishes the
+ * fdinfo in a hazard slot of its own.  While any slot holds an fdinfo,
+ * __citp_fdinfo_ref_count_zero() puts it on a retired list rather than
+ * acting on it, and the thread that clears the last such slot finishes the
+ * job by calling citp_fdtable_reclaim().
+ */
+struct citp_fdt_hazard {
+  citp_fdinfo* volatile fdi;
+  /* Nested fast lookups of [fdi] by the owning thread. */
+  unsigned              depth;
+  volatile ci_int32     in_use;
+} CI_ALIGN(CI_CACHE_LINE_SIZE);
+
+#define CITP_FDT_HAZARDS_MAX  256
+
+extern struct citp_fdt_hazard citp_fdt_hazards[CITP_FDT_HAZARDS_MAX] CI_HV;
+/* Slots at or above this index have never been used. */
+extern volatile ci_uint32 citp_fdt_hazards_n CI_HV;
+/* Length of the retired list. */
+extern volatile unsigned citp_fdt_n_retired CI_HV;
+/* This thread's slot; a dummy that is never free when all are taken. */
+extern __thread struct citp_fdt_hazard* citp_fdt_hazard_self CI_HV;
+
+extern void citp_fdt_hazard_claim(void) CI_HF;
+extern void citp_fdtable_reclaim(int fdt_locked) CI_HF;
+
+ci_inline struct citp_fdt_hazard* citp_fdt_hazard_get(void)
+{
+  if(CI_UNLIKELY( citp_fdt_hazard_self == NULL ))
+    citp_fdt_hazard_claim();
+  return citp_fdt_hazard_self;
+}
+
+ci_inline void citp_fdt_hazard_release(struct citp_fdt_hazard* hz,
+                                       int fdt_locked)
+{
+  ci_assert_gt(hz->depth, 0);
+  if( --hz->depth == 0 ) {
+    ci_mb();
+    hz->fdi = NULL;
+    ci_mb();
+    if(CI_UNLIKELY( citp_fdt_n_retired != 0 ))
+      citp_fdtable_reclaim(fdt_locked);
+  }
+}
+
 /*! Release reference obtained by calling citp_fdtable_lookup_fast(). */
+ci_inline void __citp_fdinfo_release_ref_fast(citp_fdinfo* fdinfo,
+                                              int fdt_locked) {
+  if( citp_fdtable_not_mt_safe() ) {
+    struct citp_fdt_hazard* hz = citp_fdt_hazard_self;
+    if( hz != NULL && hz->fdi == fdinfo )
+      citp_fdt_hazard_release(hz, fdt_locked);
+    else
+      citp_fdinfo_release_ref(fdinfo, fdt_locked);
+  }
+}
 ci_inline void citp_fdinfo_release_ref_fast(citp_fdinfo* fdinfo) {
-  if( citp_fdtable_not_mt_safe() )
-    citp_fdinfo_release_ref(fdinfo, 0);
+  __citp_fdinfo_release_ref_fast(fdinfo, 0);
 }
-/*! Take the same number of references as with citp_fdtable_lookup_fast(). */
+/*! Take the same number of references as with citp_fdtable_lookup_fast().
+ * The caller must already hold a reference. */
 ci_inline void citp_fdinfo_ref_fast(citp_fdinfo* fdinfo) {
-  if( citp_fdtable_not_mt_safe() )
-    citp_fdinfo_ref(fdinfo);
+  if( citp_fdtable_not_mt_safe() ) {
+    struct citp_fdt_hazard* hz;
+    if( CITP_OPTS.fds_defer_free &&
+        ((hz = citp_fdt_hazard_get())->fdi == NULL || hz->fdi == fdinfo) ) {
+      if( hz->depth++ == 0 ) {
+        hz->fdi = fdinfo;
+        ci_mb();
+      }
+    }
+    else {
+      citp_fdinfo_ref(fdinfo);
+    }
+  }
 }
 
 /* Called when refcount reaches zero. */
@@ -465,6 +539,8 @@ extern citp_protocol_impl citp_epollb_protocol_impl CI_HV;
 #endif
 extern citp_protocol_impl citp_pipe_read_protocol_impl CI_HV;
 extern citp_protocol_impl citp_pipe_write_protocol_impl CI_HV;
+extern citp_protocol_impl citp_eventfd_protocol_impl CI_HV;
+extern citp_protocol_impl citp_unix_stream_protocol_impl CI_HV;
 extern citp_protocol_impl citp_passthrough_protocol_impl;
 
 
@@ -1126,6 +1202,11 @@ ci_inline ci_uint64 citp_usec_to_cycles64(unsigned usec)
 
 extern int citp_sock_is_spinning(citp_fdinfo* fdi);
 
+/* Drop a reference to a zero-copy memory registration.  Dropping the last
+ * one unpins and unmaps the memory and frees the registration.  Returns 0,
+ * or the error from unregistering with the kernel if that fails. */
+extern int ci_zc_usermem_put(ci_netif* ni, struct ci_zc_usermem* um) CI_HF;
+
 /**********************************************************************
  * Utils
  */
@@ -25,6 +25,7 @@ LIB_SRCS	:=			\
 		onload_ext_intercept.c	\
 		zc_intercept.c          \
 		zc_hlrx.c          \
+		ring_intercept.c	\
 		tmpl_intercept.c	\
 		stackname.c		\
 		stackopt.c		\
@@ -76,6 +76,8 @@ int onload_fd_stat(int fd, struct onload_stat* stat)
       rc = 0;
       break;
     case CITP_PIPE_FD:
+    case CITP_EVENTFD_FD:
+    case CITP_UNIX_STREAM_FD:
       if( stat ==  NULL ) {
         rc = 1;
       }
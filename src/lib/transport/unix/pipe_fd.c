@@ -19,6 +19,8 @@
 #include <onload/ul/tcp_helper.h>
 #include <onload/oo_pipe.h>
 #include <onload/tcp_poll.h>
+#include <sys/eventfd.h>
+#include <sys/un.h>
 
 
 #define VERB(x) Log_VTC(x)
@@ -980,3 +982,760 @@ fail1:
 
   return rc;
 }
+
+
+/**********************************************************************
+ * eventfd
+ */
+
+/* An accelerated eventfd is a pipe without buffers whose count lives in
+ * the stack, so that it can be read and written without system calls and
+ * polled by the user-level select(), poll() and epoll.  Only the reader
+ * end of the pipe is kept: the kernel polls the eventfd through that, and
+ * the reader is woken by a write only when it has gone to sleep.
+ */
+
+static int citp_eventfd_recv(citp_fdinfo* fdinfo,
+                             struct msghdr* msg, int flags)
+{
+  citp_pipe_fdi* epi = fdi_to_pipe_fdi(fdinfo);
+
+  ci_assert(msg);
+  ci_assert(msg->msg_iov);
+
+  return ci_eventfd_read(epi->ni, epi->pipe, msg->msg_iov, msg->msg_iovlen);
+}
+
+
+static int citp_eventfd_send(citp_fdinfo* fdinfo,
+                             const struct msghdr* msg, int flags)
+{
+  citp_pipe_fdi* epi = fdi_to_pipe_fdi(fdinfo);
+
+  ci_assert(msg);
+  ci_assert(msg->msg_iov);
+
+  return ci_eventfd_write(epi->ni, epi->pipe, msg->msg_iov, msg->msg_iovlen);
+}
+
+
+static int citp_eventfd_select(citp_fdinfo* fdinfo, int* n,
+                               int rd, int wr, int ex,
+                               struct oo_ul_select_state* ss)
+{
+  citp_pipe_fdi* epi = fdi_to_pipe_fdi(fdinfo);
+  unsigned mask;
+
+#if CI_CFG_SPIN_STATS
+  if( CI_UNLIKELY(! ss->stat_incremented) ) {
+    epi->ni->state->stats.spin_select++;
+    ss->stat_incremented = 1;
+  }
+#endif
+
+  mask = oo_eventfd_poll_events(epi->pipe);
+
+  if( rd && (mask & SELECT_RD_SET) ) {
+    FD_SET(fdinfo->fd, ss->rdu);
+    ++*n;
+  }
+  if( wr && (mask & SELECT_WR_SET) ) {
+    FD_SET(fdinfo->fd, ss->wru);
+    ++*n;
+  }
+
+  return 1;
+}
+
+
+static int citp_eventfd_poll(citp_fdinfo* fdinfo, struct pollfd* pfd,
+                             struct oo_ul_poll_state* ps)
+{
+  citp_pipe_fdi* epi = fdi_to_pipe_fdi(fdinfo);
+  unsigned mask;
+
+#if CI_CFG_SPIN_STATS
+  if( CI_UNLIKELY(! ps->stat_incremented) ) {
+    epi->ni->state->stats.spin_poll++;
+    ps->stat_incremented = 1;
+  }
+#endif
+
+  mask = oo_eventfd_poll_events(epi->pipe);
+  pfd->revents = mask & (pfd->events | POLLERR | POLLHUP);
+
+  return 1;
+}
+
+
+static int citp_eventfd_epoll(citp_fdinfo* fdinfo,
+                              struct citp_epoll_member* eitem,
+                              struct oo_ul_epoll_state* eps,
+                              int* stored_event)
+{
+  struct oo_pipe* pipe = fdi_to_pipe_fdi(fdinfo)->pipe;
+  unsigned mask;
+  ci_uint64 sleep_seq;
+  int seq_mismatch = 0;
+
+#if CI_CFG_SPIN_STATS
+  if( CI_UNLIKELY(! eps->stat_incremented) ) {
+    fdi_to_pipe_fdi(fdinfo)->ni->state->stats.spin_epoll++;
+    eps->stat_incremented = 1;
+  }
+#endif
+
+  sleep_seq = pipe->b.sleep_seq.all;
+  mask = oo_eventfd_poll_events(pipe);
+  *stored_event = citp_ul_epoll_set_ul_events(eps, eitem, mask, sleep_seq,
+                                              &pipe->b.sleep_seq.all,
+                                              &seq_mismatch);
+  return seq_mismatch;
+}
+
+
+/* Both ends of the underlying pipe share the eventfd's O_NONBLOCK. */
+static void citp_eventfd_set_nonblock(struct oo_pipe* p, int nonblock)
+{
+  ci_uint32 bits = (CI_PFD_AFLAG_NONBLOCK << CI_PFD_AFLAG_READER_SHIFT) |
+                   (CI_PFD_AFLAG_NONBLOCK << CI_PFD_AFLAG_WRITER_SHIFT);
+  if( nonblock )
+    ci_bit_mask_set(&p->aflags, bits);
+  else
+    ci_bit_mask_clear(&p->aflags, bits);
+}
+
+
+static int citp_eventfd_fcntl(citp_fdinfo* fdinfo, int cmd, long arg)
+{
+  struct oo_pipe* p = fdi_to_pipe(fdinfo);
+  int rc;
+
+  switch( cmd ) {
+  case F_GETFL:
+    rc = O_RDWR;
+    if( p->aflags & (CI_PFD_AFLAG_NONBLOCK << CI_PFD_AFLAG_READER_SHIFT) )
+      rc |= O_NONBLOCK;
+    break;
+  case F_SETFL:
+    rc = ci_sys_fcntl(fdinfo->fd, cmd, arg);
+    if( rc == 0 )
+      citp_eventfd_set_nonblock(p, arg & (O_NONBLOCK | O_NDELAY));
+    break;
+  case F_DUPFD:
+    rc = citp_ep_dup(fdinfo->fd, citp_ep_dup_fcntl_dup, arg);
+    break;
+  case F_DUPFD_CLOEXEC:
+    rc = citp_ep_dup(fdinfo->fd, citp_ep_dup_fcntl_dup_cloexec, arg);
+    break;
+  default:
+    rc = ci_sys_fcntl(fdinfo->fd, cmd, arg);
+    break;
+  }
+
+  Log_VSC(log("%s(%d, %d, %ld) = %d  (errno=%d)",
+              __FUNCTION__, fdinfo->fd, cmd, arg, rc, errno));
+  return rc;
+}
+
+
+static int citp_eventfd_ioctl(citp_fdinfo* fdinfo, int cmd, void* arg)
+{
+  switch( cmd ) {
+  case FIONBIO:
+    citp_eventfd_set_nonblock(fdi_to_pipe(fdinfo), *(int*) arg);
+    return 0;
+  default:
+    errno = ENOTTY;
+    return -1;
+  }
+}
+
+
+citp_protocol_impl citp_eventfd_protocol_impl = {
+  .type        = CITP_EVENTFD_FD,
+  .ops         = {
+    .socket      = NULL,        /* nobody should ever call this */
+    .dtor        = citp_pipe_dtor,
+    .dup         = citp_pipe_dup,
+
+    .recv        = citp_eventfd_recv,
+    .send        = citp_eventfd_send,
+
+    .fcntl       = citp_eventfd_fcntl,
+    .ioctl       = citp_eventfd_ioctl,
+    .select	 = citp_eventfd_select,
+    .poll	 = citp_eventfd_poll,
+    .epoll       = citp_eventfd_epoll,
+    .sleep_seq   = citp_pipe_sock_sleep_seq,
+
+    .bind        = citp_nonsock_bind,
+    .listen      = citp_nonsock_listen,
+    .accept      = citp_nonsock_accept,
+    .connect     = citp_nonsock_connect,
+    .shutdown    = citp_nonsock_shutdown,
+    .getsockname = citp_nonsock_getsockname,
+    .getpeername = citp_nonsock_getpeername,
+    .getsockopt  = citp_nonsock_getsockopt,
+    .setsockopt  = citp_nonsock_setsockopt,
+    .recvmmsg    = citp_nonsock_recvmmsg,
+    .sendmmsg    = citp_nonsock_sendmmsg,
+    .zc_send     = citp_nonsock_zc_send,
+    .zc_recv     = citp_nonsock_zc_recv,
+    .zc_recv_filter = citp_nonsock_zc_recv_filter,
+    .recvmsg_kernel = citp_nonsock_recvmsg_kernel,
+    .tmpl_alloc    = citp_nonsock_tmpl_alloc,
+    .tmpl_update   = citp_nonsock_tmpl_update,
+    .tmpl_abort    = citp_nonsock_tmpl_abort,
+#if CI_CFG_TIMESTAMPING
+    .ordered_data   = citp_nonsock_ordered_data,
+#endif
+    .is_spinning   = citp_pipe_is_spinning,
+#if CI_CFG_FD_CACHING
+    .cache          = citp_nonsock_cache,
+#endif
+  }
+};
+
+
+/* Returns the new fd, CITP_NOT_HANDLED, or -1 with errno set. */
+int citp_eventfd_create(unsigned int initval, int flags)
+{
+  citp_pipe_fdi* epi;
+  struct oo_pipe* p = NULL;
+  ci_netif* ni;
+  int fds[2];
+  int rc = -1;
+  ef_driver_handle fd = -1;
+
+  Log_V(log(LPF "eventfd(%u, %x)", initval, flags));
+
+  if( CITP_OPTS.ul_eventfd == CI_UNIX_PIPE_ACCELERATE_IF_NETIF &&
+      ! citp_netif_exists() ) {
+    return CITP_NOT_HANDLED;
+  }
+
+  rc = citp_netif_alloc_and_init(&fd, &ni);
+  if( rc != 0 ) {
+    if( rc == CI_SOCKET_HANDOVER )
+      return CITP_NOT_HANDLED;
+    goto fail1;
+  }
+  rc = -1;
+
+  CI_MAGIC_CHECK(ni, NETIF_MAGIC);
+
+  epi = CI_ALLOC_OBJ(citp_pipe_fdi);
+  if( epi == NULL ) {
+    errno = ENOMEM;
+    goto fail2;
+  }
+  citp_fdinfo_init(&epi->fdinfo, &citp_eventfd_protocol_impl);
+  epi->ni = ni;
+
+  if( fdtable_strict() )  CITP_FDTABLE_LOCK();
+  rc = oo_pipe_ctor(ni, &p, fds, flags & (O_NONBLOCK | O_CLOEXEC));
+  if( rc < 0 )
+    goto fail3;
+  p->efd_count = initval;
+  ci_atomic32_or(&p->aflags, CI_PFD_AFLAG_EVENTFD |
+                 ((flags & EFD_SEMAPHORE) ? CI_PFD_AFLAG_EFD_SEMAPHORE : 0));
+  /* The writer end is not needed: the eventfd is written through the
+   * reader, and the pipe is freed when that is closed. */
+  ci_sys_close(fds[1]);
+  citp_fdtable_new_fd_set(fds[0], fdip_busy, fdtable_strict());
+  if( fdtable_strict() )  CITP_FDTABLE_UNLOCK();
+
+  LOG_PIPE("%s: eventfd=%p id=%d", __FUNCTION__, p, p->b.bufid);
+
+  epi->pipe = p;
+  ci_assert(p->b.sb_aflags & CI_SB_AFLAG_NOT_READY);
+  ci_atomic32_and(&p->b.sb_aflags, ~CI_SB_AFLAG_NOT_READY);
+  citp_fdtable_insert(&epi->fdinfo, fds[0], 0);
+
+  return fds[0];
+
+fail3:
+  if( fdtable_strict() )  CITP_FDTABLE_UNLOCK();
+  CI_FREE_OBJ(epi);
+fail2:
+  citp_netif_release_ref(ni, 0);
+fail1:
+  if( CITP_OPTS.no_fail && errno != ELIBACC ) {
+    Log_U(ci_log("%s: failed (errno:%d) - PASSING TO OS", __FUNCTION__, errno));
+    return CITP_NOT_HANDLED;
+  }
+
+  return rc;
+}
+
+
+/**********************************************************************
+ * AF_UNIX socketpair
+ */
+
+/* An accelerated socketpair(AF_UNIX, SOCK_STREAM) is a pair of pipes, one
+ * for each direction.  Each end is the reader file of the pipe it receives
+ * from, and sends into the pipe whose unix_peer that is; the writer files
+ * are closed when the pair is created, and the kernel closes the writer of
+ * the other pipe when the reader file of an end goes.  Space freed in the
+ * pipe an end sends into is signalled on the pipe it receives from, so
+ * each end polls and is polled through its own pipe alone.
+ */
+
+#define fdi_to_unix_rx(_fdi) fdi_to_pipe(_fdi)
+#define fdi_to_unix_tx(_fdi) \
+  SP_TO_PIPE(fdi_to_pipe_fdi(_fdi)->ni, fdi_to_unix_rx(_fdi)->unix_peer)
+
+
+static int citp_unix_recv(citp_fdinfo* fdinfo, struct msghdr* msg, int flags)
+{
+  citp_pipe_fdi* epi = fdi_to_pipe_fdi(fdinfo);
+  int rc;
+
+  ci_assert(msg);
+  ci_assert(msg->msg_iov);
+
+  if( flags & ~(MSG_DONTWAIT | MSG_CMSG_CLOEXEC) ) {
+    errno = EOPNOTSUPP;
+    return -1;
+  }
+  rc = ci_pipe_recv(epi->ni, epi->pipe, msg->msg_iov, msg->msg_iovlen, flags);
+  if( rc >= 0 ) {
+    msg->msg_namelen = 0;
+    msg->msg_controllen = 0;
+    msg->msg_flags = 0;
+  }
+  return rc;
+}
+
+
+static int citp_unix_send(citp_fdinfo* fdinfo,
+                          const struct msghdr* msg, int flags)
+{
+  citp_pipe_fdi* epi = fdi_to_pipe_fdi(fdinfo);
+
+  ci_assert(msg);
+  ci_assert(msg->msg_iov);
+
+  /* Passing file descriptors and credentials is not supported. */
+  if( msg->msg_controllen != 0 ||
+      (flags & ~(MSG_DONTWAIT | MSG_NOSIGNAL | MSG_MORE | MSG_EOR)) ) {
+    errno = EOPNOTSUPP;
+    return -1;
+  }
+  if( msg->msg_iovlen == 0 )
+    return 0;
+  return ci_pipe_send(epi->ni, fdi_to_unix_tx(fdinfo), msg->msg_iov,
+                      msg->msg_iovlen, flags);
+}
+
+
+static int citp_unix_select(citp_fdinfo* fdinfo, int* n,
+                            int rd, int wr, int ex,
+                            struct oo_ul_select_state* ss)
+{
+  citp_pipe_fdi* epi = fdi_to_pipe_fdi(fdinfo);
+  unsigned mask;
+
+#if CI_CFG_SPIN_STATS
+  if( CI_UNLIKELY(! ss->stat_incremented) ) {
+    epi->ni->state->stats.spin_select++;
+    ss->stat_incremented = 1;
+  }
+#endif
+
+  mask = oo_unix_stream_poll_events(epi->pipe, fdi_to_unix_tx(fdinfo));
+
+  if( rd && (mask & SELECT_RD_SET) ) {
+    FD_SET(fdinfo->fd, ss->rdu);
+    ++*n;
+  }
+  if( wr && (mask & SELECT_WR_SET) ) {
+    FD_SET(fdinfo->fd, ss->wru);
+    ++*n;
+  }
+
+  return 1;
+}
+
+
+static int citp_unix_poll(citp_fdinfo* fdinfo, struct pollfd* pfd,
+                          struct oo_ul_poll_state* ps)
+{
+  citp_pipe_fdi* epi = fdi_to_pipe_fdi(fdinfo);
+  unsigned mask;
+
+#if CI_CFG_SPIN_STATS
+  if( CI_UNLIKELY(! ps->stat_incremented) ) {
+    epi->ni->state->stats.spin_poll++;
+    ps->stat_incremented = 1;
+  }
+#endif
+
+  mask = oo_unix_stream_poll_events(epi->pipe, fdi_to_unix_tx(fdinfo));
+  pfd->revents = mask & (pfd->events | POLLERR | POLLHUP);
+
+  return 1;
+}
+
+
+static int citp_unix_epoll(citp_fdinfo* fdinfo,
+                           struct citp_epoll_member* eitem,
+                           struct oo_ul_epoll_state* eps,
+                           int* stored_event)
+{
+  struct oo_pipe* pipe = fdi_to_pipe_fdi(fdinfo)->pipe;
+  unsigned mask;
+  ci_uint64 sleep_seq;
+  int seq_mismatch = 0;
+
+#if CI_CFG_SPIN_STATS
+  if( CI_UNLIKELY(! eps->stat_incremented) ) {
+    fdi_to_pipe_fdi(fdinfo)->ni->state->stats.spin_epoll++;
+    eps->stat_incremented = 1;
+  }
+#endif
+
+  sleep_seq = pipe->b.sleep_seq.all;
+  mask = oo_unix_stream_poll_events(pipe, fdi_to_unix_tx(fdinfo));
+  *stored_event = citp_ul_epoll_set_ul_events(eps, eitem, mask, sleep_seq,
+                                              &pipe->b.sleep_seq.all,
+                                              &seq_mismatch);
+  return seq_mismatch;
+}
+
+
+/* An end is non-blocking for both the pipe it reads and the one it
+ * writes. */
+static void citp_unix_set_nonblock(citp_fdinfo* fdinfo, int nonblock)
+{
+  ci_uint32 rx_bit = CI_PFD_AFLAG_NONBLOCK << CI_PFD_AFLAG_READER_SHIFT;
+  ci_uint32 tx_bit = CI_PFD_AFLAG_NONBLOCK << CI_PFD_AFLAG_WRITER_SHIFT;
+
+  if( nonblock ) {
+    ci_bit_mask_set(&fdi_to_unix_rx(fdinfo)->aflags, rx_bit);
+    ci_bit_mask_set(&fdi_to_unix_tx(fdinfo)->aflags, tx_bit);
+  }
+  else {
+    ci_bit_mask_clear(&fdi_to_unix_rx(fdinfo)->aflags, rx_bit);
+    ci_bit_mask_clear(&fdi_to_unix_tx(fdinfo)->aflags, tx_bit);
+  }
+}
+
+
+static int citp_unix_fcntl(citp_fdinfo* fdinfo, int cmd, long arg)
+{
+  struct oo_pipe* p = fdi_to_pipe(fdinfo);
+  int rc;
+
+  switch( cmd ) {
+  case F_GETFL:
+    rc = O_RDWR;
+    if( p->aflags & (CI_PFD_AFLAG_NONBLOCK << CI_PFD_AFLAG_READER_SHIFT) )
+      rc |= O_NONBLOCK;
+    break;
+  case F_SETFL:
+    rc = ci_sys_fcntl(fdinfo->fd, cmd, arg);
+    if( rc == 0 )
+      citp_unix_set_nonblock(fdinfo, arg & (O_NONBLOCK | O_NDELAY));
+    break;
+  case F_DUPFD:
+    rc = citp_ep_dup(fdinfo->fd, citp_ep_dup_fcntl_dup, arg);
+    break;
+  case F_DUPFD_CLOEXEC:
+    rc = citp_ep_dup(fdinfo->fd, citp_ep_dup_fcntl_dup_cloexec, arg);
+    break;
+  case F_SETOWN:
+  case F_SETOWN_EX:
+    rc = ci_sys_fcntl(fdinfo->fd, cmd, arg);
+    if( rc != 0 )
+      break;
+    p->b.sigown = arg;
+    if( p->b.sigown && (p->b.sb_aflags & CI_SB_AFLAG_O_ASYNC) )
+      ci_bit_set(&p->b.wake_request, CI_SB_FLAG_WAKE_RX_B);
+    break;
+  default:
+    rc = ci_sys_fcntl(fdinfo->fd, cmd, arg);
+    break;
+  }
+
+  Log_VSC(log("%s(%d, %d, %ld) = %d  (errno=%d)",
+              __FUNCTION__, fdinfo->fd, cmd, arg, rc, errno));
+  return rc;
+}
+
+
+static int citp_unix_ioctl(citp_fdinfo* fdinfo, int cmd, void* arg)
+{
+  struct oo_pipe* rx = fdi_to_unix_rx(fdinfo);
+  struct oo_pipe* tx = fdi_to_unix_tx(fdinfo);
+
+  switch( cmd ) {
+  case FIONBIO:
+    citp_unix_set_nonblock(fdinfo, *(int*) arg);
+    return 0;
+  case FIONREAD:
+    *(int*) arg = rx->bytes_added - rx->bytes_removed;
+    return 0;
+  case TIOCOUTQ:
+    *(int*) arg = tx->bytes_added - tx->bytes_removed;
+    return 0;
+  default:
+    errno = ENOTTY;
+    return -1;
+  }
+}
+
+
+static int citp_unix_shutdown(citp_fdinfo* fdinfo, int how)
+{
+  citp_pipe_fdi* epi = fdi_to_pipe_fdi(fdinfo);
+
+  Log_V(log(LPF "shutdown(%d, %d)", fdinfo->fd, how));
+
+  switch( how ) {
+  case SHUT_RD:
+    ci_pipe_shutdown(epi->ni, epi->pipe, CI_PFD_AFLAG_READER_SHIFT);
+    break;
+  case SHUT_WR:
+    ci_pipe_shutdown(epi->ni, fdi_to_unix_tx(fdinfo),
+                     CI_PFD_AFLAG_WRITER_SHIFT);
+    break;
+  case SHUT_RDWR:
+    ci_pipe_shutdown(epi->ni, epi->pipe, CI_PFD_AFLAG_READER_SHIFT);
+    ci_pipe_shutdown(epi->ni, fdi_to_unix_tx(fdinfo),
+                     CI_PFD_AFLAG_WRITER_SHIFT);
+    break;
+  default:
+    errno = EINVAL;
+    return -1;
+  }
+  return 0;
+}
+
+
+/* The ends of a socketpair are unnamed. */
+static int citp_unix_getname(citp_fdinfo* fdinfo,
+                             struct sockaddr* sa, socklen_t* p_sa_len)
+{
+  sa_family_t family = AF_UNIX;
+
+  if( sa == NULL || p_sa_len == NULL ) {
+    errno = EFAULT;
+    return -1;
+  }
+  memcpy(sa, &family, CI_MIN(*p_sa_len, sizeof(family)));
+  *p_sa_len = sizeof(family);
+  return 0;
+}
+
+
+static int citp_unix_getsockopt(citp_fdinfo* fdinfo, int level,
+                                int optname, void* optval, socklen_t* optlen)
+{
+  int val;
+
+  if( level != SOL_SOCKET ) {
+    errno = EOPNOTSUPP;
+    return -1;
+  }
+  switch( optname ) {
+  case SO_TYPE:
+    val = SOCK_STREAM;
+    break;
+  case SO_DOMAIN:
+    val = AF_UNIX;
+    break;
+  case SO_PROTOCOL:
+  case SO_ERROR:
+  case SO_ACCEPTCONN:
+    val = 0;
+    break;
+  case SO_RCVBUF:
+    val = fdi_to_unix_rx(fdinfo)->bufs_max * OO_PIPE_BUF_MAX_SIZE;
+    break;
+  case SO_SNDBUF:
+    val = fdi_to_unix_tx(fdinfo)->bufs_max * OO_PIPE_BUF_MAX_SIZE;
+    break;
+  default:
+    errno = ENOPROTOOPT;
+    return -1;
+  }
+  if( optval == NULL || optlen == NULL ) {
+    errno = EFAULT;
+    return -1;
+  }
+  memcpy(optval, &val, CI_MIN(*optlen, sizeof(val)));
+  *optlen = CI_MIN(*optlen, sizeof(val));
+  return 0;
+}
+
+
+static int citp_unix_setsockopt(citp_fdinfo* fdinfo, int level, int optname,
+                                const void* optval, socklen_t optlen)
+{
+  citp_pipe_fdi* epi = fdi_to_pipe_fdi(fdinfo);
+  int rc;
+
+  if( level != SOL_SOCKET ||
+      (optname != SO_RCVBUF && optname != SO_SNDBUF) ) {
+    rc = -ENOPROTOOPT;
+  }
+  else if( optval == NULL || optlen < sizeof(int) ) {
+    rc = -EINVAL;
+  }
+  else {
+    rc = ci_pipe_set_size(epi->ni, optname == SO_RCVBUF ? epi->pipe :
+                                   fdi_to_unix_tx(fdinfo),
+                          *(const int*) optval);
+  }
+
+  citp_fdinfo_release_ref(fdinfo, 0);
+  if( rc < 0 ) {
+    errno = -rc;
+    return -1;
+  }
+  return 0;
+}
+
+
+citp_protocol_impl citp_unix_stream_protocol_impl = {
+  .type        = CITP_UNIX_STREAM_FD,
+  .ops         = {
+    .socket      = NULL,        /* nobody should ever call this */
+    .dtor        = citp_pipe_dtor,
+    .dup         = citp_pipe_dup,
+
+    .recv        = citp_unix_recv,
+    .send        = citp_unix_send,
+
+    .fcntl       = citp_unix_fcntl,
+    .ioctl       = citp_unix_ioctl,
+    .select	 = citp_unix_select,
+    .poll	 = citp_unix_poll,
+    .epoll       = citp_unix_epoll,
+    .sleep_seq   = citp_pipe_sock_sleep_seq,
+
+    .bind        = citp_nonsock_bind,
+    .listen      = citp_nonsock_listen,
+    .accept      = citp_nonsock_accept,
+    .connect     = citp_nonsock_connect,
+    .shutdown    = citp_unix_shutdown,
+    .getsockname = citp_unix_getname,
+    .getpeername = citp_unix_getname,
+    .getsockopt  = citp_unix_getsockopt,
+    .setsockopt  = citp_unix_setsockopt,
+    .recvmmsg    = citp_nonsock_recvmmsg,
+    .sendmmsg    = citp_nonsock_sendmmsg,
+    .zc_send     = citp_nonsock_zc_send,
+    .zc_recv     = citp_nonsock_zc_recv,
+    .zc_recv_filter = citp_nonsock_zc_recv_filter,
+    .recvmsg_kernel = citp_nonsock_recvmsg_kernel,
+    .tmpl_alloc    = citp_nonsock_tmpl_alloc,
+    .tmpl_update   = citp_nonsock_tmpl_update,
+    .tmpl_abort    = citp_nonsock_tmpl_abort,
+#if CI_CFG_TIMESTAMPING
+    .ordered_data   = citp_nonsock_ordered_data,
+#endif
+    .is_spinning   = citp_pipe_is_spinning,
+#if CI_CFG_FD_CACHING
+    .cache          = citp_nonsock_cache,
+#endif
+  }
+};
+
+
+/* Returns 0, CITP_NOT_HANDLED, or -1 with errno set. */
+int citp_unix_socketpair_create(int flags, int sv[2])
+{
+  citp_pipe_fdi* epi[2];
+  struct oo_pipe* p[2];
+  ci_netif* ni;
+  int fds[2][2];
+  int rc = -1;
+  int i;
+  ef_driver_handle fd = -1;
+
+  Log_V(log(LPF "socketpair(AF_UNIX, SOCK_STREAM | %x)", flags));
+
+  if( CITP_OPTS.ul_unix_socketpair == CI_UNIX_PIPE_ACCELERATE_IF_NETIF &&
+      ! citp_netif_exists() ) {
+    return CITP_NOT_HANDLED;
+  }
+
+  rc = citp_netif_alloc_and_init(&fd, &ni);
+  if( rc != 0 ) {
+    if( rc == CI_SOCKET_HANDOVER )
+      return CITP_NOT_HANDLED;
+    goto fail1;
+  }
+  rc = -1;
+
+  CI_MAGIC_CHECK(ni, NETIF_MAGIC);
+
+  /* add another reference as we have 2 fdis */
+  citp_netif_add_ref(ni);
+
+  for( i = 0; i < 2; ++i ) {
+    epi[i] = CI_ALLOC_OBJ(citp_pipe_fdi);
+    if( epi[i] == NULL ) {
+      errno = ENOMEM;
+      goto fail2;
+    }
+    citp_fdinfo_init(&epi[i]->fdinfo, &citp_unix_stream_protocol_impl);
+    epi[i]->ni = ni;
+  }
+
+  if( fdtable_strict() )  CITP_FDTABLE_LOCK();
+  rc = oo_pipe_ctor(ni, &p[0], fds[0], flags);
+  if( rc < 0 )
+    goto fail3;
+  rc = oo_pipe_ctor(ni, &p[1], fds[1], flags);
+  if( rc < 0 ) {
+    ci_sys_close(fds[0][0]);
+    ci_sys_close(fds[0][1]);
+    goto fail3;
+  }
+
+  /* The link must be in place before the writer files are closed, so that
+   * the kernel does not take that as the end of the pipes. */
+  p[0]->unix_peer = W_SP(&p[1]->b);
+  p[1]->unix_peer = W_SP(&p[0]->b);
+  ci_wmb();
+  for( i = 0; i < 2; ++i ) {
+    ci_atomic32_or(&p[i]->aflags, CI_PFD_AFLAG_UNIX_STREAM);
+    ci_sys_close(fds[i][1]);
+    sv[i] = fds[i][0];
+    citp_fdtable_new_fd_set(sv[i], fdip_busy, fdtable_strict());
+  }
+  if( fdtable_strict() )  CITP_FDTABLE_UNLOCK();
+
+  LOG_PIPE("%s: socketpair=%d,%d", __FUNCTION__, p[0]->b.bufid,
+           p[1]->b.bufid);
+
+  for( i = 0; i < 2; ++i ) {
+    epi[i]->pipe = p[i];
+    ci_assert(p[i]->b.sb_aflags & CI_SB_AFLAG_NOT_READY);
+    ci_atomic32_and(&p[i]->b.sb_aflags, ~CI_SB_AFLAG_NOT_READY);
+    citp_fdtable_insert(&epi[i]->fdinfo, sv[i], 0);
+  }
+
+  return 0;
+
+fail3:
+  if( fdtable_strict() )  CITP_FDTABLE_UNLOCK();
+  i = 2;
+fail2:
+  while( --i >= 0 )
+    CI_FREE_OBJ(epi[i]);
+  citp_netif_release_ref(ni, 0);
+  citp_netif_release_ref(ni, 0);
+fail1:
+  if( CITP_OPTS.no_fail && errno != ELIBACC ) {
+    Log_U(ci_log("%s: failed (errno:%d) - PASSING TO OS", __FUNCTION__, errno));
+    return CITP_NOT_HANDLED;
+  }
+
+  return rc;
+}
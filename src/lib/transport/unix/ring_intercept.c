@@ -0,0 +1,528 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+/**************************************************************************\
+** <L5_PRIVATE L5_SOURCE>
+** Description: Submission/completion ring API (onload_ring_*)
+** </L5_PRIVATE>
+\**************************************************************************/
+
+/* A ring is processed in passes.  Each pass enters the library once,
+ * moves new submissions onto the list of outstanding operations and then
+ * attempts every outstanding operation without blocking.  Each socket the
+ * pass refers to is looked up once, and sends and receives call the
+ * socket's own op with MSG_DONTWAIT.  Operations that are not ready stay
+ * outstanding, and so do any later operations of the same kind on the
+ * same socket, so that those complete in the order they were submitted.
+ *
+ * The number of outstanding operations plus unreaped completions never
+ * exceeds the size of the completion queue, so every operation that
+ * completes has a slot to complete into.
+ */
+
+#include "internal.h"
+#include "ul_poll.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include <onload/extensions.h>
+#include <onload/extensions_ring.h>
+
+
+/* Largest submission queue a ring may have. */
+#define OO_RING_MAX_ENTRIES  32768
+
+/* How long the poller thread spins without finding work before it waits
+ * on the sockets with outstanding operations (or just sleeps if there are
+ * none), and how long each wait lasts.
+ */
+#define OO_RING_POLLER_IDLE_US   1000
+#define OO_RING_POLLER_WAIT_MS   1
+
+
+/* A socket looked up by the current pass. */
+struct oo_ring_fd {
+  citp_fdinfo*            fdi;
+  int                     fd;
+  int                     in_use;
+  /* Opcodes that have an operation left outstanding by this pass. */
+  unsigned                blocked;
+};
+
+
+struct oo_ring {
+  struct onload_ring      ring;
+
+  /* Operations consumed from the SQ that have not completed yet. */
+  struct onload_ring_sqe* pending;
+  unsigned                n_pending;
+
+  /* Scratch space for waiting on [pending]. */
+  struct pollfd*          pfds;
+
+  /* The sockets looked up by the current pass: an open-addressed hash
+   * table with as many slots as there can be operations outstanding, and
+   * the list of slots in use. */
+  struct oo_ring_fd*      fds;
+  unsigned*               fds_used;
+
+  int                     has_poller;
+  volatile int            poller_stop;
+  pthread_t               poller;
+
+  /* With a poller thread, onload_ring_enter() sleeps on [cq_seq], which the
+   * poller bumps whenever operations complete. */
+  volatile ci_uint32      cq_seq;
+  volatile ci_uint32      cq_waiters;
+};
+
+
+static unsigned oo_ring_cq_ready(struct onload_ring* ring)
+{
+  return ring->cq_tail - OO_ACCESS_ONCE(ring->cq_head);
+}
+
+
+/* Attempt one operation without blocking.  Returns 1 and fills in [cqe]
+ * if the operation has completed, or 0 if it must be retried.
+ */
+static int oo_ring_op_try(const struct onload_ring_sqe* sqe,
+                          citp_fdinfo* fdi, struct oo_ul_poll_state* ps,
+                          citp_lib_context_t* lib_context,
+                          struct onload_ring_cqe* cqe)
+{
+  struct pollfd pfd;
+  struct msghdr m;
+  struct iovec iov;
+  socklen_t sa_len;
+  int flags, rc;
+
+  switch( sqe->opcode ) {
+  case ONLOAD_RING_OP_NOP:
+    rc = 0;
+    break;
+
+  case ONLOAD_RING_OP_SEND:
+  case ONLOAD_RING_OP_RECV:
+    flags = sqe->msg_flags | MSG_DONTWAIT;
+    if( fdi == NULL ) {
+      if( sqe->opcode == ONLOAD_RING_OP_SEND )
+        rc = ci_sys_send(sqe->fd, sqe->buf, sqe->len, flags);
+      else
+        rc = ci_sys_recv(sqe->fd, sqe->buf, sqe->len, flags);
+      break;
+    }
+    iov.iov_base = sqe->buf;
+    iov.iov_len = sqe->len;
+    memset(&m, 0, sizeof(m));
+    m.msg_iov = &iov;
+    m.msg_iovlen = 1;
+    if( sqe->opcode == ONLOAD_RING_OP_SEND )
+      rc = citp_fdinfo_get_ops(fdi)->send(fdi, &m, flags);
+    else
+      rc = citp_fdinfo_get_ops(fdi)->recv(fdi, &m, flags);
+    break;
+
+  case ONLOAD_RING_OP_ACCEPT:
+    /* accept() has no per-call non-blocking flag, so only call it once a
+     * connection is waiting.
+     */
+    pfd.fd = sqe->fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if( fdi == NULL || ! citp_fdinfo_get_ops(fdi)->poll(fdi, &pfd, ps) ) {
+      if( ci_sys_poll(&pfd, 1, 0) < 0 ) {
+        rc = -1;
+        break;
+      }
+    }
+    if( pfd.revents == 0 )
+      return 0;
+    sa_len = sqe->len;
+    if( fdi != NULL ) {
+      rc = citp_fdinfo_get_ops(fdi)->accept(fdi, sqe->buf,
+                                            sqe->buf ? &sa_len : NULL,
+                                            sqe->msg_flags, lib_context);
+    }
+    else {
+      rc = ci_sys_accept4(sqe->fd, sqe->buf, sqe->buf ? &sa_len : NULL,
+                          sqe->msg_flags);
+      if( rc >= 0 )
+        citp_fdtable_passthru(rc, 0);
+    }
+    if( rc >= 0 && sqe->buf != NULL )
+      cqe->len = sa_len;
+    break;
+
+  default:
+    errno = EINVAL;
+    rc = -1;
+    break;
+  }
+
+  if( rc < 0 ) {
+    if( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR )
+      return 0;
+    rc = -errno;
+  }
+  cqe->user_data = sqe->user_data;
+  cqe->res = rc;
+  return 1;
+}
+
+
+/* Find the slot for [fd] in the current pass, looking it up if the pass
+ * has not seen it yet. */
+static struct oo_ring_fd* oo_ring_fd_get(struct oo_ring* r, int fd,
+                                         unsigned* n_used)
+{
+  unsigned mask = r->ring.cq_mask;
+  unsigned i = ((unsigned) fd * 0x9e3779b1u) & mask;
+  struct oo_ring_fd* f;
+
+  while( (f = &r->fds[i])->in_use ) {
+    if( f->fd == fd )
+      return f;
+    i = (i + 1) & mask;
+  }
+  f->in_use = 1;
+  f->fd = fd;
+  f->fdi = citp_fdtable_lookup(fd);
+  r->fds_used[(*n_used)++] = i;
+  return f;
+}
+
+
+/* Make one pass over the ring.  Returns the number of operations that
+ * completed.  Called with the library entered.
+ */
+static int oo_ring_pass(struct oo_ring* r, citp_lib_context_t* lib_context)
+{
+  struct onload_ring* ring = &r->ring;
+  struct oo_ul_poll_state ps;
+  struct onload_ring_cqe* cqe;
+  struct oo_ring_fd* f;
+  unsigned sq_head, sq_tail, cq_tail, room, i, n, op_bit, n_fds = 0;
+  int n_done = 0;
+
+  /* Move new submissions onto the outstanding list, as long as the
+   * completion queue has room for all of them to complete.
+   */
+  sq_head = ring->sq_head;
+  sq_tail = OO_ACCESS_ONCE(ring->sq_tail);
+  ci_rmb();
+  room = ring->cq_mask + 1 - oo_ring_cq_ready(ring) - r->n_pending;
+  while( sq_head != sq_tail && room != 0 ) {
+    r->pending[r->n_pending++] = ring->sqes[sq_head++ & ring->sq_mask];
+    --room;
+  }
+  ci_mb();
+  OO_ACCESS_ONCE(ring->sq_head) = sq_head;
+
+  ci_frc64(&ps.this_poll_frc);
+  ps.ul_poll_spin = 0;
+
+  cq_tail = ring->cq_tail;
+  for( i = n = 0; i < r->n_pending; ++i ) {
+    const struct onload_ring_sqe* sqe = &r->pending[i];
+    f = oo_ring_fd_get(r, sqe->fd, &n_fds);
+    /* Unknown opcodes fail without ever being left outstanding. */
+    op_bit = sqe->opcode < 32 ? 1u << sqe->opcode : 0;
+    cqe = &ring->cqes[cq_tail & ring->cq_mask];
+    cqe->len = 0;
+    if( ! (f->blocked & op_bit) &&
+        oo_ring_op_try(sqe, f->fdi, &ps, lib_context, cqe) ) {
+      ++cq_tail;
+      ++n_done;
+    }
+    else {
+      f->blocked |= op_bit;
+      if( n != i )
+        r->pending[n] = *sqe;
+      ++n;
+    }
+  }
+  for( i = 0; i < n_fds; ++i ) {
+    f = &r->fds[r->fds_used[i]];
+    if( f->fdi != NULL )
+      citp_fdinfo_release_ref(f->fdi, 0);
+    f->in_use = 0;
+    f->blocked = 0;
+  }
+
+  /* Completions are published before they leave [n_pending], so that a
+   * waiter that finds nothing outstanding also finds every completion. */
+  if( n_done ) {
+    ci_wmb();
+    OO_ACCESS_ONCE(ring->cq_tail) = cq_tail;
+    ci_wmb();
+  }
+  OO_ACCESS_ONCE(r->n_pending) = n;
+
+  if( n_done && r->has_poller ) {
+    ci_wmb();
+    OO_ACCESS_ONCE(r->cq_seq) = r->cq_seq + 1;
+    ci_mb();
+    if( OO_ACCESS_ONCE(r->cq_waiters) )
+      syscall(SYS_futex, &r->cq_seq, FUTEX_WAKE_PRIVATE, INT_MAX,
+              NULL, NULL, 0);
+  }
+  return n_done;
+}
+
+
+/* Is any submitted operation still to complete?  With a poller thread this
+ * reads the poller's state, so sq_head is read before n_pending, which
+ * includes the operations consumed from the SQ before sq_head moves. */
+static int oo_ring_outstanding(struct oo_ring* r)
+{
+  struct onload_ring* ring = &r->ring;
+  int rc;
+
+  rc = OO_ACCESS_ONCE(ring->sq_head) != ring->sq_tail;
+  ci_rmb();
+  return rc || OO_ACCESS_ONCE(r->n_pending) != 0;
+}
+
+
+/* Wait for the poller thread to complete an operation.  Returns 0 if it
+ * may have done so, or -errno. */
+static int oo_ring_poller_wait(struct oo_ring* r, unsigned min_complete,
+                               int timeout_ms)
+{
+  struct timespec ts, *pts = NULL;
+  ci_uint32 seq;
+  int rc = 0;
+
+  if( timeout_ms >= 0 ) {
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+    pts = &ts;
+  }
+
+  ci_atomic32_inc(&r->cq_waiters);
+  ci_mb();
+  seq = OO_ACCESS_ONCE(r->cq_seq);
+  ci_rmb();
+  /* Anything that completes after [seq] was read changes it, so the
+   * futex cannot miss it. */
+  if( oo_ring_outstanding(r) &&
+      oo_ring_cq_ready(&r->ring) < min_complete &&
+      syscall(SYS_futex, &r->cq_seq, FUTEX_WAIT_PRIVATE, seq,
+              pts, NULL, 0) < 0 &&
+      errno != EAGAIN && errno != ETIMEDOUT )
+    rc = -errno;
+  ci_atomic32_dec(&r->cq_waiters);
+  return rc;
+}
+
+
+/* Wait for one of the outstanding operations to become ready, as poll()
+ * would.  Returns >0 if one may be, 0 if there is nothing to wait for or
+ * the timeout expired, or -1 with errno set.
+ */
+static int oo_ring_wait(struct oo_ring* r, int timeout_ms)
+{
+  citp_lib_context_t lib_context;
+  ci_uint64 used_ms = 0;
+  unsigned i;
+  int rc;
+
+  if( r->n_pending == 0 )
+    return 0;
+
+  for( i = 0; i < r->n_pending; ++i ) {
+    r->pfds[i].fd = r->pending[i].fd;
+    r->pfds[i].events =
+      r->pending[i].opcode == ONLOAD_RING_OP_SEND ? POLLOUT : POLLIN;
+    r->pfds[i].revents = 0;
+  }
+
+  if( ! CITP_OPTS.ul_poll )
+    return ci_sys_poll(r->pfds, r->n_pending, timeout_ms);
+
+  citp_enter_lib(&lib_context);
+  rc = citp_ul_do_poll(r->pfds, r->n_pending, timeout_ms, &used_ms,
+                       &lib_context, NULL);
+  if( timeout_ms != used_ms && rc == 0 )
+    rc = ci_sys_poll(r->pfds, r->n_pending, timeout_ms - used_ms);
+  return rc;
+}
+
+
+static void* oo_ring_poller(void* arg)
+{
+  struct oo_ring* r = arg;
+  citp_lib_context_t lib_context;
+  ci_uint64 idle_cycles = citp_usec_to_cycles64(OO_RING_POLLER_IDLE_US);
+  ci_uint64 last_work_frc, now_frc;
+  int n;
+
+  ci_frc64(&last_work_frc);
+  while( ! r->poller_stop ) {
+    citp_enter_lib(&lib_context);
+    n = oo_ring_pass(r, &lib_context);
+    citp_exit_lib(&lib_context, TRUE);
+
+    ci_frc64(&now_frc);
+    if( n != 0 || OO_ACCESS_ONCE(r->ring.sq_tail) != r->ring.sq_head )
+      last_work_frc = now_frc;
+    else if( now_frc - last_work_frc < idle_cycles )
+      continue;
+    else if( r->n_pending != 0 )
+      oo_ring_wait(r, OO_RING_POLLER_WAIT_MS);
+    else
+      ci_sys_poll(NULL, 0, OO_RING_POLLER_WAIT_MS);
+  }
+  return NULL;
+}
+
+
+static void oo_ring_free(struct oo_ring* r)
+{
+  free(r->ring.sqes);
+  free(r->ring.cqes);
+  free(r->pending);
+  free(r->pfds);
+  free(r->fds);
+  free(r->fds_used);
+  free(r);
+}
+
+
+int onload_ring_alloc(unsigned entries, unsigned flags,
+                      struct onload_ring** ring_out)
+{
+  struct oo_ring* r;
+  unsigned sq_n, cq_n;
+  sigset_t all, saved;
+  int rc;
+
+  Log_CALL(ci_log("%s(%u, %x, %p)", __FUNCTION__, entries, flags, ring_out));
+
+  if( entries == 0 || entries > OO_RING_MAX_ENTRIES ||
+      (flags & ~ONLOAD_RING_F_POLLER) )
+    return -EINVAL;
+
+  for( sq_n = 1; sq_n < entries; sq_n <<= 1 )
+    ;
+  cq_n = sq_n * 2;
+
+  if( (r = calloc(1, sizeof(*r))) == NULL )
+    return -ENOMEM;
+  r->ring.sqes = calloc(sq_n, sizeof(*r->ring.sqes));
+  r->ring.cqes = calloc(cq_n, sizeof(*r->ring.cqes));
+  r->pending = calloc(cq_n, sizeof(*r->pending));
+  r->pfds = calloc(cq_n, sizeof(*r->pfds));
+  r->fds = calloc(cq_n, sizeof(*r->fds));
+  r->fds_used = calloc(cq_n, sizeof(*r->fds_used));
+  if( r->ring.sqes == NULL || r->ring.cqes == NULL ||
+      r->pending == NULL || r->pfds == NULL ||
+      r->fds == NULL || r->fds_used == NULL ) {
+    oo_ring_free(r);
+    return -ENOMEM;
+  }
+  r->ring.sq_mask = sq_n - 1;
+  r->ring.cq_mask = cq_n - 1;
+  r->ring.priv = r;
+
+  if( flags & ONLOAD_RING_F_POLLER ) {
+    /* Signals are for the application's threads, not ours. */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+    rc = pthread_create(&r->poller, NULL, oo_ring_poller, r);
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    if( rc != 0 ) {
+      oo_ring_free(r);
+      return -rc;
+    }
+    r->has_poller = 1;
+  }
+
+  *ring_out = &r->ring;
+  Log_CALL_RESULT(0);
+  return 0;
+}
+
+
+int onload_ring_free(struct onload_ring* ring)
+{
+  struct oo_ring* r = ring->priv;
+
+  Log_CALL(ci_log("%s(%p)", __FUNCTION__, ring));
+
+  if( r->has_poller ) {
+    r->poller_stop = 1;
+    pthread_join(r->poller, NULL);
+  }
+  oo_ring_free(r);
+  return 0;
+}
+
+
+int onload_ring_enter(struct onload_ring* ring, unsigned min_complete,
+                      int timeout_ms)
+{
+  struct oo_ring* r = ring->priv;
+  citp_lib_context_t lib_context;
+  ci_uint64 start_frc, now_frc, used_ms;
+  unsigned n_ready;
+  int rc;
+
+  Log_CALL(ci_log("%s(%p, %u, %d)", __FUNCTION__, ring, min_complete,
+                  timeout_ms));
+
+  if( min_complete > ring->cq_mask + 1 )
+    min_complete = ring->cq_mask + 1;
+  ci_frc64(&start_frc);
+
+  while( 1 ) {
+    if( ! r->has_poller ) {
+      citp_enter_lib(&lib_context);
+      oo_ring_pass(r, &lib_context);
+      citp_exit_lib(&lib_context, TRUE);
+    }
+
+    n_ready = oo_ring_cq_ready(ring);
+    if( n_ready >= min_complete || timeout_ms == 0 )
+      break;
+    ci_frc64(&now_frc);
+    used_ms = (now_frc - start_frc) / citp.cpu_khz;
+    if( timeout_ms > 0 && used_ms >= timeout_ms )
+      break;
+
+    if( r->has_poller ) {
+      if( ! oo_ring_outstanding(r) ) {
+        /* n_ready may be stale: the last operations may have completed
+         * since it was read. */
+        n_ready = oo_ring_cq_ready(ring);
+        break;
+      }
+      rc = oo_ring_poller_wait(r, min_complete,
+                               timeout_ms < 0 ? -1 :
+                               timeout_ms - (int) used_ms);
+      if( rc < 0 ) {
+        Log_CALL_RESULT(rc);
+        return rc;
+      }
+      continue;
+    }
+    rc = oo_ring_wait(r, timeout_ms < 0 ? -1 : timeout_ms - (int) used_ms);
+    if( rc < 0 ) {
+      rc = -errno;
+      Log_CALL_RESULT(rc);
+      return rc;
+    }
+    if( rc == 0 && r->n_pending == 0 )
+      /* Nothing outstanding can complete: either all submissions have
+       * been processed or the completion queue is full. */
+      break;
+  }
+
+  Log_CALL_RESULT(n_ready);
+  return n_ready;
+}
@@ -2282,14 +2282,22 @@ OO_INTERCEPT(int, socketpair,
   Log_CALL(ci_log("%s(%d, %d, %d, [%d, %d])", __FUNCTION__,d,type,protocol,
                   sv ? sv[0] : -1, sv ? sv[1] : -1));
 
-  rc = ci_sys_socketpair(d, type, protocol, sv);
   citp_enter_lib(&lib_context);
-  if( rc == 0 ) {
-    citp_fdtable_passthru(sv[0], 0);
-    citp_fdtable_passthru(sv[1], 0);
+  rc = CITP_NOT_HANDLED;
+  if( CITP_OPTS.ul_unix_socketpair && d == AF_UNIX && sv != NULL &&
+      (type & ~(SOCK_NONBLOCK | SOCK_CLOEXEC)) == SOCK_STREAM &&
+      protocol == 0 )
+    rc = citp_unix_socketpair_create(type & (SOCK_NONBLOCK | SOCK_CLOEXEC),
+                                     sv);
+  if( rc == CITP_NOT_HANDLED ) {
+    rc = ci_sys_socketpair(d, type, protocol, sv);
+    if( rc == 0 ) {
+      citp_fdtable_passthru(sv[0], 0);
+      citp_fdtable_passthru(sv[1], 0);
+    }
+    Log_PT(log("PT: sys_socketpair(%d, %d, %d, sv) = %d  sv={%d,%d}",
+               d, type, protocol, rc, sv ? sv[0]:-1, sv ? sv[1]:-1));
   }
-  Log_PT(log("PT: sys_socketpair(%d, %d, %d, sv) = %d  sv={%d,%d}",
-             d, type, protocol, rc, sv ? sv[0]:-1, sv ? sv[1]:-1));
   citp_exit_lib(&lib_context, rc == 0);
   Log_CALL(ci_log("%s returning %d, [%d,%d] (errno %d)",__FUNCTION__,
                   rc,sv[0],sv[1],errno));
@@ -2369,6 +2377,37 @@ OO_INTERCEPT(int, pipe2,
 }
 
 
+OO_INTERCEPT(int, eventfd,
+             (unsigned int initval, int flags))
+{
+  int rc = CITP_NOT_HANDLED;
+  citp_lib_context_t lib_context;
+
+  if( CI_UNLIKELY(citp.init_level < CITP_INIT_ALL) ) {
+    citp_do_init(CITP_INIT_SYSCALLS);
+    return ci_sys_eventfd(initval, flags);
+  }
+  if( (flags & ~(EFD_CLOEXEC | EFD_NONBLOCK | EFD_SEMAPHORE)) != 0 )
+    return ci_sys_eventfd(initval, flags);
+
+  Log_CALL(ci_log("%s(%u, %x)", __FUNCTION__, initval, flags));
+  citp_enter_lib(&lib_context);
+
+  if( CITP_OPTS.ul_eventfd )
+    rc = citp_eventfd_create(initval, flags);
+  if( rc == CITP_NOT_HANDLED ) {
+    rc = ci_sys_eventfd(initval, flags);
+    if( rc >= 0 )
+      citp_fdtable_passthru(rc, 0);
+    Log_PT(log("PT: sys_eventfd(%u, %x) = %d", initval, flags, rc));
+  }
+
+  citp_exit_lib(&lib_context, rc >= 0);
+  Log_CALL_RESULT(rc);
+  return rc;
+}
+
+
 OO_INTERCEPT(int, setuid, (uid_t uid))
 {
   int rc;
@@ -2414,7 +2453,8 @@ static void oo_update_fstat_mode(int fd, __mode_t* st_mode_p)
       }
       else
       if( fdi->protocol->type == CITP_EPOLLB_FD ||
-          fdi->protocol->type == CITP_EPOLL_FD )
+          fdi->protocol->type == CITP_EPOLL_FD ||
+          fdi->protocol->type == CITP_EVENTFD_FD )
         *st_mode_p = 0600;
       else
         *st_mode_p |= S_IFSOCK;
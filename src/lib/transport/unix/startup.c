@@ -173,17 +173,21 @@ static void citp_dump_opts(citp_opts_t *o)
   DUMP_OPT_INT("EF_EPOLL_MT_SAFE",      ul_epoll_mt_safe);
   DUMP_OPT_INT("EF_FDTABLE_SIZE",	fdtable_size);
   DUMP_OPT_INT("EF_SPIN_USEC",		ul_spin_usec);
+  DUMP_OPT_INT("EF_SPIN_ADAPTIVE",	ul_spin_adaptive);
   DUMP_OPT_INT("EF_SLEEP_SPIN_USEC",	sleep_spin_usec);
   DUMP_OPT_INT("EF_STACK_PER_THREAD",	stack_per_thread);
   DUMP_OPT_INT("EF_DONT_ACCELERATE",	dont_accelerate);
   DUMP_OPT_INT("EF_FDTABLE_STRICT",	fdtable_strict);
   DUMP_OPT_INT("EF_FDS_MT_SAFE",	fds_mt_safe);
+  DUMP_OPT_INT("EF_FDS_DEFER_FREE",	fds_defer_free);
   DUMP_OPT_INT("EF_FORK_NETIF",		fork_netif);
   DUMP_OPT_INT("EF_NETIF_DTOR",		netif_dtor);
   DUMP_OPT_INT("EF_NO_FAIL",		no_fail);
   DUMP_OPT_INT("EF_SA_ONSTACK_INTERCEPT",	sa_onstack_intercept);
   DUMP_OPT_INT("EF_ACCEPT_INHERIT_NONBLOCK", accept_force_inherit_nonblock);
   DUMP_OPT_INT("EF_PIPE", ul_pipe);
+  DUMP_OPT_INT("EF_EVENTFD", ul_eventfd);
+  DUMP_OPT_INT("EF_UNIX_SOCKETPAIR", ul_unix_socketpair);
   DUMP_OPT_HEX("EF_SIGNALS_NOPOSTPONE", signals_no_postpone);
   DUMP_OPT_HEX("EF_SYNC_CPLANE_AT_CREATE", sync_cplane);
   DUMP_OPT_INT("EF_CLUSTER_SIZE",  cluster_size);
@@ -436,16 +440,20 @@ static void citp_opts_getenv(citp_opts_t* opts)
   GET_ENV_OPT_INT("EF_WODA_SINGLE_INTERFACE", woda_single_if);
   GET_ENV_OPT_INT("EF_FDTABLE_SIZE",	fdtable_size);
   GET_ENV_OPT_INT("EF_SPIN_USEC",	ul_spin_usec);
+  GET_ENV_OPT_INT("EF_SPIN_ADAPTIVE",	ul_spin_adaptive);
   GET_ENV_OPT_INT("EF_SLEEP_SPIN_USEC",	sleep_spin_usec);
   GET_ENV_OPT_INT("EF_STACK_PER_THREAD",stack_per_thread);
   GET_ENV_OPT_INT("EF_DONT_ACCELERATE",	dont_accelerate);
   GET_ENV_OPT_INT("EF_FDTABLE_STRICT",	fdtable_strict);
   GET_ENV_OPT_INT("EF_FDS_MT_SAFE",	fds_mt_safe);
+  GET_ENV_OPT_INT("EF_FDS_DEFER_FREE",	fds_defer_free);
   GET_ENV_OPT_INT("EF_NO_FAIL",		no_fail);
   GET_ENV_OPT_INT("EF_SA_ONSTACK_INTERCEPT",	sa_onstack_intercept);
   GET_ENV_OPT_INT("EF_ACCEPT_INHERIT_NONBLOCK",	accept_force_inherit_nonblock);
   GET_ENV_OPT_INT("EF_VFORK_MODE",	vfork_mode);
   GET_ENV_OPT_INT("EF_PIPE",        ul_pipe);
+  GET_ENV_OPT_INT("EF_EVENTFD",     ul_eventfd);
+  GET_ENV_OPT_INT("EF_UNIX_SOCKETPAIR", ul_unix_socketpair);
   GET_ENV_OPT_INT("EF_SYNC_CPLANE_AT_CREATE",	sync_cplane);
 
   if( (s = getenv("EF_FORK_NETIF")) && sscanf(s, "%x", &v) == 1 ) {
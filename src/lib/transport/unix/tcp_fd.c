@@ -742,35 +742,53 @@ fail:
 #endif
 
 
+#if CI_CFG_TCP_ACCEPTQ_SHARDS
+/* The accept sub-queue that this thread prefers; see EF_TCP_ACCEPTQ_SHARDS.
+ */
+static inline unsigned citp_tcp_acceptq_home_shard(void)
+{
+  int cpu = sched_getcpu();
+  return cpu < 0 ? 0 : cpu;
+}
+#endif
+
+
+/* Accept a connection from the accept queue.  If [w] is NULL the caller
+ * holds the listening socket lock and the accept queue is not empty.
+ * Otherwise [w] has already been taken from accept sub-queue [shard], and
+ * the socket lock is not held.
+ */
 static int citp_tcp_accept_ul(citp_fdinfo* fdinfo, ci_netif* ni,
 			      ci_tcp_socket_listen* listener,
 			      struct sockaddr* sa, socklen_t* p_sa_len,
-                              int flags)
+                              int flags, citp_waitable* w, unsigned shard)
 {
   citp_sock_fdi* newepi;
   citp_fdinfo* newfdi;
   ci_tcp_state* ts;
-  citp_waitable* w;
   int newfd;
 #if CI_CFG_FD_CACHING
   int from_cache;
 #endif
-  int unlocked = 0;
+  int unlocked = w != NULL;
 
   Log_VSS(ci_log(LPF "accept(%d:%d, sa, %d)", fdinfo->fd,
                  S_FMT(listener), p_sa_len ? *p_sa_len : -1));
 #if CI_CFG_FD_CACHING
 redo:
 #endif
-  /* Pop the socket off the accept queue. */
-  ci_assert(ci_sock_is_locked(ni, &listener->s.b));
-  ci_assert(ci_tcp_acceptq_not_empty(listener));
-  w = ci_tcp_acceptq_get(ni, listener);
+  if( w == NULL ) {
+    /* Pop the socket off the accept queue. */
+    ci_assert(ci_sock_is_locked(ni, &listener->s.b));
+    ci_assert(ci_tcp_acceptq_not_empty(listener));
+    w = ci_tcp_acceptq_get(ni, listener);
+  }
 
 #if CI_CFG_ENDPOINT_MOVE
   if( w->sb_aflags & CI_SB_AFLAG_MOVED_AWAY ) {
     int rc;
-    ci_sock_unlock(ni, &listener->s.b);
+    if( ! unlocked )
+      ci_sock_unlock(ni, &listener->s.b);
     rc = citp_tcp_accept_alien(ni, listener, sa, p_sa_len, flags, w);
     if( rc != CI_ACCEPT_FAKED_UP )
       return rc;
@@ -794,10 +812,14 @@ redo:
   if( from_cache ) {
     /* We need a listening socket lock to remove from the epcache list.
      * But faked-up loopback connection can't be cached, so we are safe
-     * here. */
-    ci_assert(! unlocked);
+     * here.  Connections from accept sub-queues are taken without the
+     * lock, so take it now. */
+    if( unlocked )
+      ci_sock_lock(ni, &listener->s.b);
     oo_p_dllink_del_init(ni, oo_p_dllink_sb(ni, &ts->s.b,
                                             &ts->epcache_fd_link));
+    if( unlocked )
+      ci_sock_unlock(ni, &listener->s.b);
   }
 #endif
   if( ! unlocked )
@@ -808,6 +830,30 @@ redo:
   if( newfd < 0 ) {
     Log_E(ci_log(LPF "%s: citp_tcp_ep_acquire_fd failed: %d",
                  __FUNCTION__, newfd));
+#if CI_CFG_TCP_ACCEPTQ_SHARDS
+    if( listener->acceptq_shards_n != 0 ) {
+      ci_assert(ts->s.b.sb_aflags & CI_SB_AFLAG_TCP_IN_ACCEPTQ);
+#if CI_CFG_FD_CACHING
+      if( newfd == -ENOANO ) {
+        Log_EP(ci_log("%s: [%d:%d]. puttint accepted socket back on acceptq "
+                      "shard %u", __FUNCTION__, NI_ID(ni), S_SP(ts), shard));
+        ci_tcp_acceptq_shard_put_back(ni, listener, shard, &ts->s.b, 1,
+                                      citp_getpid());
+        CITP_STATS_NETIF_INC(ni, accept_attach_fd_retry);
+        sched_yield();
+        w = ci_tcp_acceptq_shard_get(ni, listener, shard, citp_getpid(),
+                                     &shard);
+        if( w != NULL )
+          goto redo;
+        RET_WITH_ERRNO(EAGAIN);
+      }
+#endif
+      ci_tcp_acceptq_shard_put_back(ni, listener, shard, &ts->s.b, 0,
+                                    citp_getpid());
+      CITP_STATS_TCP_LISTEN(++listener->stats.n_accept_no_fd);
+      RET_WITH_ERRNO(-newfd);
+    }
+#endif
     ci_sock_lock(ni, &listener->s.b);
     ci_assert(ts->s.b.sb_aflags & CI_SB_AFLAG_TCP_IN_ACCEPTQ);
 #if CI_CFG_FD_CACHING
@@ -817,6 +863,8 @@ redo:
       ci_tcp_acceptq_put_back_tail(ni, listener, &ts->s.b);
       CITP_STATS_NETIF_INC(ni, accept_attach_fd_retry);
       sched_yield();
+      w = NULL;
+      unlocked = 0;
       goto redo;
     } else
 #endif
@@ -917,6 +965,26 @@ check_ul_accept_q:
     return -1;
   }
 
+#if CI_CFG_TCP_ACCEPTQ_SHARDS
+  if( listener->acceptq_shards_n != 0 ) {
+    if( ci_tcp_acceptq_n(listener) ) {
+      citp_waitable* w;
+      unsigned shard;
+      /* delayed error report (after a connect came) */
+      if( CI_UNLIKELY(p_sa_len == NULL && sa != NULL) ) {
+        CI_SET_ERROR(rc, EFAULT);
+        return rc;
+      }
+      w = ci_tcp_acceptq_shard_get(ni, listener,
+                                   citp_tcp_acceptq_home_shard(),
+                                   citp_getpid(), &shard);
+      if( w != NULL )
+        return citp_tcp_accept_ul(fdinfo, ni, listener, sa, p_sa_len, flags,
+                                  w, shard);
+    }
+  }
+  else
+#endif
   if( ci_tcp_acceptq_n(listener) ) {
       ci_sock_lock(ni, &listener->s.b);
       if( ci_tcp_acceptq_not_empty(listener) ) {
@@ -926,7 +994,8 @@ check_ul_accept_q:
               CI_SET_ERROR(rc, EFAULT);
               return rc;
           }
-          return citp_tcp_accept_ul(fdinfo, ni, listener, sa, p_sa_len, flags);
+          return citp_tcp_accept_ul(fdinfo, ni, listener, sa, p_sa_len, flags,
+                                    NULL, 0);
       }
       ci_sock_unlock(ni, &listener->s.b);
   }
@@ -1731,24 +1800,89 @@ static int citp_tcp_recv(citp_fdinfo* fdinfo, struct msghdr* msg, int flags)
 }
 
 
-static int citp_tcp_recvmmsg(citp_fdinfo* fdinfo, struct mmsghdr* msg, 
-                             unsigned vlen, int flags,
-                             ci_recvmmsg_timespec* timeout)
+#if CI_CFG_TIMESTAMPING
+#define CITP_TCP_SEND_ZC_IOV_MAX  16
+
+/* Drop a send's reference to a registration.  If it was unregistered
+ * while the send was in progress, this is where the memory is unpinned. */
+static void citp_tcp_send_zc_put(ci_netif* ni, struct ci_zc_usermem* um)
 {
-  Log_E(ci_log("%s: TCP fd recvmmsg not supported by OpenOnload",
-               __FUNCTION__));
-  errno = ENOSYS;
-  return -1;
+  int rc = ci_zc_usermem_put(ni, um);
+  if( rc != 0 )
+    Log_E(log(LPF "%s: failed to unregister zero-copy memory (rc=%d)",
+              __FUNCTION__, rc));
 }
 
-static int citp_tcp_sendmmsg(citp_fdinfo* fdinfo, struct mmsghdr* msg, 
-                             unsigned vlen, int flags)
+
+/* Send [msg] by reference to the caller's memory, as if by onload_zc_send(),
+ * if it is at least EF_TCP_SEND_ZC_THRESH bytes and lies entirely in memory
+ * registered with onload_zc_register_buffers().  Each buffer's address is
+ * given back as the cookie of its completion.
+ *
+ * Returns false, having sent nothing, if the send is not eligible.
+ */
+static bool citp_tcp_send_zc(citp_sock_fdi* epi, const struct msghdr* msg,
+                             int flags, int* rc_out)
 {
-  Log_E(ci_log("%s: TCP fd sendmmsg not supported by OpenOnload",
-               __FUNCTION__));
-  errno = ENOSYS;
-  return -1;
+  ci_netif* ni = epi->sock.netif;
+  ci_tcp_state* ts = SOCK_TO_TCP(epi->sock.s);
+  struct onload_zc_iovec iov[CITP_TCP_SEND_ZC_IOV_MAX];
+  struct onload_zc_mmsg mmsg;
+  struct ci_zc_usermem* um[CITP_TCP_SEND_ZC_IOV_MAX];
+  size_t bytes = 0;
+  int i, n = 0;
+
+  if( msg->msg_iovlen > CITP_TCP_SEND_ZC_IOV_MAX ||
+      (flags & ~ONLOAD_ZC_SEND_FLAGS_MASK) ||
+      OO_SP_NOT_NULL(ts->local_peer) )
+    return false;
+  for( i = 0; i < msg->msg_iovlen; ++i )
+    bytes += msg->msg_iov[i].iov_len;
+  if( bytes < NI_OPTS(ni).tcp_send_zc_thresh )
+    return false;
+
+  ci_netif_lock(ni);
+  for( i = 0; i < msg->msg_iovlen; ++i ) {
+    if( msg->msg_iov[i].iov_len == 0 )
+      continue;
+    um[n] = ci_zc_usermem_find(ni, (uintptr_t) msg->msg_iov[i].iov_base,
+                               msg->msg_iov[i].iov_len);
+    if( um[n] == NULL ) {
+      ++ts->stats.tx_zc_unregistered;
+      ci_netif_unlock(ni);
+      while( n > 0 )
+        citp_tcp_send_zc_put(ni, um[--n]);
+      return false;
+    }
+    /* Keep the registration alive until the send is done, in case another
+     * thread unregisters it once we drop the lock. */
+    ci_atomic32_inc(&um[n]->refs);
+    memset(&iov[n], 0, sizeof(iov[n]));
+    iov[n].iov_base = msg->msg_iov[i].iov_base;
+    iov[n].iov_len = msg->msg_iov[i].iov_len;
+    iov[n].buf = zc_usermem_to_handle(um[n]);
+    iov[n].app_cookie = msg->msg_iov[i].iov_base;
+    ++n;
+  }
+  ci_netif_unlock(ni);
+
+  memset(&mmsg, 0, sizeof(mmsg));
+  mmsg.msg.iov = iov;
+  mmsg.msg.msghdr.msg_iovlen = n;
+  ci_tcp_zc_send(ni, ts, &mmsg, flags);
+  for( i = 0; i < n; ++i )
+    citp_tcp_send_zc_put(ni, um[i]);
+  if( mmsg.rc < 0 ) {
+    CI_SET_ERROR(*rc_out, -mmsg.rc);
+  }
+  else {
+    *rc_out = mmsg.rc;
+    ++ts->stats.tx_zc_sends;
+  }
+  return true;
 }
+#endif
+
 
 static int citp_tcp_send(citp_fdinfo* fdinfo, const struct msghdr* msg,
                          int flags)
@@ -1784,6 +1918,12 @@ static int citp_tcp_send(citp_fdinfo* fdinfo, const struct msghdr* msg,
       else
         CI_SET_ERROR(rc, EPIPE);
     }
+#if CI_CFG_TIMESTAMPING
+    else if( NI_OPTS(epi->sock.netif).tcp_send_zc_thresh != 0 &&
+             citp_tcp_send_zc(epi, msg, flags, &rc) ) {
+      /* Sent by reference to registered memory. */
+    }
+#endif
     else {
       rc = ci_tcp_sendmsg(epi->sock.netif, SOCK_TO_TCP(epi->sock.s),
                           msg->msg_iov, msg->msg_iovlen, flags); 
@@ -1812,6 +1952,184 @@ static int citp_tcp_send(citp_fdinfo* fdinfo, const struct msghdr* msg,
 }
 
 
+/* Messages are gathered into one iovec of up to this many entries, so that
+ * a batch of small messages is handled by one call into the stack.
+ */
+#define CITP_TCP_MMSG_IOV_MAX  256
+
+
+/* Gather the iovecs of messages [i, vlen) into [iov] and set [m] to
+ * describe them, with the name and control of message [i].  A message whose
+ * iovec does not fit on its own is used as it is.  Returns the index after
+ * the last message gathered, and sets [*bytes] to their total length.
+ */
+static unsigned citp_tcp_mmsg_gather(struct mmsghdr* mmsg, unsigned i,
+                                     unsigned vlen, struct iovec* iov,
+                                     struct msghdr* m, size_t* bytes)
+{
+  struct msghdr* h = &mmsg[i].msg_hdr;
+  int iovlen = 0;
+
+  *m = *h;
+  if( h->msg_iov == NULL || h->msg_iovlen > CITP_TCP_MMSG_IOV_MAX ) {
+    *bytes = h->msg_iov == NULL ? 0 :
+             ci_iovec_bytes(h->msg_iov, h->msg_iovlen);
+    return i + 1;
+  }
+
+  *bytes = 0;
+  for( ; i < vlen; ++i ) {
+    h = &mmsg[i].msg_hdr;
+    if( h->msg_iov == NULL ||
+        iovlen + h->msg_iovlen > CITP_TCP_MMSG_IOV_MAX )
+      break;
+    memcpy(iov + iovlen, h->msg_iov, h->msg_iovlen * sizeof(iov[0]));
+    iovlen += h->msg_iovlen;
+    *bytes += ci_iovec_bytes(h->msg_iov, h->msg_iovlen);
+  }
+  m->msg_iov = iov;
+  m->msg_iovlen = iovlen;
+  return i;
+}
+
+
+/* Spread [len] bytes, sent or received with an iovec gathered from messages
+ * [i, end), over the messages in order.  Returns the index after the last
+ * message that any bytes went to, and at least [i + 1].
+ */
+static unsigned citp_tcp_mmsg_scatter(struct mmsghdr* mmsg, unsigned i,
+                                      unsigned end, size_t len)
+{
+  unsigned last = i + 1;
+  size_t bytes;
+
+  for( ; i < end; ++i ) {
+    bytes = mmsg[i].msg_hdr.msg_iov == NULL ? 0 :
+            ci_iovec_bytes(mmsg[i].msg_hdr.msg_iov,
+                           mmsg[i].msg_hdr.msg_iovlen);
+    mmsg[i].msg_len = CI_MIN(bytes, len);
+    if( len > 0 && mmsg[i].msg_len > 0 )
+      last = i + 1;
+    len -= mmsg[i].msg_len;
+  }
+  return last;
+}
+
+
+/* TCP has no message boundaries, so recvmmsg() receives into the buffers of
+ * as many messages as possible with one call to ci_tcp_recvmsg(), taking
+ * everything that is queued in one pass, and then works out which bytes
+ * went to which message.  Without MSG_DONTWAIT or MSG_WAITFORONE each
+ * further message blocks for more data, as it does with the kernel stack.
+ */
+static int citp_tcp_recvmmsg(citp_fdinfo* fdinfo, struct mmsghdr* mmsg,
+                             unsigned vlen, int flags,
+                             ci_recvmmsg_timespec* timeout)
+{
+  struct iovec iov[CITP_TCP_MMSG_IOV_MAX];
+  struct msghdr m;
+  struct timeval tv_before;
+  int timeout_msec = -1;
+  unsigned i = 0, j, n;
+  size_t bytes;
+  int rc;
+
+  Log_V(log(LPF "recvmmsg("EF_FMT", msg, %u, %#x)",
+            EF_PRI_ARGS(fdi_to_sock_fdi(fdinfo), fdinfo->fd), vlen,
+            (unsigned) flags));
+
+  if( timeout ) {
+    timeout_msec = timeout->tv_sec * 1000 + timeout->tv_nsec / 1000000;
+    gettimeofday(&tv_before, NULL);
+  }
+
+  while( i < vlen ) {
+    n = citp_tcp_mmsg_gather(mmsg, i, vlen, iov, &m, &bytes);
+    rc = citp_tcp_recv(fdinfo, &m, flags & ~MSG_WAITFORONE);
+    if( rc < 0 )
+      return i != 0 ? (int) i : rc;
+
+    j = citp_tcp_mmsg_scatter(mmsg, i, n, rc);
+    mmsg[i].msg_hdr.msg_flags = m.msg_flags;
+    mmsg[i].msg_hdr.msg_controllen = m.msg_controllen;
+    mmsg[i].msg_hdr.msg_namelen = m.msg_namelen;
+    for( ++i; i < j; ++i ) {
+      mmsg[i].msg_hdr.msg_flags = 0;
+      mmsg[i].msg_hdr.msg_controllen = 0;
+      mmsg[i].msg_hdr.msg_namelen = 0;
+    }
+
+    if( (size_t) rc == bytes ) {
+      /* Every buffer was filled, so there may be more queued: carry on
+       * without waiting.
+       */
+      for( ; i < n; ++i ) {
+        mmsg[i].msg_hdr.msg_flags = 0;
+        mmsg[i].msg_hdr.msg_controllen = 0;
+        mmsg[i].msg_hdr.msg_namelen = 0;
+      }
+    }
+    else if( rc == 0 || (flags & MSG_DONTWAIT) ) {
+      break;
+    }
+
+    if( flags & MSG_WAITFORONE )
+      flags |= MSG_DONTWAIT;
+
+    if( timeout_msec >= 0 ) {
+      struct timeval tv_after, tv_sub;
+      gettimeofday(&tv_after, NULL);
+      /* Ignore any time where time seems to have gone backwards */
+      if( timercmp(&tv_before, &tv_after, <) ) {
+        timersub(&tv_after, &tv_before, &tv_sub);
+        timeout_msec -= tv_sub.tv_sec * 1000 + tv_sub.tv_usec / 1000;
+        if( timeout_msec < 0 )
+          break;
+      }
+      tv_before = tv_after;
+    }
+  }
+
+  Log_V(log(LPF "recvmmsg("EF_FMT") = %u",
+            EF_PRI_ARGS(fdi_to_sock_fdi(fdinfo), fdinfo->fd), i));
+  return i;
+}
+
+
+/* sendmmsg() gathers the messages into one iovec, so that they are copied
+ * into the send queue under one acquisition of the stack lock and pushed
+ * with one ci_tcp_tx_advance().  A short write counts the message it ended
+ * in as sent, with its msg_len giving the bytes sent from it, as happens
+ * with the kernel stack.
+ */
+static int citp_tcp_sendmmsg(citp_fdinfo* fdinfo, struct mmsghdr* mmsg,
+                             unsigned vlen, int flags)
+{
+  struct iovec iov[CITP_TCP_MMSG_IOV_MAX];
+  struct msghdr m;
+  unsigned i = 0, n;
+  size_t bytes;
+  int rc;
+
+  Log_V(log(LPF "sendmmsg("EF_FMT", msg, %u, %#x)",
+            EF_PRI_ARGS(fdi_to_sock_fdi(fdinfo), fdinfo->fd), vlen,
+            (unsigned) flags));
+
+  while( i < vlen ) {
+    n = citp_tcp_mmsg_gather(mmsg, i, vlen, iov, &m, &bytes);
+    rc = citp_tcp_send(fdinfo, &m, flags);
+    if( rc < 0 )
+      return i != 0 ? (int) i : rc;
+
+    if( (size_t) rc < bytes )
+      return citp_tcp_mmsg_scatter(mmsg, i, n, rc);
+    citp_tcp_mmsg_scatter(mmsg, i, n, rc);
+    i = n;
+  }
+  return i;
+}
+
+
 static int citp_tcp_fcntl(citp_fdinfo* fdinfo, int cmd, long arg)
 {
   return citp_sock_fcntl(fdi_to_sock_fdi(fdinfo), fdinfo->fd, cmd, arg);
@@ -14,6 +14,8 @@ typedef struct {
 #define fdi_to_pipe_fdi(_fdi) CI_CONTAINER(citp_pipe_fdi, fdinfo, (_fdi))
 
 extern int citp_pipe_create(int fds[2], int flags);
+extern int citp_eventfd_create(unsigned int initval, int flags);
+extern int citp_unix_socketpair_create(int flags, int sv[2]);
 
 extern int citp_splice_pipe_pipe(citp_pipe_fdi* in_pipe_fdi,
                                  citp_pipe_fdi* out_pipe_fdi, size_t rlen,
@@ -502,10 +502,21 @@ int onload_zc_register_buffers(int fd, ef_addrspace addr_space,
       um->base = base_ptr;
       um->size = len;
 
-      if( addr_space == EF_ADDRSPACE_LOCAL )
+      um->next = NULL;
+      um->refs = 1;
+
+      if( addr_space == EF_ADDRSPACE_LOCAL ) {
         rc = ci_tcp_helper_zc_register_buffers(ni, (void*)(uintptr_t)base_ptr,
                                                num_pages, um->hw_addrs,
                                                &um->kernel_id);
+        /* Remember it so that EF_TCP_SEND_ZC_THRESH can find it. */
+        if( rc == 0 ) {
+          ci_netif_lock(ni);
+          um->next = ni->zc_usermem;
+          ni->zc_usermem = um;
+          ci_netif_unlock(ni);
+        }
+      }
 
       if( rc == 0 )
         *handle = zc_usermem_to_handle(um);
@@ -540,11 +551,30 @@ int onload_zc_unregister_buffers(int fd, onload_zc_handle handle, int flags)
   else if( (rc = fd_to_stack(fd, &ni, &fdi)) == 0 ) {
     struct ci_zc_usermem* um = zc_handle_to_usermem(handle);
 
-    if( um->addr_space == EF_ADDRSPACE_LOCAL )
-      rc = ci_tcp_helper_zc_unregister_buffers(ni, um->kernel_id);
+    if( um->addr_space == EF_ADDRSPACE_LOCAL ) {
+      struct ci_zc_usermem** p;
 
-    if( rc == 0 )
-      free(um);
+      /* Once it is off the list no new EF_TCP_SEND_ZC_THRESH send can take
+       * a reference, so the memory is unregistered by whichever of us and
+       * the sends in progress drops the last one. */
+      ci_netif_lock(ni);
+      for( p = &ni->zc_usermem; *p != NULL; p = &(*p)->next )
+        if( *p == um ) {
+          *p = um->next;
+          break;
+        }
+      ci_netif_unlock(ni);
+    }
+
+    rc = ci_zc_usermem_put(ni, um);
+    if( rc != 0 ) {
+      /* Still registered, so put it back as it was. */
+      um->refs = 1;
+      ci_netif_lock(ni);
+      um->next = ni->zc_usermem;
+      ni->zc_usermem = um;
+      ci_netif_unlock(ni);
+    }
 
     citp_fdinfo_release_ref(fdi, 0);
   }
@@ -555,6 +585,20 @@ int onload_zc_unregister_buffers(int fd, onload_zc_handle handle, int flags)
 }
 
 
+int ci_zc_usermem_put(ci_netif* ni, struct ci_zc_usermem* um)
+{
+  int rc = 0;
+
+  if( ! ci_atomic32_dec_and_test(&um->refs) )
+    return 0;
+  if( um->addr_space == EF_ADDRSPACE_LOCAL )
+    rc = ci_tcp_helper_zc_unregister_buffers(ni, um->kernel_id);
+  if( rc == 0 )
+    free(um);
+  return rc;
+}
+
+
 int onload_recvmsg_kernel(int fd, struct msghdr *msg, int flags)
 {
   int rc;
@@ -0,0 +1,859 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+/* efcapture
+ *
+ * Capture packets received on an interface to disk in pcapng format.
+ *
+ * The receive thread appends each packet to the current capture block, a
+ * large aligned buffer that holds a contiguous piece of the output file.
+ * Full blocks are queued to a set of writer threads, which write them at
+ * their offsets in the file with O_DIRECT, so the page cache is bypassed
+ * and several writes are in flight at once.  The receive thread never
+ * waits for the disk: if every block is queued, packets are dropped and
+ * counted.
+ *
+ * Packets are copied once, from the receive buffer into the block, so
+ * receive buffers are recycled straight away.  In packed-stream mode the
+ * packets are copied straight out of the packed-stream buffer, and on
+ * X3-series adapters out of the adapter's buffers.
+ *
+ * Output files are rotated by size and/or time.
+ */
+
+#define _GNU_SOURCE
+
+#include <etherfabric/vi.h>
+#include <etherfabric/pd.h>
+#include <etherfabric/memreg.h>
+#include <etherfabric/efct_vi.h>
+#include <etherfabric/packedstream.h>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+
+#include "utils.h"
+
+
+#define EV_POLL_BATCH_SIZE   16
+#define REFILL_BATCH_SIZE    16
+#define PKT_BUF_SIZE         2048
+
+/* Writes with O_DIRECT must be aligned to the logical block size of the
+ * device.  4K is the largest in common use.
+ */
+#define DIO_ALIGN            4096
+
+#define PCAPNG_BT_SHB        0x0a0d0d0a
+#define PCAPNG_BT_IDB        0x00000001
+#define PCAPNG_BT_EPB        0x00000006
+#define PCAPNG_BYTE_ORDER    0x1a2b3c4d
+#define PCAPNG_LINKTYPE_ETH  1
+#define PCAPNG_OPT_TSRESOL   9
+
+#define EPB_HDR_LEN          28
+
+
+/* A file being written.  It is freed when the receive thread has moved on
+ * to the next file and the writers have written all of its blocks.
+ */
+struct out_file {
+  char               name[PATH_MAX];
+  int                fd;
+  /* Number of blocks queued for this file, plus one while it is current.
+   * Protected by capture::lock.
+   */
+  int                refs;
+  /* Length of the data, valid once the file is no longer current. */
+  off_t              len;
+};
+
+
+/* A piece of the output file, filled by the receive thread. */
+struct block {
+  char*              mem;
+  size_t             len;
+  off_t              offset;
+  struct out_file*   file;
+  struct block*      next;
+};
+
+
+struct capture {
+  /* Receive thread state. */
+  ef_driver_handle   dh;
+  struct ef_pd       pd;
+  struct ef_vi       vi;
+  struct ef_memreg   memreg;
+  ef_vi_rx_burst     rx_burst;
+  void*              pkt_bufs;
+  int                pkt_bufs_n;
+  int*               free_ids;
+  int                free_n;
+
+  int                psp_start_offset;
+  int                ps_bufs_n;
+  size_t             ps_buf_size;
+  int                ps_buf_i;
+  ef_packed_stream_packet* ps_pkt_iter;
+
+  struct block*      cur;
+  struct out_file*   file;
+  off_t              file_off;
+  unsigned           file_seq;
+  time_t             file_opened;
+  struct timespec    sw_ts;
+
+  /* Shared with the writers, protected by lock. */
+  pthread_mutex_t    lock;
+  pthread_cond_t     cond;
+  struct block*      free_blocks;
+  struct block*      queue_head;
+  struct block**     queue_tail;
+  int                queue_n;
+  int                writers_stop;
+  uint64_t           n_written_bytes;
+
+  /* Stats, written by the receive thread. */
+  uint64_t           n_rx_pkts;
+  uint64_t           n_rx_bytes;
+  uint64_t           n_captured_pkts;
+  uint64_t           n_dropped_pkts;
+  uint64_t           n_discards;
+};
+
+
+static const char* cfg_output;
+static size_t cfg_block_size = 4 * 1024 * 1024;
+static int cfg_n_blocks = 64;
+static int cfg_n_writers = 2;
+static uint64_t cfg_rotate_bytes;
+static int cfg_rotate_secs;
+static int cfg_snaplen = 65535;
+static int cfg_timestamping;
+static int cfg_packed_stream;
+static int cfg_direct_io = 1;
+static int cfg_stats = 1;
+
+static volatile int stop;
+
+
+static void sigint_handler(int sig)
+{
+  stop = 1;
+}
+
+/**********************************************************************
+ * Writer threads.
+ */
+
+static void file_put(struct capture* cap, struct out_file* f)
+{
+  /* Called with cap->lock held. */
+  if( --f->refs > 0 )
+    return;
+  if( f->fd >= 0 ) {
+    /* The last block was padded for O_DIRECT, so trim the padding. */
+    TRY(ftruncate(f->fd, f->len));
+    TRY(close(f->fd));
+  }
+  free(f);
+}
+
+
+static int file_open(struct out_file* f)
+{
+  int flags = O_WRONLY | O_CREAT | O_TRUNC;
+  int fd;
+
+  if( cfg_direct_io ) {
+    fd = open(f->name, flags | O_DIRECT, 0644);
+    if( fd >= 0 || errno != EINVAL )
+      return fd;
+    /* Not all filesystems support O_DIRECT (tmpfs, for example). */
+    LOGW("WARNING: %s does not support O_DIRECT\n", f->name);
+    cfg_direct_io = 0;
+  }
+  return open(f->name, flags, 0644);
+}
+
+
+static void block_write(struct capture* cap, struct block* b)
+{
+  size_t len = ROUND_UP(b->len, DIO_ALIGN);
+  size_t done = 0;
+  ssize_t rc;
+
+  /* The padding at the end of the last block of a file is written, and
+   * trimmed when the file is closed.
+   */
+  while( done < len ) {
+    rc = pwrite(b->file->fd, b->mem + done, len - done, b->offset + done);
+    if( rc < 0 && errno == EINTR )
+      continue;
+    if( rc <= 0 ) {
+      LOGE("ERROR: write to %s failed (%s)\n", b->file->name,
+           rc < 0 ? strerror(errno) : "short write");
+      exit(2);
+    }
+    done += rc;
+  }
+}
+
+
+static void* writer_fn(void* arg)
+{
+  struct capture* cap = arg;
+  struct block* b;
+
+  pthread_mutex_lock(&cap->lock);
+  while( 1 ) {
+    while( cap->queue_head == NULL && ! cap->writers_stop )
+      pthread_cond_wait(&cap->cond, &cap->lock);
+    if( (b = cap->queue_head) == NULL )
+      break;
+    cap->queue_head = b->next;
+    if( cap->queue_head == NULL )
+      cap->queue_tail = &cap->queue_head;
+    --cap->queue_n;
+
+    /* Files are opened by the writers so that the receive thread does not
+     * wait for the filesystem.
+     */
+    if( b->file->fd < 0 ) {
+      b->file->fd = file_open(b->file);
+      if( b->file->fd < 0 ) {
+        LOGE("ERROR: could not open %s (%s)\n", b->file->name,
+             strerror(errno));
+        exit(2);
+      }
+    }
+    pthread_mutex_unlock(&cap->lock);
+
+    block_write(cap, b);
+
+    pthread_mutex_lock(&cap->lock);
+    cap->n_written_bytes += b->len;
+    file_put(cap, b->file);
+    b->next = cap->free_blocks;
+    cap->free_blocks = b;
+  }
+  pthread_mutex_unlock(&cap->lock);
+  return NULL;
+}
+
+/**********************************************************************
+ * Building the pcapng stream.
+ */
+
+static struct block* block_get(struct capture* cap)
+{
+  struct block* b;
+  pthread_mutex_lock(&cap->lock);
+  if( (b = cap->free_blocks) != NULL )
+    cap->free_blocks = b->next;
+  pthread_mutex_unlock(&cap->lock);
+  return b;
+}
+
+
+static void block_submit(struct capture* cap, struct block* b)
+{
+  b->next = NULL;
+  pthread_mutex_lock(&cap->lock);
+  ++b->file->refs;
+  *cap->queue_tail = b;
+  cap->queue_tail = &b->next;
+  ++cap->queue_n;
+  pthread_cond_signal(&cap->cond);
+  pthread_mutex_unlock(&cap->lock);
+}
+
+
+/* Append bytes to the stream.  When the current block is full it is
+ * queued for writing and *next becomes the current block, so the caller
+ * must provide a block when the bytes might not fit.
+ */
+static void stream_put(struct capture* cap, struct block** next,
+                       const void* p, size_t len)
+{
+  struct block* b = cap->cur;
+  size_t n;
+
+  while( len ) {
+    n = cfg_block_size - b->len;
+    if( n > len )
+      n = len;
+    memcpy(b->mem + b->len, p, n);
+    b->len += n;
+    cap->file_off += n;
+    p = (const char*) p + n;
+    len -= n;
+    if( b->len == cfg_block_size ) {
+      block_submit(cap, b);
+      TEST(*next != NULL);
+      b = cap->cur = *next;
+      b->len = 0;
+      b->offset = cap->file_off;
+      b->file = cap->file;
+      *next = NULL;
+    }
+  }
+}
+
+
+/* Make sure there is room for len bytes, getting a block to follow the
+ * current one if needed.  Returns false if there is no free block.
+ */
+static bool stream_reserve(struct capture* cap, size_t len,
+                           struct block** next)
+{
+  *next = NULL;
+  if( cap->cur->len + len < cfg_block_size )
+    return true;
+  return (*next = block_get(cap)) != NULL;
+}
+
+
+static void stream_unreserve(struct capture* cap, struct block* next)
+{
+  if( next == NULL )
+    return;
+  pthread_mutex_lock(&cap->lock);
+  next->next = cap->free_blocks;
+  cap->free_blocks = next;
+  pthread_mutex_unlock(&cap->lock);
+}
+
+
+static void put_headers(struct capture* cap, struct block** next)
+{
+  uint32_t shb[7], idb[8];
+  int64_t section_len = -1;
+
+  shb[0] = PCAPNG_BT_SHB;
+  shb[1] = sizeof(shb);
+  shb[2] = PCAPNG_BYTE_ORDER;
+  shb[3] = 1;  /* major 1, minor 0 */
+  memcpy(&shb[4], &section_len, sizeof(section_len));
+  shb[6] = sizeof(shb);
+  stream_put(cap, next, shb, sizeof(shb));
+
+  idb[0] = PCAPNG_BT_IDB;
+  idb[1] = sizeof(idb);
+  idb[2] = PCAPNG_LINKTYPE_ETH;
+  idb[3] = cfg_snaplen;
+  /* if_tsresol: timestamps are in nanoseconds. */
+  idb[4] = PCAPNG_OPT_TSRESOL | (1 << 16);
+  idb[5] = 9;
+  idb[6] = 0;  /* opt_endofopt */
+  idb[7] = sizeof(idb);
+  stream_put(cap, next, idb, sizeof(idb));
+}
+
+
+/* Queue the rest of the current file for writing, and let it go. */
+static void file_finish(struct capture* cap)
+{
+  struct block* b = cap->cur;
+
+  if( b == NULL )
+    return;
+  cap->file->len = cap->file_off;
+  if( b->len ) {
+    block_submit(cap, b);
+  }
+  else {
+    pthread_mutex_lock(&cap->lock);
+    b->next = cap->free_blocks;
+    cap->free_blocks = b;
+    pthread_mutex_unlock(&cap->lock);
+  }
+  pthread_mutex_lock(&cap->lock);
+  file_put(cap, cap->file);
+  pthread_mutex_unlock(&cap->lock);
+  cap->cur = NULL;
+  cap->file = NULL;
+}
+
+
+/* Finish the current file and start a new one.  Returns false if there is
+ * no free block to start it with.
+ */
+static bool file_rotate(struct capture* cap)
+{
+  struct out_file* f;
+  struct block* next;
+
+  file_finish(cap);
+  if( (next = block_get(cap)) == NULL )
+    return false;
+
+  TEST((f = calloc(1, sizeof(*f))) != NULL);
+  if( cfg_rotate_bytes || cfg_rotate_secs )
+    snprintf(f->name, sizeof(f->name), "%s.%u", cfg_output, cap->file_seq++);
+  else
+    snprintf(f->name, sizeof(f->name), "%s", cfg_output);
+  f->fd = -1;
+  f->refs = 1;
+  cap->file = f;
+  cap->file_off = 0;
+  cap->file_opened = time(NULL);
+  cap->cur = next;
+  next->len = 0;
+  next->offset = 0;
+  next->file = f;
+  next = NULL;
+  put_headers(cap, &next);
+  return true;
+}
+
+
+static void capture_pkt(struct capture* cap, const void* data, unsigned len,
+                        unsigned orig_len, const struct timespec* ts)
+{
+  static const uint32_t zero = 0;
+  unsigned cap_len = len < (unsigned) cfg_snaplen ? len : cfg_snaplen;
+  unsigned pad = ROUND_UP(cap_len, 4) - cap_len;
+  uint32_t hdr[EPB_HDR_LEN / 4];
+  uint32_t blk_len = EPB_HDR_LEN + cap_len + pad + 4;
+  uint64_t ts_ns;
+  struct block* next;
+
+  if( cap->cur == NULL && ! file_rotate(cap) ) {
+    ++cap->n_dropped_pkts;
+    return;
+  }
+  if( ! stream_reserve(cap, blk_len, &next) ) {
+    ++cap->n_dropped_pkts;
+    return;
+  }
+
+  ts_ns = ts->tv_sec * 1000000000ull + ts->tv_nsec;
+  hdr[0] = PCAPNG_BT_EPB;
+  hdr[1] = blk_len;
+  hdr[2] = 0;  /* interface id */
+  hdr[3] = ts_ns >> 32;
+  hdr[4] = (uint32_t) ts_ns;
+  hdr[5] = cap_len;
+  hdr[6] = orig_len;
+  stream_put(cap, &next, hdr, sizeof(hdr));
+  stream_put(cap, &next, data, cap_len);
+  stream_put(cap, &next, &zero, pad);
+  stream_put(cap, &next, &blk_len, sizeof(blk_len));
+  stream_unreserve(cap, next);
+  ++cap->n_captured_pkts;
+}
+
+
+static void maybe_rotate(struct capture* cap)
+{
+  if( cap->cur == NULL )
+    return;
+  if( (cfg_rotate_bytes && cap->file_off >= cfg_rotate_bytes) ||
+      (cfg_rotate_secs && time(NULL) - cap->file_opened >= cfg_rotate_secs) )
+    file_rotate(cap);
+}
+
+/**********************************************************************
+ * Receive.
+ */
+
+static void refill_rx_ring(struct capture* cap)
+{
+  int i, id;
+
+  if( ef_vi_receive_space(&cap->vi) < REFILL_BATCH_SIZE ||
+      cap->free_n < REFILL_BATCH_SIZE )
+    return;
+  do {
+    for( i = 0; i < REFILL_BATCH_SIZE; ++i ) {
+      id = cap->free_ids[--cap->free_n];
+      ef_vi_receive_init(&cap->vi,
+                         ef_memreg_dma_addr(&cap->memreg, id * PKT_BUF_SIZE),
+                         id);
+    }
+  } while( ef_vi_receive_space(&cap->vi) >= REFILL_BATCH_SIZE &&
+           cap->free_n >= REFILL_BATCH_SIZE );
+  ef_vi_receive_push(&cap->vi);
+}
+
+
+static int poll_burst(struct capture* cap)
+{
+  ef_vi_rx_pkt pkts[EV_POLL_BATCH_SIZE * 4];
+  ef_event evs[EV_POLL_BATCH_SIZE];
+  int evs_len = EV_POLL_BATCH_SIZE;
+  int i, n_pkts;
+
+  n_pkts = ef_vi_receive_burst(&cap->vi, &cap->rx_burst, pkts,
+                               sizeof(pkts) / sizeof(pkts[0]),
+                               evs, &evs_len);
+  if( n_pkts && ! cfg_timestamping )
+    clock_gettime(CLOCK_REALTIME, &cap->sw_ts);
+
+  for( i = 0; i < n_pkts; ++i ) {
+    const ef_vi_rx_pkt* p = &pkts[i];
+    ++cap->n_rx_pkts;
+    cap->n_rx_bytes += p->len;
+    /* Packets spanning buffers (jumbos) are not captured. */
+    if( (p->flags & (EF_VI_RX_PKT_F_DISCARD | EF_VI_RX_PKT_F_SOP |
+                     EF_VI_RX_PKT_F_CONT)) != EF_VI_RX_PKT_F_SOP )
+      ++cap->n_discards;
+    else
+      capture_pkt(cap, p->data, p->len, p->len,
+                  (p->flags & EF_VI_RX_PKT_F_TS) ? &p->ts : &cap->sw_ts);
+    if( p->flags & EF_VI_RX_PKT_F_REF )
+      efct_vi_rxpkt_release(&cap->vi, p->id);
+    else
+      cap->free_ids[cap->free_n++] = p->id;
+  }
+
+  for( i = 0; i < evs_len; ++i ) {
+    if( EF_EVENT_TYPE(evs[i]) == EF_EVENT_TYPE_RESET ) {
+      LOGE("ERROR: NIC has been Reset and VI is no longer valid\n");
+      exit(2);
+    }
+    LOGE("ERROR: unexpected event type=%d\n", (int) EF_EVENT_TYPE(evs[i]));
+  }
+
+  refill_rx_ring(cap);
+  return n_pkts;
+}
+
+
+static void handle_rx_ps(struct capture* cap, const ef_event* ev)
+{
+  ef_packed_stream_packet* ps_pkt;
+  struct timespec ts;
+  int n_pkts, n_bytes, i;
+
+  if( EF_EVENT_RX_PS_NEXT_BUFFER(*ev) ) {
+    /* Buffers are consumed in the order they were posted, so repost the
+     * one just finished and move on to the next.
+     */
+    if( cap->ps_pkt_iter != NULL ) {
+      TRY(ef_vi_receive_post(&cap->vi,
+                             ef_memreg_dma_addr(&cap->memreg,
+                                                cap->ps_buf_i *
+                                                cap->ps_buf_size), 0));
+      cap->ps_buf_i = (cap->ps_buf_i + 1) % cap->ps_bufs_n;
+    }
+    cap->ps_pkt_iter = ef_packed_stream_packet_first(
+                           (char*) cap->pkt_bufs +
+                           cap->ps_buf_i * cap->ps_buf_size,
+                           cap->psp_start_offset);
+  }
+
+  ps_pkt = cap->ps_pkt_iter;
+  ef_vi_packed_stream_unbundle(&cap->vi, ev, &cap->ps_pkt_iter,
+                               &n_pkts, &n_bytes);
+  cap->n_rx_pkts += n_pkts;
+  cap->n_rx_bytes += n_bytes;
+  if( n_pkts && ! cfg_timestamping )
+    clock_gettime(CLOCK_REALTIME, &cap->sw_ts);
+  for( i = 0; i < n_pkts; ++i ) {
+    ts.tv_sec = ps_pkt->ps_ts_sec;
+    ts.tv_nsec = ps_pkt->ps_ts_nsec;
+    capture_pkt(cap, ef_packed_stream_packet_payload(ps_pkt),
+                ps_pkt->ps_cap_len, ps_pkt->ps_orig_len,
+                cfg_timestamping ? &ts : &cap->sw_ts);
+    ps_pkt = ef_packed_stream_packet_next(ps_pkt);
+  }
+}
+
+
+static int poll_packed_stream(struct capture* cap)
+{
+  ef_event evs[EV_POLL_BATCH_SIZE];
+  int i, n_ev;
+
+  n_ev = ef_eventq_poll(&cap->vi, evs, EV_POLL_BATCH_SIZE);
+  for( i = 0; i < n_ev; ++i )
+    switch( EF_EVENT_TYPE(evs[i]) ) {
+    case EF_EVENT_TYPE_RX_PACKED_STREAM:
+      handle_rx_ps(cap, &evs[i]);
+      break;
+    case EF_EVENT_TYPE_RESET:
+      LOGE("ERROR: NIC has been Reset and VI is no longer valid\n");
+      exit(2);
+    default:
+      LOGE("ERROR: unexpected event type=%d\n", (int) EF_EVENT_TYPE(evs[i]));
+      break;
+    }
+  return n_ev;
+}
+
+
+static void capture_loop(struct capture* cap)
+{
+  unsigned idle = 0;
+
+  while( ! stop ) {
+    int n = cfg_packed_stream ? poll_packed_stream(cap) : poll_burst(cap);
+    /* Checking the time is cheap, but not free. */
+    if( n || ++idle % 1024 == 0 )
+      maybe_rotate(cap);
+  }
+}
+
+/**********************************************************************
+ * Setup.
+ */
+
+static void init_vi(struct capture* cap, const char* interface)
+{
+  unsigned vi_flags = EF_VI_FLAGS_DEFAULT;
+  size_t alloc_size;
+  int i;
+
+  TRY(ef_driver_open(&cap->dh));
+  if( cfg_timestamping )
+    vi_flags |= EF_VI_RX_TIMESTAMPS;
+
+  if( cfg_packed_stream ) {
+    ef_packed_stream_params psp;
+    TRY(ef_pd_alloc_by_name(&cap->pd, cap->dh, interface,
+                            EF_PD_RX_PACKED_STREAM));
+    vi_flags |= EF_VI_RX_PACKED_STREAM | EF_VI_RX_PS_BUF_SIZE_64K;
+    TRY(ef_vi_alloc_from_pd(&cap->vi, cap->dh, &cap->pd, cap->dh,
+                            -1, -1, -1, NULL, -1, vi_flags));
+    TRY(ef_vi_packed_stream_get_params(&cap->vi, &psp));
+    cap->psp_start_offset = psp.psp_start_offset;
+    cap->ps_bufs_n = psp.psp_max_usable_buffers;
+    cap->ps_buf_size = psp.psp_buffer_size;
+    alloc_size = ROUND_UP(cap->ps_bufs_n * cap->ps_buf_size, huge_page_size);
+    cap->pkt_bufs = mmap(NULL, alloc_size, PROT_READ | PROT_WRITE,
+                         MAP_ANONYMOUS | MAP_PRIVATE | MAP_HUGETLB, -1, 0);
+    if( cap->pkt_bufs == MAP_FAILED ) {
+      LOGE("ERROR: mmap failed.  You probably need to allocate some "
+           "huge pages.\n");
+      exit(2);
+    }
+    TEST(((uintptr_t) cap->pkt_bufs & (psp.psp_buffer_align - 1)) == 0);
+    TRY(ef_memreg_alloc(&cap->memreg, cap->dh, &cap->pd, cap->dh,
+                        cap->pkt_bufs, alloc_size));
+    for( i = 0; i < cap->ps_bufs_n; ++i )
+      TRY(ef_vi_receive_post(&cap->vi,
+                             ef_memreg_dma_addr(&cap->memreg,
+                                                i * cap->ps_buf_size), 0));
+    return;
+  }
+
+  TRY(ef_pd_alloc_by_name(&cap->pd, cap->dh, interface, EF_PD_DEFAULT));
+  TRY(ef_vi_alloc_from_pd(&cap->vi, cap->dh, &cap->pd, cap->dh,
+                          -1, -1, 0, NULL, -1, vi_flags));
+  cap->pkt_bufs_n = ef_vi_receive_capacity(&cap->vi);
+  alloc_size = ROUND_UP(cap->pkt_bufs_n * PKT_BUF_SIZE, huge_page_size);
+  cap->pkt_bufs = mmap(NULL, alloc_size, PROT_READ | PROT_WRITE,
+                       MAP_ANONYMOUS | MAP_PRIVATE | MAP_HUGETLB, -1, 0);
+  if( cap->pkt_bufs == MAP_FAILED ) {
+    LOGW("mmap() failed. Are huge pages configured?\n");
+    TEST(posix_memalign(&cap->pkt_bufs, huge_page_size, alloc_size) == 0);
+  }
+  TRY(ef_memreg_alloc(&cap->memreg, cap->dh, &cap->pd, cap->dh,
+                      cap->pkt_bufs, alloc_size));
+  TEST((cap->free_ids = malloc(cap->pkt_bufs_n * sizeof(int))) != NULL);
+  for( i = 0; i < cap->pkt_bufs_n; ++i )
+    cap->free_ids[cap->free_n++] = i;
+  ef_vi_rx_burst_init(&cap->rx_burst, cap->pkt_bufs, PKT_BUF_SIZE, 0,
+                      cfg_timestamping ? EF_VI_RX_BURST_TIMESTAMPS : 0);
+  refill_rx_ring(cap);
+}
+
+
+static void init_blocks(struct capture* cap)
+{
+  struct block* b;
+  int i;
+
+  pthread_mutex_init(&cap->lock, NULL);
+  pthread_cond_init(&cap->cond, NULL);
+  cap->queue_tail = &cap->queue_head;
+  for( i = 0; i < cfg_n_blocks; ++i ) {
+    TEST((b = calloc(1, sizeof(*b))) != NULL);
+    TEST(posix_memalign((void**) &b->mem, huge_page_size,
+                        cfg_block_size) == 0);
+    /* Fault the memory in now rather than in the receive path. */
+    memset(b->mem, 0, cfg_block_size);
+    b->next = cap->free_blocks;
+    cap->free_blocks = b;
+  }
+}
+
+
+static void* monitor_fn(void* arg)
+{
+  struct capture* cap = arg;
+  uint64_t prev_pkts, prev_bytes, prev_written, prev_dropped;
+  uint64_t now_pkts, now_bytes, now_written, now_dropped;
+  struct timeval start, end;
+  int ms, queued;
+
+  printf("#%9s %10s %10s %10s %10s %8s\n", "pkt-rate", "rx-Mbps",
+         "write-MBps", "drop-rate", "dropped", "queued");
+  prev_pkts = cap->n_rx_pkts;
+  prev_bytes = cap->n_rx_bytes;
+  prev_dropped = cap->n_dropped_pkts;
+  prev_written = cap->n_written_bytes;
+  gettimeofday(&start, NULL);
+
+  while( 1 ) {
+    sleep(1);
+    now_pkts = cap->n_rx_pkts;
+    now_bytes = cap->n_rx_bytes;
+    now_dropped = cap->n_dropped_pkts;
+    pthread_mutex_lock(&cap->lock);
+    now_written = cap->n_written_bytes;
+    queued = cap->queue_n;
+    pthread_mutex_unlock(&cap->lock);
+    gettimeofday(&end, NULL);
+    ms = (end.tv_sec - start.tv_sec) * 1000;
+    ms += (end.tv_usec - start.tv_usec) / 1000;
+    printf("%10"PRIu64" %10"PRIu64" %10"PRIu64" %10"PRIu64" %10"PRIu64
+           " %8d\n", (now_pkts - prev_pkts) * 1000 / ms,
+           (now_bytes - prev_bytes) * 8 / 1000 / ms,
+           (now_written - prev_written) / 1000 / ms,
+           (now_dropped - prev_dropped) * 1000 / ms, now_dropped, queued);
+    fflush(stdout);
+    prev_pkts = now_pkts;
+    prev_bytes = now_bytes;
+    prev_dropped = now_dropped;
+    prev_written = now_written;
+    start = end;
+  }
+  return NULL;
+}
+
+
+static __attribute__ ((__noreturn__)) void usage(void)
+{
+  fprintf(stderr, "usage:\n");
+  fprintf(stderr, "  efcapture [options] -w <file> <interface> "
+          "<filter-spec>...\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "filter-spec:\n");
+  fprintf(stderr, "  {udp|tcp}:[mcastloop-rx,][vid=<vlan>,]<local-host>:"
+          "<local-port>[,<remote-host>:<remote-port>]\n");
+  fprintf(stderr, "  eth:[vid=<vlan>,]<local-mac>\n");
+  fprintf(stderr, "  {unicast-all,multicast-all}\n");
+  fprintf(stderr, "  {unicast-mis,multicast-mis}:[vid=<vlan>]\n");
+  fprintf(stderr, "  {sniff}:[promisc|no-promisc]\n");
+  fprintf(stderr, "  {tx-sniff}\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "options:\n");
+  fprintf(stderr, "  -w <file>   write to <file>, or <file>.N when rotating\n");
+  fprintf(stderr, "  -C <MB>     start a new file after <MB> megabytes\n");
+  fprintf(stderr, "  -G <secs>   start a new file after <secs> seconds\n");
+  fprintf(stderr, "  -s <bytes>  capture at most <bytes> of each packet "
+          "(default %d)\n", cfg_snaplen);
+  fprintf(stderr, "  -t          use hardware timestamps\n");
+  fprintf(stderr, "  -p          receive in packed-stream mode\n");
+  fprintf(stderr, "  -W <num>    number of writer threads (default %d)\n",
+          cfg_n_writers);
+  fprintf(stderr, "  -b <MB>     size of each capture block (default %d)\n",
+          (int) (cfg_block_size >> 20));
+  fprintf(stderr, "  -N <num>    number of capture blocks (default %d)\n",
+          cfg_n_blocks);
+  fprintf(stderr, "  -D          do not use O_DIRECT\n");
+  fprintf(stderr, "  -n          don't output per-second stats\n");
+  exit(1);
+}
+
+
+int main(int argc, char* argv[])
+{
+  struct capture* cap;
+  pthread_t* writers;
+  pthread_t monitor_id;
+  const char* interface;
+  int c, i;
+
+  while( (c = getopt(argc, argv, "w:C:G:s:tpW:b:N:Dn")) != -1 )
+    switch( c ) {
+    case 'w':
+      cfg_output = optarg;
+      break;
+    case 'C':
+      cfg_rotate_bytes = strtoull(optarg, NULL, 0) << 20;
+      break;
+    case 'G':
+      cfg_rotate_secs = atoi(optarg);
+      break;
+    case 's':
+      cfg_snaplen = atoi(optarg);
+      break;
+    case 't':
+      cfg_timestamping = 1;
+      break;
+    case 'p':
+      cfg_packed_stream = 1;
+      break;
+    case 'W':
+      cfg_n_writers = atoi(optarg);
+      break;
+    case 'b':
+      cfg_block_size = (size_t) atoi(optarg) << 20;
+      break;
+    case 'N':
+      cfg_n_blocks = atoi(optarg);
+      break;
+    case 'D':
+      cfg_direct_io = 0;
+      break;
+    case 'n':
+      cfg_stats = 0;
+      break;
+    case '?':
+      usage();
+    default:
+      TEST(0);
+    }
+
+  argc -= optind;
+  argv += optind;
+  if( argc < 2 || cfg_output == NULL || cfg_snaplen < 1 ||
+      cfg_n_writers < 1 || cfg_block_size == 0 || cfg_n_blocks < 2 )
+    usage();
+  interface = argv[0];
+  ++argv; --argc;
+
+  TEST((cap = calloc(1, sizeof(*cap))) != NULL);
+  init_blocks(cap);
+  init_vi(cap, interface);
+
+  while( argc > 0 ) {
+    ef_filter_spec filter_spec;
+    if( filter_parse(&filter_spec, argv[0], NULL) != 0 ) {
+      LOGE("ERROR: Bad filter spec '%s'\n", argv[0]);
+      exit(1);
+    }
+    TRY(ef_vi_filter_add(&cap->vi, cap->dh, &filter_spec, NULL));
+    ++argv; --argc;
+  }
+
+  TEST((writers = calloc(cfg_n_writers, sizeof(*writers))) != NULL);
+  for( i = 0; i < cfg_n_writers; ++i )
+    TEST(pthread_create(&writers[i], NULL, writer_fn, cap) == 0);
+  if( cfg_stats )
+    TEST(pthread_create(&monitor_id, NULL, monitor_fn, cap) == 0);
+  signal(SIGINT, sigint_handler);
+  signal(SIGTERM, sigint_handler);
+
+  capture_loop(cap);
+
+  /* Write out what has been captured so far. */
+  file_finish(cap);
+  pthread_mutex_lock(&cap->lock);
+  cap->writers_stop = 1;
+  pthread_cond_broadcast(&cap->cond);
+  pthread_mutex_unlock(&cap->lock);
+  for( i = 0; i < cfg_n_writers; ++i )
+    TEST(pthread_join(writers[i], NULL) == 0);
+
+  fprintf(stderr, "%"PRIu64" packets received, %"PRIu64" captured, "
+          "%"PRIu64" dropped, %"PRIu64" discarded\n", cap->n_rx_pkts,
+          cap->n_captured_pkts, cap->n_dropped_pkts, cap->n_discards);
+  return 0;
+}
@@ -0,0 +1,295 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+/* effanout_bench
+ *
+ * Measure the cost of fanning packets out to consumers with the ef_fanout
+ * library (etherfabric/fanout.h) as the number of consumers grows.
+ *
+ * No NIC is used: the producer thread publishes packets from the buffers of
+ * an ef_fanout in shared memory as fast as it can, and each consumer
+ * thread gets them, reads their contents and releases them.  Each consumer
+ * checks that it sees every packet it should, in order.
+ *
+ * For each number of consumers, the packet rate and the producer's cost
+ * per packet are reported, together with the number of times the producer
+ * found the ring full or had no free buffers.
+ */
+
+#define _GNU_SOURCE
+#include <etherfabric/fanout.h>
+#include <ci/compat.h>
+
+#include <sched.h>
+#include <time.h>
+
+#include "utils.h"
+
+
+struct consumer {
+  pthread_t          thread;
+  ef_fanout          fo;
+  void*              mem;
+  size_t             mem_len;
+  uint32_t           filter;
+  int                cpu;
+  uint64_t           n_pkts;
+  uint64_t           n_bad;
+};
+
+
+static int cfg_max_consumers = 8;
+static int cfg_duration_ms = 1000;
+static int cfg_n_bufs = 16384;
+static int cfg_ring_size = 4096;
+static int cfg_pkt_len = 64;
+static int cfg_drop_slow;
+static int cfg_partition;
+static int cfg_first_cpu = -1;
+
+static volatile int stop;
+
+
+static double now_s(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static void pin(int cpu)
+{
+  cpu_set_t cpus;
+  if( cpu < 0 )
+    return;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  TEST(sched_setaffinity(0, sizeof(cpus), &cpus) == 0);
+}
+
+
+static void* consumer_fn(void* arg)
+{
+  struct consumer* c = arg;
+  struct ef_fanout_pkt pkts[32];
+  uint64_t next_seq = 0;
+  int i, n;
+
+  pin(c->cpu);
+
+  while( ! stop ) {
+    n = ef_fanout_consumer_get(&c->fo, pkts, sizeof(pkts) / sizeof(pkts[0]));
+    if( n < 0 )
+      break;  /* evicted */
+    for( i = 0; i < n; ++i ) {
+      const uint8_t* p = ef_fanout_pkt_ptr(&c->fo, &pkts[i]);
+      uint64_t seq;
+      uint8_t sum = 0;
+      int j;
+
+      /* Touch the whole packet, as a real consumer would. */
+      for( j = 0; j < pkts[i].len; ++j )
+        sum += p[j];
+      memcpy(&seq, p, sizeof(seq));
+      if( sum != (uint8_t) (seq * 0x9d) )
+        ++c->n_bad;
+      /* When dropping, or when sharing the packets out, we see only some
+       * of the sequence numbers.
+       */
+      if( cfg_drop_slow || cfg_partition ? seq < next_seq :
+                                           seq != next_seq )
+        ++c->n_bad;
+      next_seq = seq + 1;
+      ef_fanout_consumer_release(&c->fo, pkts[i].buf_id);
+    }
+    c->n_pkts += n;
+  }
+
+  ef_fanout_consumer_detach(&c->fo);
+  return NULL;
+}
+
+
+/* Fill in a packet so that the consumers can check it. */
+static void fill_pkt(uint8_t* p, uint64_t seq)
+{
+  uint8_t sum = 0;
+  int j;
+
+  memcpy(p, &seq, sizeof(seq));
+  for( j = 0; j < (int) sizeof(seq); ++j )
+    sum += p[j];
+  for( ; j < cfg_pkt_len - 1; ++j ) {
+    p[j] = j;
+    sum += j;
+  }
+  /* Make the bytes add up to (seq * 0x9d). */
+  p[j] = (uint8_t) (seq * 0x9d) - sum;
+}
+
+
+static void run(void* mem, size_t mem_len,
+                const struct ef_fanout_params* params, int n_consumers)
+{
+  struct consumer* consumers;
+  struct ef_fanout_consumer_stats stats;
+  ef_fanout fo;
+  uint64_t seq = 0, n_full = 0, n_nobufs = 0, n_bad = 0, n_dropped = 0;
+  uint64_t min_pkts = UINT64_MAX;
+  double t_start, t_end;
+  int i, rc;
+
+  TRY(ef_fanout_producer_init(&fo, mem, mem_len, params));
+  TEST((consumers = calloc(n_consumers, sizeof(*consumers))) != NULL);
+
+  stop = 0;
+  for( i = 0; i < n_consumers; ++i ) {
+    struct consumer* c = &consumers[i];
+    c->filter = cfg_partition ? 1u << i : ~0u;
+    c->cpu = cfg_first_cpu < 0 ? -1 : cfg_first_cpu + 1 + i;
+    TRY(ef_fanout_consumer_attach(&c->fo, mem, mem_len, c->filter));
+    TEST(pthread_create(&c->thread, NULL, consumer_fn, c) == 0);
+  }
+
+  /* Wait for the consumers to be attached before starting the clock. */
+  for( i = 0; i < n_consumers; ++i )
+    while( ef_fanout_consumer_stats(&fo, i, &stats) < 0 )
+      ef_fanout_producer_poll(&fo);
+
+  t_start = now_s();
+  t_end = t_start + cfg_duration_ms / 1000.0;
+  while( 1 ) {
+    int id = ef_fanout_buf_alloc(&fo);
+    uint32_t tag;
+    if( id < 0 ) {
+      ++n_nobufs;
+    }
+    else {
+      fill_pkt(ef_fanout_buf_ptr(&fo, id), seq);
+      tag = cfg_partition ? 1u << (seq % n_consumers) : 1;
+      rc = ef_fanout_publish(&fo, id, 0, cfg_pkt_len, tag);
+      if( rc == -EAGAIN )
+        ++n_full;
+      else
+        ++seq;
+    }
+    if( (seq & 0xfff) == 0 && now_s() >= t_end )
+      break;
+  }
+  t_end = now_s();
+  for( i = 0; i < n_consumers; ++i )
+    if( ef_fanout_consumer_stats(&fo, i, &stats) == 0 )
+      n_dropped += stats.n_dropped;
+  stop = 1;
+
+  for( i = 0; i < n_consumers; ++i ) {
+    TEST(pthread_join(consumers[i].thread, NULL) == 0);
+    n_bad += consumers[i].n_bad;
+    if( consumers[i].n_pkts < min_pkts )
+      min_pkts = consumers[i].n_pkts;
+  }
+  ef_fanout_producer_poll(&fo);
+
+  printf("%9d %10.3f %10.1f %12"PRIu64" %12"PRIu64" %12"PRIu64" %12"PRIu64
+         " %8"PRIu64"\n", n_consumers,
+         seq / (t_end - t_start) / 1e6, (t_end - t_start) * 1e9 / seq,
+         min_pkts, n_full, n_nobufs, n_dropped, n_bad);
+  fflush(stdout);
+
+  ef_fanout_producer_fini(&fo);
+  free(consumers);
+}
+
+
+static __attribute__ ((__noreturn__)) void usage(void)
+{
+  fprintf(stderr, "usage:\n");
+  fprintf(stderr, "  effanout_bench [options]\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "options:\n");
+  fprintf(stderr, "  -n <num>     maximum number of consumers (default %d)\n",
+          cfg_max_consumers);
+  fprintf(stderr, "  -t <millis>  duration of each run (default %d)\n",
+          cfg_duration_ms);
+  fprintf(stderr, "  -b <num>     number of buffers (default %d)\n",
+          cfg_n_bufs);
+  fprintf(stderr, "  -r <num>     ring size (default %d)\n", cfg_ring_size);
+  fprintf(stderr, "  -l <bytes>   packet length (default %d)\n", cfg_pkt_len);
+  fprintf(stderr, "  -d           drop packets for slow consumers rather "
+          "than blocking\n");
+  fprintf(stderr, "  -p           share the packets out between the "
+          "consumers rather\n"
+          "               than giving every packet to every consumer\n");
+  fprintf(stderr, "  -c <cpu>     pin the producer to <cpu> and the "
+          "consumers to the\n"
+          "               following cpus\n");
+  exit(1);
+}
+
+
+int main(int argc, char* argv[])
+{
+  struct ef_fanout_params params;
+  size_t mem_len;
+  void* mem;
+  int c, n;
+
+  while( (c = getopt (argc, argv, "n:t:b:r:l:dpc:")) != -1 )
+    switch( c ) {
+    case 'n':
+      cfg_max_consumers = atoi(optarg);
+      break;
+    case 't':
+      cfg_duration_ms = atoi(optarg);
+      break;
+    case 'b':
+      cfg_n_bufs = atoi(optarg);
+      break;
+    case 'r':
+      cfg_ring_size = atoi(optarg);
+      break;
+    case 'l':
+      cfg_pkt_len = atoi(optarg);
+      break;
+    case 'd':
+      cfg_drop_slow = 1;
+      break;
+    case 'p':
+      cfg_partition = 1;
+      break;
+    case 'c':
+      cfg_first_cpu = atoi(optarg);
+      break;
+    case '?':
+      usage();
+    default:
+      TEST(0);
+    }
+  if( optind != argc || cfg_max_consumers < 1 ||
+      cfg_max_consumers > EF_FANOUT_MAX_CONSUMERS ||
+      cfg_pkt_len < (int) sizeof(uint64_t) + 1 || cfg_pkt_len > 2048 )
+    usage();
+
+  memset(&params, 0, sizeof(params));
+  params.n_bufs = cfg_n_bufs;
+  params.buf_size = 2048;
+  params.ring_size = cfg_ring_size;
+  params.policy = cfg_drop_slow ? EF_FANOUT_POLICY_DROP_SLOW :
+                                  EF_FANOUT_POLICY_BLOCK;
+  mem_len = ef_fanout_mem_size(&params);
+  mem = mmap(NULL, mem_len, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  TEST(mem != MAP_FAILED);
+
+  pin(cfg_first_cpu);
+  printf("#%8s %10s %10s %12s %12s %12s %12s %8s\n", "consumers", "Mpps",
+         "ns/pkt", "min-rx-pkts", "ring-full", "no-bufs", "dropped", "bad");
+  for( n = 1; n <= cfg_max_consumers; n *= 2 ) {
+    run(mem, mem_len, &params, n);
+    if( n < cfg_max_consumers && n * 2 > cfg_max_consumers )
+      n = cfg_max_consumers / 2;
+  }
+
+  munmap(mem, mem_len);
+  return 0;
+}
@@ -0,0 +1,195 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+/* effwd
+ *
+ * Forward packets between two interfaces with the zero-copy forwarding
+ * engine (etherfabric/forward.h), and report the forwarding rate.
+ *
+ * Unlike efforward, packets are received and transmitted in batches, and
+ * an optional hook rewrites the Ethernet header of each packet, to show
+ * the cost of touching the packet on the way through.
+ */
+
+#define _GNU_SOURCE
+
+#include <etherfabric/vi.h>
+#include <etherfabric/pd.h>
+#include <etherfabric/memreg.h>
+#include <etherfabric/forward.h>
+
+#include "utils.h"
+
+
+#define PKT_BUF_SIZE         2048
+#define RX_RING_SIZE         512
+#define TX_RING_SIZE         2048
+
+
+struct port {
+  ef_driver_handle   dh;
+  ef_pd              pd;
+  ef_vi              vi;
+  ef_memreg          memreg;
+};
+
+
+static struct port ports[2];
+static ef_fwd fwd;
+static void* bufs;
+static size_t bufs_size;
+static int cfg_unidirectional;
+static int cfg_rewrite;
+static int cfg_headroom;
+static int cfg_stats = 1;
+
+
+/* Swap the MAC addresses, as a reflector would. */
+static int rewrite_hook(void* arg, struct ef_fwd_pkt* pkt)
+{
+  uint8_t tmp[6];
+  if( pkt->len < 14 )
+    return -1;
+  memcpy(tmp, pkt->data, 6);
+  memcpy(pkt->data, pkt->data + 6, 6);
+  memcpy(pkt->data + 6, tmp, 6);
+  return 0;
+}
+
+
+static void* monitor_fn(void* dummy)
+{
+  struct ef_fwd_port_stats prev[2], now[2];
+  struct timeval start, end;
+  int ms, i;
+
+  pthread_setname_np(pthread_self(), "effwd_mon");
+
+  for( i = 0; i < 2; ++i )
+    prev[i] = *ef_fwd_port_stats(&fwd, i);
+  gettimeofday(&start, NULL);
+
+  printf("#%9s %10s %10s %10s %10s %10s %10s\n", "port0-rx", "port0-tx",
+         "port1-rx", "port1-tx", "tx-full", "tx-err", "starved");
+  while( 1 ) {
+    sleep(1);
+    for( i = 0; i < 2; ++i )
+      now[i] = *ef_fwd_port_stats(&fwd, i);
+    gettimeofday(&end, NULL);
+    ms = (end.tv_sec - start.tv_sec) * 1000;
+    ms += (end.tv_usec - start.tv_usec) / 1000;
+
+#define RATE(f, i)  ((int64_t) (now[i].f - prev[i].f) * 1000 / ms)
+    printf("%10"PRId64" %10"PRId64" %10"PRId64" %10"PRId64" %10"PRId64
+           " %10"PRId64" %10"PRId64"\n", RATE(rx_pkts, 0), RATE(tx_pkts, 0),
+           RATE(rx_pkts, 1), RATE(tx_pkts, 1),
+           RATE(tx_full, 0) + RATE(tx_full, 1),
+           RATE(tx_errors, 0) + RATE(tx_errors, 1),
+           RATE(rx_refill_starved, 0) + RATE(rx_refill_starved, 1));
+#undef RATE
+    fflush(stdout);
+    memcpy(prev, now, sizeof(prev));
+    start = end;
+  }
+  return NULL;
+}
+
+
+static void init_port(const char* intf, int port_i)
+{
+  struct port* p = &ports[port_i];
+  ef_filter_spec fs;
+  int rx_ring_size = RX_RING_SIZE;
+
+  /* In one direction, port 1 only sends. */
+  if( cfg_unidirectional && port_i == 1 )
+    rx_ring_size = 0;
+
+  TRY(ef_driver_open(&p->dh));
+  TRY(ef_pd_alloc_by_name(&p->pd, p->dh, intf, EF_PD_DEFAULT));
+  TRY(ef_vi_alloc_from_pd(&p->vi, p->dh, &p->pd, p->dh, -1, rx_ring_size,
+                          TX_RING_SIZE, NULL, -1, EF_VI_FLAGS_DEFAULT));
+  TRY(ef_memreg_alloc(&p->memreg, p->dh, &p->pd, p->dh, bufs, bufs_size));
+  TEST(ef_fwd_port_add(&fwd, &p->vi, &p->memreg,
+                       rx_ring_size ? 1 - port_i : -1) == port_i);
+  if( rx_ring_size == 0 )
+    return;
+
+  ef_filter_spec_init(&fs, EF_FILTER_FLAG_NONE);
+  TRY(ef_filter_spec_set_unicast_all(&fs));
+  TRY(ef_vi_filter_add(&p->vi, p->dh, &fs, NULL));
+  ef_filter_spec_init(&fs, EF_FILTER_FLAG_NONE);
+  TRY(ef_filter_spec_set_multicast_all(&fs));
+  TRY(ef_vi_filter_add(&p->vi, p->dh, &fs, NULL));
+}
+
+
+static __attribute__ ((__noreturn__)) void usage(void)
+{
+  fprintf(stderr, "usage:\n");
+  fprintf(stderr, "  effwd [options] <intf0> <intf1>\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "options:\n");
+  fprintf(stderr, "  -u       unidirectional - only forward from <intf0> to"
+          " <intf1>\n");
+  fprintf(stderr, "  -r       swap the MAC addresses of each packet\n");
+  fprintf(stderr, "  -H <n>   leave <n> bytes of headroom in front of each "
+          "packet\n");
+  fprintf(stderr, "  -n       don't output per-second stats\n");
+  exit(1);
+}
+
+
+int main(int argc, char* argv[])
+{
+  pthread_t thread_id;
+  int n_bufs, c;
+
+  while( (c = getopt(argc, argv, "urH:n")) != -1 )
+    switch( c ) {
+    case 'u':
+      cfg_unidirectional = 1;
+      break;
+    case 'r':
+      cfg_rewrite = 1;
+      break;
+    case 'H':
+      cfg_headroom = atoi(optarg);
+      break;
+    case 'n':
+      cfg_stats = 0;
+      break;
+    case '?':
+      usage();
+    default:
+      TEST(0);
+    }
+
+  argc -= optind;
+  argv += optind;
+  if( argc != 2 )
+    usage();
+
+  /* Enough buffers to fill the RX and TX rings in both directions. */
+  n_bufs = 2 * (RX_RING_SIZE + TX_RING_SIZE);
+  bufs_size = ROUND_UP((size_t) n_bufs * PKT_BUF_SIZE, huge_page_size);
+  bufs = mmap(NULL, bufs_size, PROT_READ | PROT_WRITE,
+              MAP_ANONYMOUS | MAP_PRIVATE | MAP_HUGETLB, -1, 0);
+  if( bufs == MAP_FAILED ) {
+    fprintf(stderr, "mmap() failed. Are huge pages configured?\n");
+    TEST(posix_memalign(&bufs, huge_page_size, bufs_size) == 0);
+  }
+
+  TRY(ef_fwd_init(&fwd, bufs, PKT_BUF_SIZE, n_bufs, cfg_headroom));
+  if( cfg_rewrite )
+    ef_fwd_set_hook(&fwd, rewrite_hook, NULL);
+  init_port(argv[0], 0);
+  init_port(argv[1], 1);
+  ef_fwd_fill(&fwd);
+
+  if( cfg_stats )
+    TEST(pthread_create(&thread_id, NULL, monitor_fn, NULL) == 0);
+  while( 1 )
+    ef_fwd_poll(&fwd);
+
+  return 0;
+}
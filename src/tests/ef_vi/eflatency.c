@@ -18,6 +18,7 @@
 #include <ci/tools.h>
 #include <ci/tools/ipcsum_base.h>
 #include <ci/tools/ippacket.h>
+#include <ci/app/histogram.h>
 
 #include <stddef.h>
 #include <inttypes.h>
@@ -43,6 +44,7 @@ static int              cfg_payload_step = 1;
 static int              cfg_ctpio_no_poison;
 static unsigned         cfg_ctpio_thresh = 64;
 static const char*      cfg_save_file = NULL;
+static const char*      cfg_hgrm_file = NULL;
 enum mode {
   MODE_DMA = 1,
   MODE_PIO = 2,
@@ -134,59 +136,76 @@ static inline void rx_post(ef_vi* vi)
 }
 
 
-static int cmp_u64(const void* ap, const void* bp)
+/* Substitute the payload length for "$s" in a user-supplied file name. */
+static FILE* open_output_file(const char* name)
 {
-  uint64_t a = *(const uint64_t*)ap;
-  uint64_t b = *(const uint64_t*)bp;
-  if (a < b)
-    return -1;
-  return a > b;
+  char* subst = strstr(name, "$s");
+  FILE* fp;
+
+  if( subst ) {
+    size_t ix = subst - name;
+    size_t len = strlen(name);
+    char* path = malloc(len + 12);
+    memcpy(path, name, ix);
+    snprintf(path + ix, 12, "%d", cfg_payload_len);
+    memcpy(path + strlen(path), name + ix + 2, len - ix - 1);
+    fp = fopen(path, "wt");
+    free(path);
+  }
+  else {
+    fp = fopen(name, "wt");
+  }
+  TEST(fp != NULL);
+  return fp;
 }
 
 
+/* Timings are in cycles; anything above 2^40 is clamped. */
+#define HIST_HIGHEST  (1ll << 40)
+#define HIST_BITS     7
+
+
 static void output_results(struct timeval start, struct timeval end)
 {
   unsigned freq = 0;
   double div;
+  ci_hist hist;
+  int i;
   int usec = (end.tv_sec - start.tv_sec) * 1000000;
   usec += end.tv_usec - start.tv_usec;
 
   ci_get_cpu_khz(&freq);
   div = freq / 1e3;
   if( cfg_save_file ) {
-    int i;
-    char* subst = strstr(cfg_save_file, "$s");
-    FILE* fp;
-
-    if( subst ) {
-      size_t ix = subst - cfg_save_file;
-      size_t len = strlen(cfg_save_file);
-      char* path = malloc(len + 12);
-      memcpy(path, cfg_save_file, ix);
-      snprintf(path + ix, 12, "%d", cfg_payload_len);
-      memcpy(path + strlen(path), cfg_save_file + ix + 2, len - ix - 1);
-      fp = fopen(path, "wt");
-      free(path);
-    }
-    else {
-      fp = fopen(cfg_save_file, "wt");
-    }
-    TEST(fp != NULL);
+    FILE* fp = open_output_file(cfg_save_file);
     for( i = 0 ; i < cfg_iter; ++i )
       fprintf(fp, "%lld\n", (long long)(timings[i] * 1000. / div));
     fclose(fp);
   }
 
-  qsort(timings, cfg_iter, sizeof(timings[0]), cmp_u64);
-  printf("%d\t%0.3lf\t%0.3lf\t%0.3lf\t%0.3lf\t%0.3lf\t%0.3lf\n",
+  TRY(ci_hist_init(&hist, HIST_HIGHEST, HIST_BITS));
+  for( i = 0 ; i < cfg_iter; ++i )
+    ci_hist_record(&hist, timings[i]);
+
+  if( cfg_hgrm_file ) {
+    FILE* fp = open_output_file(cfg_hgrm_file);
+    TRY(ci_hist_write_hgrm(&hist, fp, div));
+    fclose(fp);
+  }
+
+  printf("%d\t%0.3lf\t%0.3lf\t%0.3lf\t%0.3lf\t%0.3lf\t%0.3lf\t%0.3lf"
+         "\t%0.3lf\n",
          cfg_payload_len,
          (double) usec / cfg_iter,
-         timings[0] / div,
-         timings[cfg_iter / 2] / div,
-         timings[cfg_iter - cfg_iter / 20] / div,
-         timings[cfg_iter - cfg_iter / 100] / div,
-         timings[cfg_iter - 1] / div);
+         hist.min / div,
+         ci_hist_percentile(&hist, 50) / div,
+         ci_hist_percentile(&hist, 95) / div,
+         ci_hist_percentile(&hist, 99) / div,
+         ci_hist_percentile(&hist, 99.9) / div,
+         ci_hist_percentile(&hist, 99.99) / div,
+         hist.max / div);
   last_mean_latency_usec = (double) usec / cfg_iter;
+  ci_hist_fini(&hist);
 }
 
 /**********************************************************************/
@@ -687,6 +706,8 @@ static CI_NORETURN usage(void)
   fprintf(stderr, "  -m <modes>          - allow mode of the set: [c]tpio, \n");
   fprintf(stderr, "                      [pio], [a]lternatives, [d]ma, [x]dp\n");
   fprintf(stderr, "  -o <filename>       - save raw timings to file\n");
+  fprintf(stderr, "  -H <filename>       - save HdrHistogram percentile "
+                  "distribution to file\n");
   fprintf(stderr, "\n");
   exit(1);
 }
@@ -708,7 +729,7 @@ int main(int argc, char* argv[])
 
   printf("# ef_vi_version_str: %s\n", ef_vi_version_str());
 
-  while( (c = getopt (argc, argv, "n:s:w:c:pm:o:")) != -1 )
+  while( (c = getopt (argc, argv, "n:s:w:c:pm:o:H:")) != -1 )
     switch( c ) {
     case 'n':
       cfg_iter = atoi(optarg);
@@ -737,6 +758,9 @@ int main(int argc, char* argv[])
     case 'o':
       cfg_save_file = optarg;
       break;
+    case 'H':
+      cfg_hgrm_file = optarg;
+      break;
     case 'm':
       #define OPT_C(ch) (strchr(optarg, ch) != NULL)
       cfg_mode =
@@ -844,7 +868,7 @@ int main(int argc, char* argv[])
   printf("# frame len: %d\n", tx_frame_len);
   printf("# mode: %s\n", t->name);
   if( ping )
-    printf("paylen\tmean\tmin\t50%%\t95%%\t99%%\tmax\n");
+    printf("paylen\tmean\tmin\t50%%\t95%%\t99%%\t99.9%%\t99.99%%\tmax\n");
 
   for( ; ; ) {
     ++iters_run;
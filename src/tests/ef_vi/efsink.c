@@ -63,6 +63,7 @@ struct resources {
   int                refill_level;
   int                refill_min;
   unsigned           batch_loops;
+  ef_vi_rx_burst     rx_burst;
 
   /* registered memory for DMA */
   void*              pkt_bufs;
@@ -92,6 +93,7 @@ static int cfg_fd_wait;
 static int cfg_max_fill = -1;
 static int cfg_exit_pkts = -1;
 static int cfg_register_mcast;
+static int cfg_rx_burst;
 
 /* Mutex to protect printing from different threads */
 static pthread_mutex_t printf_mutex;
@@ -294,13 +296,63 @@ static bool refill_rx_ring(struct resources* res)
 }
 
 
+/* Same as poll_evq(), but with a single code path for all adapters. */
+static int poll_evq_burst(struct resources* res)
+{
+  ef_vi_rx_pkt pkts[EV_POLL_BATCH_SIZE * 4];
+  ef_event evs[EV_POLL_BATCH_SIZE];
+  int evs_len = EV_POLL_BATCH_SIZE;
+  int i, n_pkts;
+
+  n_pkts = ef_vi_receive_burst(&res->vi, &res->rx_burst, pkts,
+                               sizeof(pkts) / sizeof(pkts[0]),
+                               evs, &evs_len);
+
+  for( i = 0; i < n_pkts; ++i ) {
+    const ef_vi_rx_pkt* p = &pkts[i];
+    /* This code does not handle scattered jumbos. */
+    TEST( (p->flags & EF_VI_RX_PKT_F_SOP) &&
+          ! (p->flags & EF_VI_RX_PKT_F_CONT) );
+    if( p->flags & EF_VI_RX_PKT_F_DISCARD )
+      LOGE("ERROR: discard flags=%x\n", p->discard);
+    if( p->flags & EF_VI_RX_PKT_F_TS ) {
+      pthread_mutex_lock(&printf_mutex);
+      printf("HW_TSTAMP=%ld.%09ld\n", p->ts.tv_sec, p->ts.tv_nsec);
+      pthread_mutex_unlock(&printf_mutex);
+    }
+    if( cfg_hexdump )
+      hexdump(p->data, p->len);
+    res->n_rx_pkts += 1;
+    res->n_rx_bytes += p->len;
+    if( p->flags & EF_VI_RX_PKT_F_REF )
+      efct_vi_rxpkt_release(&res->vi, p->id);
+    else
+      pkt_buf_free(res, pkt_buf_from_id(res, p->id));
+  }
+
+  for( i = 0; i < evs_len; ++i ) {
+    if( EF_EVENT_TYPE(evs[i]) == EF_EVENT_TYPE_RESET ) {
+      LOGE("ERROR: NIC has been Reset and VI is no longer valid\n");
+      exit(2);
+    }
+    LOGE("ERROR: unexpected event type=%d\n", (int) EF_EVENT_TYPE(evs[i]));
+  }
+
+  return n_pkts + evs_len;
+}
+
+
 static int poll_evq(struct resources* res)
 {
   ef_event evs[EV_POLL_BATCH_SIZE];
   ef_request_id ids[EF_VI_RECEIVE_BATCH];
   int i, j, n_rx;
+  int n_ev;
+
+  if( cfg_rx_burst )
+    return poll_evq_burst(res);
 
-  int n_ev = ef_eventq_poll(&res->vi, evs, EV_POLL_BATCH_SIZE);
+  n_ev = ef_eventq_poll(&res->vi, evs, EV_POLL_BATCH_SIZE);
 
   for( i = 0; i < n_ev; ++i ) {
     switch( EF_EVENT_TYPE(evs[i]) ) {
@@ -544,6 +596,7 @@ static __attribute__ ((__noreturn__)) void usage(void)
   fprintf(stderr, "  -F <fl>  set max fill level for RX ring\n");
   fprintf(stderr, "  -n <num> exit after receiving n packets\n");
   fprintf(stderr, "  -j       join multicast ipv4 address mentioned in filter-spec\n");
+  fprintf(stderr, "  -B       receive with ef_vi_receive_burst()\n");
   exit(1);
 }
 
@@ -557,7 +610,7 @@ int main(int argc, char* argv[])
   struct in_addr sa_mcast;
   int c, sock;
 
-  while( (c = getopt (argc, argv, "dtVL:vmbefF:n:j")) != -1 )
+  while( (c = getopt (argc, argv, "dtVL:vmbefF:n:jB")) != -1 )
     switch( c ) {
     case 'd':
       cfg_hexdump = 1;
@@ -595,6 +648,9 @@ int main(int argc, char* argv[])
     case 'j':
       cfg_register_mcast = 1;
       break;
+    case 'B':
+      cfg_rx_burst = 1;
+      break;
     case '?':
       usage();
     default:
@@ -693,6 +749,10 @@ int main(int argc, char* argv[])
     pkt_buf->ef_addr = ef_memreg_dma_addr(&res->memreg, i * PKT_BUF_SIZE);
   }
 
+  ef_vi_rx_burst_init(&res->rx_burst, res->pkt_bufs, PKT_BUF_SIZE,
+                      RX_DMA_OFF,
+                      cfg_timestamping ? EF_VI_RX_BURST_TIMESTAMPS : 0);
+
   /* Fill the RX ring. */
   res->refill_level = cfg_max_fill - REFILL_BATCH_SIZE;
   res->refill_min = cfg_max_fill / 2;
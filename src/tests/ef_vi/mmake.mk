@@ -4,7 +4,8 @@
 EFSEND_APPS := efsend efsend_pio efsend_timestamping efsend_pio_warm
 TEST_APPS	:= efforward efrss efsink \
 		   efsink_packed efforward_packed eflatency stats \
-		   efjumborx $(EFSEND_APPS)
+		   efjumborx effanout_bench effwd efcapture \
+		   $(EFSEND_APPS)
 
 ifeq (${PLATFORM},gnu_x86_64)
 	TEST_APPS += efrink_controller efrink_consumer
@@ -46,5 +47,11 @@ eflatency: MMAKE_LIB_DEPS := $(CITOOLS_LIB_DEPEND) $(MMAKE_LIB_DEPS)
 
 efrink_controller: efrink_controller.o utils.o
 
+effanout_bench: effanout_bench.o utils.o
+
+effwd: effwd.o utils.o
+
+efcapture: efcapture.o utils.o
+
 stats: stats.py
 	cp $< $@
@@ -0,0 +1,239 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+/* Tests for the accept sub-queues of listening sockets
+ * (EF_TCP_ACCEPTQ_SHARDS).
+ *
+ *  - accept:   several threads accept() from one listening socket while
+ *              several others connect to it.  Each client sends its number
+ *              on its connection, and every client must be accepted exactly
+ *              once, by one of the threads;
+ *  - drain:    a listening socket closed with connections still waiting to
+ *              be accepted resets them, so that their clients see the
+ *              connection close rather than hang.
+ *
+ * Run under Onload with loopback acceleration, so that the connections
+ * land on the sub-queues:
+ *
+ *   EF_TCP_ACCEPTQ_SHARDS=4 EF_TCP_CLIENT_LOOPBACK=4 \
+ *     EF_TCP_SERVER_LOOPBACK=2 onload ./acceptq_shards [accept] [drain]
+ *
+ * With no arguments both tests are run.  acceptq_shard_lock_steals and
+ * acceptq_shard_lock_timeouts in "onload_stackdump lots" should stay at
+ * zero.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <poll.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+
+#define TRY(x)                                                          \
+  do {                                                                  \
+    int __rc = (x);                                                     \
+      if( __rc < 0 ) {                                                  \
+        fprintf(stderr, "ERROR: TRY(%s) failed\n", #x);                 \
+        fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__);       \
+        fprintf(stderr, "ERROR: rc=%d errno=%d (%s)\n",                 \
+                __rc, errno, strerror(errno));                          \
+        exit(1);                                                        \
+      }                                                                 \
+  } while( 0 )
+
+#define TEST(x)                                                         \
+  do {                                                                  \
+    if( ! (x) ) {                                                       \
+      fprintf(stderr, "ERROR: TEST(%s) failed\n", #x);                  \
+      fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__);         \
+      exit(1);                                                          \
+    }                                                                   \
+  } while( 0 )
+
+
+#define ACCEPTERS          4
+#define CONNECTERS         4
+#define CONNS_PER_THREAD   256
+#define CONNS              (CONNECTERS * CONNS_PER_THREAD)
+#define DRAIN_CONNS        32
+
+
+static struct sockaddr_in listen_sa;
+static int listen_fd;
+
+
+static void listen_on_loopback(int backlog)
+{
+  socklen_t sa_len = sizeof(listen_sa);
+
+  TRY(listen_fd = socket(AF_INET, SOCK_STREAM, 0));
+  memset(&listen_sa, 0, sizeof(listen_sa));
+  listen_sa.sin_family = AF_INET;
+  listen_sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  TRY(bind(listen_fd, (struct sockaddr*) &listen_sa, sizeof(listen_sa)));
+  TRY(getsockname(listen_fd, (struct sockaddr*) &listen_sa, &sa_len));
+  TRY(listen(listen_fd, backlog));
+}
+
+
+static int connect_to_listener(void)
+{
+  int fd;
+
+  TRY(fd = socket(AF_INET, SOCK_STREAM, 0));
+  TRY(connect(fd, (struct sockaddr*) &listen_sa, sizeof(listen_sa)));
+  return fd;
+}
+
+
+/**********************************************************************
+ * accept
+ */
+
+static int client_fd[CONNS];
+static int accepted_by[CONNS];
+static volatile int n_accepted;
+
+
+static void* connecter_thread(void* arg)
+{
+  int first = (intptr_t) arg * CONNS_PER_THREAD;
+  uint32_t id;
+  int i;
+
+  for( i = 0; i < CONNS_PER_THREAD; ++i ) {
+    id = first + i;
+    client_fd[id] = connect_to_listener();
+    TEST(send(client_fd[id], &id, sizeof(id), 0) == sizeof(id));
+  }
+  return NULL;
+}
+
+
+static void* accepter_thread(void* arg)
+{
+  int me = (intptr_t) arg;
+  struct pollfd pfd;
+  uint32_t id;
+  int fd;
+
+  pfd.fd = listen_fd;
+  pfd.events = POLLIN;
+  while( n_accepted < CONNS ) {
+    TRY(poll(&pfd, 1, 100));
+    /* Another thread may have taken the connection that woke us. */
+    if( (fd = accept(listen_fd, NULL, NULL)) < 0 ) {
+      TEST(errno == EAGAIN);
+      continue;
+    }
+    TEST(recv(fd, &id, sizeof(id), MSG_WAITALL) == sizeof(id));
+    TEST(id < CONNS);
+    TEST(__sync_bool_compare_and_swap(&accepted_by[id], -1, me));
+    __sync_fetch_and_add(&n_accepted, 1);
+    close(fd);
+  }
+  return NULL;
+}
+
+
+static void test_accept(void)
+{
+  pthread_t accepters[ACCEPTERS], connecters[CONNECTERS];
+  int per_thread[ACCEPTERS];
+  int i;
+
+  listen_on_loopback(CONNS);
+  TRY(fcntl(listen_fd, F_SETFL, O_NONBLOCK));
+  for( i = 0; i < CONNS; ++i )
+    accepted_by[i] = -1;
+  n_accepted = 0;
+
+  for( i = 0; i < ACCEPTERS; ++i )
+    TRY(-pthread_create(&accepters[i], NULL, accepter_thread,
+                        (void*) (intptr_t) i));
+  for( i = 0; i < CONNECTERS; ++i )
+    TRY(-pthread_create(&connecters[i], NULL, connecter_thread,
+                        (void*) (intptr_t) i));
+  alarm(60);
+  for( i = 0; i < CONNECTERS; ++i )
+    pthread_join(connecters[i], NULL);
+  for( i = 0; i < ACCEPTERS; ++i )
+    pthread_join(accepters[i], NULL);
+  alarm(0);
+
+  TEST(n_accepted == CONNS);
+  memset(per_thread, 0, sizeof(per_thread));
+  for( i = 0; i < CONNS; ++i ) {
+    TEST(accepted_by[i] >= 0);
+    ++per_thread[accepted_by[i]];
+    close(client_fd[i]);
+  }
+  close(listen_fd);
+
+  printf("accept: OK (");
+  for( i = 0; i < ACCEPTERS; ++i )
+    printf("%s%d", i ? " " : "", per_thread[i]);
+  printf(")\n");
+}
+
+
+/**********************************************************************
+ * drain
+ */
+
+static void test_drain(void)
+{
+  int fds[DRAIN_CONNS];
+  struct pollfd pfd;
+  char c;
+  int i, rc;
+
+  listen_on_loopback(DRAIN_CONNS);
+  for( i = 0; i < DRAIN_CONNS; ++i ) {
+    fds[i] = connect_to_listener();
+    TEST(send(fds[i], "x", 1, 0) == 1);
+  }
+  close(listen_fd);
+
+  for( i = 0; i < DRAIN_CONNS; ++i ) {
+    pfd.fd = fds[i];
+    pfd.events = POLLIN;
+    TRY(rc = poll(&pfd, 1, 5000));
+    TEST(rc == 1);
+    rc = recv(fds[i], &c, 1, MSG_DONTWAIT);
+    TEST(rc == 0 || (rc < 0 && errno == ECONNRESET));
+    close(fds[i]);
+  }
+  printf("drain: OK\n");
+}
+
+
+int main(int argc, char* argv[])
+{
+  int i;
+
+  if( argc == 1 ) {
+    test_accept();
+    test_drain();
+    return 0;
+  }
+  for( i = 1; i < argc; ++i )
+    if( ! strcmp(argv[i], "accept") )
+      test_accept();
+    else if( ! strcmp(argv[i], "drain") )
+      test_drain();
+    else {
+      fprintf(stderr, "ERROR: unknown test '%s'\n", argv[i]);
+      return 1;
+    }
+  return 0;
+}
@@ -0,0 +1,245 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+/* Benchmark for stacks with a large number of sockets.
+ *
+ * Opens many TCP connections to itself, and then sends small messages on
+ * connections chosen at random, receiving each one on the other end before
+ * sending the next.  With enough connections the socket state touched by
+ * each message is spread over a large amount of memory, so the cost per
+ * message is dominated by TLB and cache misses rather than by the protocol
+ * processing itself.  This is intended for comparing the cost with and
+ * without huge pages backing the shared stack state, for example:
+ *
+ *   EF_TCP_CLIENT_LOOPBACK=1 EF_TCP_SERVER_LOOPBACK=1 EF_MAX_ENDPOINTS=32768 \
+ *     onload ./ep_scale -n 10000 <local-address>
+ *
+ *   EF_STATE_HUGE_PAGES=1 EF_TCP_CLIENT_LOOPBACK=1 EF_TCP_SERVER_LOOPBACK=1 \
+ *   EF_MAX_ENDPOINTS=32768 onload ./ep_scale -n 10000 <local-address>
+ *
+ * and check shmbuf_huge_allocs and shmbuf_huge_maps with
+ * "onload_stackdump lots" in the second case.
+ *
+ * With -c, one connection chosen at random is closed and reopened every so
+ * many messages.  This churns the software filter table as well as sending
+ * messages through it, for comparing EF_FILTER_TABLE_BUCKETS=0 and 1.  The
+ * table_* counters in "onload_stackdump lots" show the probe lengths.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+
+#define TRY(x)                                                          \
+  do {                                                                  \
+    int __rc = (x);                                                     \
+      if( __rc < 0 ) {                                                  \
+        fprintf(stderr, "ERROR: TRY(%s) failed\n", #x);                 \
+        fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__);       \
+        fprintf(stderr, "ERROR: rc=%d errno=%d (%s)\n",                 \
+                __rc, errno, strerror(errno));                          \
+        exit(1);                                                        \
+      }                                                                 \
+  } while( 0 )
+
+
+struct conn {
+  int tx_fd;
+  int rx_fd;
+};
+
+
+static int cfg_conns = 4096;
+static int cfg_iters = 1000000;
+static int cfg_warm = 100000;
+static int cfg_size = 64;
+static int cfg_port = 0;
+static int cfg_churn = 0;
+
+static int listen_fd;
+static struct sockaddr_in listen_sa;
+
+
+static void usage(void)
+{
+  fprintf(stderr, "\nusage:\n");
+  fprintf(stderr, "  ep_scale [options] <local-address>\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -n <conns>   - number of connections (default %d)\n",
+          cfg_conns);
+  fprintf(stderr, "  -i <iters>   - number of measured messages "
+          "(default %d)\n", cfg_iters);
+  fprintf(stderr, "  -w <iters>   - number of warm-up messages "
+          "(default %d)\n", cfg_warm);
+  fprintf(stderr, "  -s <bytes>   - message size (default %d)\n", cfg_size);
+  fprintf(stderr, "  -p <port>    - port to listen on (default any)\n");
+  fprintf(stderr, "  -c <msgs>    - reopen a connection every <msgs> messages "
+          "(default never)\n");
+  exit(1);
+}
+
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+/* Each connection uses two fds, plus a few for stdio and the listener. */
+static void raise_fd_limit(void)
+{
+  struct rlimit rl;
+  rlim_t want = (rlim_t) cfg_conns * 2 + 16;
+
+  TRY(getrlimit(RLIMIT_NOFILE, &rl));
+  if( rl.rlim_cur >= want )
+    return;
+  if( rl.rlim_max < want ) {
+    fprintf(stderr, "ERROR: need %llu fds, but hard limit is %llu\n",
+            (unsigned long long) want, (unsigned long long) rl.rlim_max);
+    exit(1);
+  }
+  rl.rlim_cur = want;
+  TRY(setrlimit(RLIMIT_NOFILE, &rl));
+}
+
+
+static void conn_open(struct conn* c)
+{
+  int one = 1;
+
+  TRY(c->tx_fd = socket(AF_INET, SOCK_STREAM, 0));
+  TRY(connect(c->tx_fd, (struct sockaddr*) &listen_sa, sizeof(listen_sa)));
+  TRY(c->rx_fd = accept(listen_fd, NULL, NULL));
+  TRY(setsockopt(c->tx_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)));
+}
+
+
+static void setup(struct conn* conns, const char* addr_str)
+{
+  socklen_t sa_len = sizeof(listen_sa);
+  int i, one = 1;
+
+  memset(&listen_sa, 0, sizeof(listen_sa));
+  listen_sa.sin_family = AF_INET;
+  listen_sa.sin_port = htons(cfg_port);
+  if( inet_pton(AF_INET, addr_str, &listen_sa.sin_addr) != 1 )
+    usage();
+
+  TRY(listen_fd = socket(AF_INET, SOCK_STREAM, 0));
+  TRY(setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)));
+  TRY(bind(listen_fd, (struct sockaddr*) &listen_sa, sizeof(listen_sa)));
+  TRY(listen(listen_fd, 128));
+  TRY(getsockname(listen_fd, (struct sockaddr*) &listen_sa, &sa_len));
+
+  for( i = 0; i < cfg_conns; ++i )
+    conn_open(&conns[i]);
+  if( ! cfg_churn )
+    close(listen_fd);
+}
+
+
+/* Cheap generator so that choosing the connection costs next to nothing
+ * compared with the message itself. */
+static inline uint32_t xorshift32(uint32_t* s)
+{
+  uint32_t x = *s;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *s = x;
+}
+
+
+static void run(struct conn* conns, int iters, uint32_t* seed)
+{
+  static char buf[65536];
+  int i;
+
+  for( i = 0; i < iters; ++i ) {
+    struct conn* c = &conns[xorshift32(seed) % cfg_conns];
+    int got = 0;
+    ssize_t rc;
+    TRY(rc = send(c->tx_fd, buf, cfg_size, 0));
+    while( got < cfg_size ) {
+      TRY(rc = recv(c->rx_fd, buf, cfg_size - got, 0));
+      if( rc == 0 ) {
+        fprintf(stderr, "ERROR: unexpected EOF\n");
+        exit(1);
+      }
+      got += rc;
+    }
+    if( cfg_churn && (i + 1) % cfg_churn == 0 ) {
+      c = &conns[xorshift32(seed) % cfg_conns];
+      close(c->tx_fd);
+      close(c->rx_fd);
+      conn_open(c);
+    }
+  }
+}
+
+
+int main(int argc, char* argv[])
+{
+  struct conn* conns;
+  uint32_t seed = 0x12345678;
+  uint64_t t0, t1;
+  int c;
+
+  while( (c = getopt(argc, argv, "n:i:w:s:p:c:")) != -1 )
+    switch( c ) {
+    case 'n':
+      cfg_conns = atoi(optarg);
+      break;
+    case 'i':
+      cfg_iters = atoi(optarg);
+      break;
+    case 'w':
+      cfg_warm = atoi(optarg);
+      break;
+    case 's':
+      cfg_size = atoi(optarg);
+      break;
+    case 'p':
+      cfg_port = atoi(optarg);
+      break;
+    case 'c':
+      cfg_churn = atoi(optarg);
+      break;
+    default:
+      usage();
+    }
+  if( optind != argc - 1 || cfg_conns < 1 || cfg_iters < 1 ||
+      cfg_size < 1 || cfg_size > 65536 || cfg_churn < 0 )
+    usage();
+
+  raise_fd_limit();
+  conns = calloc(cfg_conns, sizeof(*conns));
+  if( conns == NULL ) {
+    fprintf(stderr, "ERROR: out of memory\n");
+    return 1;
+  }
+  setup(conns, argv[optind]);
+
+  run(conns, cfg_warm, &seed);
+  t0 = now_ns();
+  run(conns, cfg_iters, &seed);
+  t1 = now_ns();
+
+  printf("conns=%d size=%d iters=%d churn=%d ns_per_msg=%.1f\n", cfg_conns,
+         cfg_size, cfg_iters, cfg_churn, (double) (t1 - t0) / cfg_iters);
+  return 0;
+}
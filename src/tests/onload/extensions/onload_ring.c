@@ -0,0 +1,314 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+/* Tests for the submission/completion ring API (onload_ring_*).
+ *
+ *  - order:    receives on one socket complete in submission order while
+ *              datagrams arrive concurrently;
+ *  - cqfull:   a full completion queue stops the ring consuming
+ *              submissions until completions are reaped;
+ *  - poller:   with ONLOAD_RING_F_POLLER, onload_ring_enter() sleeps until
+ *              the poller thread completes an operation, and times out when
+ *              none does.
+ *
+ * Run under Onload with no arguments to run all of the tests, or name the
+ * tests to run:
+ *
+ *   onload ./onload_ring [order] [cqfull] [poller]
+ */
+
+#include <onload/extensions.h>
+#include <onload/extensions_ring.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+
+#define TRY(x)                                                          \
+  do {                                                                  \
+    int __rc = (x);                                                     \
+      if( __rc < 0 ) {                                                  \
+        fprintf(stderr, "ERROR: TRY(%s) failed\n", #x);                 \
+        fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__);       \
+        fprintf(stderr, "ERROR: rc=%d errno=%d (%s)\n",                 \
+                __rc, errno, strerror(errno));                          \
+        exit(1);                                                        \
+      }                                                                 \
+  } while( 0 )
+
+#define TEST(x)                                                         \
+  do {                                                                  \
+    if( ! (x) ) {                                                       \
+      fprintf(stderr, "ERROR: TEST(%s) failed\n", #x);                  \
+      fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__);         \
+      exit(1);                                                          \
+    }                                                                   \
+  } while( 0 )
+
+
+static int64_t now_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/* Make a pair of connected UDP sockets on the loopback interface. */
+static void udp_pair(int* tx, int* rx)
+{
+  struct sockaddr_in sa;
+  socklen_t sa_len = sizeof(sa);
+
+  TRY(*rx = socket(AF_INET, SOCK_DGRAM, 0));
+  TRY(*tx = socket(AF_INET, SOCK_DGRAM, 0));
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  TRY(bind(*rx, (struct sockaddr*) &sa, sizeof(sa)));
+  TRY(getsockname(*rx, (struct sockaddr*) &sa, &sa_len));
+  TRY(connect(*tx, (struct sockaddr*) &sa, sa_len));
+}
+
+
+static void submit(struct onload_ring* ring, uint8_t opcode, int fd,
+                   void* buf, uint32_t len, uint64_t user_data)
+{
+  struct onload_ring_sqe* sqe = onload_ring_get_sqe(ring);
+
+  TEST(sqe != NULL);
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->buf = buf;
+  sqe->len = len;
+  sqe->user_data = user_data;
+  onload_ring_submit_sqe(ring);
+}
+
+
+/**********************************************************************
+ * order
+ */
+
+#define ORDER_N  64
+
+struct sender {
+  int      fd;
+  int      n;
+  int      gap_us;
+};
+
+
+static void* sender_thread(void* arg)
+{
+  struct sender* s = arg;
+  uint32_t seq;
+
+  for( seq = 0; seq < s->n; ++seq ) {
+    if( s->gap_us )
+      usleep(s->gap_us);
+    TRY(send(s->fd, &seq, sizeof(seq), 0));
+  }
+  return NULL;
+}
+
+
+static void test_order(void)
+{
+  struct onload_ring* ring;
+  struct onload_ring_cqe* cqe;
+  struct sender s;
+  pthread_t thread;
+  uint32_t bufs[ORDER_N];
+  int tx, rx, i, rc;
+
+  TRY(onload_ring_alloc(ORDER_N, 0, &ring));
+  udp_pair(&tx, &rx);
+
+  for( i = 0; i < ORDER_N; ++i )
+    submit(ring, ONLOAD_RING_OP_RECV, rx, &bufs[i], sizeof(bufs[i]), i);
+
+  s.fd = tx;
+  s.n = ORDER_N;
+  s.gap_us = 10;
+  TRY(-pthread_create(&thread, NULL, sender_thread, &s));
+  TRY(rc = onload_ring_enter(ring, ORDER_N, 5000));
+  pthread_join(thread, NULL);
+  TEST(rc == ORDER_N);
+
+  for( i = 0; i < ORDER_N; ++i ) {
+    TEST((cqe = onload_ring_peek_cqe(ring)) != NULL);
+    TEST(cqe->user_data == i);
+    TEST(cqe->res == sizeof(uint32_t));
+    TEST(bufs[i] == i);
+    onload_ring_cqe_seen(ring);
+  }
+  TEST(onload_ring_peek_cqe(ring) == NULL);
+
+  TRY(onload_ring_free(ring));
+  close(tx);
+  close(rx);
+  printf("order: OK\n");
+}
+
+
+/**********************************************************************
+ * cqfull
+ */
+
+static void test_cqfull(void)
+{
+  struct onload_ring* ring;
+  struct onload_ring_cqe* cqe;
+  unsigned sq_n, cq_n, i;
+  uint64_t next = 0, reaped = 0;
+
+  TRY(onload_ring_alloc(4, 0, &ring));
+  sq_n = ring->sq_mask + 1;
+  cq_n = ring->cq_mask + 1;
+  TEST(sq_n == 4 && cq_n == 8);
+
+  /* Two submission queues' worth of operations fill the CQ. */
+  for( i = 0; i < sq_n; ++i )
+    submit(ring, ONLOAD_RING_OP_NOP, -1, NULL, 0, next++);
+  TEST(onload_ring_enter(ring, 0, 0) == sq_n);
+  for( i = 0; i < sq_n; ++i )
+    submit(ring, ONLOAD_RING_OP_NOP, -1, NULL, 0, next++);
+  TEST(onload_ring_enter(ring, 0, 0) == cq_n);
+
+  /* Now the ring must leave new submissions in the SQ. */
+  for( i = 0; i < sq_n; ++i )
+    submit(ring, ONLOAD_RING_OP_NOP, -1, NULL, 0, next++);
+  TEST(onload_ring_get_sqe(ring) == NULL);
+  TEST(onload_ring_enter(ring, 0, 0) == cq_n);
+  TEST(ring->sq_head == ring->sq_tail - sq_n);
+
+  /* Reaping makes room, and everything completes in order. */
+  for( i = 0; i < sq_n; ++i ) {
+    TEST((cqe = onload_ring_peek_cqe(ring)) != NULL);
+    TEST(cqe->user_data == reaped++);
+    TEST(cqe->res == 0);
+    onload_ring_cqe_seen(ring);
+  }
+  TEST(onload_ring_enter(ring, 0, 0) == cq_n);
+  TEST(ring->sq_head == ring->sq_tail);
+  while( (cqe = onload_ring_peek_cqe(ring)) != NULL ) {
+    TEST(cqe->user_data == reaped++);
+    onload_ring_cqe_seen(ring);
+  }
+  TEST(reaped == next);
+
+  /* Waiting with nothing outstanding returns rather than blocking. */
+  alarm(10);
+  TEST(onload_ring_enter(ring, 1, -1) == 0);
+  alarm(0);
+
+  TRY(onload_ring_free(ring));
+  printf("cqfull: OK\n");
+}
+
+
+/**********************************************************************
+ * poller
+ */
+
+#define POLLER_ROUNDS    20
+#define POLLER_DELAY_MS  50
+
+static void test_poller(void)
+{
+  struct onload_ring* ring;
+  struct onload_ring_cqe* cqe;
+  struct sender s;
+  pthread_t thread;
+  uint32_t buf;
+  int64_t t;
+  int tx, rx, round, rc;
+
+  TRY(onload_ring_alloc(4, ONLOAD_RING_F_POLLER, &ring));
+  udp_pair(&tx, &rx);
+
+  /* Nothing outstanding: returns at once. */
+  TEST(onload_ring_enter(ring, 1, -1) == 0);
+
+  /* Nothing completes: the timeout expires. */
+  submit(ring, ONLOAD_RING_OP_RECV, rx, &buf, sizeof(buf), 0);
+  t = now_ms();
+  TEST(onload_ring_enter(ring, 1, POLLER_DELAY_MS) == 0);
+  t = now_ms() - t;
+  TEST(t >= POLLER_DELAY_MS - 1 && t < POLLER_DELAY_MS * 20);
+
+  /* A datagram that arrives after the poller has gone idle wakes the
+   * waiter, however long it has been waiting. */
+  for( round = 0; round < POLLER_ROUNDS; ++round ) {
+    if( round != 0 )
+      submit(ring, ONLOAD_RING_OP_RECV, rx, &buf, sizeof(buf), round);
+    s.fd = tx;
+    s.n = 1;
+    s.gap_us = POLLER_DELAY_MS * 1000;
+    TRY(-pthread_create(&thread, NULL, sender_thread, &s));
+    t = now_ms();
+    alarm(10);
+    TRY(rc = onload_ring_enter(ring, 1, -1));
+    alarm(0);
+    t = now_ms() - t;
+    pthread_join(thread, NULL);
+    TEST(rc == 1);
+    TEST(t < POLLER_DELAY_MS * 20);
+    TEST((cqe = onload_ring_peek_cqe(ring)) != NULL);
+    TEST(cqe->user_data == round);
+    TEST(cqe->res == sizeof(buf));
+    TEST(buf == 0);
+    onload_ring_cqe_seen(ring);
+  }
+
+  TRY(onload_ring_free(ring));
+  close(tx);
+  close(rx);
+  printf("poller: OK\n");
+}
+
+
+int main(int argc, char* argv[])
+{
+  struct onload_ring* ring;
+  int i, rc;
+
+  rc = onload_ring_alloc(1, 0, &ring);
+  if( rc == -ENOSYS ) {
+    fprintf(stderr, "ERROR: onload_ring_*() not available: run under "
+            "onload\n");
+    return 1;
+  }
+  TRY(rc);
+  TRY(onload_ring_free(ring));
+
+  if( argc == 1 ) {
+    test_order();
+    test_cqfull();
+    test_poller();
+    return 0;
+  }
+  for( i = 1; i < argc; ++i )
+    if( ! strcmp(argv[i], "order") )
+      test_order();
+    else if( ! strcmp(argv[i], "cqfull") )
+      test_cqfull();
+    else if( ! strcmp(argv[i], "poller") )
+      test_poller();
+    else {
+      fprintf(stderr, "ERROR: unknown test '%s'\n", argv[i]);
+      return 1;
+    }
+  return 0;
+}
@@ -0,0 +1,182 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+/* Tests the pool of pre-created stacks (EF_STACK_POOL).
+ *
+ * Child processes are started one at a time, each once the pool has a
+ * stack ready for it.  The children exec this program again, so that they
+ * start afresh rather than sharing the parent's stack.  Each child creates
+ * a socket, and so a stack, and checks that /proc/driver/onload/stacks
+ * gives the child as the stack's owner.  The parent checks that the children's stacks came from the pool,
+ * using the hit and miss counts in /proc/driver/onload/stack_pool.
+ *
+ * Run as:
+ *
+ *   EF_STACK_POOL=2 onload ./onload_stack_pool [<children>]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+
+#include <onload/extensions.h>
+
+
+#define TRY(x)                                                          \
+  do {                                                                  \
+    int __rc = (x);                                                     \
+      if( __rc < 0 ) {                                                  \
+        fprintf(stderr, "ERROR: TRY(%s) failed\n", #x);                 \
+        fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__);       \
+        fprintf(stderr, "ERROR: rc=%d errno=%d (%s)\n",                 \
+                __rc, errno, strerror(errno));                          \
+        exit(1);                                                        \
+      }                                                                 \
+  } while( 0 )
+
+#define TEST(x)                                                         \
+  do {                                                                  \
+    if( ! (x) ) {                                                       \
+      fprintf(stderr, "ERROR: TEST(%s) failed\n", #x);                  \
+      fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__);         \
+      exit(1);                                                          \
+    }                                                                   \
+  } while( 0 )
+
+
+struct pool_state {
+  unsigned ready;
+  unsigned hits;
+  unsigned misses;
+};
+
+
+/* Sums the counts over all of the pool's profiles. */
+static void read_pool(struct pool_state* ps)
+{
+  char line[512];
+  unsigned ready, depth, hits, misses;
+  FILE* f;
+
+  memset(ps, 0, sizeof(*ps));
+  f = fopen("/proc/driver/onload/stack_pool", "r");
+  if( f == NULL ) {
+    perror("ERROR: /proc/driver/onload/stack_pool");
+    exit(1);
+  }
+  while( fgets(line, sizeof(line), f) != NULL )
+    if( sscanf(line, "profile: euid=%*u ready=%u/%u hits=%u misses=%u",
+               &ready, &depth, &hits, &misses) == 4 ) {
+      ps->ready += ready;
+      ps->hits += hits;
+      ps->misses += misses;
+    }
+  fclose(f);
+}
+
+
+/* Returns the pid that /proc/driver/onload/stacks gives as the owner of
+ * stack [stack_id], or -1 if the stack is not listed.
+ */
+static int stack_owner(int stack_id)
+{
+  char line[512];
+  int id, pid = -1;
+  FILE* f;
+
+  f = fopen("/proc/driver/onload/stacks", "r");
+  if( f == NULL ) {
+    perror("ERROR: /proc/driver/onload/stacks");
+    exit(1);
+  }
+  while( fgets(line, sizeof(line), f) != NULL )
+    if( sscanf(line, "%d: %d", &id, &pid) == 2 && id == stack_id )
+      break;
+    else
+      pid = -1;
+  fclose(f);
+  return pid;
+}
+
+
+static void child(void)
+{
+  struct onload_stat stat;
+  int fd, owner;
+
+  TRY(fd = socket(AF_INET, SOCK_DGRAM, 0));
+  TEST(onload_fd_stat(fd, &stat) == 1);
+  free(stat.stack_name);
+  owner = stack_owner(stat.stack_id);
+  if( owner != getpid() ) {
+    fprintf(stderr, "ERROR: stack %d owned by %d, not %d\n",
+            stat.stack_id, owner, (int) getpid());
+    exit(1);
+  }
+  close(fd);
+}
+
+
+static void wait_for_ready(void)
+{
+  struct pool_state ps;
+  int i;
+
+  for( i = 0; i < 100; ++i ) {
+    read_pool(&ps);
+    if( ps.ready > 0 )
+      return;
+    usleep(100000);
+  }
+  fprintf(stderr, "ERROR: no pooled stack ready after 10s\n");
+  exit(1);
+}
+
+
+int main(int argc, char* argv[])
+{
+  struct pool_state before, after;
+  int n_children = argc > 1 ? atoi(argv[1]) : 8;
+  int fd, i, status;
+  pid_t pid;
+
+  if( argc == 2 && ! strcmp(argv[1], "-c") ) {
+    child();
+    return 0;
+  }
+  if( ! onload_is_present() ) {
+    fprintf(stderr, "ERROR: run under onload with EF_STACK_POOL set\n");
+    return 1;
+  }
+
+  /* Our own first stack registers the profile, and the driver starts
+   * filling the pool. */
+  TRY(fd = socket(AF_INET, SOCK_DGRAM, 0));
+  close(fd);
+
+  read_pool(&before);
+  for( i = 0; i < n_children; ++i ) {
+    wait_for_ready();
+    TRY(pid = fork());
+    if( pid == 0 ) {
+      execl("/proc/self/exe", argv[0], "-c", NULL);
+      perror("ERROR: exec");
+      _exit(1);
+    }
+    TRY(waitpid(pid, &status, 0));
+    TEST(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+  read_pool(&after);
+
+  printf("hits=%u misses=%u\n", after.hits - before.hits,
+         after.misses - before.misses);
+  TEST((int) (after.hits - before.hits) == n_children);
+  TEST(after.misses == before.misses);
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,295 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+/* Races onload_zc_unregister_buffers() against sends that are in flight
+ * by reference to the memory being unregistered (EF_TCP_SEND_ZC_THRESH).
+ *
+ * Several threads each send a fixed pattern from one registered buffer on
+ * their own TCP connection, while another thread repeatedly unregisters
+ * the buffer and registers it again.  Sends that find the memory
+ * unregistered are copied instead.  The receiver checks that every byte of
+ * every stream matches the pattern, which would not survive the memory
+ * being unpinned under a send in progress.
+ *
+ * On the receiving host (with or without Onload):
+ *
+ *   ./zc_tcp_send_unregister -l
+ *
+ * On the sending host:
+ *
+ *   EF_TCP_SEND_ZC_THRESH=16384 onload ./zc_tcp_send_unregister <receiver>
+ *
+ * The sender exits non-zero if unregistering fails, and the receiver if
+ * any stream is corrupt.  tx_zc_sends and tx_zc_unregistered in
+ * "onload_stackdump lots" show how many sends went each way.
+ */
+
+#include <onload/extensions.h>
+#include <onload/extensions_zc.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+
+#define TRY(x)                                                          \
+  do {                                                                  \
+    int __rc = (x);                                                     \
+      if( __rc < 0 ) {                                                  \
+        fprintf(stderr, "ERROR: TRY(%s) failed\n", #x);                 \
+        fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__);       \
+        fprintf(stderr, "ERROR: rc=%d errno=%d (%s)\n",                 \
+                __rc, errno, strerror(errno));                          \
+        exit(1);                                                        \
+      }                                                                 \
+  } while( 0 )
+
+
+#define BUF_LEN    (4 << 20)
+#define MAX_CONNS  16
+
+
+static int cfg_port = 8099;
+static int cfg_conns = 4;
+static int cfg_secs = 10;
+static int cfg_chunk = 65536;
+
+static uint8_t* buf;
+static int conn_fd[MAX_CONNS];
+static volatile int stop;
+
+
+static uint8_t pattern(uint64_t i)
+{
+  i %= BUF_LEN;
+  return (uint8_t) (i * 7 + (i >> 12));
+}
+
+
+static void usage(void)
+{
+  fprintf(stderr, "\nusage:\n");
+  fprintf(stderr, "  zc_tcp_send_unregister [options] <receiver>\n");
+  fprintf(stderr, "  zc_tcp_send_unregister [options] -l\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -l          - receive and check the streams\n");
+  fprintf(stderr, "  -p <port>   - port (default %d)\n", cfg_port);
+  fprintf(stderr, "  -n <conns>  - sending connections (default %d)\n",
+          cfg_conns);
+  fprintf(stderr, "  -t <secs>   - how long to run (default %d)\n", cfg_secs);
+  fprintf(stderr, "  -c <bytes>  - bytes per send (default %d)\n",
+          cfg_chunk);
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+
+/**********************************************************************
+ * Receiver
+ */
+
+static int do_receive(void)
+{
+  struct sockaddr_in sa;
+  struct pollfd pfd[MAX_CONNS];
+  uint64_t pos[MAX_CONNS];
+  static uint8_t rbuf[1 << 20];
+  int one = 1;
+  int lfd, i, j, n_open;
+  ssize_t rc;
+
+  TRY(lfd = socket(AF_INET, SOCK_STREAM, 0));
+  TRY(setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)));
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(cfg_port);
+  TRY(bind(lfd, (struct sockaddr*) &sa, sizeof(sa)));
+  TRY(listen(lfd, MAX_CONNS));
+
+  for( i = 0; i < cfg_conns; ++i ) {
+    TRY(pfd[i].fd = accept(lfd, NULL, NULL));
+    pfd[i].events = POLLIN;
+    pos[i] = 0;
+  }
+  close(lfd);
+
+  for( n_open = cfg_conns; n_open > 0; ) {
+    TRY(poll(pfd, cfg_conns, -1));
+    for( i = 0; i < cfg_conns; ++i ) {
+      if( pfd[i].fd < 0 || pfd[i].revents == 0 )
+        continue;
+      TRY(rc = recv(pfd[i].fd, rbuf, sizeof(rbuf), 0));
+      if( rc == 0 ) {
+        close(pfd[i].fd);
+        pfd[i].fd = -1;
+        --n_open;
+        continue;
+      }
+      for( j = 0; j < rc; ++j )
+        if( rbuf[j] != pattern(pos[i] + j) ) {
+          fprintf(stderr, "ERROR: stream %d corrupt at byte %llu: "
+                  "got %#x expected %#x\n", i,
+                  (unsigned long long) (pos[i] + j), rbuf[j],
+                  pattern(pos[i] + j));
+          return 1;
+        }
+      pos[i] += rc;
+    }
+  }
+
+  for( i = 0; i < cfg_conns; ++i )
+    printf("stream %d: %llu bytes OK\n", i, (unsigned long long) pos[i]);
+  return 0;
+}
+
+
+/**********************************************************************
+ * Sender
+ */
+
+static void drain_completions(int fd)
+{
+  char control[1024];
+  struct msghdr m;
+
+  do {
+    memset(&m, 0, sizeof(m));
+    m.msg_control = control;
+    m.msg_controllen = sizeof(control);
+  } while( recvmsg(fd, &m, MSG_ERRQUEUE | MSG_DONTWAIT) > 0 );
+}
+
+
+static void* sender(void* arg)
+{
+  int fd = conn_fd[(intptr_t) arg];
+  uint64_t pos = 0;
+  size_t off, len;
+  ssize_t rc;
+
+  while( ! stop ) {
+    off = pos % BUF_LEN;
+    len = cfg_chunk;
+    if( len > BUF_LEN - off )
+      len = BUF_LEN - off;
+    TRY(rc = send(fd, buf + off, len, 0));
+    pos += rc;
+    drain_completions(fd);
+  }
+  shutdown(fd, SHUT_WR);
+  return NULL;
+}
+
+
+static int do_send(const char* host)
+{
+  struct addrinfo hints, *ai;
+  pthread_t threads[MAX_CONNS];
+  onload_zc_handle handle;
+  char port[16];
+  time_t end;
+  unsigned long cycles = 0;
+  int i, rc;
+
+  buf = mmap(NULL, BUF_LEN, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if( buf == MAP_FAILED ) {
+    perror("mmap");
+    return 1;
+  }
+  for( i = 0; i < BUF_LEN; ++i )
+    buf[i] = pattern(i);
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  snprintf(port, sizeof(port), "%d", cfg_port);
+  if( getaddrinfo(host, port, &hints, &ai) != 0 ) {
+    fprintf(stderr, "ERROR: cannot resolve %s\n", host);
+    return 1;
+  }
+  for( i = 0; i < cfg_conns; ++i ) {
+    TRY(conn_fd[i] = socket(AF_INET, SOCK_STREAM, 0));
+    TRY(connect(conn_fd[i], ai->ai_addr, ai->ai_addrlen));
+  }
+  freeaddrinfo(ai);
+
+  TRY(onload_zc_register_buffers(conn_fd[0], EF_ADDRSPACE_LOCAL,
+                                 (uintptr_t) buf, BUF_LEN, 0, &handle));
+  for( i = 0; i < cfg_conns; ++i )
+    TRY(-pthread_create(&threads[i], NULL, sender, (void*) (intptr_t) i));
+
+  /* Unregister while sends are in progress, and register again. */
+  for( end = time(NULL) + cfg_secs; time(NULL) < end; ++cycles ) {
+    usleep(rand() % 1000);
+    rc = onload_zc_unregister_buffers(conn_fd[0], handle, 0);
+    if( rc != 0 ) {
+      fprintf(stderr, "ERROR: onload_zc_unregister_buffers: %d\n", rc);
+      return 1;
+    }
+    usleep(rand() % 100);
+    TRY(onload_zc_register_buffers(conn_fd[0], EF_ADDRSPACE_LOCAL,
+                                   (uintptr_t) buf, BUF_LEN, 0, &handle));
+  }
+
+  stop = 1;
+  for( i = 0; i < cfg_conns; ++i )
+    pthread_join(threads[i], NULL);
+  rc = onload_zc_unregister_buffers(conn_fd[0], handle, 0);
+  if( rc != 0 ) {
+    fprintf(stderr, "ERROR: final onload_zc_unregister_buffers: %d\n", rc);
+    return 1;
+  }
+  for( i = 0; i < cfg_conns; ++i )
+    close(conn_fd[i]);
+
+  printf("%lu unregister/register cycles OK\n", cycles);
+  return 0;
+}
+
+
+int main(int argc, char* argv[])
+{
+  int receive = 0;
+  int c;
+
+  while( (c = getopt(argc, argv, "lp:n:t:c:")) != -1 )
+    switch( c ) {
+    case 'l':
+      receive = 1;
+      break;
+    case 'p':
+      cfg_port = atoi(optarg);
+      break;
+    case 'n':
+      cfg_conns = atoi(optarg);
+      break;
+    case 't':
+      cfg_secs = atoi(optarg);
+      break;
+    case 'c':
+      cfg_chunk = atoi(optarg);
+      break;
+    default:
+      usage();
+    }
+  argc -= optind;
+  argv += optind;
+  if( cfg_conns < 1 || cfg_conns > MAX_CONNS || cfg_chunk < 1 ||
+      argc != (receive ? 0 : 1) )
+    usage();
+
+  return receive ? do_receive() : do_send(argv[0]);
+}
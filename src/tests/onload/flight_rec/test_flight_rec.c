@@ -0,0 +1,136 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+/* Unit tests for the stack's flight recorder: wrap-around of the ring,
+ * which polls get recorded, and freezing.
+ */
+
+#include <ci/internal/ip.h>
+
+#include "../../tap/tap.h"
+
+
+#define LEN  CI_CFG_FLIGHT_RECORDER_LEN
+
+
+static void fr_netif_mock(ci_netif* ni)
+{
+  memset(ni, 0, sizeof(*ni));
+  ni->state = calloc(1, sizeof(*ni->state));
+  if( ni->state == NULL )
+    bail_out(0, "calloc");
+  IPTIMER_STATE(ni)->khz = 1000000;
+}
+
+
+static void fr_netif_mock_destroy(ci_netif* ni)
+{
+  free(ni->state);
+}
+
+
+static const struct oo_flight_rec_ev* fr_ev(ci_netif* ni, ci_uint32 n)
+{
+  return &ni->state->flight_rec.ring[n & (LEN - 1)];
+}
+
+
+static void test_wrap(void)
+{
+  ci_netif ni;
+  ci_uint32 i;
+
+  fr_netif_mock(&ni);
+
+  for( i = 0; i < LEN + 5; ++i )
+    ci_netif_flight_rec(&ni, OO_FR_WAKE, i & 0xffff, i);
+  cmp_ok(ni.state->flight_rec.n, "==", LEN + 5, "counted every event");
+  for( i = 0; i < 5; ++i )
+    cmp_ok(fr_ev(&ni, i)->b, "==", LEN + i,
+           "slot %u overwritten by the newest events", i);
+  cmp_ok(fr_ev(&ni, 5)->b, "==", 5, "slot 5 holds the oldest event kept");
+
+  /* The count wraps at 2^32, which is a multiple of the ring size, so the
+   * newest events stay in consecutive slots. */
+  ni.state->flight_rec.n = 0xfffffffe;
+  for( i = 0; i < 4; ++i )
+    ci_netif_flight_rec(&ni, OO_FR_RETRANS, 0, 100 + i);
+  cmp_ok(ni.state->flight_rec.n, "==", 2, "count wrapped");
+  cmp_ok(fr_ev(&ni, LEN - 2)->b, "==", 100, "slot before the count wrapped");
+  cmp_ok(fr_ev(&ni, LEN - 1)->b, "==", 101, "last slot before wrap");
+  cmp_ok(fr_ev(&ni, 0)->b, "==", 102, "first slot after wrap");
+  cmp_ok(fr_ev(&ni, 1)->b, "==", 103, "second slot after wrap");
+
+  fr_netif_mock_destroy(&ni);
+}
+
+
+static void test_poll(void)
+{
+  ci_netif ni;
+  ci_uint64 frc;
+
+  fr_netif_mock(&ni);
+
+  ci_frc64(&frc);
+  ci_netif_flight_rec_poll(&ni, frc, 0);
+  cmp_ok(ni.state->flight_rec.n, "==", 0, "idle poll not recorded");
+
+  ci_netif_flight_rec(&ni, OO_FR_LOCK_CONTEND, 0, 0);
+  ci_netif_flight_rec_poll(&ni, frc, 0);
+  cmp_ok(ni.state->flight_rec.n, "==", 1,
+         "idle poll leaves earlier events alone");
+
+  ci_netif_flight_rec_poll(&ni, frc, 7);
+  cmp_ok(ni.state->flight_rec.n, "==", 2, "busy poll recorded");
+  cmp_ok(fr_ev(&ni, 1)->type, "==", OO_FR_POLL, "as a poll event");
+  cmp_ok(fr_ev(&ni, 1)->a, "==", 7, "with its event count");
+
+  ci_netif_flight_rec_poll(&ni, frc, 100000);
+  cmp_ok(fr_ev(&ni, 2)->a, "==", 0xffff, "event count saturates");
+
+  fr_netif_mock_destroy(&ni);
+}
+
+
+static void test_freeze(void)
+{
+  ci_netif ni;
+  ci_uint64 frc;
+
+  fr_netif_mock(&ni);
+
+  ni.state->flight_rec.frozen = OO_FR_FROZEN_DISABLED;
+  ci_netif_flight_rec(&ni, OO_FR_WAKE, 0, 0);
+  ci_frc64(&frc);
+  ci_netif_flight_rec_poll(&ni, frc, 3);
+  cmp_ok(ni.state->flight_rec.n, "==", 0, "nothing recorded when disabled");
+
+  /* An idle poll that exceeds the threshold is recorded and freezes. */
+  ni.state->flight_rec.frozen = 0;
+  /* [freeze_cycles] is const at user level; the stack sets it at init. */
+  *(ci_uint64*) &ni.state->flight_rec.freeze_cycles = 100000000;
+  ci_frc64(&frc);
+  ci_netif_flight_rec_poll(&ni, frc, 0);
+  cmp_ok(ni.state->flight_rec.n, "==", 0, "fast idle poll not recorded");
+  ci_netif_flight_rec_poll(&ni, frc - 1000000000, 0);
+  cmp_ok(ni.state->flight_rec.n, "==", 2, "slow idle poll recorded");
+  cmp_ok(fr_ev(&ni, 0)->type, "==", OO_FR_POLL, "poll first");
+  cmp_ok(fr_ev(&ni, 1)->type, "==", OO_FR_FREEZE, "then the freeze");
+  cmp_ok(fr_ev(&ni, 1)->a, "==", OO_FR_FROZEN_POLL, "because of the poll");
+  cmp_ok(ni.state->flight_rec.frozen, "==", OO_FR_FROZEN_POLL, "frozen");
+
+  ci_netif_flight_rec(&ni, OO_FR_WAKE, 0, 0);
+  ci_netif_flight_rec_poll(&ni, frc - 1000000000, 5);
+  cmp_ok(ni.state->flight_rec.n, "==", 2, "nothing recorded once frozen");
+
+  fr_netif_mock_destroy(&ni);
+}
+
+
+int main(int argc, char* argv[])
+{
+  test_wrap();
+  test_poll();
+  test_freeze();
+  done_testing();
+}
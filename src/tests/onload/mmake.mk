@@ -1,12 +1,15 @@
 # SPDX-License-Identifier: BSD-2-Clause
 # X-SPDX-Copyright-Text: (c) Copyright 2002-2020 Xilinx, Inc.
 SUBDIRS	:= wire_order tproxy_preload hwtimestamping \
-           sync_preload l3xudp_preload
+           sync_preload l3xudp_preload pkt_pool ep_scale \
+           udp_mmsg tcp_mmsg rx_scale acceptq_shards \
+           udp_send_ipcache tcp_loopback
 
 ifneq ($(ONLOAD_ONLY),1)
 # These tests have dependency on kernel_compat lib,
 # tests/tap, libmnl that are !ONLOAD_ONLY
-SUBDIRS += oof onload_remote_monitor
+SUBDIRS += oof onload_remote_monitor flight_rec poll_profile \
+           spin_adapt
 ifneq ($(NO_TEAMING),1)
 ifneq ($(NO_NETLINK),1)
 SUBDIRS += cplane_unit cplane_sysunit
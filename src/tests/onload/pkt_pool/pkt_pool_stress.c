@@ -0,0 +1,260 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+/* Stress test for dynamic growth and shrinking of the packet buffer pool.
+ *
+ * Opens a number of TCP connections to itself and repeatedly fills them
+ * without reading, so that the stack has to allocate packet sets, then
+ * drains them and stays idle so that the sets can be released again.  The
+ * size of the burst alternates between the full size and a quarter of it,
+ * so the pool is driven both up and down.  All the data is checked on
+ * receipt, so that a packet set which is released and reallocated while
+ * still in use shows up as corruption.
+ *
+ * Run it in a single stack, with loopback acceleration, for example:
+ *
+ *   EF_TCP_CLIENT_LOOPBACK=1 EF_TCP_SERVER_LOOPBACK=1 \
+ *   EF_PACKET_SET_IDLE_RELEASE_MS=500 EF_MAX_PACKETS=262144 \
+ *     onload ./pkt_pool_stress <local-address>
+ *
+ * and watch bufset_hwm, bufset_released and bufset_alloc_budget with
+ * "onload_stackdump lots".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+
+#define TRY(x)                                                          \
+  do {                                                                  \
+    int __rc = (x);                                                     \
+      if( __rc < 0 ) {                                                  \
+        fprintf(stderr, "ERROR: TRY(%s) failed\n", #x);                 \
+        fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__);       \
+        fprintf(stderr, "ERROR: rc=%d errno=%d (%s)\n",                 \
+                __rc, errno, strerror(errno));                          \
+        exit(1);                                                        \
+      }                                                                 \
+  } while( 0 )
+
+
+struct conn {
+  int      tx_fd;
+  int      rx_fd;
+  uint64_t tx_off;
+  uint64_t rx_off;
+};
+
+
+static int cfg_conns = 8;
+static int cfg_cycles = 10;
+static int cfg_idle_ms = 2000;
+static int cfg_port = 0;
+static size_t cfg_burst = 4 * 1024 * 1024;
+
+
+static void usage(void)
+{
+  fprintf(stderr, "\nusage:\n");
+  fprintf(stderr, "  pkt_pool_stress [options] <local-address>\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -n <conns>   - number of connections (default %d)\n",
+          cfg_conns);
+  fprintf(stderr, "  -b <bytes>   - bytes queued per connection in a full "
+          "burst (default %zu)\n", cfg_burst);
+  fprintf(stderr, "  -c <cycles>  - number of fill/drain cycles "
+          "(default %d)\n", cfg_cycles);
+  fprintf(stderr, "  -i <millis>  - idle time after each drain "
+          "(default %d)\n", cfg_idle_ms);
+  fprintf(stderr, "  -p <port>    - port to listen on (default any)\n");
+  exit(1);
+}
+
+
+static double now_s(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/* The byte at offset [off] of the stream on connection [conn_i]. */
+static inline uint8_t pattern(int conn_i, uint64_t off)
+{
+  return (uint8_t) (off * 7 + conn_i + (off >> 12));
+}
+
+
+static void set_buf_sizes(int fd)
+{
+  int size = (int) (cfg_burst * 2);
+  TRY(setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)));
+  TRY(setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)));
+}
+
+
+static void set_nonblock(int fd)
+{
+  TRY(fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK));
+}
+
+
+static void setup(struct conn* conns, const char* addr_str)
+{
+  struct sockaddr_in sa;
+  socklen_t sa_len = sizeof(sa);
+  int lfd, i, one = 1;
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(cfg_port);
+  if( inet_pton(AF_INET, addr_str, &sa.sin_addr) != 1 )
+    usage();
+
+  TRY(lfd = socket(AF_INET, SOCK_STREAM, 0));
+  TRY(setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)));
+  set_buf_sizes(lfd);
+  TRY(bind(lfd, (struct sockaddr*) &sa, sizeof(sa)));
+  TRY(listen(lfd, cfg_conns));
+  TRY(getsockname(lfd, (struct sockaddr*) &sa, &sa_len));
+
+  for( i = 0; i < cfg_conns; ++i ) {
+    TRY(conns[i].tx_fd = socket(AF_INET, SOCK_STREAM, 0));
+    set_buf_sizes(conns[i].tx_fd);
+    TRY(connect(conns[i].tx_fd, (struct sockaddr*) &sa, sizeof(sa)));
+    TRY(conns[i].rx_fd = accept(lfd, NULL, NULL));
+    set_nonblock(conns[i].tx_fd);
+    set_nonblock(conns[i].rx_fd);
+    conns[i].tx_off = conns[i].rx_off = 0;
+  }
+  close(lfd);
+}
+
+
+/* Queue up to [bytes] on each connection without reading anything. */
+static size_t fill(struct conn* conns, size_t bytes)
+{
+  static uint8_t buf[65536];
+  size_t total = 0;
+  int i;
+
+  for( i = 0; i < cfg_conns; ++i ) {
+    struct conn* c = &conns[i];
+    size_t queued = 0;
+    while( queued < bytes ) {
+      size_t n = bytes - queued < sizeof(buf) ? bytes - queued : sizeof(buf);
+      ssize_t rc;
+      size_t j;
+      for( j = 0; j < n; ++j )
+        buf[j] = pattern(i, c->tx_off + j);
+      rc = send(c->tx_fd, buf, n, 0);
+      if( rc < 0 && errno == EAGAIN )
+        break;
+      TRY(rc);
+      c->tx_off += rc;
+      queued += rc;
+    }
+    total += queued;
+  }
+  return total;
+}
+
+
+/* Read and check everything sent so far. */
+static void drain(struct conn* conns)
+{
+  static uint8_t buf[65536];
+  int i;
+
+  for( i = 0; i < cfg_conns; ++i ) {
+    struct conn* c = &conns[i];
+    while( c->rx_off < c->tx_off ) {
+      ssize_t rc = recv(c->rx_fd, buf, sizeof(buf), 0);
+      ssize_t j;
+      if( rc < 0 && errno == EAGAIN ) {
+        usleep(1000);
+        continue;
+      }
+      TRY(rc);
+      if( rc == 0 ) {
+        fprintf(stderr, "ERROR: conn %d: unexpected EOF at %llu\n", i,
+                (unsigned long long) c->rx_off);
+        exit(1);
+      }
+      for( j = 0; j < rc; ++j )
+        if( buf[j] != pattern(i, c->rx_off + j) ) {
+          fprintf(stderr, "ERROR: conn %d: corrupt data at offset %llu: "
+                  "got %02x expected %02x\n", i,
+                  (unsigned long long) (c->rx_off + j), buf[j],
+                  pattern(i, c->rx_off + j));
+          exit(2);
+        }
+      c->rx_off += rc;
+    }
+  }
+}
+
+
+int main(int argc, char* argv[])
+{
+  struct conn* conns;
+  double t0;
+  int c, cycle;
+
+  while( (c = getopt(argc, argv, "n:b:c:i:p:")) != -1 )
+    switch( c ) {
+    case 'n':
+      cfg_conns = atoi(optarg);
+      break;
+    case 'b':
+      cfg_burst = strtoull(optarg, NULL, 0);
+      break;
+    case 'c':
+      cfg_cycles = atoi(optarg);
+      break;
+    case 'i':
+      cfg_idle_ms = atoi(optarg);
+      break;
+    case 'p':
+      cfg_port = atoi(optarg);
+      break;
+    default:
+      usage();
+    }
+  if( optind != argc - 1 || cfg_conns < 1 || cfg_burst == 0 )
+    usage();
+
+  conns = calloc(cfg_conns, sizeof(*conns));
+  if( conns == NULL ) {
+    fprintf(stderr, "ERROR: out of memory\n");
+    return 1;
+  }
+  setup(conns, argv[optind]);
+
+  t0 = now_s();
+  for( cycle = 0; cycle < cfg_cycles; ++cycle ) {
+    size_t burst = (cycle & 1) ? cfg_burst / 4 : cfg_burst;
+    size_t queued = fill(conns, burst);
+    printf("%9.3f cycle %d: queued %zu bytes\n", now_s() - t0, cycle, queued);
+    fflush(stdout);
+    drain(conns);
+    printf("%9.3f cycle %d: drained, idle for %dms\n",
+           now_s() - t0, cycle, cfg_idle_ms);
+    fflush(stdout);
+    usleep(cfg_idle_ms * 1000);
+  }
+
+  printf("PASS: %d cycles\n", cfg_cycles);
+  return 0;
+}
@@ -0,0 +1,28 @@
+# SPDX-License-Identifier: BSD-2-Clause
+# X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc.
+
+MMAKE_LIBS := $(LINK_CIIP_LIB) $(LINK_CITOOLS_LIB) $(LINK_CIUL_LIB)
+MMAKE_LIB_DEPS := $(CIIP_LIB_DEPEND) $(CITOOLS_LIB_DEPEND) $(CIUL_LIB_DEPEND)
+
+SRCS := ../../tap/tap.c test_poll_profile.c
+OBJS := $(patsubst %.c,%.o,$(SRCS))
+
+TARGETS := test_poll_profile
+
+%.o: %.c
+	$(MMakeCompileC)
+
+$(TARGETS): $(OBJS) $(MMAKE_LIB_DEPS)
+	@(libs="$(MMAKE_LIBS)"; $(MMakeLinkCApp))
+
+all: $(TARGETS)
+
+targets:
+	@echo $(TARGETS)
+
+clean:
+	@$(MakeClean)
+
+.PHONY: test
+test: $(TARGETS)
+	prove --merge --exec '' $(patsubst %,./%,$(TARGETS))
@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+/* Unit tests for the poll loop profile (EF_POLL_PROFILE): nothing is
+ * accumulated when it is off, and when it is on each phase accumulates its
+ * own cycles and calls, including phases nested in another.
+ */
+
+#include <ci/internal/ip.h>
+
+#include "../../tap/tap.h"
+
+
+static void prof_netif_mock(ci_netif* ni)
+{
+  memset(ni, 0, sizeof(*ni));
+  ni->state = calloc(1, sizeof(*ni->state));
+  if( ni->state == NULL )
+    bail_out(0, "calloc");
+}
+
+
+static void prof_netif_mock_destroy(ci_netif* ni)
+{
+  free(ni->state);
+}
+
+
+static int prof_is_empty(ci_netif* ni)
+{
+  const struct oo_poll_profile* prof = &ni->state->poll_profile;
+  int i;
+
+  for( i = 0; i < OO_PROF_N; ++i )
+    if( prof->cycles[i] != 0 || prof->calls[i] != 0 )
+      return 0;
+  return 1;
+}
+
+
+/* Spins for long enough that the cycle counter is sure to advance. */
+static void burn(void)
+{
+  ci_uint64 start, now;
+
+  ci_frc64(&start);
+  do
+    ci_frc64(&now);
+  while( now - start < 10000 );
+}
+
+
+static void test_disabled(void)
+{
+  ci_netif ni;
+  ci_uint64 start;
+
+  prof_netif_mock(&ni);
+
+  start = ci_netif_prof_start(&ni);
+  cmp_ok(start, "==", 0, "start returns 0 when off");
+  burn();
+  ci_netif_prof_end(&ni, OO_PROF_POLL, start);
+  ok(prof_is_empty(&ni), "nothing accumulated when off");
+
+  /* Turning the profile on part way through a phase does not count it. */
+  start = ci_netif_prof_start(&ni);
+  NI_OPTS(&ni).poll_profile = 1;
+  ci_netif_prof_end(&ni, OO_PROF_POLL, start);
+  ok(prof_is_empty(&ni), "phase started while off not counted");
+
+  prof_netif_mock_destroy(&ni);
+}
+
+
+static void test_enabled(void)
+{
+  struct oo_poll_profile* prof;
+  ci_netif ni;
+  ci_uint64 poll, evq, rx, before, after;
+  int i;
+
+  prof_netif_mock(&ni);
+  prof = &ni.state->poll_profile;
+  NI_OPTS(&ni).poll_profile = 1;
+
+  ci_frc64(&before);
+  poll = ci_netif_prof_start(&ni);
+  ok(poll != 0, "start returns the time when on");
+  for( i = 0; i < 3; ++i ) {
+    evq = ci_netif_prof_start(&ni);
+    burn();
+    ci_netif_prof_end(&ni, OO_PROF_EVQ, evq);
+  }
+  rx = ci_netif_prof_start(&ni);
+  burn();
+  ci_netif_prof_end(&ni, OO_PROF_RX, rx);
+  ci_netif_prof_end(&ni, OO_PROF_POLL, poll);
+  ci_frc64(&after);
+
+  cmp_ok(prof->calls[OO_PROF_POLL], "==", 1, "one poll");
+  cmp_ok(prof->calls[OO_PROF_EVQ], "==", 3, "three event queue polls");
+  cmp_ok(prof->calls[OO_PROF_RX], "==", 1, "one receive");
+  cmp_ok(prof->calls[OO_PROF_TIMERS], "==", 0, "no timers");
+  cmp_ok(prof->cycles[OO_PROF_TIMERS], "==", 0, "no timer cycles");
+  cmp_ok(prof->cycles[OO_PROF_EVQ], ">=", 3 * 10000,
+         "event queue cycles accumulated");
+  cmp_ok(prof->cycles[OO_PROF_RX], ">=", 10000, "receive cycles accumulated");
+  cmp_ok(prof->cycles[OO_PROF_POLL], ">=",
+         prof->cycles[OO_PROF_EVQ] + prof->cycles[OO_PROF_RX],
+         "poll includes the phases nested in it");
+  cmp_ok(prof->cycles[OO_PROF_POLL], "<=", after - before,
+         "poll no longer than it took");
+
+  /* Turning the profile off part way through a phase still counts it. */
+  poll = ci_netif_prof_start(&ni);
+  NI_OPTS(&ni).poll_profile = 0;
+  ci_netif_prof_end(&ni, OO_PROF_POLL, poll);
+  cmp_ok(prof->calls[OO_PROF_POLL], "==", 2, "phase started while on counted");
+
+  prof_netif_mock_destroy(&ni);
+}
+
+
+int main(int argc, char* argv[])
+{
+  test_disabled();
+  test_enabled();
+  done_testing();
+}
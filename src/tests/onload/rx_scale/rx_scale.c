@@ -0,0 +1,247 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+/* Receive rate benchmark for stacks with a large number of sockets.
+ *
+ * The receiver binds a UDP socket to each of a range of ports and reports
+ * how many datagrams per second it receives across all of them.  The
+ * sender, on another host, sprays small datagrams over the same range of
+ * ports in a random order, so that each packet received is likely to be
+ * for a socket whose state is not in cache.  This is intended for
+ * comparing the receive path with and without prefetching, for example:
+ *
+ *   EF_MAX_ENDPOINTS=16384 EF_RX_PREFETCH=0 \
+ *     onload ./rx_scale -n 10000 recv <local-address>
+ *
+ *   EF_MAX_ENDPOINTS=16384 EF_RX_PREFETCH=1 \
+ *     onload ./rx_scale -n 10000 recv <local-address>
+ *
+ * with the following on the other host:
+ *
+ *   onload ./rx_scale -n 10000 send <receiver-address>
+ *
+ * The sender must be fast enough to keep the receiver busy; run more than
+ * one if necessary.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+
+#define TRY(x)                                                          \
+  do {                                                                  \
+    int __rc = (x);                                                     \
+      if( __rc < 0 ) {                                                  \
+        fprintf(stderr, "ERROR: TRY(%s) failed\n", #x);                 \
+        fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__);       \
+        fprintf(stderr, "ERROR: rc=%d errno=%d (%s)\n",                 \
+                __rc, errno, strerror(errno));                          \
+        exit(1);                                                        \
+      }                                                                 \
+  } while( 0 )
+
+
+#define MAX_EVENTS  256
+#define SEND_BATCH  32
+
+
+static int cfg_socks = 10000;
+static int cfg_port = 20000;
+static int cfg_size = 32;
+static int cfg_secs = 10;
+
+
+static void usage(void)
+{
+  fprintf(stderr, "\nusage:\n");
+  fprintf(stderr, "  rx_scale [options] recv <local-address>\n");
+  fprintf(stderr, "  rx_scale [options] send <receiver-address>\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -n <socks>   - number of sockets/ports (default %d)\n",
+          cfg_socks);
+  fprintf(stderr, "  -p <port>    - first port (default %d)\n", cfg_port);
+  fprintf(stderr, "  -s <bytes>   - datagram size (default %d)\n", cfg_size);
+  fprintf(stderr, "  -t <secs>    - duration (default %d)\n", cfg_secs);
+  exit(1);
+}
+
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+/* One fd per socket, plus a few for stdio and epoll. */
+static void raise_fd_limit(void)
+{
+  struct rlimit rl;
+  rlim_t want = (rlim_t) cfg_socks + 16;
+
+  TRY(getrlimit(RLIMIT_NOFILE, &rl));
+  if( rl.rlim_cur >= want )
+    return;
+  if( rl.rlim_max < want ) {
+    fprintf(stderr, "ERROR: need %llu fds, but hard limit is %llu\n",
+            (unsigned long long) want, (unsigned long long) rl.rlim_max);
+    exit(1);
+  }
+  rl.rlim_cur = want;
+  TRY(setrlimit(RLIMIT_NOFILE, &rl));
+}
+
+
+static inline uint32_t xorshift32(uint32_t* s)
+{
+  uint32_t x = *s;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *s = x;
+}
+
+
+/* Prints the rate once a second, and returns non-zero when the run is
+ * over. */
+static int report(const char* what, uint64_t* n, uint64_t* t_last,
+                  uint64_t t_end)
+{
+  uint64_t t = now_ns();
+  if( t - *t_last < 1000000000ull )
+    return 0;
+  printf("%s: %.0f pkts/s\n", what, *n * 1e9 / (t - *t_last));
+  fflush(stdout);
+  *n = 0;
+  *t_last = t;
+  return t >= t_end;
+}
+
+
+static void do_recv(const struct sockaddr_in* sa_base)
+{
+  struct epoll_event evs[MAX_EVENTS];
+  struct sockaddr_in sa = *sa_base;
+  char buf[65536];
+  uint64_t n = 0, t_last, t_end;
+  int epfd, fd, i, n_evs;
+
+  raise_fd_limit();
+  TRY(epfd = epoll_create(1));
+  for( i = 0; i < cfg_socks; ++i ) {
+    struct epoll_event e;
+    TRY(fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0));
+    sa.sin_port = htons(cfg_port + i);
+    TRY(bind(fd, (struct sockaddr*) &sa, sizeof(sa)));
+    e.events = EPOLLIN;
+    e.data.fd = fd;
+    TRY(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &e));
+  }
+  printf("recv: %d sockets bound to ports %d-%d\n", cfg_socks, cfg_port,
+         cfg_port + cfg_socks - 1);
+  fflush(stdout);
+
+  /* Don't start the clock until the first datagram arrives. */
+  TRY(epoll_wait(epfd, evs, 1, -1));
+  t_last = now_ns();
+  t_end = t_last + cfg_secs * 1000000000ull;
+
+  do {
+    TRY(n_evs = epoll_wait(epfd, evs, MAX_EVENTS, 0));
+    for( i = 0; i < n_evs; ++i )
+      while( recv(evs[i].data.fd, buf, sizeof(buf), MSG_DONTWAIT) >= 0 )
+        ++n;
+  } while( ! report("recv", &n, &t_last, t_end) );
+}
+
+
+static void do_send(const struct sockaddr_in* sa_base)
+{
+  struct sockaddr_in sas[SEND_BATCH];
+  struct mmsghdr msgs[SEND_BATCH];
+  struct iovec iov;
+  char buf[65536];
+  uint32_t seed = 0x12345678;
+  uint64_t n = 0, t_last, t_end;
+  int fd, i, rc;
+
+  TRY(fd = socket(AF_INET, SOCK_DGRAM, 0));
+  memset(buf, 0, cfg_size);
+  iov.iov_base = buf;
+  iov.iov_len = cfg_size;
+  memset(msgs, 0, sizeof(msgs));
+  for( i = 0; i < SEND_BATCH; ++i ) {
+    sas[i] = *sa_base;
+    msgs[i].msg_hdr.msg_name = &sas[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof(sas[i]);
+    msgs[i].msg_hdr.msg_iov = &iov;
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  t_last = now_ns();
+  t_end = t_last + cfg_secs * 1000000000ull;
+  do {
+    for( i = 0; i < SEND_BATCH; ++i )
+      sas[i].sin_port = htons(cfg_port + xorshift32(&seed) % cfg_socks);
+    rc = sendmmsg(fd, msgs, SEND_BATCH, 0);
+    if( rc < 0 && errno != EAGAIN && errno != ENOBUFS )
+      TRY(rc);
+    if( rc > 0 )
+      n += rc;
+  } while( ! report("send", &n, &t_last, t_end) );
+}
+
+
+int main(int argc, char* argv[])
+{
+  struct sockaddr_in sa;
+  int c;
+
+  while( (c = getopt(argc, argv, "n:p:s:t:")) != -1 )
+    switch( c ) {
+    case 'n':
+      cfg_socks = atoi(optarg);
+      break;
+    case 'p':
+      cfg_port = atoi(optarg);
+      break;
+    case 's':
+      cfg_size = atoi(optarg);
+      break;
+    case 't':
+      cfg_secs = atoi(optarg);
+      break;
+    default:
+      usage();
+    }
+  if( optind != argc - 2 || cfg_socks < 1 || cfg_port < 1 ||
+      cfg_port + cfg_socks > 65536 || cfg_size < 1 || cfg_size > 65507 ||
+      cfg_secs < 1 )
+    usage();
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  if( inet_pton(AF_INET, argv[optind + 1], &sa.sin_addr) != 1 )
+    usage();
+
+  if( ! strcmp(argv[optind], "recv") )
+    do_recv(&sa);
+  else if( ! strcmp(argv[optind], "send") )
+    do_send(&sa);
+  else
+    usage();
+  return 0;
+}
@@ -0,0 +1,130 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+/* Unit tests for adaptive spinning (EF_SPIN_ADAPTIVE): how long a blocking
+ * call spins given the history of its waits, the periodic full spin of
+ * calls that expect to block, and the stats counted.
+ */
+
+#include <ci/internal/ip.h>
+
+#include "../../tap/tap.h"
+
+
+#define MAX_SPIN  1000000
+
+
+static void test_budget(void)
+{
+  struct oo_spin_adapt sa;
+  ci_uint64 budget;
+  int i;
+
+  memset(&sa, 0, sizeof(sa));
+  cmp_ok(oo_spin_adapt_budget(&sa, MAX_SPIN), "==", MAX_SPIN,
+         "no history: spin in full");
+
+  /* Events that come quickly and regularly: spin a little longer than
+   * they take, but not the full spin. */
+  for( i = 0; i < 100; ++i )
+    oo_spin_adapt_update(&sa, 1000);
+  cmp_ok(sa.wait_avg, ">=", 990, "average converges from below");
+  cmp_ok(sa.wait_avg, "<=", 1010, "average converges from above");
+  budget = oo_spin_adapt_budget(&sa, MAX_SPIN);
+  cmp_ok(budget, ">=", 1000, "spin at least as long as a wait");
+  cmp_ok(budget, "<", MAX_SPIN / 10, "spin much less than in full");
+  cmp_ok(budget, "==", (ci_uint64) sa.wait_avg + 4 * sa.wait_dev,
+         "spin for average plus four deviations");
+
+  /* Less regular waits spin for longer. */
+  for( i = 0; i < 100; ++i )
+    oo_spin_adapt_update(&sa, (i & 1) ? 500 : 1500);
+  cmp_ok(oo_spin_adapt_budget(&sa, MAX_SPIN), ">", budget,
+         "deviation lengthens the spin");
+
+  /* A limit lower than expected caps the spin. */
+  cmp_ok(oo_spin_adapt_budget(&sa, 500), "<=", 500, "capped by the limit");
+}
+
+
+static void test_probe(void)
+{
+  struct oo_spin_adapt sa;
+  int i, n_full, n_none;
+
+  memset(&sa, 0, sizeof(sa));
+
+  /* Events that take longer than the full spin: block at once, except for
+   * one call in OO_SPIN_ADAPT_PROBE. */
+  for( i = 0; i < 100; ++i )
+    oo_spin_adapt_update(&sa, MAX_SPIN * 10);
+  n_full = n_none = 0;
+  for( i = 0; i < OO_SPIN_ADAPT_PROBE * 4; ++i )
+    switch( oo_spin_adapt_budget(&sa, MAX_SPIN) ) {
+    case 0:
+      ++n_none;
+      break;
+    case MAX_SPIN:
+      ++n_full;
+      break;
+    }
+  cmp_ok(n_full, "==", 4, "one probe per %d calls", OO_SPIN_ADAPT_PROBE);
+  cmp_ok(n_none, "==", (OO_SPIN_ADAPT_PROBE - 1) * 4, "others do not spin");
+
+  /* When traffic picks up, spinning resumes and the probe count restarts. */
+  for( i = 0; i < 3; ++i )
+    cmp_ok(oo_spin_adapt_budget(&sa, MAX_SPIN), "==", 0, "skip %d", i);
+  for( i = 0; i < 100; ++i )
+    oo_spin_adapt_update(&sa, 1000);
+  ok(oo_spin_adapt_budget(&sa, MAX_SPIN) != 0, "spins again");
+  cmp_ok(sa.n_skips, "==", 0, "probe count reset");
+
+  /* Waits longer than 32 bits of cycles do not wrap. */
+  memset(&sa, 0, sizeof(sa));
+  oo_spin_adapt_update(&sa, 1ull << 40);
+  cmp_ok(sa.wait_avg, ">=", 0x7ffffffe, "long wait saturates");
+  cmp_ok(oo_spin_adapt_budget(&sa, MAX_SPIN), "==", 0,
+         "and means not spinning");
+}
+
+
+static void test_sock(void)
+{
+  ci_netif ni;
+  citp_waitable w;
+  int i;
+
+  memset(&ni, 0, sizeof(ni));
+  ni.state = calloc(1, sizeof(*ni.state));
+  if( ni.state == NULL )
+    bail_out(0, "calloc");
+  memset(&w, 0, sizeof(w));
+
+  /* Off: always the full spin, and no history kept. */
+  ci_sock_spin_done(&ni, &w, 0, 10 * MAX_SPIN, 1);
+  cmp_ok(w.spin_adapt.wait_avg, "==", 0, "no history when off");
+  cmp_ok(ci_sock_spin_budget(&ni, &w, MAX_SPIN), "==", MAX_SPIN,
+         "full spin when off");
+
+  NI_OPTS(&ni).spin_adaptive = 1;
+  for( i = 0; i < 10; ++i )
+    ci_sock_spin_done(&ni, &w, 0, 10 * MAX_SPIN, 1);
+  ci_sock_spin_done(&ni, &w, 0, MAX_SPIN, 0);
+  cmp_ok(w.spin_adapt.wait_avg, ">", MAX_SPIN, "hits are recorded");
+  cmp_ok(ci_sock_spin_budget(&ni, &w, MAX_SPIN), "==", 0, "skips when on");
+#if CI_CFG_STATS_NETIF
+  cmp_ok(ni.state->stats.spin_wait_hits, "==", 11, "hits counted");
+  cmp_ok(ni.state->stats.spin_wait_misses, "==", 1, "misses counted");
+  cmp_ok(ni.state->stats.spin_wait_skips, "==", 1, "skips counted");
+#endif
+
+  free(ni.state);
+}
+
+
+int main(int argc, char* argv[])
+{
+  test_budget();
+  test_probe();
+  test_sock();
+  done_testing();
+}
@@ -0,0 +1,372 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+/* Tests of TCP loopback connections, intended for EF_TCP_LOOPBACK_DIRECT,
+ * where data goes straight to the peer's receive queue and everything else
+ * takes the normal path.
+ *
+ *  - stream:   each end sends a patterned stream to the other at once, in
+ *              sends and receives of assorted sizes, and then shuts down
+ *              its sending side.  Each end checks every byte and sees EOF
+ *              exactly at the end of the stream;
+ *  - oob:      urgent data in the middle of normal data is marked and
+ *              received out of band, with normal data on either side in
+ *              order;
+ *  - inq:      SIOCINQ counts data as it arrives, and SIOCOUTQ drains;
+ *  - reset:    data followed by an abortive close arrives as a correct
+ *              prefix of the data and then ECONNRESET.
+ *
+ * Run under Onload with loopback acceleration:
+ *
+ *   EF_TCP_LOOPBACK_DIRECT=1 EF_TCP_CLIENT_LOOPBACK=4 \
+ *     EF_TCP_SERVER_LOOPBACK=2 onload ./tcp_loopback [stream] [oob] [inq] \
+ *     [reset]
+ *
+ * With no arguments all of the tests are run.  tcp_loopback_direct in
+ * "onload_stackdump lots" counts the segments that went direct.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <linux/sockios.h>
+
+
+#define TRY(x)                                                          \
+  do {                                                                  \
+    int __rc = (x);                                                     \
+      if( __rc < 0 ) {                                                  \
+        fprintf(stderr, "ERROR: TRY(%s) failed\n", #x);                 \
+        fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__);       \
+        fprintf(stderr, "ERROR: rc=%d errno=%d (%s)\n",                 \
+                __rc, errno, strerror(errno));                          \
+        exit(1);                                                        \
+      }                                                                 \
+  } while( 0 )
+
+#define TEST(x)                                                         \
+  do {                                                                  \
+    if( ! (x) ) {                                                       \
+      fprintf(stderr, "ERROR: TEST(%s) failed\n", #x);                  \
+      fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__);         \
+      exit(1);                                                          \
+    }                                                                   \
+  } while( 0 )
+
+
+#define STREAM_LEN   (64 << 20)
+#define MAX_IO       (64 << 10)
+#define PATTERN_LEN  251
+
+
+static uint8_t pattern[PATTERN_LEN + MAX_IO];
+
+
+/* Makes a connected pair of TCP sockets on the loopback interface. */
+static void tcp_pair(int* client, int* server)
+{
+  struct sockaddr_in sa;
+  socklen_t sa_len = sizeof(sa);
+  int lfd;
+
+  TRY(lfd = socket(AF_INET, SOCK_STREAM, 0));
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  TRY(bind(lfd, (struct sockaddr*) &sa, sizeof(sa)));
+  TRY(getsockname(lfd, (struct sockaddr*) &sa, &sa_len));
+  TRY(listen(lfd, 1));
+  TRY(*client = socket(AF_INET, SOCK_STREAM, 0));
+  TRY(connect(*client, (struct sockaddr*) &sa, sa_len));
+  TRY(*server = accept(lfd, NULL, NULL));
+  close(lfd);
+}
+
+
+/* Sizes of the sends and receives: mostly small, sometimes large. */
+static size_t io_len(unsigned* seed, size_t left)
+{
+  size_t len;
+
+  switch( rand_r(seed) & 3 ) {
+  case 0:
+    len = 1 + rand_r(seed) % 16;
+    break;
+  case 1:
+  case 2:
+    len = 1 + rand_r(seed) % 1500;
+    break;
+  default:
+    len = 1 + rand_r(seed) % MAX_IO;
+    break;
+  }
+  return len < left ? len : left;
+}
+
+
+static void wait_readable(int fd)
+{
+  struct pollfd pfd;
+  int rc;
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  TRY(rc = poll(&pfd, 1, 5000));
+  TEST(rc == 1);
+}
+
+
+/**********************************************************************
+ * stream
+ */
+
+struct stream_end {
+  int      fd;
+  unsigned seed;
+};
+
+
+static void* stream_send(void* arg)
+{
+  struct stream_end* e = arg;
+  struct iovec iov[2];
+  size_t pos = 0, len;
+  ssize_t rc;
+
+  while( pos < STREAM_LEN ) {
+    len = io_len(&e->seed, STREAM_LEN - pos);
+    iov[0].iov_base = pattern + pos % PATTERN_LEN;
+    if( len > 1 && (rand_r(&e->seed) & 1) ) {
+      /* Split over two buffers. */
+      iov[0].iov_len = len / 2;
+      iov[1].iov_base = (uint8_t*) iov[0].iov_base + len / 2;
+      iov[1].iov_len = len - len / 2;
+      TRY(rc = writev(e->fd, iov, 2));
+    }
+    else {
+      TRY(rc = send(e->fd, iov[0].iov_base, len, 0));
+    }
+    pos += rc;
+  }
+  TRY(shutdown(e->fd, SHUT_WR));
+  return NULL;
+}
+
+
+static void* stream_recv(void* arg)
+{
+  struct stream_end* e = arg;
+  static __thread uint8_t buf[MAX_IO];
+  size_t pos = 0;
+  ssize_t rc;
+
+  while( 1 ) {
+    TRY(rc = recv(e->fd, buf, io_len(&e->seed, MAX_IO), 0));
+    if( rc == 0 )
+      break;
+    TEST(pos + rc <= STREAM_LEN);
+    if( memcmp(buf, pattern + pos % PATTERN_LEN, rc) ) {
+      fprintf(stderr, "ERROR: stream corrupt in %zd bytes at %zu\n",
+              rc, pos);
+      exit(1);
+    }
+    pos += rc;
+  }
+  TEST(pos == STREAM_LEN);
+  return NULL;
+}
+
+
+static void test_stream(void)
+{
+  struct stream_end tx[2], rx[2];
+  pthread_t threads[4];
+  int fd[2], i;
+
+  tcp_pair(&fd[0], &fd[1]);
+  for( i = 0; i < 2; ++i ) {
+    tx[i].fd = rx[i].fd = fd[i];
+    tx[i].seed = i + 1;
+    rx[i].seed = i + 3;
+  }
+
+  alarm(120);
+  for( i = 0; i < 2; ++i ) {
+    TRY(-pthread_create(&threads[i * 2], NULL, stream_send, &tx[i]));
+    TRY(-pthread_create(&threads[i * 2 + 1], NULL, stream_recv, &rx[i]));
+  }
+  for( i = 0; i < 4; ++i )
+    pthread_join(threads[i], NULL);
+  alarm(0);
+
+  close(fd[0]);
+  close(fd[1]);
+  printf("stream: OK\n");
+}
+
+
+/**********************************************************************
+ * oob
+ */
+
+static void test_oob(void)
+{
+  struct pollfd pfd;
+  char buf[16];
+  int client, server, at_mark, rc;
+
+  tcp_pair(&client, &server);
+
+  TEST(send(client, "ab", 2, 0) == 2);
+  TEST(send(client, "c", 1, MSG_OOB) == 1);
+  TEST(send(client, "de", 2, 0) == 2);
+
+  /* Wait for the urgent data to arrive, and so the data before it. */
+  pfd.fd = server;
+  pfd.events = POLLPRI;
+  TRY(rc = poll(&pfd, 1, 5000));
+  TEST(rc == 1 && (pfd.revents & POLLPRI));
+
+  TRY(ioctl(server, SIOCATMARK, &at_mark));
+  TEST(! at_mark);
+  TEST(recv(server, buf, sizeof(buf), 0) == 2);
+  TEST(! memcmp(buf, "ab", 2));
+  TRY(ioctl(server, SIOCATMARK, &at_mark));
+  TEST(at_mark);
+  TEST(recv(server, buf, 1, MSG_OOB) == 1);
+  TEST(buf[0] == 'c');
+  TEST(recv(server, buf, 2, MSG_WAITALL) == 2);
+  TEST(! memcmp(buf, "de", 2));
+
+  /* Normal data after urgent data still flows. */
+  TEST(send(client, "fgh", 3, 0) == 3);
+  wait_readable(server);
+  TEST(recv(server, buf, 3, MSG_WAITALL) == 3);
+  TEST(! memcmp(buf, "fgh", 3));
+
+  close(client);
+  close(server);
+  printf("oob: OK\n");
+}
+
+
+/**********************************************************************
+ * inq
+ */
+
+static void test_inq(void)
+{
+  static uint8_t buf[MAX_IO];
+  int client, server, inq, outq, i;
+
+  tcp_pair(&client, &server);
+
+  TRY(ioctl(server, SIOCINQ, &inq));
+  TEST(inq == 0);
+  for( i = 1; i <= 4; ++i ) {
+    TEST(send(client, pattern, 1000, 0) == 1000);
+    do {
+      wait_readable(server);
+      TRY(ioctl(server, SIOCINQ, &inq));
+    } while( inq < i * 1000 );
+    TEST(inq == i * 1000);
+  }
+
+  TEST(recv(server, buf, 1500, 0) == 1500);
+  TRY(ioctl(server, SIOCINQ, &inq));
+  TEST(inq == 2500);
+  TEST(recv(server, buf, 2500, MSG_WAITALL) == 2500);
+  TRY(ioctl(server, SIOCINQ, &inq));
+  TEST(inq == 0);
+
+  for( i = 0; i < 500; ++i ) {
+    TRY(ioctl(client, SIOCOUTQ, &outq));
+    if( outq == 0 )
+      break;
+    usleep(10000);
+  }
+  TEST(outq == 0);
+
+  close(client);
+  close(server);
+  printf("inq: OK\n");
+}
+
+
+/**********************************************************************
+ * reset
+ */
+
+static void test_reset(void)
+{
+  static uint8_t buf[MAX_IO];
+  struct linger linger = { .l_onoff = 1, .l_linger = 0 };
+  size_t pos = 0;
+  ssize_t rc;
+  int client, server;
+
+  tcp_pair(&client, &server);
+
+  TEST(send(client, pattern, 10000, 0) == 10000);
+  TRY(setsockopt(client, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger)));
+  close(client);
+
+  while( 1 ) {
+    wait_readable(server);
+    rc = recv(server, buf, sizeof(buf), 0);
+    if( rc < 0 ) {
+      TEST(errno == ECONNRESET);
+      break;
+    }
+    TEST(rc != 0);
+    TEST(pos + rc <= 10000);
+    TEST(! memcmp(buf, pattern + pos, rc));
+    pos += rc;
+  }
+
+  close(server);
+  printf("reset: OK (%zu bytes before the reset)\n", pos);
+}
+
+
+int main(int argc, char* argv[])
+{
+  int i;
+
+  for( i = 0; i < sizeof(pattern); ++i )
+    pattern[i] = i % PATTERN_LEN;
+
+  if( argc == 1 ) {
+    test_stream();
+    test_oob();
+    test_inq();
+    test_reset();
+    return 0;
+  }
+  for( i = 1; i < argc; ++i )
+    if( ! strcmp(argv[i], "stream") )
+      test_stream();
+    else if( ! strcmp(argv[i], "oob") )
+      test_oob();
+    else if( ! strcmp(argv[i], "inq") )
+      test_inq();
+    else if( ! strcmp(argv[i], "reset") )
+      test_reset();
+    else {
+      fprintf(stderr, "ERROR: unknown test '%s'\n", argv[i]);
+      return 1;
+    }
+  return 0;
+}
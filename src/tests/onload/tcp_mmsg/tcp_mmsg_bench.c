@@ -0,0 +1,300 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+/* Throughput benchmark for recvmmsg() and sendmmsg() on TCP sockets.
+ *
+ * One instance accepts a connection and receives from it with recvmmsg(),
+ * reporting the bytes per second and the average number of messages filled
+ * by each call:
+ *
+ *   onload ./tcp_mmsg_bench -r -b 64 -l 64 <local-address> <port>
+ *
+ * and another connects and sends as fast as it can with sendmmsg():
+ *
+ *   onload ./tcp_mmsg_bench -s -b 64 -l 64 <remote-address> <port>
+ *
+ * The sender writes a repeating pattern, and with -c the receiver checks
+ * that every byte arrives in the right place, which exercises the splitting
+ * of the stream over the messages of each call.  With -1 either side uses
+ * recv() or send() with a single buffer of the same total size instead, for
+ * comparison.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+
+#define TRY(x)                                                          \
+  do {                                                                  \
+    int __rc = (x);                                                     \
+      if( __rc < 0 ) {                                                  \
+        fprintf(stderr, "ERROR: TRY(%s) failed\n", #x);                 \
+        fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__);       \
+        fprintf(stderr, "ERROR: rc=%d errno=%d (%s)\n",                 \
+                __rc, errno, strerror(errno));                          \
+        exit(1);                                                        \
+      }                                                                 \
+  } while( 0 )
+
+
+#define MAX_BATCH    1024
+#define MAX_SIZE     65536
+#define PATTERN_LEN  251
+
+
+static int cfg_batch = 64;
+static int cfg_size = 64;
+static int cfg_duration = 10;
+static int cfg_check;
+static int cfg_single;
+
+
+static void usage(void)
+{
+  fprintf(stderr, "\nusage:\n");
+  fprintf(stderr, "  tcp_mmsg_bench -r [options] <local-address> <port>\n");
+  fprintf(stderr, "  tcp_mmsg_bench -s [options] <remote-address> <port>\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -b <num>     - messages per call (default %d)\n",
+          cfg_batch);
+  fprintf(stderr, "  -l <bytes>   - message size (default %d)\n", cfg_size);
+  fprintf(stderr, "  -t <secs>    - duration (default %d)\n", cfg_duration);
+  fprintf(stderr, "  -c           - check the received data\n");
+  fprintf(stderr, "  -1           - use recv() or send() instead\n");
+  exit(1);
+}
+
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+static void init_msgs(struct mmsghdr* msgs, struct iovec* iovs, char* buf)
+{
+  int i;
+
+  memset(msgs, 0, sizeof(*msgs) * cfg_batch);
+  for( i = 0; i < cfg_batch; ++i ) {
+    iovs[i].iov_base = buf + (size_t) i * cfg_size;
+    iovs[i].iov_len = cfg_size;
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+}
+
+
+/* The stream carries byte (offset % PATTERN_LEN) at each offset.  Check the
+ * bytes received into each message, which must follow on from each other
+ * even where a message was not filled.
+ */
+static void check_msgs(const struct mmsghdr* msgs, int n, uint64_t* offset)
+{
+  const unsigned char* p;
+  unsigned j;
+  int i;
+
+  for( i = 0; i < n; ++i ) {
+    p = msgs[i].msg_hdr.msg_iov[0].iov_base;
+    for( j = 0; j < msgs[i].msg_len; ++j, ++*offset )
+      if( p[j] != *offset % PATTERN_LEN ) {
+        fprintf(stderr, "ERROR: bad byte at offset %"PRIu64" (message %d of "
+                "%d, byte %u): got %u expected %u\n", *offset, i, n, j,
+                p[j], (unsigned) (*offset % PATTERN_LEN));
+        exit(1);
+      }
+  }
+}
+
+
+static void do_recv(int fd, struct mmsghdr* msgs, char* buf)
+{
+  uint64_t start, end, last, now;
+  uint64_t n_bytes = 0, n_msgs = 0, n_calls = 0, offset = 0;
+  uint64_t last_bytes = 0, last_msgs = 0, last_calls = 0;
+  int i, rc;
+
+  printf("#%11s %10s\n", "Mbit/s", "msgs/call");
+  start = last = now_ns();
+  end = start + cfg_duration * 1000000000ull;
+
+  do {
+    if( cfg_single ) {
+      TRY(rc = recv(fd, buf, (size_t) cfg_batch * cfg_size, 0));
+      if( rc == 0 )
+        break;
+      n_bytes += rc;
+      ++n_msgs;
+      if( cfg_check ) {
+        msgs[0].msg_len = rc;
+        check_msgs(msgs, 1, &offset);
+      }
+    }
+    else {
+      TRY(rc = recvmmsg(fd, msgs, cfg_batch, MSG_WAITFORONE, NULL));
+      if( rc == 1 && msgs[0].msg_len == 0 )
+        break;
+      for( i = 0; i < rc; ++i )
+        n_bytes += msgs[i].msg_len;
+      n_msgs += rc;
+      if( cfg_check )
+        check_msgs(msgs, rc, &offset);
+    }
+    ++n_calls;
+    if( (n_calls & 0xff) == 0 && (now = now_ns()) - last >= 1000000000ull ) {
+      printf("%12.1f %10.2f\n",
+             (n_bytes - last_bytes) * 8e3 / (now - last),
+             (double) (n_msgs - last_msgs) / (n_calls - last_calls));
+      fflush(stdout);
+      last = now;
+      last_bytes = n_bytes;
+      last_msgs = n_msgs;
+      last_calls = n_calls;
+      if( now >= end )
+        break;
+    }
+  } while( 1 );
+
+  now = now_ns();
+  printf("batch=%d size=%d bytes=%"PRIu64" mbps=%.1f msgs_per_call=%.2f%s\n",
+         cfg_batch, cfg_size, n_bytes, n_bytes * 8e3 / (now - start),
+         n_calls ? (double) n_msgs / n_calls : 0.0,
+         cfg_check ? " checked" : "");
+}
+
+
+static void do_send(int fd, struct mmsghdr* msgs, struct iovec* iovs,
+                    char* buf)
+{
+  size_t call_bytes = (size_t) cfg_batch * cfg_size;
+  uint64_t start, end, now;
+  uint64_t n_bytes = 0, n_calls = 0;
+  size_t i;
+  int rc, j;
+
+  /* The pattern is written once, and each call sends from the point in it
+   * at which the stream has got to.
+   */
+  for( i = 0; i < call_bytes + PATTERN_LEN; ++i )
+    buf[i] = i % PATTERN_LEN;
+
+  start = now_ns();
+  end = start + cfg_duration * 1000000000ull;
+  do {
+    char* base = buf + n_bytes % PATTERN_LEN;
+    if( cfg_single ) {
+      rc = send(fd, base, call_bytes, MSG_NOSIGNAL);
+      if( rc < 0 )
+        break;
+      n_bytes += rc;
+    }
+    else {
+      for( j = 0; j < cfg_batch; ++j )
+        iovs[j].iov_base = base + (size_t) j * cfg_size;
+      rc = sendmmsg(fd, msgs, cfg_batch, MSG_NOSIGNAL);
+      if( rc < 0 )
+        break;
+      for( j = 0; j < rc; ++j )
+        n_bytes += msgs[j].msg_len;
+      if( rc != cfg_batch || msgs[rc - 1].msg_len != cfg_size )
+        /* A short write, so resend from where it ended. */
+        continue;
+    }
+    ++n_calls;
+  } while( (n_calls & 0xff) || (now = now_ns()) < end );
+
+  /* The receiver may have gone first. */
+  if( rc < 0 && errno != EPIPE && errno != ECONNRESET )
+    TRY(rc);
+  now = now_ns();
+  printf("batch=%d size=%d bytes=%"PRIu64" mbps=%.1f\n",
+         cfg_batch, cfg_size, n_bytes, n_bytes * 8e3 / (now - start));
+}
+
+
+int main(int argc, char* argv[])
+{
+  struct sockaddr_in sa;
+  struct mmsghdr* msgs;
+  struct iovec* iovs;
+  char* buf;
+  int c, fd, recv = 0, send = 0, one = 1;
+
+  while( (c = getopt(argc, argv, "rsb:l:t:c1")) != -1 )
+    switch( c ) {
+    case 'r':
+      recv = 1;
+      break;
+    case 's':
+      send = 1;
+      break;
+    case 'b':
+      cfg_batch = atoi(optarg);
+      break;
+    case 'l':
+      cfg_size = atoi(optarg);
+      break;
+    case 't':
+      cfg_duration = atoi(optarg);
+      break;
+    case 'c':
+      cfg_check = 1;
+      break;
+    case '1':
+      cfg_single = 1;
+      break;
+    default:
+      usage();
+    }
+  if( optind != argc - 2 || recv == send || cfg_batch < 1 ||
+      cfg_batch > MAX_BATCH || cfg_size < 1 || cfg_size > MAX_SIZE )
+    usage();
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(atoi(argv[optind + 1]));
+  if( inet_pton(AF_INET, argv[optind], &sa.sin_addr) != 1 )
+    usage();
+
+  msgs = calloc(cfg_batch, sizeof(*msgs));
+  iovs = calloc(cfg_batch, sizeof(*iovs));
+  buf = malloc((size_t) cfg_batch * cfg_size + PATTERN_LEN);
+  if( msgs == NULL || iovs == NULL || buf == NULL ) {
+    fprintf(stderr, "ERROR: out of memory\n");
+    return 1;
+  }
+  init_msgs(msgs, iovs, buf);
+
+  TRY(fd = socket(AF_INET, SOCK_STREAM, 0));
+  if( recv ) {
+    int lfd = fd;
+    TRY(setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)));
+    TRY(bind(lfd, (struct sockaddr*) &sa, sizeof(sa)));
+    TRY(listen(lfd, 1));
+    TRY(fd = accept(lfd, NULL, NULL));
+    close(lfd);
+    do_recv(fd, msgs, buf);
+  }
+  else {
+    TRY(connect(fd, (struct sockaddr*) &sa, sizeof(sa)));
+    TRY(setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)));
+    do_send(fd, msgs, iovs, buf);
+  }
+  close(fd);
+  return 0;
+}
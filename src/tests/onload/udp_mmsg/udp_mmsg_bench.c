@@ -0,0 +1,258 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+/* Throughput benchmark for recvmmsg() and sendmmsg() on UDP sockets.
+ *
+ * One instance receives datagrams with recvmmsg() and reports the number of
+ * messages per second, and the average number taken by each call:
+ *
+ *   onload ./udp_mmsg_bench -r -b 64 <local-address> <port>
+ *
+ * and another sends them as fast as it can with sendmmsg():
+ *
+ *   onload ./udp_mmsg_bench -s -b 64 <remote-address> <port>
+ *
+ * The sender uses a connected socket by default.  With -d <n> it instead
+ * gives a destination with each message, spreading each batch over <n>
+ * destination ports starting at <port>, to measure bursts to a mix of
+ * destinations.  -d 1 measures unconnected sends to a single destination.
+ *
+ * The receiver can join a multicast group with -g.  To compare Onload's
+ * batched recvmmsg() with receiving each message in turn, run the receiver
+ * with EF_UDP_RECVMMSG_BATCH=0 and with EF_UDP_RECVMMSG_BATCH=1.  Likewise
+ * run the sender with EF_UDP_SENDMMSG_BATCH=0 and EF_UDP_SENDMMSG_BATCH=1
+ * to compare sendmmsg() with sending each message in turn.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+
+#define TRY(x)                                                          \
+  do {                                                                  \
+    int __rc = (x);                                                     \
+      if( __rc < 0 ) {                                                  \
+        fprintf(stderr, "ERROR: TRY(%s) failed\n", #x);                 \
+        fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__);       \
+        fprintf(stderr, "ERROR: rc=%d errno=%d (%s)\n",                 \
+                __rc, errno, strerror(errno));                          \
+        exit(1);                                                        \
+      }                                                                 \
+  } while( 0 )
+
+
+#define MAX_BATCH  1024
+#define MAX_SIZE   65507
+
+
+static int cfg_batch = 64;
+static int cfg_size = 64;
+static int cfg_duration = 10;
+static int cfg_n_dests;
+static const char* cfg_mcast;
+
+
+static void usage(void)
+{
+  fprintf(stderr, "\nusage:\n");
+  fprintf(stderr, "  udp_mmsg_bench -r [options] <local-address> <port>\n");
+  fprintf(stderr, "  udp_mmsg_bench -s [options] <remote-address> <port>\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -b <num>     - messages per call (default %d)\n",
+          cfg_batch);
+  fprintf(stderr, "  -l <bytes>   - message size when sending (default %d)\n",
+          cfg_size);
+  fprintf(stderr, "  -t <secs>    - duration (default %d)\n", cfg_duration);
+  fprintf(stderr, "  -g <group>   - join multicast group when receiving\n");
+  fprintf(stderr, "  -d <num>     - send unconnected to <num> destination "
+          "ports\n");
+  exit(1);
+}
+
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+static void init_msgs(struct mmsghdr* msgs, struct iovec* iovs, char* bufs,
+                      int size, struct sockaddr_in* dests)
+{
+  int i;
+
+  memset(msgs, 0, sizeof(*msgs) * cfg_batch);
+  for( i = 0; i < cfg_batch; ++i ) {
+    iovs[i].iov_base = bufs + (size_t) i * MAX_SIZE;
+    iovs[i].iov_len = size;
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    if( dests != NULL ) {
+      msgs[i].msg_hdr.msg_name = &dests[i % cfg_n_dests];
+      msgs[i].msg_hdr.msg_namelen = sizeof(dests[0]);
+    }
+  }
+}
+
+
+static void do_recv(int fd, struct mmsghdr* msgs)
+{
+  uint64_t start, end, last, now;
+  uint64_t n_msgs = 0, n_calls = 0, last_msgs = 0, last_calls = 0;
+  int rc;
+
+  printf("#%11s %10s\n", "msgs/s", "msgs/call");
+  /* Wait for the first message before starting the clock. */
+  TRY(rc = recvmmsg(fd, msgs, cfg_batch, MSG_WAITFORONE, NULL));
+  start = last = now_ns();
+  end = start + cfg_duration * 1000000000ull;
+
+  do {
+    TRY(rc = recvmmsg(fd, msgs, cfg_batch, MSG_WAITFORONE, NULL));
+    n_msgs += rc;
+    ++n_calls;
+    if( (n_calls & 0xff) == 0 && (now = now_ns()) - last >= 1000000000ull ) {
+      printf("%12.0f %10.2f\n",
+             (n_msgs - last_msgs) * 1e9 / (now - last),
+             (double) (n_msgs - last_msgs) / (n_calls - last_calls));
+      fflush(stdout);
+      last = now;
+      last_msgs = n_msgs;
+      last_calls = n_calls;
+      if( now >= end )
+        break;
+    }
+  } while( 1 );
+
+  printf("batch=%d msgs=%"PRIu64" msgs_per_sec=%.0f msgs_per_call=%.2f\n",
+         cfg_batch, n_msgs, n_msgs * 1e9 / (last - start),
+         (double) n_msgs / n_calls);
+}
+
+
+static void do_send(int fd, struct mmsghdr* msgs)
+{
+  uint64_t start, end, now = 0;
+  uint64_t n_msgs = 0, n_calls = 0;
+  int rc;
+
+  start = now_ns();
+  end = start + cfg_duration * 1000000000ull;
+  do {
+    TRY(rc = sendmmsg(fd, msgs, cfg_batch, 0));
+    n_msgs += rc;
+    ++n_calls;
+  } while( (n_calls & 0xff) || (now = now_ns()) < end );
+
+  printf("batch=%d size=%d dests=%d msgs=%"PRIu64" msgs_per_sec=%.0f\n",
+         cfg_batch, cfg_size, cfg_n_dests, n_msgs,
+         n_msgs * 1e9 / (now - start));
+}
+
+
+int main(int argc, char* argv[])
+{
+  struct sockaddr_in sa;
+  struct sockaddr_in* dests = NULL;
+  struct mmsghdr* msgs;
+  struct iovec* iovs;
+  char* bufs;
+  int c, i, fd, recv = 0, send = 0;
+
+  while( (c = getopt(argc, argv, "rsb:l:t:g:d:")) != -1 )
+    switch( c ) {
+    case 'r':
+      recv = 1;
+      break;
+    case 's':
+      send = 1;
+      break;
+    case 'b':
+      cfg_batch = atoi(optarg);
+      break;
+    case 'l':
+      cfg_size = atoi(optarg);
+      break;
+    case 't':
+      cfg_duration = atoi(optarg);
+      break;
+    case 'g':
+      cfg_mcast = optarg;
+      break;
+    case 'd':
+      cfg_n_dests = atoi(optarg);
+      break;
+    default:
+      usage();
+    }
+  if( optind != argc - 2 || recv == send || cfg_batch < 1 ||
+      cfg_batch > MAX_BATCH || cfg_size < 1 || cfg_size > MAX_SIZE ||
+      cfg_n_dests < 0 || (cfg_n_dests > 0 && ! send) )
+    usage();
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(atoi(argv[optind + 1]));
+  if( inet_pton(AF_INET, argv[optind], &sa.sin_addr) != 1 )
+    usage();
+
+  msgs = calloc(cfg_batch, sizeof(*msgs));
+  iovs = calloc(cfg_batch, sizeof(*iovs));
+  bufs = calloc(cfg_batch, MAX_SIZE);
+  if( msgs == NULL || iovs == NULL || bufs == NULL ) {
+    fprintf(stderr, "ERROR: out of memory\n");
+    return 1;
+  }
+
+  TRY(fd = socket(AF_INET, SOCK_DGRAM, 0));
+  if( recv ) {
+    int one = 1;
+    TRY(setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)));
+    if( cfg_mcast != NULL ) {
+      struct ip_mreq mreq;
+      if( inet_pton(AF_INET, cfg_mcast, &mreq.imr_multiaddr) != 1 )
+        usage();
+      mreq.imr_interface = sa.sin_addr;
+      sa.sin_addr = mreq.imr_multiaddr;
+      TRY(bind(fd, (struct sockaddr*) &sa, sizeof(sa)));
+      TRY(setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)));
+    }
+    else {
+      TRY(bind(fd, (struct sockaddr*) &sa, sizeof(sa)));
+    }
+    init_msgs(msgs, iovs, bufs, MAX_SIZE, NULL);
+    do_recv(fd, msgs);
+  }
+  else {
+    if( cfg_n_dests > 0 ) {
+      dests = calloc(cfg_n_dests, sizeof(*dests));
+      if( dests == NULL ) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        return 1;
+      }
+      for( i = 0; i < cfg_n_dests; ++i ) {
+        dests[i] = sa;
+        dests[i].sin_port = htons(ntohs(sa.sin_port) + i);
+      }
+    }
+    else {
+      TRY(connect(fd, (struct sockaddr*) &sa, sizeof(sa)));
+    }
+    init_msgs(msgs, iovs, bufs, cfg_size, dests);
+    do_send(fd, msgs);
+  }
+  return 0;
+}
@@ -0,0 +1,256 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+/* Checks that unconnected UDP sends go to the right place when their
+ * control plane lookups are cached (EF_UDP_SEND_IPCACHE_SIZE).
+ *
+ * The sender has two unconnected sockets with different IP_TTL, which
+ * must not share cached lookups.  Each sends in turn to every one of a
+ * range of destination ports, with a payload naming the port and the TTL.
+ * With more ports than the cache has entries, lookups are evicted and
+ * cached again throughout.  The receiver checks that every datagram
+ * arrives on the port it names, with the TTL it names, and that every
+ * port hears from both sockets.
+ *
+ * On the receiving host, which should be on the same subnet as the sender
+ * so that the TTL arrives unchanged (with or without Onload):
+ *
+ *   ./udp_send_ipcache -l
+ *
+ * On the sending host:
+ *
+ *   EF_UDP_SEND_IPCACHE_SIZE=16 onload ./udp_send_ipcache <receiver>
+ *
+ * Both exit non-zero on failure.  n_tx_cp_cache_hit and n_tx_cp_cache_miss
+ * in "onload_stackdump lots" on the sender show that the cache was used.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <poll.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+
+#define TRY(x)                                                          \
+  do {                                                                  \
+    int __rc = (x);                                                     \
+      if( __rc < 0 ) {                                                  \
+        fprintf(stderr, "ERROR: TRY(%s) failed\n", #x);                 \
+        fprintf(stderr, "ERROR: at %s:%d\n", __FILE__, __LINE__);       \
+        fprintf(stderr, "ERROR: rc=%d errno=%d (%s)\n",                 \
+                __rc, errno, strerror(errno));                          \
+        exit(1);                                                        \
+      }                                                                 \
+  } while( 0 )
+
+
+#define MAX_PORTS  1024
+#define TTL_A      7
+#define TTL_B      9
+
+
+struct msg {
+  uint16_t port;
+  uint16_t ttl;
+  uint32_t seq;
+};
+
+
+static int cfg_port = 8200;
+static int cfg_ports = 64;
+static int cfg_rounds = 100;
+static int cfg_gap_us = 100;
+
+
+static void usage(void)
+{
+  fprintf(stderr, "\nusage:\n");
+  fprintf(stderr, "  udp_send_ipcache [options] <receiver>\n");
+  fprintf(stderr, "  udp_send_ipcache [options] -l\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -l          - receive and check the datagrams\n");
+  fprintf(stderr, "  -p <port>   - first port (default %d)\n", cfg_port);
+  fprintf(stderr, "  -n <ports>  - number of ports (default %d)\n", cfg_ports);
+  fprintf(stderr, "  -r <rounds> - sends to each port by each socket "
+          "(default %d)\n", cfg_rounds);
+  fprintf(stderr, "  -g <usecs>  - gap between rounds (default %d)\n",
+          cfg_gap_us);
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+
+/**********************************************************************
+ * Receiver
+ */
+
+static int recv_ttl(struct msghdr* m)
+{
+  struct cmsghdr* c;
+
+  for( c = CMSG_FIRSTHDR(m); c != NULL; c = CMSG_NXTHDR(m, c) )
+    if( c->cmsg_level == IPPROTO_IP && c->cmsg_type == IP_TTL )
+      return *(int*) CMSG_DATA(c);
+  return -1;
+}
+
+
+static int do_receive(void)
+{
+  static struct pollfd pfd[MAX_PORTS];
+  static unsigned n_a[MAX_PORTS], n_b[MAX_PORTS];
+  struct sockaddr_in sa;
+  struct msghdr m;
+  struct iovec iov;
+  struct msg msg;
+  char control[256];
+  unsigned long total = 0;
+  int one = 1;
+  int i, rc, ttl, bad = 0;
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  for( i = 0; i < cfg_ports; ++i ) {
+    TRY(pfd[i].fd = socket(AF_INET, SOCK_DGRAM, 0));
+    TRY(setsockopt(pfd[i].fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)));
+    TRY(setsockopt(pfd[i].fd, IPPROTO_IP, IP_RECVTTL, &one, sizeof(one)));
+    sa.sin_port = htons(cfg_port + i);
+    TRY(bind(pfd[i].fd, (struct sockaddr*) &sa, sizeof(sa)));
+    pfd[i].events = POLLIN;
+  }
+
+  /* Wait as long as it takes for the first datagram, and then until the
+   * sender has been quiet for a while. */
+  while( (rc = poll(pfd, cfg_ports, total ? 2000 : -1)) != 0 ) {
+    TRY(rc);
+    for( i = 0; i < cfg_ports; ++i ) {
+      if( pfd[i].revents == 0 )
+        continue;
+      iov.iov_base = &msg;
+      iov.iov_len = sizeof(msg);
+      memset(&m, 0, sizeof(m));
+      m.msg_iov = &iov;
+      m.msg_iovlen = 1;
+      m.msg_control = control;
+      m.msg_controllen = sizeof(control);
+      TRY(rc = recvmsg(pfd[i].fd, &m, 0));
+      ttl = recv_ttl(&m);
+      ++total;
+      if( rc != sizeof(msg) || msg.port != cfg_port + i || msg.ttl != ttl ) {
+        fprintf(stderr, "ERROR: port %d got len=%d port=%d ttl=%d seq=%u "
+                "with ttl=%d\n", cfg_port + i, rc, msg.port, msg.ttl,
+                msg.seq, ttl);
+        if( ++bad == 10 )
+          return 1;
+        continue;
+      }
+      if( ttl == TTL_A )
+        ++n_a[i];
+      else
+        ++n_b[i];
+    }
+  }
+
+  for( i = 0; i < cfg_ports; ++i )
+    if( n_a[i] == 0 || n_b[i] == 0 ) {
+      fprintf(stderr, "ERROR: port %d got %u with ttl %d and %u with ttl %d\n",
+              cfg_port + i, n_a[i], TTL_A, n_b[i], TTL_B);
+      bad = 1;
+    }
+  if( bad )
+    return 1;
+  printf("%lu datagrams OK\n", total);
+  return 0;
+}
+
+
+/**********************************************************************
+ * Sender
+ */
+
+static int do_send(const char* host)
+{
+  struct addrinfo hints, *ai;
+  struct sockaddr_in sa;
+  struct msg msg;
+  int fd[2], ttl[2] = { TTL_A, TTL_B };
+  int round, i, s;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  if( getaddrinfo(host, NULL, &hints, &ai) != 0 ) {
+    fprintf(stderr, "ERROR: cannot resolve %s\n", host);
+    return 1;
+  }
+  memcpy(&sa, ai->ai_addr, sizeof(sa));
+  freeaddrinfo(ai);
+
+  for( s = 0; s < 2; ++s ) {
+    TRY(fd[s] = socket(AF_INET, SOCK_DGRAM, 0));
+    TRY(setsockopt(fd[s], IPPROTO_IP, IP_TTL, &ttl[s], sizeof(ttl[s])));
+  }
+
+  msg.seq = 0;
+  for( round = 0; round < cfg_rounds; ++round ) {
+    for( i = 0; i < cfg_ports; ++i )
+      for( s = 0; s < 2; ++s ) {
+        msg.port = cfg_port + i;
+        msg.ttl = ttl[s];
+        ++msg.seq;
+        sa.sin_port = htons(msg.port);
+        TRY(sendto(fd[s], &msg, sizeof(msg), 0,
+                   (struct sockaddr*) &sa, sizeof(sa)));
+      }
+    usleep(cfg_gap_us);
+  }
+
+  close(fd[0]);
+  close(fd[1]);
+  printf("%u datagrams sent\n", msg.seq);
+  return 0;
+}
+
+
+int main(int argc, char* argv[])
+{
+  int receive = 0;
+  int c;
+
+  while( (c = getopt(argc, argv, "lp:n:r:g:")) != -1 )
+    switch( c ) {
+    case 'l':
+      receive = 1;
+      break;
+    case 'p':
+      cfg_port = atoi(optarg);
+      break;
+    case 'n':
+      cfg_ports = atoi(optarg);
+      break;
+    case 'r':
+      cfg_rounds = atoi(optarg);
+      break;
+    case 'g':
+      cfg_gap_us = atoi(optarg);
+      break;
+    default:
+      usage();
+    }
+  argc -= optind;
+  argv += optind;
+  if( cfg_ports < 1 || cfg_ports > MAX_PORTS || cfg_port < 1 ||
+      cfg_port + cfg_ports > 65536 || cfg_rounds < 1 ||
+      argc != (receive ? 0 : 1) )
+    usage();
+
+  return receive ? do_receive() : do_send(argv[0]);
+}
@@ -20,6 +20,16 @@ static void usage_msg(FILE* f)
   fprintf(f, "  -w WARMUPS              - num warm-up iterations\n");
   fprintf(f, "  -f FRAME_LEN            - frame length (bytes)\n");
   fprintf(f, "  -g GAP_NANOS            - pause between iterations (nanos)\n");
+  fprintf(f, "  -s                      - print percentile summary instead of "
+          "raw samples\n");
+  fprintf(f, "  -I N                    - print a percentile summary every N "
+          "iterations\n");
+  fprintf(f, "  -H FILE                 - write HdrHistogram percentile "
+          "distribution to FILE\n");
+  fprintf(f, "  -C INTERVAL_NANOS       - correct for coordinated omission "
+          "assuming\n"
+             "                            samples are expected every "
+          "INTERVAL_NANOS\n");
 }
 
 
@@ -150,6 +160,11 @@ static int measure_overhead(const struct rtt_options* opts)
 }
 
 
+/* Latencies are recorded in nanoseconds; anything above 10s is clamped. */
+#define RTT_HIST_HIGHEST  10000000000ll
+#define RTT_HIST_BITS     7
+
+
 static void do_pinger(const struct rtt_options* opts,
                       struct rtt_endpoint* tx_ep,
                       struct rtt_endpoint* rx_ep)
@@ -157,10 +172,15 @@ static void do_pinger(const struct rtt_options* opts,
   int overhead = measure_overhead(opts);
   int n_warm_ups = opts->n_warm_ups;
   int n_iters = opts->n_iters;
+  ci_hist hist, interval_hist;
   int* results;
   int i;
 
   RTT_TEST( results = malloc(n_iters * sizeof(results[0])) );
+  RTT_TRY( ci_hist_init(&hist, RTT_HIST_HIGHEST, RTT_HIST_BITS) );
+  RTT_TRY( ci_hist_init(&interval_hist, RTT_HIST_HIGHEST, RTT_HIST_BITS) );
+  ci_hist_set_expected_interval(&hist, opts->expected_interval_ns);
+  ci_hist_set_expected_interval(&interval_hist, opts->expected_interval_ns);
 
   for( i = 0; i < n_warm_ups; ++i ) {
     tx_ep->ping(tx_ep);
@@ -182,6 +202,15 @@ static void do_pinger(const struct rtt_options* opts,
     rx_ep->pong(rx_ep);
     clock_gettime(CLOCK_REALTIME, &end);
     results[i] = timespec_diff_ns(end, start) - overhead;
+    if( opts->report_interval ) {
+      ci_hist_record(&interval_hist, results[i]);
+      if( (i + 1) % opts->report_interval == 0 ) {
+        ci_hist_dump_summary(&interval_hist, stdout, "# interval: ", 1.0);
+        fflush(stdout);
+        ci_hist_add(&hist, &interval_hist);
+        ci_hist_reset(&interval_hist);
+      }
+    }
     if( opts->inter_iter_gap_ns ) {
       do
         clock_gettime(CLOCK_REALTIME, &start);
@@ -194,8 +223,28 @@ static void do_pinger(const struct rtt_options* opts,
     tx_ep->dump_info(tx_ep, stdout);
   if( rx_ep != tx_ep && rx_ep->dump_info != NULL )
     rx_ep->dump_info(rx_ep, stdout);
-  for( i = 0; i < n_iters; ++i )
-    printf("%d\n", results[i]);
+
+  if( opts->report_interval )
+    ci_hist_add(&hist, &interval_hist);
+  else
+    for( i = 0; i < n_iters; ++i )
+      ci_hist_record(&hist, results[i]);
+  ci_hist_dump_summary(&hist, stdout, "# latency_ns: ", 1.0);
+
+  if( opts->hgrm_file != NULL ) {
+    FILE* fp;
+    RTT_TEST( (fp = fopen(opts->hgrm_file, "w")) != NULL );
+    RTT_TRY( ci_hist_write_hgrm(&hist, fp, 1.0) );
+    fclose(fp);
+  }
+
+  if( ! opts->summary_only )
+    for( i = 0; i < n_iters; ++i )
+      printf("%d\n", results[i]);
+
+  ci_hist_fini(&interval_hist);
+  ci_hist_fini(&hist);
+  free(results);
 }
 
 
@@ -245,9 +294,13 @@ int main(int argc, char* argv[])
   opts.n_warm_ups = 10000;
   opts.n_iters = 100000;
   opts.inter_iter_gap_ns = 0;
+  opts.summary_only = 0;
+  opts.report_interval = 0;
+  opts.expected_interval_ns = 0;
+  opts.hgrm_file = NULL;
 
   int c;
-  while( (c = getopt(argc, argv, "i:w:f:g:h")) != -1 )
+  while( (c = getopt(argc, argv, "i:w:f:g:sI:H:C:h")) != -1 )
     switch( c ) {
     case 'i':
       opts.n_iters = atoi(optarg);
@@ -262,6 +315,18 @@ int main(int argc, char* argv[])
     case 'g':
       opts.inter_iter_gap_ns = atoi(optarg);
       break;
+    case 's':
+      opts.summary_only = 1;
+      break;
+    case 'I':
+      opts.report_interval = atoi(optarg);
+      break;
+    case 'H':
+      opts.hgrm_file = optarg;
+      break;
+    case 'C':
+      opts.expected_interval_ns = atoll(optarg);
+      break;
     case 'h':
       usage_msg(stdout);
       exit(0);
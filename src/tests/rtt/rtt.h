@@ -27,6 +27,10 @@ struct rtt_options {
   int     n_warm_ups;
   int     n_iters;
   int     inter_iter_gap_ns;
+  int     summary_only;
+  int     report_interval;
+  int64_t expected_interval_ns;
+  const char* hgrm_file;
 };
 
 
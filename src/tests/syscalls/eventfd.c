@@ -0,0 +1,128 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+/**************************************************************************\
+*//*! \file
+**  \brief  Test eventfd() semantics
+**
+** Checks counting and semaphore reads, non-blocking behaviour, poll() and
+** epoll readiness, and wake-ups from another thread.  Run it with
+** EF_EVENTFD=1 under onload to test accelerated eventfds, and without
+** onload to check the test against the kernel.
+*//*
+\**************************************************************************/
+
+/*! \cidoxg_tests_syscalls */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+
+#define TEST(x)                                                 \
+  do {                                                          \
+    if( ! (x) ) {                                               \
+      fprintf(stderr, "FAIL: %s at %s:%d (errno=%d %s)\n",      \
+              #x, __FILE__, __LINE__, errno, strerror(errno));  \
+      exit(1);                                                  \
+    }                                                           \
+  } while( 0 )
+
+
+static int efd_write(int fd, uint64_t v)
+{
+  return write(fd, &v, sizeof(v));
+}
+
+
+static uint64_t efd_read(int fd)
+{
+  uint64_t v;
+  TEST(read(fd, &v, sizeof(v)) == sizeof(v));
+  return v;
+}
+
+
+static void* writer_thread(void* arg)
+{
+  int fd = *(int*) arg;
+  int i;
+
+  for( i = 0; i < 1000; ++i )
+    TEST(efd_write(fd, 1) == sizeof(uint64_t));
+  return NULL;
+}
+
+
+int main(void)
+{
+  struct epoll_event ev;
+  struct pollfd pfd;
+  pthread_t tid;
+  uint64_t v, total;
+  int fd, epfd;
+
+  /* Counting reads take the whole count. */
+  TEST((fd = eventfd(3, 0)) >= 0);
+  TEST(efd_write(fd, 4) == sizeof(uint64_t));
+  TEST(efd_read(fd) == 7);
+  TEST(read(fd, &v, 4) < 0 && errno == EINVAL);
+  v = (uint64_t) -1;
+  TEST(write(fd, &v, sizeof(v)) < 0 && errno == EINVAL);
+  TEST((fcntl(fd, F_GETFL) & O_ACCMODE) == O_RDWR);
+
+  /* Non-blocking reads of a zero count fail. */
+  TEST(fcntl(fd, F_SETFL, O_NONBLOCK) == 0);
+  TEST(fcntl(fd, F_GETFL) & O_NONBLOCK);
+  TEST(read(fd, &v, sizeof(v)) < 0 && errno == EAGAIN);
+
+  /* A write that would overflow the count fails when non-blocking. */
+  TEST(efd_write(fd, 0xfffffffffffffffeull) == sizeof(uint64_t));
+  TEST(efd_write(fd, 1) < 0 && errno == EAGAIN);
+  pfd.fd = fd;
+  pfd.events = POLLIN | POLLOUT;
+  TEST(poll(&pfd, 1, 0) == 1 && pfd.revents == POLLIN);
+  TEST(efd_read(fd) == 0xfffffffffffffffeull);
+  TEST(poll(&pfd, 1, 0) == 1 && pfd.revents == POLLOUT);
+  close(fd);
+
+  /* Semaphore reads take one at a time. */
+  TEST((fd = eventfd(2, EFD_SEMAPHORE | EFD_NONBLOCK)) >= 0);
+  TEST(efd_read(fd) == 1);
+  TEST(efd_read(fd) == 1);
+  TEST(read(fd, &v, sizeof(v)) < 0 && errno == EAGAIN);
+  close(fd);
+
+  /* epoll sees the count change, and a blocking reader is woken by writes
+   * from another thread. */
+  TEST((fd = eventfd(0, 0)) >= 0);
+  TEST((epfd = epoll_create1(0)) >= 0);
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  TEST(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == 0);
+  TEST(epoll_wait(epfd, &ev, 1, 0) == 0);
+  TEST(efd_write(fd, 1) == sizeof(uint64_t));
+  TEST(epoll_wait(epfd, &ev, 1, 0) == 1 && ev.data.fd == fd);
+  TEST(efd_read(fd) == 1);
+  TEST(epoll_wait(epfd, &ev, 1, 0) == 0);
+
+  TEST(pthread_create(&tid, NULL, writer_thread, &fd) == 0);
+  for( total = 0; total < 1000; total += efd_read(fd) )
+    TEST(epoll_wait(epfd, &ev, 1, -1) == 1);
+  TEST(total == 1000);
+  TEST(pthread_join(tid, NULL) == 0);
+  close(epfd);
+  close(fd);
+
+  printf("PASS\n");
+  return 0;
+}
+
+/*! \cidoxg_end */
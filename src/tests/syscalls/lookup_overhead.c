@@ -0,0 +1,271 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+/**************************************************************************\
+*//*! \file
+**  \brief  Measure the per-call cost of intercepted send() and recv()
+**
+** Each thread times non-blocking recv() on an empty UDP socket against
+** onload_zc_recv() with ONLOAD_MSG_DONTWAIT on the same socket.  Given a
+** destination, it also times send() of a small datagram against
+** onload_zc_send() of one buffer.  The difference is mostly the cost of
+** interposition: the fd table lookup and entering and leaving the library.
+**
+** Run it under onload, with and without EF_FDS_MT_SAFE=0 and
+** EF_FDS_DEFER_FREE=1, and with several threads (-t) to see the effect of
+** cache-line sharing.  Without onload the onload_zc_* rows are skipped.
+*//*
+\**************************************************************************/
+
+/*! \cidoxg_tests_syscalls */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <onload/extensions.h>
+#include <onload/extensions_zc.h>
+
+
+#define TEST(x)                                                 \
+  do {                                                          \
+    if( ! (x) ) {                                               \
+      fprintf(stderr, "FAIL: %s at %s:%d (errno=%d %s)\n",      \
+              #x, __FILE__, __LINE__, errno, strerror(errno));  \
+      exit(1);                                                  \
+    }                                                           \
+  } while( 0 )
+
+
+static int cfg_iter = 1000000;
+static int cfg_threads = 1;
+static int cfg_size = 16;
+static struct sockaddr_storage cfg_dest;
+static socklen_t cfg_dest_len;
+
+enum {
+  T_RECV,
+  T_ZC_RECV,
+  T_SEND,
+  T_ZC_SEND,
+  T_N
+};
+
+static const char* const test_names[T_N] = {
+  "recv(MSG_DONTWAIT)",
+  "onload_zc_recv(DONTWAIT)",
+  "send()",
+  "onload_zc_send()",
+};
+
+struct thread_result {
+  pthread_t thread;
+  double    ns[T_N];   /* per call, or negative if not run */
+};
+
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static enum onload_zc_callback_rc
+zc_recv_cb(struct onload_zc_recv_args* args, int flags)
+{
+  return ONLOAD_ZC_TERMINATE;
+}
+
+
+static double time_recv(int fd)
+{
+  char buf[64];
+  uint64_t start = now_ns();
+  int i;
+
+  for( i = 0; i < cfg_iter; ++i )
+    TEST(recv(fd, buf, sizeof(buf), MSG_DONTWAIT) < 0 && errno == EAGAIN);
+  return (double) (now_ns() - start) / cfg_iter;
+}
+
+
+static double time_zc_recv(int fd)
+{
+  struct onload_zc_recv_args args;
+  uint64_t start;
+  int i, rc;
+
+  memset(&args, 0, sizeof(args));
+  args.cb = zc_recv_cb;
+  args.flags = ONLOAD_MSG_DONTWAIT;
+  if( onload_zc_recv(fd, &args) == -ENOSYS )
+    return -1;
+
+  start = now_ns();
+  for( i = 0; i < cfg_iter; ++i ) {
+    args.flags = ONLOAD_MSG_DONTWAIT;
+    rc = onload_zc_recv(fd, &args);
+    TEST(rc == -EAGAIN || rc == 0);
+  }
+  return (double) (now_ns() - start) / cfg_iter;
+}
+
+
+static double time_send(int fd)
+{
+  char buf[1500];
+  uint64_t start;
+  int i;
+
+  memset(buf, 0, cfg_size);
+  start = now_ns();
+  /* Tolerate ICMP port unreachable from a destination with no listener. */
+  for( i = 0; i < cfg_iter; ++i )
+    TEST(send(fd, buf, cfg_size, 0) == cfg_size || errno == ECONNREFUSED);
+  return (double) (now_ns() - start) / cfg_iter;
+}
+
+
+static double time_zc_send(int fd)
+{
+  struct onload_zc_iovec iov;
+  struct onload_zc_mmsg mmsg;
+  uint64_t start;
+  int i;
+
+  if( onload_zc_alloc_buffers(fd, &iov, 1, ONLOAD_ZC_BUFFER_HDR_UDP) < 0 )
+    return -1;
+  onload_zc_release_buffers(fd, &iov.buf, 1);
+
+  start = now_ns();
+  for( i = 0; i < cfg_iter; ++i ) {
+    TEST(onload_zc_alloc_buffers(fd, &iov, 1, ONLOAD_ZC_BUFFER_HDR_UDP) == 0);
+    memset(iov.iov_base, 0, cfg_size);
+    iov.iov_len = cfg_size;
+    memset(&mmsg, 0, sizeof(mmsg));
+    mmsg.fd = fd;
+    mmsg.msg.iov = &iov;
+    mmsg.msg.msghdr.msg_iovlen = 1;
+    TEST(onload_zc_send(&mmsg, 1, 0) == 1);
+    if( mmsg.rc < 0 ) {
+      onload_zc_release_buffers(fd, &iov.buf, 1);
+      TEST(mmsg.rc == -EAGAIN);
+    }
+  }
+  return (double) (now_ns() - start) / cfg_iter;
+}
+
+
+static void* thread_fn(void* arg)
+{
+  struct thread_result* res = arg;
+  int i, fd;
+
+  for( i = 0; i < T_N; ++i )
+    res->ns[i] = -1;
+
+  TEST((fd = socket(cfg_dest.ss_family ? cfg_dest.ss_family : AF_INET,
+                    SOCK_DGRAM, 0)) >= 0);
+  if( cfg_dest_len )
+    TEST(connect(fd, (struct sockaddr*) &cfg_dest, cfg_dest_len) == 0);
+
+  res->ns[T_RECV] = time_recv(fd);
+  res->ns[T_ZC_RECV] = time_zc_recv(fd);
+  if( cfg_dest_len ) {
+    res->ns[T_SEND] = time_send(fd);
+    res->ns[T_ZC_SEND] = time_zc_send(fd);
+  }
+
+  close(fd);
+  return NULL;
+}
+
+
+static void usage(void)
+{
+  fprintf(stderr, "usage:\n");
+  fprintf(stderr, "  lookup_overhead [options] [<dest-host> <dest-port>]\n");
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -n <iterations>   calls per test (default %d)\n",
+          cfg_iter);
+  fprintf(stderr, "  -t <threads>      threads, one socket each "
+          "(default %d)\n", cfg_threads);
+  fprintf(stderr, "  -s <bytes>        datagram size for sends (default %d)\n",
+          cfg_size);
+  exit(1);
+}
+
+
+int main(int argc, char* argv[])
+{
+  struct thread_result* res;
+  struct addrinfo hints, *ai;
+  int c, i, t;
+
+  while( (c = getopt(argc, argv, "n:t:s:")) != -1 )
+    switch( c ) {
+    case 'n':
+      cfg_iter = atoi(optarg);
+      break;
+    case 't':
+      cfg_threads = atoi(optarg);
+      break;
+    case 's':
+      cfg_size = atoi(optarg);
+      break;
+    default:
+      usage();
+    }
+  argc -= optind;
+  argv += optind;
+  if( (argc != 0 && argc != 2) || cfg_iter <= 0 || cfg_threads <= 0 ||
+      cfg_size <= 0 || cfg_size > 1472 )
+    usage();
+
+  if( argc == 2 ) {
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_DGRAM;
+    TEST(getaddrinfo(argv[0], argv[1], &hints, &ai) == 0);
+    memcpy(&cfg_dest, ai->ai_addr, ai->ai_addrlen);
+    cfg_dest_len = ai->ai_addrlen;
+    freeaddrinfo(ai);
+  }
+
+  /* Always measure from threads other than main(), so that the fd table
+   * is used in its multi-threaded mode even with -t 1.
+   */
+  TEST((res = calloc(cfg_threads, sizeof(*res))) != NULL);
+  for( t = 0; t < cfg_threads; ++t )
+    TEST(pthread_create(&res[t].thread, NULL, thread_fn, &res[t]) == 0);
+  for( t = 0; t < cfg_threads; ++t )
+    TEST(pthread_join(res[t].thread, NULL) == 0);
+
+  printf("# %d thread(s), %d calls each; ns per call\n",
+         cfg_threads, cfg_iter);
+  for( i = 0; i < T_N; ++i ) {
+    double sum = 0, max = 0;
+    if( res[0].ns[i] < 0 ) {
+      printf("%-26s  %s\n", test_names[i], "n/a");
+      continue;
+    }
+    for( t = 0; t < cfg_threads; ++t ) {
+      sum += res[t].ns[i];
+      if( res[t].ns[i] > max )
+        max = res[t].ns[i];
+    }
+    printf("%-26s  mean %8.1f  max %8.1f\n", test_names[i],
+           sum / cfg_threads, max);
+  }
+
+  free(res);
+  return 0;
+}
@@ -13,9 +13,13 @@ close		:= $(patsubst %,$(AppPattern),close)
 sendfile	:= $(patsubst %,$(AppPattern),sendfile)
 sendfile_clnt	:= $(patsubst %,$(AppPattern),sendfile_clnt)
 splice		:= $(patsubst %,$(AppPattern),splice)
+eventfd		:= $(patsubst %,$(AppPattern),eventfd)
+socketpair	:= $(patsubst %,$(AppPattern),socketpair)
+lookup_overhead	:= $(patsubst %,$(AppPattern),lookup_overhead)
 
 TARGETS	:= $(read) $(write) $(writev) $(printf) $(ci_log) $(dup) $(streams) \
-	   $(execve) $(close) $(splice)
+	   $(execve) $(close) $(splice) $(eventfd) $(socketpair) \
+	   $(lookup_overhead)
 
 ifeq ($(GNU),1)
 TARGETS	+= $(sendfile) $(sendfile_clnt)
@@ -35,6 +39,12 @@ $(dup): dup.o $(CITOOLS_LIB_DEPEND) $(CIAPP_LIB_DEPEND) $(LINK_CIUL_LIB_DEPEND)
 $(streams): streams.o $(CITOOLS_LIB_DEPEND) $(CIAPP_LIB_DEPEND)
 	libs="$(LINK_CIAPP_LIB) $(LINK_CITOOLS_LIB) -ldl -lrt"; $(MMakeLinkCApp)
 
+$(eventfd): eventfd.o
+	libs="-lpthread"; $(MMakeLinkCApp)
+
+$(lookup_overhead): lookup_overhead.o $(ONLOAD_EXT_LIB_DEPEND)
+	libs="$(LINK_ONLOAD_EXT_LIB) -lpthread"; $(MMakeLinkCApp)
+
 
 ifneq ($(strip $(USE_SSL)),)
 
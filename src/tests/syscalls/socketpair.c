@@ -0,0 +1,150 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2022 Xilinx, Inc. */
+/**************************************************************************\
+*//*! \file
+**  \brief  Test socketpair(AF_UNIX, SOCK_STREAM) semantics
+**
+** Checks transfers in both directions, socket options, non-blocking
+** behaviour with a full pair, poll() and epoll readiness, shutdown() and
+** close() of one end, and an echo through a forked child.  Run it with
+** EF_UNIX_SOCKETPAIR=1 under onload to test accelerated socketpairs, and
+** without onload to check the test against the kernel.
+*//*
+\**************************************************************************/
+
+/*! \cidoxg_tests_syscalls */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+
+#define TEST(x)                                                 \
+  do {                                                          \
+    if( ! (x) ) {                                               \
+      fprintf(stderr, "FAIL: %s at %s:%d (errno=%d %s)\n",      \
+              #x, __FILE__, __LINE__, errno, strerror(errno));  \
+      exit(1);                                                  \
+    }                                                           \
+  } while( 0 )
+
+
+#define N_ECHOES  1000
+
+
+static short poll_events(int fd)
+{
+  struct pollfd pfd;
+
+  pfd.fd = fd;
+  pfd.events = POLLIN | POLLOUT | POLLRDHUP;
+  pfd.revents = 0;
+  TEST(poll(&pfd, 1, 0) >= 0);
+  return pfd.revents;
+}
+
+
+static void echo_child(int fd)
+{
+  char buf[64];
+  ssize_t n;
+
+  while( (n = read(fd, buf, sizeof(buf))) > 0 )
+    TEST(write(fd, buf, n) == n);
+  TEST(n == 0);
+  exit(0);
+}
+
+
+int main(void)
+{
+  struct epoll_event ev;
+  char buf[4096];
+  int sv[2], val, epfd, i, status;
+  socklen_t len;
+  size_t filled, drained;
+  ssize_t n;
+  pid_t pid;
+
+  /* Data goes both ways. */
+  TEST(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+  TEST(write(sv[0], "ping", 4) == 4);
+  TEST(read(sv[1], buf, sizeof(buf)) == 4 && memcmp(buf, "ping", 4) == 0);
+  TEST(send(sv[1], "pong", 4, 0) == 4);
+  TEST(recv(sv[0], buf, sizeof(buf), 0) == 4 && memcmp(buf, "pong", 4) == 0);
+  TEST((fcntl(sv[0], F_GETFL) & O_ACCMODE) == O_RDWR);
+  len = sizeof(val);
+  TEST(getsockopt(sv[0], SOL_SOCKET, SO_TYPE, &val, &len) == 0);
+  TEST(len == sizeof(val) && val == SOCK_STREAM);
+  TEST(getsockopt(sv[0], SOL_SOCKET, SO_DOMAIN, &val, &len) == 0);
+  TEST(val == AF_UNIX);
+
+  /* Non-blocking: an empty end has nothing to read, and a full one has no
+   * space until its peer reads. */
+  TEST(fcntl(sv[0], F_SETFL, O_NONBLOCK) == 0);
+  TEST(fcntl(sv[0], F_GETFL) & O_NONBLOCK);
+  TEST(recv(sv[0], buf, sizeof(buf), 0) < 0 && errno == EAGAIN);
+  TEST(recv(sv[1], buf, sizeof(buf), MSG_DONTWAIT) < 0 && errno == EAGAIN);
+  TEST(poll_events(sv[0]) == POLLOUT);
+  memset(buf, 0xa5, sizeof(buf));
+  for( filled = 0; (n = write(sv[0], buf, sizeof(buf))) > 0; filled += n )
+    ;
+  TEST(n < 0 && errno == EAGAIN && filled > 0);
+  TEST(poll_events(sv[0]) == 0);
+  TEST(poll_events(sv[1]) == (POLLIN | POLLOUT));
+  for( drained = 0; drained < filled; drained += n )
+    TEST((n = recv(sv[1], buf, sizeof(buf), MSG_DONTWAIT)) > 0);
+  TEST(drained == filled);
+  TEST(poll_events(sv[0]) == POLLOUT);
+
+  /* shutdown(SHUT_WR) is end-of-file for the peer. */
+  TEST(shutdown(sv[0], SHUT_WR) == 0);
+  TEST(poll_events(sv[1]) & (POLLIN | POLLRDHUP));
+  TEST(read(sv[1], buf, sizeof(buf)) == 0);
+  TEST(send(sv[1], "late", 4, 0) == 4);
+  TEST(read(sv[0], buf, sizeof(buf)) == 4);
+
+  /* Closing an end is end-of-file for the peer, and its writes fail. */
+  close(sv[0]);
+  TEST(read(sv[1], buf, sizeof(buf)) == 0);
+  TEST(send(sv[1], "gone", 4, MSG_NOSIGNAL) < 0 && errno == EPIPE);
+  close(sv[1]);
+
+  /* A forked child echoes what it reads, and the parent waits for each
+   * echo with epoll. */
+  TEST(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == 0);
+  TEST((pid = fork()) >= 0);
+  if( pid == 0 ) {
+    close(sv[0]);
+    echo_child(sv[1]);
+  }
+  close(sv[1]);
+  TEST((epfd = epoll_create1(0)) >= 0);
+  ev.events = EPOLLIN;
+  ev.data.fd = sv[0];
+  TEST(epoll_ctl(epfd, EPOLL_CTL_ADD, sv[0], &ev) == 0);
+  for( i = 0; i < N_ECHOES; ++i ) {
+    TEST(write(sv[0], &i, sizeof(i)) == sizeof(i));
+    TEST(epoll_wait(epfd, &ev, 1, -1) == 1 && ev.data.fd == sv[0]);
+    TEST(read(sv[0], &val, sizeof(val)) == sizeof(val) && val == i);
+  }
+  TEST(shutdown(sv[0], SHUT_WR) == 0);
+  TEST(waitpid(pid, &status, 0) == pid);
+  TEST(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  TEST(read(sv[0], buf, sizeof(buf)) == 0);
+  close(epfd);
+  close(sv[0]);
+
+  printf("PASS\n");
+  return 0;
+}
+
+/*! \cidoxg_end */
@@ -11,6 +11,7 @@
 #include "utils.h"
 
 #include <onload/extensions.h>
+#include <ci/app.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <netinet/tcp.h>
@@ -38,6 +39,7 @@ static bool        cfg_hw_ts = true;
 static int         cfg_send_rate = 100000;
 static int         cfg_iter;
 static int         cfg_warm_n;
+static const char* cfg_hgrm_file;
 
 
 struct server_state {
@@ -55,9 +57,7 @@ struct server_state {
   char*    tx_buf;
   char*    tx_buf_ts;
   int      inter_tx_gap_ns;
-  uint64_t rtt_sum;
-  unsigned rtt_min, rtt_max;
-  int      rtt_n;
+  ci_hist  rtt_hist;
   unsigned n_lost_msgs;
 };
 
@@ -188,10 +188,9 @@ static void wait_for_client(struct server_state* ss)
     if( cfg_warm_n == 0 )
       cfg_warm_n = 2;
   }
-  ss->rtt_sum = 0;
-  ss->rtt_min = -1;
-  ss->rtt_max = 0;
-  ss->rtt_n = -cfg_warm_n;
+  /* Latencies are in nanoseconds; anything above 10s is clamped. */
+  TRY( ci_hist_init(&ss->rtt_hist, 10000000000ll, 7) );
+  ci_hist_set_warmups(&ss->rtt_hist, cfg_warm_n);
 }
 
 
@@ -202,20 +201,25 @@ static void measured_rtt(struct server_state* ss, struct timespec tx_ts,
   uint64_t ns = (rx_ts.tv_sec - tx_ts.tv_sec) * 1000000000;
   ns += rx_ts.tv_nsec - tx_ts.tv_nsec;
   msg(2, "rtt: %d\n", (int) ns);
-  if( ++(ss->rtt_n) > 0 ) {
-    ss->rtt_sum += ns;
-    if( ns <= ss->rtt_min )
-      ss->rtt_min = ns;
-    else if( ns >= ss->rtt_max )
-      ss->rtt_max = ns;
-    if( ss->rtt_n == cfg_iter ) {
-      printf("n_lost_msgs:  %u\n", ss->n_lost_msgs);
-      printf("n_samples:    %d\n", ss->rtt_n);
-      printf("latency_mean: %u\n", (unsigned) (ss->rtt_sum / ss->rtt_n));
-      printf("latency_min:  %u\n", ss->rtt_min);
-      printf("latency_max:  %u\n", ss->rtt_max);
-      exit(0);
+  ci_hist_record(&ss->rtt_hist, ns);
+  if( ci_hist_count(&ss->rtt_hist) == cfg_iter ) {
+    const ci_hist* h = &ss->rtt_hist;
+    printf("n_lost_msgs:  %u\n", ss->n_lost_msgs);
+    printf("n_samples:    %d\n", (int) ci_hist_count(h));
+    printf("latency_mean: %u\n", (unsigned) ci_hist_mean(h));
+    printf("latency_min:  %u\n", (unsigned) h->min);
+    printf("latency_p50:  %u\n", (unsigned) ci_hist_percentile(h, 50));
+    printf("latency_p99:  %u\n", (unsigned) ci_hist_percentile(h, 99));
+    printf("latency_p99.9: %u\n", (unsigned) ci_hist_percentile(h, 99.9));
+    printf("latency_p99.99: %u\n", (unsigned) ci_hist_percentile(h, 99.99));
+    printf("latency_max:  %u\n", (unsigned) h->max);
+    if( cfg_hgrm_file != NULL ) {
+      FILE* fp = fopen(cfg_hgrm_file, "w");
+      TEST( fp != NULL );
+      TRY( ci_hist_write_hgrm(h, fp, 1.0) );
+      fclose(fp);
     }
+    exit(0);
   }
 }
 
@@ -267,7 +271,7 @@ static void event_loop(struct server_state* ss)
           else if( ss->have_tx_ts &&
                    timespec_diff_ns(now, lost_tx_ts) > 10000000 ) {
             msg(2, "WARNING: No response to timed message\n");
-            if( ss->rtt_n > 0 )
+            if( ss->rtt_hist.n_warmups == 0 )
               ++(ss->n_lost_msgs);
             ss->have_sent = false;
             ss->have_tx_ts = false;
@@ -380,6 +384,7 @@ static void usage_msg(FILE* f)
   fprintf(f, "  -s                - use software timestamps\n");
   fprintf(f, "  -l <log-level>    - set log level\n");
   fprintf(f, "  -p <port>         - set TCP/UDP port number\n");
+  fprintf(f, "  -H <filename>     - save HdrHistogram percentile distribution\n");
   fprintf(f, "\n");
 }
 
@@ -395,7 +400,7 @@ int main(int argc, char* argv[])
 {
   int c;
 
-  while( (c = getopt(argc, argv, "hr:n:i:w:sl:p:")) != -1 )
+  while( (c = getopt(argc, argv, "hr:n:i:w:sl:p:H:")) != -1 )
     switch( c ) {
     case 'h':
       usage_msg(stdout);
@@ -422,6 +427,9 @@ int main(int argc, char* argv[])
     case 'p':
       cfg_port = optarg;
       break;
+    case 'H':
+      cfg_hgrm_file = optarg;
+      break;
     case '?':
       usage_err();
       break;
@@ -14,8 +14,10 @@ clean:
 
 
 exchange: exchange.o utils.o
-exchange: MMAKE_LIBS     += $(LINK_ONLOAD_EXT_LIB)
-exchange: MMAKE_LIB_DEPS += $(ONLOAD_EXT_LIB_DEPEND)
+exchange: MMAKE_LIBS     += $(LINK_ONLOAD_EXT_LIB) $(LINK_CIAPP_LIB) \
+				$(LINK_CITOOLS_LIB)
+exchange: MMAKE_LIB_DEPS += $(ONLOAD_EXT_LIB_DEPEND) $(CIAPP_LIB_DEPEND) \
+				$(CITOOLS_LIB_DEPEND)
 
 trader_onload_ds_efvi: trader_onload_ds_efvi.o utils.o
 trader_onload_ds_efvi: \
@@ -1269,6 +1269,90 @@ static void stack_timeoutq(ci_netif* ni)
   ci_netif_dump_timeoutq(ni);
 }
 
+#if CI_CFG_FLIGHT_RECORDER
+static void stack_flight_recorder(ci_netif* ni)
+{
+  ci_netif_dump_flight_recorder(ni);
+}
+
+static void stack_flight_recorder_freeze(ci_netif* ni)
+{
+  if( ! ni->state->flight_rec.frozen )
+    ci_netif_flight_rec_freeze(ni, OO_FR_FROZEN_USER, 0);
+}
+
+static void stack_flight_recorder_rearm(ci_netif* ni)
+{
+  struct oo_flight_rec* fr = &ni->state->flight_rec;
+  if( fr->frozen == OO_FR_FROZEN_DISABLED ) {
+    ci_log("%d: flight recorder is disabled (EF_FLIGHT_RECORDER=0)",
+           NI_ID(ni));
+    return;
+  }
+  fr->n = 0;
+  memset(fr->ring, 0, sizeof(fr->ring));
+  ci_wmb();
+  fr->frozen = 0;
+}
+#endif
+
+#if CI_CFG_POLL_PROFILE
+static void stack_watch_profile(ci_netif* ni)
+{
+  static const char* const names[OO_PROF_N] = {
+    [OO_PROF_POLL]        = "poll",
+    [OO_PROF_EVQ]         = "  evq",
+    [OO_PROF_RX]          = "  rx",
+    [OO_PROF_TCP_RX]      = "    tcp_rx",
+    [OO_PROF_UDP_RX]      = "    udp_rx",
+    [OO_PROF_TX_COMPLETE] = "  tx_complete",
+    [OO_PROF_RX_REFILL]   = "  rx_refill",
+    [OO_PROF_POST_POLL]   = "  post_poll",
+    [OO_PROF_LOOPBACK]    = "  loopback",
+    [OO_PROF_TIMERS]      = "  timers",
+    [OO_PROF_DEFERRED]    = "deferred",
+  };
+  struct oo_poll_profile p, c;
+  unsigned time_msec = 0, target_msec = 0, prev_msec;
+  struct timeval start, now;
+  int i;
+
+  if( ! NI_OPTS(ni).poll_profile )
+    ci_log("%d: EF_POLL_PROFILE is off; enable it with \"set_opt "
+           "EF_POLL_PROFILE 1\"", NI_ID(ni));
+
+  memcpy(&c, &ni->state->poll_profile, sizeof(c));
+  gettimeofday(&start, 0);
+
+  while( 1 ) {
+    ci_uint64 elapsed_cycles;
+
+    memcpy(&p, &c, sizeof(p));
+    prev_msec = time_msec;
+    target_msec += cfg_watch_msec;
+    ci_sleep(target_msec - time_msec);
+    memcpy(&c, &ni->state->poll_profile, sizeof(c));
+    gettimeofday(&now, 0);
+    time_msec = tv_delta(&now, &start);
+    elapsed_cycles = (ci_uint64) (time_msec - prev_msec) *
+                     IPTIMER_STATE(ni)->khz;
+
+    ci_log("%d: poll profile over %ums", NI_ID(ni), time_msec - prev_msec);
+    ci_log("  %-16s %12s %14s %10s %7s", "phase", "calls", "cycles",
+           "cyc/call", "%time");
+    for( i = 0; i < OO_PROF_N; ++i ) {
+      ci_uint64 calls = c.calls[i] - p.calls[i];
+      ci_uint64 cycles = c.cycles[i] - p.cycles[i];
+      ci_log("  %-16s %12llu %14llu %10llu %6.2f%%", names[i],
+             (unsigned long long) calls, (unsigned long long) cycles,
+             (unsigned long long) (calls ? cycles / calls : 0),
+             elapsed_cycles ? 100.0 * cycles / elapsed_cycles : 0.0);
+    }
+    fflush(stdout);
+  }
+}
+#endif
+
 static void stack_opts(ci_netif* ni)
 {
   ci_log("ci_netif_config_opts_dump: %d", NI_ID(ni));
@@ -2225,6 +2309,15 @@ static const stack_op_t stack_ops[] = {
   STACK_OP(netstat,            "show netstat like output for sockets"),
   STACK_OP(dmaq,               "show state of DMA queue"),
   STACK_OP(timeoutq,           "show state of timeout queue"),
+#if CI_CFG_FLIGHT_RECORDER
+  STACK_OP(flight_recorder,    "show recent events from the flight recorder"),
+  STACK_OP(flight_recorder_freeze, "stop recording in the flight recorder"),
+  STACK_OP(flight_recorder_rearm,  "clear and restart the flight recorder"),
+#endif
+#if CI_CFG_POLL_PROFILE
+  STACK_OP(watch_profile,      "show running poll loop profile "
+                               "(EF_POLL_PROFILE)"),
+#endif
   STACK_OP(opts,               "show configuration options"),
   STACK_OP(stats,              "show stack statistics"),
   STACK_OP(describe_stats,     "show stack statistics with description"),